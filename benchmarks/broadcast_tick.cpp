@@ -0,0 +1,235 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "server.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+
+// Typists insert at a steady rate while viewers only watch, and the server broadcasts with different ticks.
+// Reports how many ops each write carried, the writes that saved and what the tick cost in latency.
+// Usage: reped_bench_broadcast_tick [typists] [viewers] [ops per typist per second] [seconds per tick]
+
+namespace
+{
+    struct Result
+    {
+        double operationsPerWrite;
+        uint64_t writesSaved;
+        double p50Micros;
+        double p99Micros;
+    };
+
+    int connectToServer(uint16_t port)
+    {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        if (connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            close(clientSocket);
+            return -1;
+        }
+
+        return clientSocket;
+    }
+
+    double getPercentile(std::vector<double>& samples, double percentile)
+    {
+        if (samples.empty())
+            return 0;
+
+        std::size_t index = static_cast<std::size_t>(percentile * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    int64_t getNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Client
+    {
+        int socket;
+        FrameReader reader;
+        std::size_t frames = 0;
+        std::atomic<uint64_t> version = 0;  // Ops the client has seen, the version its next op is based on
+    };
+
+    /**
+     * Reads every client on one thread. Typists put their send time into the text they insert, so each
+     * broadcast tells how long it took to arrive.
+    */
+    void receive(std::vector<std::unique_ptr<Client>>& clients, const std::atomic<bool>& running, std::vector<double>& latencies,
+                 std::atomic<std::size_t>& joined)
+    {
+        int epollFd = epoll_create1(0);
+        for (std::size_t i = 0; i < clients.size(); i++)
+        {
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i]->socket, &event);
+        }
+
+        struct epoll_event events[256];
+        while (running)
+        {
+            int count = epoll_wait(epollFd, events, 256, 100);
+            for (int i = 0; i < count; i++)
+            {
+                Client& client = *clients[events[i].data.u64];
+                std::size_t space = 0;
+                char* buffer = client.reader.prepareReceive(space);
+                ssize_t length = recv(client.socket, buffer, space, 0);
+                if (length <= 0)
+                {
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, client.socket, nullptr);
+                    continue;
+                }
+
+                client.reader.commitReceive(static_cast<std::size_t>(length));
+                std::string_view frame;
+                while (client.reader.nextFrame(frame))
+                {
+                    // PROTOCOL and INIT_DOCUMENT come first
+                    if (++client.frames == 2)
+                        joined.fetch_add(1);
+                    if (client.frames <= 2)
+                        continue;
+
+                    client.version.fetch_add(1, std::memory_order_relaxed);
+                    std::size_t start = frame.find('@');
+                    std::size_t end = frame.find('@', start + 1);
+                    if (start != std::string_view::npos && end != std::string_view::npos)
+                        latencies.push_back((getNanos() - std::stoll(std::string(frame.substr(start + 1, end - start - 1)))) / 1000.0);
+                }
+            }
+        }
+
+        close(epollFd);
+    }
+
+    bool run(std::chrono::microseconds tick, uint16_t port, std::size_t typistCount, std::size_t viewerCount, std::size_t opsPerSecond,
+             std::size_t seconds, Result& result)
+    {
+        Controller controller;
+        ServerTextEngine engine;
+        controller.textEngine = &engine;
+
+        ServerConfig config;
+        config.broadcastInterval = tick;
+        auto server = std::make_unique<Server>(port, "127.0.0.1", &controller, config);
+
+        std::vector<std::unique_ptr<Client>> clients;
+        for (std::size_t i = 0; i < typistCount + viewerCount; i++)
+        {
+            int clientSocket = connectToServer(port);
+            if (clientSocket == -1)
+                return false;
+
+            std::string connected = MessageParser::createConnectedMessage("c" + std::to_string(i), "", std::nullopt, WireProtocol::TEXT);
+            if (!Framing::sendFrame(clientSocket, connected))
+                return false;
+
+            clients.push_back(std::make_unique<Client>());
+            clients.back()->socket = clientSocket;
+        }
+
+        std::atomic<bool> running = true;
+        std::atomic<std::size_t> joined = 0;
+        std::vector<double> latencies;
+        std::thread receiver(receive, std::ref(clients), std::cref(running), std::ref(latencies), std::ref(joined));
+
+        while (joined.load() < clients.size())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        BroadcastStats before = server->getBroadcastStats();
+
+        // Typists take turns, so together they send typistCount * opsPerSecond ops per second
+        const auto gap = std::chrono::nanoseconds(1000000000 / (typistCount * opsPerSecond));
+        const std::size_t opCount = typistCount * opsPerSecond * seconds;
+        auto nextSend = std::chrono::steady_clock::now();
+        for (std::size_t op = 0; op < opCount; op++)
+        {
+            std::this_thread::sleep_until(nextSend);
+            nextSend += gap;
+
+            Client& typist = *clients[op % typistCount];
+            InsertOperation insert("@" + std::to_string(getNanos()) + "@", 0, "c" + std::to_string(op % typistCount));
+            insert.docVersion = typist.version.load(std::memory_order_relaxed);
+            if (!Framing::sendFrame(typist.socket, insert.serialize()))
+                return false;
+        }
+
+        // Let the last tick go out
+        std::this_thread::sleep_for(std::chrono::milliseconds(200) + tick);
+        BroadcastStats after = server->getBroadcastStats();
+
+        running = false;
+        receiver.join();
+        for (auto& client : clients)
+            close(client->socket);
+
+        uint64_t operations = after.operationsBroadcast - before.operationsBroadcast;
+        uint64_t writes = after.writes - before.writes;
+        result.operationsPerWrite = writes > 0 ? static_cast<double>(operations) / writes : 0;
+        result.writesSaved = operations - writes;
+        result.p50Micros = getPercentile(latencies, 0.5);
+        result.p99Micros = getPercentile(latencies, 0.99);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t typistCount = argc > 1 ? std::stoul(argv[1]) : 50;
+    const std::size_t viewerCount = argc > 2 ? std::stoul(argv[2]) : 200;
+    const std::size_t opsPerSecond = argc > 3 ? std::stoul(argv[3]) : 10;
+    const std::size_t seconds = argc > 4 ? std::stoul(argv[4]) : 2;
+
+    // Keep server logging out of the measurement
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    out << typistCount << " typists at " << opsPerSecond << " ops/s each, " << viewerCount << " viewers\n";
+
+    uint16_t port = 47311;
+    for (int tickMillis : {0, 5, 16})
+    {
+        Result result;
+        if (!run(std::chrono::milliseconds(tickMillis), port++, typistCount, viewerCount, opsPerSecond, seconds, result))
+        {
+            out << "tick " << tickMillis << " ms: run failed\n";
+            return 1;
+        }
+
+        out << "tick " << tickMillis << " ms: " << result.operationsPerWrite << " ops/write, " << result.writesSaved
+            << " writes saved, latency p50 " << result.p50Micros << " us, p99 " << result.p99Micros << " us\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "client.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "client_text_engine.h"
+#include "../controller/controller.h"
+
+// Sends messages from the editing thread to a server that reads them and to one that stopped reading, and
+// reports how long each send kept the editing thread busy.
+// Usage: reped_bench_client_send [messages] [message bytes]
+
+namespace
+{
+    struct Result
+    {
+        double p50Micros;
+        double p99Micros;
+        double maxMicros;
+        std::size_t queued;
+    };
+
+    /**
+     * Accepts one client, sends it an empty document and then either reads everything or nothing.
+    */
+    class FakeServer
+    {
+    private:
+        int listenSocket;
+        const bool reading;
+        std::atomic<bool> running;
+        std::thread thread;
+
+    public:
+        FakeServer(uint16_t port, bool reading)
+            : listenSocket(socket(AF_INET, SOCK_STREAM, 0)), reading(reading), running(true)
+        {
+            int reuse = 1;
+            setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+            struct sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+            bind(listenSocket, (struct sockaddr*)&address, sizeof(address));
+            listen(listenSocket, 1);
+
+            thread = std::thread(&FakeServer::run, this);
+        }
+
+        ~FakeServer()
+        {
+            running = false;
+            shutdown(listenSocket, SHUT_RDWR);
+            thread.join();
+            close(listenSocket);
+        }
+
+    private:
+        void run()
+        {
+            int clientSocket = accept(listenSocket, nullptr, nullptr);
+            if (clientSocket == -1)
+                return;
+
+            if (!Framing::sendFrame(clientSocket, MessageParser::createInitDocumentMessage(0, "")))
+                std::cerr << "FakeServer: Failed to send the document\n";
+
+            char buffer[64 * 1024];
+            while (running)
+            {
+                if (!reading)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+
+                if (recv(clientSocket, buffer, sizeof(buffer), MSG_DONTWAIT) <= 0)
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+
+            close(clientSocket);
+        }
+    };
+
+    double getPercentile(std::vector<double>& samples, double percentile)
+    {
+        std::size_t index = static_cast<std::size_t>(percentile * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    bool run(uint16_t port, bool reading, std::size_t messageCount, std::size_t messageSize, Result& result)
+    {
+        FakeServer server(port, reading);
+
+        Controller controller;
+        ClientTextEngine engine;
+        controller.textEngine = &engine;
+        Client client(port, "127.0.0.1", &controller, "writer", "");
+        controller.client = &client;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!client.isConnected())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            controller.processIncomingMessages();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        const std::string message(messageSize, 'x');
+        std::vector<double> latencies;
+        latencies.reserve(messageCount);
+        result.queued = 0;
+        for (std::size_t i = 0; i < messageCount; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if (client.sendMessage(message))
+                result.queued++;
+
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+            // Roughly a fast typist's pace with the frame loop around it
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+        result.maxMicros = *std::max_element(latencies.begin(), latencies.end());
+        result.p50Micros = getPercentile(latencies, 0.5);
+        result.p99Micros = getPercentile(latencies, 0.99);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t messageCount = argc > 1 ? std::stoul(argv[1]) : 20000;
+    const std::size_t messageSize = argc > 2 ? std::stoul(argv[2]) : 256;
+
+    // Keep client logging out of the measurement
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+    std::cerr.rdbuf(nullptr);
+
+    out << messageCount << " messages of " << messageSize << " bytes\n";
+
+    uint16_t port = 47331;
+    for (bool reading : {true, false})
+    {
+        Result result;
+        if (!run(port++, reading, messageCount, messageSize, result))
+        {
+            out << "run failed\n";
+            return 1;
+        }
+
+        out << (reading ? "server reading" : "server stalled") << ": send p50 " << result.p50Micros << " us, p99 "
+            << result.p99Micros << " us, max " << result.maxMicros << " us, " << result.queued << " queued\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "server.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+
+// Joins a large document over a throttled loopback link with and without compressed frames, sent whole or streamed
+// in chunks, and reports how long the client waited for the first text and for the whole document, how many bytes
+// crossed the link and the largest frame the client had to hold.
+// Usage: reped_bench_compressed_join [document MiB] [link MiB/s]
+
+namespace
+{
+    struct Result
+    {
+        double firstTextMillis;
+        double joinMillis;
+        std::size_t bytesReceived;
+        std::size_t largestFrame;
+    };
+
+    /**
+     * Text that compresses like prose or code does: a small vocabulary, varied order.
+    */
+    std::string makeDocument(std::size_t size)
+    {
+        static const char* words[] = {"the ", "piece ", "table ", "holds ", "every ", "edit ", "of ", "a ", "document", "\n",
+                                      "if ", "(", ")", "{\n    ", "return ", "false;\n", "}\n", "cursor ", "server ", "client "};
+        std::mt19937 random(3);
+        std::string text;
+        text.reserve(size);
+        while (text.size() < size)
+            text += words[random() % 20];
+
+        text.resize(size);
+        return text;
+    }
+
+    int connectToServer(uint16_t port)
+    {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+
+        // A small window so the throttled reads hold the server back like a slow link would
+        int bufferSize = 64 * 1024;
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        if (connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            close(clientSocket);
+            return -1;
+        }
+
+        return clientSocket;
+    }
+
+    bool join(uint16_t port, WireProtocol wireProtocol, std::size_t bytesPerSecond, std::size_t documentSize, Result& result)
+    {
+        int clientSocket = connectToServer(port);
+        if (clientSocket == -1)
+            return false;
+
+        auto start = std::chrono::steady_clock::now();
+        if (!Framing::sendFrame(clientSocket, MessageParser::createConnectedMessage("reader", "", std::nullopt, wireProtocol)))
+            return false;
+
+        // Reads at most one slice of the link's rate every millisecond
+        const std::size_t slice = std::max<std::size_t>(bytesPerSecond / 1000, 1);
+        FrameReader reader;
+        result.bytesReceived = 0;
+        result.largestFrame = 0;
+        result.firstTextMillis = 0;
+        std::size_t textReceived = 0;
+        bool joined = false;
+        auto nextRead = start;
+        while (!joined)
+        {
+            std::this_thread::sleep_until(nextRead);
+            nextRead += std::chrono::milliseconds(1);
+
+            // The reader's buffer may hold less than a slice, the rest of the slice is read once it drained
+            std::size_t budget = slice;
+            while (budget > 0 && !joined)
+            {
+                std::size_t space = 0;
+                char* buffer = reader.prepareReceive(space);
+                ssize_t length = recv(clientSocket, buffer, std::min(space, budget), budget == slice ? 0 : MSG_DONTWAIT);
+                if (length < 0 && budget < slice && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+
+                if (length <= 0)
+                {
+                    close(clientSocket);
+                    return false;
+                }
+
+                budget -= static_cast<std::size_t>(length);
+                result.bytesReceived += static_cast<std::size_t>(length);
+                reader.commitReceive(static_cast<std::size_t>(length));
+
+                std::string_view frame;
+                while (reader.nextFrame(frame))
+                {
+                    result.largestFrame = std::max(result.largestFrame, frame.size());
+
+                    uint64_t docVersion = 0;
+                    std::string text;
+                    MessageType type = MessageParser::parseMessage(frame).type;
+                    if (type == MessageType::INIT_DOCUMENT && MessageParser::parseInitDocumentMessage(std::string(frame), docVersion, text))
+                        textReceived += text.size();
+                    else if (type == MessageType::INIT_CHUNK)
+                        textReceived += MessageParser::getInitChunkText(frame).size();
+                    else
+                        continue;
+
+                    if (result.firstTextMillis == 0)
+                        result.firstTextMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                    joined = textReceived == documentSize;
+                }
+            }
+        }
+
+        result.joinMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        close(clientSocket);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t documentSize = (argc > 1 ? std::stoul(argv[1]) : 8) * 1024 * 1024;
+    const std::size_t bytesPerSecond = (argc > 2 ? std::stoul(argv[2]) : 20) * 1024 * 1024;
+
+    // Keep server logging out of the measurement
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+    engine.processIncomingOperation(std::make_unique<InsertOperation>(makeDocument(documentSize), 0, "seed"));
+
+    out << documentSize / (1024 * 1024) << " MiB document over a " << bytesPerSecond / (1024 * 1024) << " MiB/s link\n";
+
+    struct Row
+    {
+        const char* name;
+        WireProtocol wireProtocol;
+        bool compression;
+    };
+
+    const Row rows[] = {{"plain", WireProtocol::BINARY, false}, {"compressed", WireProtocol::COMPRESSED, true},
+                        {"streamed", WireProtocol::STREAMED, false}, {"streamed compressed", WireProtocol::STREAMED, true}};
+
+    uint16_t port = 47321;
+    for (const Row& row : rows)
+    {
+        ServerConfig config;
+        config.compression = row.compression;
+        auto server = std::make_unique<Server>(port, "127.0.0.1", &controller, config);
+
+        Result result;
+        if (!join(port++, row.wireProtocol, bytesPerSecond, documentSize, result))
+        {
+            out << "join failed\n";
+            return 1;
+        }
+
+        out << row.name << ": first text after " << result.firstTextMillis << " ms, joined in " << result.joinMillis << " ms, "
+            << result.bytesReceived << " bytes received, largest frame " << result.largestFrame << " bytes\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "convergence_simulator.h"
+
+// Runs the convergence simulator over a range of seeds. It is the load benchmark for OT changes and a fuzzer at the
+// same time: every seed that does not converge is reported so it can be replayed.
+// Usage: reped_bench_convergence [clients] [editsPerClient] [seeds] [firstSeed] [maxEditInterval] [maxLatency]
+int main(int argc, char** argv)
+{
+    SimulationConfig config;
+    config.clientCount = argc > 1 ? std::stoull(argv[1]) : 16;
+    config.editsPerClient = argc > 2 ? std::stoull(argv[2]) : 500;
+    const uint64_t seedCount = argc > 3 ? std::stoull(argv[3]) : 10;
+    const uint64_t firstSeed = argc > 4 ? std::stoull(argv[4]) : 1;
+    config.maxEditInterval = argc > 5 ? std::stoull(argv[5]) : config.maxEditInterval;
+    config.maxLatency = argc > 6 ? std::stoull(argv[6]) : config.maxLatency;
+    config.minLatency = std::min(config.minLatency, config.maxLatency);
+
+    // Keep engine logging out of the measurement
+    std::cout.setstate(std::ios::failbit);
+
+    SimulationResult total;
+    std::vector<uint64_t> divergedSeeds;
+    for (uint64_t seed = firstSeed; seed < firstSeed + seedCount; seed++)
+    {
+        config.seed = seed;
+        SimulationResult result = ConvergenceSimulator(config).run();
+        if (!result.converged)
+            divergedSeeds.push_back(seed);
+
+        total.edits += result.edits;
+        total.messagesDelivered += result.messagesDelivered;
+        total.serverTransforms += result.serverTransforms;
+        total.clientTransforms += result.clientTransforms;
+        total.seconds += result.seconds;
+        total.maxServerQueueDepth = std::max(total.maxServerQueueDepth, result.maxServerQueueDepth);
+        total.maxClientQueueDepth = std::max(total.maxClientQueueDepth, result.maxClientQueueDepth);
+        total.meanClientQueueDepth += result.meanClientQueueDepth / seedCount;
+    }
+
+    std::cout.clear();
+    std::cout << "Simulated " << seedCount << " sessions of " << config.clientCount << " clients x " << config.editsPerClient << " edits\n";
+    std::cout << "Throughput: " << static_cast<uint64_t>(total.edits / total.seconds) << " ops/s, "
+              << static_cast<uint64_t>(total.messagesDelivered / total.seconds) << " messages/s\n";
+    std::cout << "Transforms per op: " << static_cast<double>(total.serverTransforms) / total.edits << " on the server, "
+              << static_cast<double>(total.clientTransforms) / total.edits << " on the clients\n";
+    std::cout << "Queue depth: server max " << total.maxServerQueueDepth << ", client max " << total.maxClientQueueDepth
+              << ", client mean " << total.meanClientQueueDepth << "\n";
+
+    if (!divergedSeeds.empty())
+    {
+        std::cout << "Diverged seeds:";
+        for (uint64_t seed : divergedSeeds)
+            std::cout << " " << seed;
+        std::cout << "\n";
+        return 1;
+    }
+
+    std::cout << "All sessions converged\n";
+    return 0;
+}
@@ -0,0 +1,367 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "server_text_engine.h"
+#include "client_text_engine.h"
+#include "crdt_text_engine.h"
+#include "crdt_server_text_engine.h"
+
+namespace
+{
+    struct TraceEdit
+    {
+        std::size_t pos;
+        std::size_t deleteLength;   // Deletes when text is empty
+        std::string text;
+    };
+
+    /**
+     * Generates a trace shaped like someone writing: mostly typing at the cursor, backspacing over typos, now and
+     * then jumping elsewhere or deleting a selection.
+    */
+    std::vector<TraceEdit> generateTrace(std::size_t editCount, unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<TraceEdit> trace;
+        std::size_t length = 0;
+        std::size_t cursor = 0;
+
+        while (trace.size() < editCount)
+        {
+            unsigned int roll = random() % 100;
+            if (roll < 2)
+            {
+                cursor = random() % (length + 1);
+            }
+            else if (roll < 88 || length == 0)
+            {
+                char c = random() % 7 == 0 ? ' ' : static_cast<char>('a' + random() % 26);
+                if (random() % 60 == 0)
+                    c = '\n';
+
+                trace.push_back({cursor, 0, std::string(1, c)});
+                cursor++;
+                length++;
+            }
+            else if (roll < 98)
+            {
+                if (cursor == 0)
+                    continue;
+
+                trace.push_back({cursor - 1, 1, ""});
+                cursor--;
+                length--;
+            }
+            else
+            {
+                std::size_t pos = random() % length;
+                std::size_t deleteLength = std::min<std::size_t>(1 + random() % 20, length - pos);
+                trace.push_back({pos, deleteLength, ""});
+                cursor = pos;
+                length -= deleteLength;
+            }
+        }
+
+        return trace;
+    }
+
+    /**
+     * Reads a recorded trace, one edit per line: "i <pos> <text>" with newlines in the text written as \n,
+     * or "d <pos> <length>".
+    */
+    bool readTrace(const std::string& path, std::vector<TraceEdit>& trace)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+
+        std::string kind;
+        while (file >> kind)
+        {
+            TraceEdit edit{0, 0, ""};
+            file >> edit.pos;
+            if (kind == "d")
+            {
+                file >> edit.deleteLength;
+            }
+            else
+            {
+                std::string line;
+                std::getline(file, line);
+                for (std::size_t i = 1; i < line.size(); i++)
+                {
+                    if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == 'n')
+                    {
+                        edit.text += '\n';
+                        i++;
+                    }
+                    else
+                    {
+                        edit.text += line[i];
+                    }
+                }
+            }
+
+            if (!file)
+                return false;
+
+            trace.push_back(std::move(edit));
+        }
+
+        return true;
+    }
+
+    std::size_t getStringHeapBytes(const std::string& str)
+    {
+        return str.capacity() > 15 ? str.capacity() + 1 : 0;
+    }
+
+    /**
+     * @returns Bytes the OT server keeps per op so late ops can be transformed
+    */
+    std::size_t getHistoryMemoryUsage(const ServerTextEngine& engine)
+    {
+        std::vector<const TextOperation*> history;
+        if (!engine.getOperationsSince(0, history))
+            return 0;
+
+        std::size_t bytes = history.capacity() * sizeof(std::unique_ptr<TextOperation>);
+        for (const TextOperation* op : history)
+        {
+            bytes += getStringHeapBytes(op->clientId);
+            if (op->type == OperationType::INSERT)
+                bytes += sizeof(InsertOperation) + getStringHeapBytes(static_cast<const InsertOperation*>(op)->text);
+            else
+                bytes += sizeof(DeleteOperation);
+        }
+
+        return bytes;
+    }
+
+    std::unique_ptr<TextOperation> copyOperation(const TextOperation& op)
+    {
+        std::unique_ptr<Operation> parsed = Operation::deserialize(op.serialize());
+        return std::unique_ptr<TextOperation>(static_cast<TextOperation*>(parsed.release()));
+    }
+
+    template <typename Function>
+    double measureSeconds(Function function)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        function();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    }
+}
+
+// Compares the OT and CRDT engines on an editing trace.
+// Memory: the trace is applied as one user and the merge metadata each server keeps is divided by the final length.
+// For OT that is the op history late ops are transformed against, for CRDT the sequence of ids and origins.
+// Merge: `clients` users replay their own part of the trace offline from the same document, then come back online
+// and merge through the server until every replica has every op. OT clients send one op at a time and rebase their
+// queue of offline ops onto each op they receive; CRDT ops are integrated as they are.
+// Usage: reped_bench_crdt [traceFile or -] [traceEdits] [clients] [mergeOpsPerClient]
+int main(int argc, char** argv)
+{
+    const std::string tracePath = argc > 1 ? argv[1] : "-";
+    const std::size_t traceEdits = argc > 2 ? std::stoull(argv[2]) : 50000;
+    const std::size_t clientCount = argc > 3 ? std::stoull(argv[3]) : 4;
+    const std::size_t mergeOpsPerClient = argc > 4 ? std::stoull(argv[4]) : 1000;
+
+    std::vector<TraceEdit> trace;
+    if (tracePath != "-")
+    {
+        if (!readTrace(tracePath, trace))
+        {
+            std::cerr << "Failed to read trace " << tracePath << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        trace = generateTrace(traceEdits, 42);
+    }
+
+    // Keep engine logging out of the measurement
+    std::cout.setstate(std::ios::failbit);
+
+    // Memory per character after one user wrote the whole trace
+    ServerTextEngine otServer;
+    CrdtTextEngine crdtEditor;
+    double otApplySeconds = measureSeconds([&]
+    {
+        for (const TraceEdit& edit : trace)
+        {
+            std::unique_ptr<TextOperation> op;
+            if (edit.text.empty())
+                op = std::make_unique<DeleteOperation>(edit.pos, edit.deleteLength, "writer");
+            else
+                op = std::make_unique<InsertOperation>(edit.text, edit.pos, "writer");
+
+            op->docVersion = otServer.getDocumentVersion();
+            otServer.processIncomingOperation(std::move(op));
+        }
+    });
+    double crdtApplySeconds = measureSeconds([&]
+    {
+        for (const TraceEdit& edit : trace)
+        {
+            if (edit.text.empty())
+                crdtEditor.applyLocalDelete(DeleteOperation(edit.pos, edit.deleteLength, "writer"));
+            else
+                crdtEditor.applyLocalInsert(InsertOperation(edit.text, edit.pos, "writer"));
+        }
+    });
+
+    const std::size_t finalLength = std::max<std::size_t>(1, crdtEditor.getDocumentLength());
+    const bool sameText = otServer.getText() == crdtEditor.getText();
+    const std::size_t otBytes = getHistoryMemoryUsage(otServer);
+    const std::size_t crdtBytes = crdtEditor.getSequence().getMemoryUsage();
+
+    // Each client writes its own slice of the trace on top of the same document
+    const std::size_t baseEdits = std::min(trace.size() / 2, trace.size() - std::min(trace.size(), clientCount * mergeOpsPerClient));
+    std::string baseText;
+    {
+        TextEngine base;
+        for (std::size_t i = 0; i < baseEdits; i++)
+        {
+            const TraceEdit& edit = trace[i];
+            if (edit.text.empty())
+            {
+                DeleteOperation op(edit.pos, edit.deleteLength, "base");
+                base.deleteLocal(&op);
+            }
+            else
+            {
+                InsertOperation op(edit.text, edit.pos, "base");
+                base.insertLocal(&op);
+            }
+        }
+        baseText = base.getText();
+    }
+
+    ServerTextEngine otMerger;
+    otMerger.readString(baseText);
+    CrdtServerTextEngine crdtMerger;
+    crdtMerger.readString(baseText);
+
+    std::vector<std::unique_ptr<ClientTextEngine>> otReplicas;
+    std::vector<std::unique_ptr<CrdtTextEngine>> crdtReplicas;
+    std::vector<std::vector<std::unique_ptr<TextOperation>>> crdtStreams(clientCount);
+    std::size_t mergeOps = 0;
+    for (std::size_t c = 0; c < clientCount; c++)
+    {
+        std::string clientId = "client" + std::to_string(c);
+        otReplicas.push_back(std::make_unique<ClientTextEngine>());
+        ClientTextEngine& otReplica = *otReplicas.back();
+        otReplica.readString(baseText);
+        otReplica.resetToServerVersion(otMerger.getDocumentVersion());
+
+        crdtReplicas.push_back(std::make_unique<CrdtTextEngine>());
+        CrdtTextEngine& crdtReplica = *crdtReplicas.back();
+        if (!crdtReplica.loadState(crdtMerger.getDocumentState(), 0))
+            return 1;
+
+        // Slices are replayed on a document of the base's length, so positions past its end are clamped
+        std::size_t length = baseText.size();
+        for (std::size_t i = 0; i < mergeOpsPerClient; i++)
+        {
+            const TraceEdit& edit = trace[(baseEdits + c * mergeOpsPerClient + i) % trace.size()];
+            std::size_t pos = std::min(edit.pos, length);
+            if (edit.text.empty())
+            {
+                std::size_t deleteLength = std::min(edit.deleteLength, length - pos);
+                if (deleteLength == 0)
+                    continue;
+
+                DeleteOperation op(pos, deleteLength, clientId);
+                otReplica.deleteLocal(&op);
+                otReplica.addPendingLocalOp(std::make_unique<DeleteOperation>(op));
+                crdtStreams[c].push_back(crdtReplica.applyLocalDelete(op));
+                length -= deleteLength;
+            }
+            else
+            {
+                InsertOperation op(edit.text, pos, clientId);
+                otReplica.insertLocal(&op);
+                otReplica.addPendingLocalOp(std::make_unique<InsertOperation>(op));
+                crdtStreams[c].push_back(crdtReplica.applyLocalInsert(op));
+                length += edit.text.size();
+            }
+
+            mergeOps++;
+        }
+    }
+
+    // OT clients send one op at a time and rebase the rest of their queue onto every op they receive
+    double otMergeSeconds = measureSeconds([&]
+    {
+        for (bool sent = true; sent; )
+        {
+            sent = false;
+            for (std::size_t c = 0; c < clientCount; c++)
+            {
+                const TextOperation* op = otReplicas[c]->takeOpToSend();
+                if (!op)
+                    continue;
+
+                auto sequenced = otMerger.processIncomingOperation(copyOperation(*op));
+                for (std::size_t r = 0; r < clientCount; r++)
+                {
+                    if (r == c)
+                        otReplicas[r]->acknowledgePendingOp(sequenced->operationId, sequenced->docVersion);
+                    else
+                        otReplicas[r]->processIncomingOperation(copyOperation(*sequenced));
+                }
+
+                sent = true;
+            }
+        }
+    });
+    double crdtMergeSeconds = measureSeconds([&]
+    {
+        for (std::size_t i = 0; i < mergeOpsPerClient; i++)
+        {
+            for (std::size_t c = 0; c < clientCount; c++)
+            {
+                if (i >= crdtStreams[c].size())
+                    continue;
+
+                auto sequenced = crdtMerger.processIncomingOperation(std::move(crdtStreams[c][i]));
+                for (std::size_t r = 0; r < clientCount; r++)
+                {
+                    if (r == c)
+                        crdtReplicas[r]->acknowledge(sequenced->operationId, sequenced->docVersion);
+                    else
+                        crdtReplicas[r]->processIncomingOperation(copyOperation(*sequenced));
+                }
+            }
+        }
+    });
+
+    bool otConverged = true;
+    bool crdtConverged = true;
+    for (std::size_t c = 0; c < clientCount; c++)
+    {
+        otConverged = otConverged && otReplicas[c]->getText() == otMerger.getText();
+        crdtConverged = crdtConverged && crdtReplicas[c]->getText() == crdtMerger.getText();
+    }
+
+    std::cout.clear();
+    std::cout << "Trace: " << trace.size() << " edits, " << finalLength << " characters at the end\n";
+    std::cout << "Apply OT:   " << static_cast<uint64_t>(trace.size() / otApplySeconds) << " ops/s\n";
+    std::cout << "Apply CRDT: " << static_cast<uint64_t>(trace.size() / crdtApplySeconds) << " ops/s"
+              << (sameText ? "" : " (text differs from OT!)") << "\n";
+    std::cout << "Memory OT history:  " << static_cast<double>(otBytes) / finalLength << " bytes/char\n";
+    std::cout << "Memory CRDT ids:    " << static_cast<double>(crdtBytes) / finalLength << " bytes/char ("
+              << crdtEditor.getSequence().getRunCount() << " runs)\n";
+    std::cout << "Merge: " << clientCount << " clients, " << mergeOps << " ops onto " << baseText.size() << " characters\n";
+    std::cout << "Merge OT:   " << static_cast<uint64_t>(mergeOps / otMergeSeconds) << " ops/s, "
+              << otMerger.getTransformCount() << " server transforms" << (otConverged ? "" : " (replicas diverged!)") << "\n";
+    std::cout << "Merge CRDT: " << static_cast<uint64_t>(mergeOps / crdtMergeSeconds) << " ops/s ("
+              << crdtMerger.getSequence().getRunCount() << " runs)" << (crdtConverged ? "" : " (replicas diverged!)") << "\n";
+}
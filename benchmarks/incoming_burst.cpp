@@ -0,0 +1,91 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "client_text_engine.h"
+#include "operations.h"
+
+// Applies a burst of ops another client typed to a large document, one op at a time and as one batch, with local
+// ops pending, and reports how long that took and how many edits reached the piece table.
+// Usage: reped_bench_incoming_burst [ops] [document KiB]
+
+namespace
+{
+    struct Result
+    {
+        double millis;
+        uint64_t edits;
+    };
+
+    std::vector<std::unique_ptr<TextOperation>> makeBurst(std::size_t opCount, std::size_t start)
+    {
+        std::vector<std::unique_ptr<TextOperation>> ops;
+        for (std::size_t i = 0; i < opCount; i++)
+        {
+            auto op = std::make_unique<InsertOperation>(std::string(1, static_cast<char>('a' + i % 26)), start + i, "typist");
+            op->docVersion = i;
+            ops.push_back(std::move(op));
+        }
+
+        return ops;
+    }
+
+    void prepare(ClientTextEngine& client, std::size_t documentSize)
+    {
+        client.readString(std::string(documentSize, 'x'));
+        client.resetToServerVersion(0);
+
+        // Waiting for acks while the burst arrives
+        for (std::size_t i = 0; i < 3; i++)
+        {
+            auto local = std::make_unique<InsertOperation>("local", i * 1000, "reader");
+            client.insertLocal(local.get());
+            client.addPendingLocalOp(std::make_unique<InsertOperation>(*local));
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t opCount = argc > 1 ? std::stoul(argv[1]) : 2000;
+    const std::size_t documentSize = (argc > 2 ? std::stoul(argv[2]) : 1024) * 1024;
+
+    // Keep engine logging out of the measurement
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+
+    out << opCount << " typed ops into a " << documentSize / 1024 << " KiB document\n";
+
+    ClientTextEngine single;
+    prepare(single, documentSize);
+    std::vector<std::unique_ptr<TextOperation>> ops = makeBurst(opCount, documentSize / 2);
+    uint64_t revision = single.getEditRevision();
+    auto start = std::chrono::steady_clock::now();
+    for (auto& op : ops)
+        single.processIncomingOperation(std::move(op));
+
+    Result singleResult = {std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+                           single.getEditRevision() - revision};
+
+    ClientTextEngine batched;
+    prepare(batched, documentSize);
+    ops = makeBurst(opCount, documentSize / 2);
+    revision = batched.getEditRevision();
+    start = std::chrono::steady_clock::now();
+    batched.processIncomingOperations(std::move(ops));
+
+    Result batchResult = {std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+                          batched.getEditRevision() - revision};
+
+    if (single.getText() != batched.getText())
+    {
+        out << "texts differ\n";
+        return 1;
+    }
+
+    out << "one at a time: " << singleResult.millis << " ms, " << singleResult.edits << " edits\n";
+    out << "batched: " << batchResult.millis << " ms, " << batchResult.edits << " edits\n";
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "server.h"
+#include "shared_memory_channel.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+
+// Talks to one server over TCP loopback, a Unix domain socket and shared memory rings and compares the three:
+// heartbeat round trips, answered on the reactor thread, measure the transport alone, op acks add a shard's
+// queue, and a burst of ops shows how many a client gets sequenced per second.
+// Usage: reped_bench_local_transports [round trips] [burst ops]
+
+namespace
+{
+    struct Result
+    {
+        double pingP50Micros;
+        double pingP99Micros;
+        double ackP50Micros;
+        double ackP99Micros;
+        double burstOpsPerSecond;
+    };
+
+    double getPercentile(std::vector<double>& samples, double percentile)
+    {
+        std::size_t index = static_cast<std::size_t>(percentile * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    int connectOverTcp(uint16_t port)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        return fd;
+    }
+
+    int connectOverUnixSocket(const std::string& path)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.data(), std::min(path.size(), sizeof(address.sun_path) - 1));
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    /**
+     * One client connection, through the socket or through the rings passed over it.
+    */
+    class Link
+    {
+    private:
+        int socket;
+        std::unique_ptr<SharedMemoryChannel> channel;
+        FrameReader reader;
+
+    public:
+        Link(int socket, std::unique_ptr<SharedMemoryChannel> channel) : socket(socket), channel(std::move(channel)) {}
+
+        ~Link()
+        {
+            channel.reset();
+            close(socket);
+        }
+
+        bool send(std::string_view bytes)
+        {
+            while (!bytes.empty())
+            {
+                ssize_t sent;
+                if (channel)
+                {
+                    struct iovec part = { const_cast<char*>(bytes.data()), bytes.size() };
+                    sent = channel->send(&part, 1);
+                    if (sent == 0 && !waitReadable())
+                        return false;
+                }
+                else
+                    sent = ::send(socket, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+
+                if (sent < 0)
+                    return false;
+
+                bytes.remove_prefix(static_cast<std::size_t>(sent));
+            }
+
+            return true;
+        }
+
+        /**
+         * Reads frames until one of the wanted type arrives.
+         * @returns False if the connection ended
+        */
+        bool receiveUntil(MessageType type, ParsedMessage& parsed)
+        {
+            while (true)
+            {
+                std::string_view frame;
+                while (reader.nextFrame(frame))
+                {
+                    parsed = MessageParser::parseMessage(frame);
+                    if (parsed.type == type)
+                        return true;
+                }
+
+                std::size_t space = 0;
+                char* buffer = reader.prepareReceive(space);
+                ssize_t received = channel ? channel->receive(buffer, space) : recv(socket, buffer, space, 0);
+                if (received < 0 && errno == EAGAIN && waitReadable())
+                    continue;
+
+                if (received <= 0)
+                    return false;
+
+                reader.commitReceive(static_cast<std::size_t>(received));
+            }
+        }
+
+    private:
+        bool waitReadable()
+        {
+            struct pollfd readable = { socket, POLLIN, 0 };
+            return poll(&readable, 1, 5000) == 1;
+        }
+    };
+
+    std::string frame(const std::string& message)
+    {
+        std::string bytes;
+        Framing::appendFrame(bytes, message, false);
+        return bytes;
+    }
+
+    bool measure(Link& link, const std::string& documentName, std::size_t roundTrips, std::size_t burstOps, Result& result)
+    {
+        ParsedMessage parsed;
+        if (!link.send(frame(MessageParser::createConnectedMessage(documentName, documentName, std::nullopt, WireProtocol::BINARY))) ||
+            !link.receiveUntil(MessageType::INIT_DOCUMENT, parsed))
+            return false;
+
+        std::vector<double> pings;
+        for (std::size_t i = 0; i < roundTrips; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if (!link.send(frame(MessageParser::createPingMessage(i))) || !link.receiveUntil(MessageType::PONG, parsed))
+                return false;
+
+            pings.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        // Each op waits for its ack, so it is never transformed
+        uint64_t version = 0;
+        std::vector<double> acks;
+        for (std::size_t i = 0; i < roundTrips; i++)
+        {
+            InsertOperation insert("a", 0, documentName);
+            insert.docVersion = version++;
+            auto start = std::chrono::steady_clock::now();
+            if (!link.send(frame(insert.serialize())) || !link.receiveUntil(MessageType::OPERATION, parsed))
+                return false;
+
+            acks.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        // Written as fast as the transport takes them, each based on the ones before it
+        std::string burst;
+        for (std::size_t i = 0; i < burstOps; i++)
+        {
+            InsertOperation insert("b", 0, documentName);
+            insert.docVersion = version++;
+            Framing::appendFrame(burst, insert.serialize(), false);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (!link.send(burst))
+            return false;
+
+        for (std::size_t i = 0; i < burstOps; i++)
+        {
+            if (!link.receiveUntil(MessageType::OPERATION, parsed))
+                return false;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.pingP50Micros = getPercentile(pings, 0.50);
+        result.pingP99Micros = getPercentile(pings, 0.99);
+        result.ackP50Micros = getPercentile(acks, 0.50);
+        result.ackP99Micros = getPercentile(acks, 0.99);
+        result.burstOpsPerSecond = burstOps / seconds;
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t roundTrips = argc > 1 ? std::stoul(argv[1]) : 20000;
+    std::size_t burstOps = argc > 2 ? std::stoul(argv[2]) : 100000;
+
+    // The server logs every message and op it handles
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+
+    const uint16_t port = 47260;
+    const std::string unixPath = "/tmp/reped_bench_" + std::to_string(getpid()) + ".sock";
+    const std::string sharedMemoryPath = "/tmp/reped_bench_" + std::to_string(getpid()) + ".shm";
+
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+
+    ServerConfig config;
+    config.shardCount = 1;
+    config.reactorCount = 1;
+    config.unixSocketPath = unixPath;
+    config.sharedMemorySocketPath = sharedMemoryPath;
+    Server server(port, "127.0.0.1", &controller, config);
+    if (!server.isRunning())
+    {
+        std::cerr << "reped_bench_local_transports: Server failed to start\n";
+        return 1;
+    }
+
+    out << roundTrips << " round trips and a burst of " << burstOps << " ops per transport\n\n";
+    out << std::left << std::setw(10) << "transport" << std::right
+        << std::setw(12) << "ping p50" << std::setw(12) << "ping p99"
+        << std::setw(12) << "ack p50" << std::setw(12) << "ack p99"
+        << std::setw(14) << "burst ops/s" << "\n";
+
+    for (const std::string transport : {"tcp", "unix", "shm"})
+    {
+        std::unique_ptr<Link> link;
+        if (transport == "tcp")
+            link = std::make_unique<Link>(connectOverTcp(port), nullptr);
+        else if (transport == "unix")
+            link = std::make_unique<Link>(connectOverUnixSocket(unixPath), nullptr);
+        else
+        {
+            int fd = connectOverUnixSocket(sharedMemoryPath);
+            auto channel = SharedMemoryChannel::accept(fd, std::chrono::milliseconds(5000));
+            link = std::make_unique<Link>(fd, std::move(channel));
+        }
+
+        Result result;
+        if (!measure(*link, transport, roundTrips, burstOps, result))
+        {
+            std::cerr << "reped_bench_local_transports: Lost the " << transport << " connection\n";
+            return 1;
+        }
+
+        out << std::left << std::setw(10) << transport << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << result.pingP50Micros << "us" << std::setw(10) << result.pingP99Micros << "us"
+            << std::setw(10) << result.ackP50Micros << "us" << std::setw(10) << result.ackP99Micros << "us"
+            << std::setw(14) << std::setprecision(0) << result.burstOpsPerSecond << "\n";
+    }
+
+    return 0;
+}
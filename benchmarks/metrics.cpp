@@ -0,0 +1,71 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "metrics.h"
+
+// What an increment costs on the hot path: the sharded Counter against one atomic that every thread adds to,
+// with one thread and with as many threads as there are cores.
+// Usage: reped_bench_metrics [increments per thread]
+
+namespace
+{
+    template <typename Increment>
+    double measure(std::size_t threadCount, std::size_t increments, Increment increment)
+    {
+        std::atomic<bool> go = false;
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < threadCount; i++)
+        {
+            threads.emplace_back([&]
+            {
+                while (!go.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+
+                for (std::size_t j = 0; j < increments; j++)
+                    increment();
+            });
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread& thread : threads)
+            thread.join();
+
+        // Threads run side by side, so this is the cost one thread sees
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / increments;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t increments = argc > 1 ? std::stoul(argv[1]) : 20000000;
+    // At least a few threads, so a small machine still shows them competing for the cache line
+    std::size_t manyThreads = std::max(4u, std::thread::hardware_concurrency());
+
+    std::cout << increments << " increments per thread\n\n";
+    std::cout << std::left << std::setw(10) << "threads" << std::right
+              << std::setw(16) << "shared atomic" << std::setw(16) << "Counter" << "\n";
+
+    for (std::size_t threadCount : {std::size_t(1), manyThreads})
+    {
+        std::atomic<uint64_t> shared = 0;
+        double sharedNanos = measure(threadCount, increments, [&shared] { shared.fetch_add(1, std::memory_order_relaxed); });
+
+        Counter counter;
+        double counterNanos = measure(threadCount, increments, [&counter] { counter.add(); });
+
+        if (shared.load() != counter.getValue())
+            std::cerr << "reped_bench_metrics: Counter lost increments\n";
+
+        std::cout << std::left << std::setw(10) << threadCount << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << sharedNanos << "ns" << std::setw(14) << counterNanos << "ns\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+
+#include "op_log.h"
+#include "server_text_engine.h"
+
+// Benchmarks op log group commit latency and recovery replay speed.
+// Usage: reped_bench_op_log [path] [opsPerSecond] [replayOps]
+
+namespace
+{
+    void benchmarkGroupCommit(std::ostream& out, const std::string& path, std::chrono::microseconds window, int opsPerSecond)
+    {
+        std::remove(path.c_str());
+        OpLog log(path, window);
+        if (!log.open())
+            return;
+
+        const int opCount = opsPerSecond; // One second of typing
+        const auto interval = std::chrono::nanoseconds(1000000000 / opsPerSecond);
+
+        // Time from append until the op is durable, which is how long its broadcast is held back
+        std::vector<double> latenciesMicros;
+        std::vector<std::chrono::steady_clock::time_point> pendingAppendTimes;
+
+        auto commit = [&] ()
+        {
+            log.commit();
+            auto now = std::chrono::steady_clock::now();
+            for (auto appendTime : pendingAppendTimes)
+                latenciesMicros.push_back(std::chrono::duration<double, std::micro>(now - appendTime).count());
+            pendingAppendTimes.clear();
+        };
+
+        auto startTime = std::chrono::steady_clock::now();
+        auto nextArrival = startTime;
+        InsertOperation op("x", 0, "bench");
+
+        for (int i = 0; i < opCount; i++)
+        {
+            // Commit anything whose window runs out before the next keystroke arrives
+            while (log.hasPendingRecords() && log.getCommitDeadline() <= nextArrival)
+            {
+                std::this_thread::sleep_until(log.getCommitDeadline());
+                commit();
+            }
+
+            std::this_thread::sleep_until(nextArrival);
+            op.docVersion = i;
+            log.append(op);
+            pendingAppendTimes.push_back(std::chrono::steady_clock::now());
+            nextArrival += interval;
+
+            if (window.count() == 0)
+                commit();
+        }
+
+        if (log.hasPendingRecords())
+            commit();
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::sort(latenciesMicros.begin(), latenciesMicros.end());
+        OpLogStats stats = log.getStats();
+
+        out << "Window " << window.count() << " us: "
+            << stats.commits / elapsed << " fsyncs/s, "
+            << static_cast<double>(stats.recordsCommitted) / stats.commits << " ops/fsync, "
+            << "avg fsync " << static_cast<double>(stats.totalCommitMicros) / stats.commits << " us, "
+            << "op latency p50 " << latenciesMicros[latenciesMicros.size() / 2] << " us, "
+            << "p99 " << latenciesMicros[latenciesMicros.size() * 99 / 100] << " us\n";
+    }
+
+    void benchmarkReplay(std::ostream& out, const std::string& path, int opCount)
+    {
+        std::remove(path.c_str());
+        {
+            OpLog log(path, std::chrono::microseconds(0));
+            if (!log.open())
+                return;
+
+            ServerTextEngine engine;
+            for (int i = 0; i < opCount; i++)
+            {
+                auto op = std::make_unique<InsertOperation>("typing ", engine.getDocumentLength(), "bench");
+                op->docVersion = engine.getDocumentVersion();
+                auto sequenced = engine.processIncomingOperation(std::move(op));
+                log.append(*sequenced);
+            }
+            log.commit();
+        }
+
+        ServerTextEngine recovered;
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t replayed = OpLog::replay(path, [&recovered] (std::unique_ptr<TextOperation> op)
+        {
+            recovered.applySequencedOperation(std::move(op));
+        });
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        out << "Replay: " << replayed << " ops in " << elapsed * 1000.0 << " ms ("
+            << static_cast<uint64_t>(replayed / elapsed) << " ops/s)\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string path = argc > 1 ? argv[1] : "reped_bench.oplog";
+    const int opsPerSecond = argc > 2 ? std::stoi(argv[2]) : 2000;
+    const int replayOps = argc > 3 ? std::stoi(argv[3]) : 20000;
+
+    // Keep engine logging out of the measurement
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+
+    out << "Group commit at " << opsPerSecond << " ops/s\n";
+    for (auto window : { std::chrono::microseconds(0), std::chrono::microseconds(1000), std::chrono::microseconds(5000) })
+        benchmarkGroupCommit(out, path, window, opsPerSecond);
+
+    benchmarkReplay(out, path, replayOps);
+
+    std::remove(path.c_str());
+}
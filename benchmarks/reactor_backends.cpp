@@ -0,0 +1,379 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstdarg>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "server.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "io_uring_reactor.h"
+#include "../controller/controller.h"
+
+// Broadcasts ops from one client to many over loopback and compares the server's reactor backends: system calls
+// the server makes per op and how long each subscriber waits for an op after it was sent.
+// Usage: reped_bench_reactor_backends [clients] [ops] [receiver threads]
+
+namespace
+{
+    std::atomic<uint64_t> serverSyscalls = 0;
+
+    // Only the server's reactor and shard threads are counted, not the benchmark's clients
+    thread_local bool countSyscalls = true;
+
+    void countSyscall()
+    {
+        if (countSyscalls)
+            serverSyscalls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template <typename Function>
+    Function getNext(const char* name)
+    {
+        return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+    }
+}
+
+// The socket calls the server makes, interposed to count them. io_uring_enter goes through syscall().
+extern "C"
+{
+    ssize_t sendmsg(int socket, const struct msghdr* msg, int flags)
+    {
+        static auto next = getNext<ssize_t (*)(int, const struct msghdr*, int)>("sendmsg");
+        countSyscall();
+        return next(socket, msg, flags);
+    }
+
+    ssize_t recv(int socket, void* buffer, size_t length, int flags)
+    {
+        static auto next = getNext<ssize_t (*)(int, void*, size_t, int)>("recv");
+        countSyscall();
+        return next(socket, buffer, length, flags);
+    }
+
+    int epoll_wait(int epollFd, struct epoll_event* events, int maxEvents, int timeout)
+    {
+        static auto next = getNext<int (*)(int, struct epoll_event*, int, int)>("epoll_wait");
+        countSyscall();
+        return next(epollFd, events, maxEvents, timeout);
+    }
+
+    int epoll_ctl(int epollFd, int operation, int fd, struct epoll_event* event)
+    {
+        static auto next = getNext<int (*)(int, int, int, struct epoll_event*)>("epoll_ctl");
+        countSyscall();
+        return next(epollFd, operation, fd, event);
+    }
+
+    long syscall(long number, ...)
+    {
+        static auto next = getNext<long (*)(long, ...)>("syscall");
+        countSyscall();
+
+        // Every system call takes at most six arguments
+        va_list args;
+        va_start(args, number);
+        long arguments[6];
+        for (long& argument : arguments)
+            argument = va_arg(args, long);
+        va_end(args);
+
+        return next(number, arguments[0], arguments[1], arguments[2], arguments[3], arguments[4], arguments[5]);
+    }
+}
+
+namespace
+{
+    struct Result
+    {
+        double syscallsPerOp;
+        double p50Micros;
+        double p99Micros;
+        double p99LastMicros;   // Until the op reached every subscriber
+    };
+
+    int connectToServer(uint16_t port)
+    {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        if (connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            close(clientSocket);
+            return -1;
+        }
+
+        return clientSocket;
+    }
+
+    double getPercentile(std::vector<double>& samples, double percentile)
+    {
+        std::size_t index = static_cast<std::size_t>(percentile * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    int64_t getNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Reads a share of the clients on its own thread and records when each op reached each of them.
+    */
+    class Receiver
+    {
+    public:
+        static constexpr std::size_t handshakeFrames = 2;   // PROTOCOL and INIT_DOCUMENT
+
+        std::vector<double> latencies;
+
+    private:
+        struct Client
+        {
+            int socket;
+            FrameReader reader;
+            std::size_t frames = 0;
+        };
+
+        std::vector<Client> clients;
+        int epollFd;
+        const std::atomic<int64_t>& sendTime;
+        std::atomic<std::size_t>& delivered;
+        std::atomic<bool> running;
+        std::thread thread;
+
+    public:
+        Receiver(const std::atomic<int64_t>& sendTime, std::atomic<std::size_t>& delivered)
+            : epollFd(epoll_create1(0)), sendTime(sendTime), delivered(delivered), running(false)
+        {}
+
+        ~Receiver()
+        {
+            stop();
+            for (Client& client : clients)
+                close(client.socket);
+
+            close(epollFd);
+        }
+
+        void addClient(int clientSocket)
+        {
+            clients.push_back({clientSocket, FrameReader()});
+        }
+
+        void start()
+        {
+            for (std::size_t i = 0; i < clients.size(); i++)
+            {
+                struct epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.u64 = i;
+                epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i].socket, &event);
+            }
+
+            running = true;
+            thread = std::thread(&Receiver::run, this);
+        }
+
+        void stop()
+        {
+            running = false;
+            if (thread.joinable())
+                thread.join();
+        }
+
+    private:
+        void run()
+        {
+            countSyscalls = false;
+
+            struct epoll_event events[256];
+            while (running)
+            {
+                int count = epoll_wait(epollFd, events, 256, 100);
+                for (int i = 0; i < count; i++)
+                {
+                    Client& client = clients[events[i].data.u64];
+                    std::size_t space = 0;
+                    char* buffer = client.reader.prepareReceive(space);
+                    ssize_t length = recv(client.socket, buffer, space, 0);
+                    if (length <= 0)
+                    {
+                        epoll_ctl(epollFd, EPOLL_CTL_DEL, client.socket, nullptr);
+                        continue;
+                    }
+
+                    client.reader.commitReceive(static_cast<std::size_t>(length));
+                    std::string_view frame;
+                    while (client.reader.nextFrame(frame))
+                    {
+                        if (++client.frames > handshakeFrames)
+                            latencies.push_back((getNanos() - sendTime.load()) / 1000.0);
+
+                        delivered.fetch_add(1);
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * Waits until the receivers got `wanted` frames in total.
+     * @returns False if that took longer than five seconds
+    */
+    bool waitForFrames(const std::atomic<std::size_t>& delivered, std::size_t wanted)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (delivered.load() < wanted)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            // Leave the cores to the server and the receivers
+            std::this_thread::yield();
+        }
+
+        return true;
+    }
+
+    bool run(ReactorBackend backend, uint16_t port, std::size_t clientCount, std::size_t opCount, std::size_t receiverCount, Result& result)
+    {
+        Controller controller;
+        ServerTextEngine engine;
+        controller.textEngine = &engine;
+
+        ServerConfig config;
+        config.reactorBackend = backend;
+        auto server = std::make_unique<Server>(port, "127.0.0.1", &controller, config);
+
+        std::atomic<int64_t> sendTime = 0;
+        std::atomic<std::size_t> delivered = 0;
+        std::vector<std::unique_ptr<Receiver>> receivers;
+        for (std::size_t i = 0; i < receiverCount; i++)
+            receivers.push_back(std::make_unique<Receiver>(sendTime, delivered));
+
+        int writerSocket = -1;
+        for (std::size_t i = 0; i < clientCount; i++)
+        {
+            int clientSocket = connectToServer(port);
+            if (clientSocket == -1)
+                return false;
+
+            std::string connected = MessageParser::createConnectedMessage("c" + std::to_string(i), "", std::nullopt, WireProtocol::BINARY);
+            if (!Framing::sendFrame(clientSocket, connected))
+                return false;
+
+            if (i == 0)
+                writerSocket = clientSocket;
+
+            receivers[i % receiverCount]->addClient(clientSocket);
+        }
+
+        for (auto& receiver : receivers)
+            receiver->start();
+
+        if (!waitForFrames(delivered, clientCount * Receiver::handshakeFrames))
+            return false;
+
+        std::vector<double> lastLatencies;
+        serverSyscalls = 0;
+        for (std::size_t op = 0; op < opCount; op++)
+        {
+            InsertOperation insert("x", op, "c0");
+            insert.docVersion = op;
+            std::string message = insert.serialize();
+
+            sendTime = getNanos();
+            if (!Framing::sendFrame(writerSocket, message))
+                return false;
+
+            if (!waitForFrames(delivered, clientCount * (Receiver::handshakeFrames + op + 1)))
+                return false;
+
+            lastLatencies.push_back((getNanos() - sendTime.load()) / 1000.0);
+        }
+
+        result.syscallsPerOp = static_cast<double>(serverSyscalls.load()) / opCount;
+
+        std::vector<double> latencies;
+        for (auto& receiver : receivers)
+        {
+            receiver->stop();
+            latencies.insert(latencies.end(), receiver->latencies.begin(), receiver->latencies.end());
+        }
+
+        result.p50Micros = getPercentile(latencies, 0.5);
+        result.p99Micros = getPercentile(latencies, 0.99);
+        result.p99LastMicros = getPercentile(lastLatencies, 0.99);
+        return true;
+    }
+
+    void report(std::ostream& out, const std::string& name, const Result& result)
+    {
+        out << name << ": " << result.syscallsPerOp << " server syscalls/op, latency p50 " << result.p50Micros
+            << " us, p99 " << result.p99Micros << " us, p99 until every subscriber had it " << result.p99LastMicros << " us\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    countSyscalls = false;
+
+    const std::size_t clientCount = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const std::size_t opCount = argc > 2 ? std::stoul(argv[2]) : 2000;
+    const std::size_t receiverCount = argc > 3 ? std::stoul(argv[3]) : std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+
+    // Keep server logging out of the measurement
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+
+    // Both ends of every connection live in this process
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    out << clientCount << " clients read by " << receiverCount << " threads, " << opCount << " ops broadcast one at a time\n";
+
+    Result epollResult;
+    if (!run(ReactorBackend::EPOLL, 47301, clientCount, opCount, receiverCount, epollResult))
+    {
+        out << "epoll run failed\n";
+        return 1;
+    }
+
+    report(out, "epoll", epollResult);
+
+    if (!IoUringReactor::isSupported())
+    {
+        out << "io_uring: not supported by this kernel\n";
+        return 0;
+    }
+
+    Result ioUringResult;
+    if (!run(ReactorBackend::IO_URING, 47302, clientCount, opCount, receiverCount, ioUringResult))
+    {
+        out << "io_uring run failed\n";
+        return 1;
+    }
+
+    report(out, "io_uring", ioUringResult);
+    return 0;
+}
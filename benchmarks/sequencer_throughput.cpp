@@ -0,0 +1,107 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+#include "sequencer.h"
+#include "server_text_engine.h"
+#include "server_document.h"
+
+// Measures sequencer throughput with many connection threads submitting concurrently.
+// Each client keeps at most `window` ops in flight, like an editor waiting on its pending ops.
+// Clients are spread over `documents` documents which are spread over `shards` sequencers.
+// Usage: reped_bench_sequencer [clients] [opsPerClient] [window] [documents] [shards]
+int main(int argc, char** argv)
+{
+    const int clientCount = argc > 1 ? std::stoi(argv[1]) : 128;
+    const int opsPerClient = argc > 2 ? std::stoi(argv[2]) : 500;
+    const uint64_t window = argc > 3 ? std::stoull(argv[3]) : 8;
+    const int documentCount = argc > 4 ? std::stoi(argv[4]) : 1;
+    const int shardCount = argc > 5 ? std::stoi(argv[5]) : 1;
+    const uint64_t totalOps = static_cast<uint64_t>(clientCount) * opsPerClient;
+
+    // Keep engine logging out of the measurement
+    std::cout.setstate(std::ios::failbit);
+
+    std::vector<std::unique_ptr<ServerDocument>> documents;
+    std::unordered_map<const ServerDocument*, int> documentIndices;
+    for (int d = 0; d < documentCount; d++)
+    {
+        documents.push_back(std::make_unique<ServerDocument>("bench" + std::to_string(d), d % shardCount));
+        documentIndices[documents.back().get()] = d;
+    }
+
+    // Clients base their ops on the latest version broadcast for their document, like connected editors would
+    std::atomic<uint64_t> broadcastOps = 0;
+    std::vector<std::atomic<uint64_t>> latestVersions(documentCount);
+    std::vector<std::atomic<uint64_t>> sequencedPerClient(clientCount);
+
+    std::vector<std::unique_ptr<Sequencer>> shards;
+    for (int s = 0; s < shardCount; s++)
+    {
+        auto shard = std::make_unique<Sequencer>();
+        shard->setBroadcastCallback([&] (ServerDocument& document, std::vector<SequencedOperation>& batch)
+        {
+            for (const auto& sequencedOp : batch)
+                sequencedPerClient[sequencedOp.clientSocket].fetch_add(1, std::memory_order_relaxed);
+
+            broadcastOps.fetch_add(batch.size(), std::memory_order_relaxed);
+            latestVersions[documentIndices.at(&document)].store(batch.back().operation->docVersion + 1, std::memory_order_relaxed);
+        });
+        shard->start(s % std::max(1u, std::thread::hardware_concurrency()));
+        shards.push_back(std::move(shard));
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> connections;
+    for (int c = 0; c < clientCount; c++)
+    {
+        connections.emplace_back([&, c]
+        {
+            const int documentIndex = c % documentCount;
+            ServerDocument* document = documents[documentIndex].get();
+            Sequencer* shard = shards[document->shardIndex].get();
+            std::string clientId = "bench" + std::to_string(c);
+
+            for (uint64_t i = 0; i < static_cast<uint64_t>(opsPerClient); i++)
+            {
+                while (i - sequencedPerClient[c].load(std::memory_order_relaxed) >= window)
+                    std::this_thread::yield();
+
+                auto op = std::make_unique<InsertOperation>("x", 0, clientId);
+                op->docVersion = latestVersions[documentIndex].load(std::memory_order_relaxed);
+                shard->submitOperation(document, c, std::move(op));
+            }
+        });
+    }
+
+    for (auto& connection : connections)
+        connection.join();
+
+    while (broadcastOps.load(std::memory_order_relaxed) < totalOps)
+        std::this_thread::yield();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    uint64_t batches = 0;
+    uint64_t largestBatch = 0;
+    for (auto& shard : shards)
+    {
+        shard->stop();
+        SequencerStats stats = shard->getStats();
+        batches += stats.batchesProcessed;
+        largestBatch = std::max(largestBatch, stats.largestBatch);
+    }
+
+    std::cout.clear();
+    std::cout << "Clients: " << clientCount << ", documents: " << documentCount << ", shards: " << shardCount << "\n";
+    std::cout << "Ops: " << totalOps << "\n";
+    std::cout << "Elapsed: " << elapsed << " s\n";
+    std::cout << "Throughput: " << static_cast<uint64_t>(totalOps / elapsed) << " ops/s\n";
+    std::cout << "Batches: " << batches << " (avg " << static_cast<double>(totalOps) / batches << ", max " << largestBatch << " ops/batch)\n";
+}
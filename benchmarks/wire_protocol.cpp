@@ -0,0 +1,184 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "wire_codec.h"
+#include "message_parser.h"
+#include "operations.h"
+
+// Compares encoding and decoding ops in the text and binary wire protocols: time, bytes and heap allocations
+// per op.
+// Usage: reped_bench_wire_protocol [ops] [rounds]
+
+namespace
+{
+    std::atomic<uint64_t> allocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+    /**
+     * Ops as they arrive from someone typing: short inserts and backspaces at a growing position.
+    */
+    std::vector<std::unique_ptr<TextOperation>> makeTypingOperations(std::size_t count)
+    {
+        std::mt19937 random(7);
+        std::vector<std::unique_ptr<TextOperation>> operations;
+        std::size_t cursor = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::unique_ptr<TextOperation> op;
+            if (cursor > 0 && random() % 100 < 20)
+            {
+                op = std::make_unique<DeleteOperation>(--cursor, 1, "alice-laptop");
+            }
+            else
+            {
+                std::string text(1 + random() % 3, static_cast<char>('a' + random() % 26));
+                op = std::make_unique<InsertOperation>(text, cursor, "alice-laptop");
+                cursor += text.size();
+            }
+
+            op->docVersion = 100000 + i;
+            operations.push_back(std::move(op));
+        }
+
+        return operations;
+    }
+
+    struct Measurement
+    {
+        double nanosPerOp;
+        double allocationsPerOp;
+    };
+
+    template <typename Function>
+    Measurement measure(std::size_t ops, int rounds, Function function)
+    {
+        uint64_t allocationsBefore = allocations.load();
+        auto startTime = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++)
+            function();
+
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+        double total = static_cast<double>(ops) * rounds;
+        return {elapsed / total, static_cast<double>(allocations.load() - allocationsBefore) / total};
+    }
+
+    void report(std::ostream& out, const std::string& name, const Measurement& measurement)
+    {
+        out << "  " << name << ": " << measurement.nanosPerOp << " ns/op, " << measurement.allocationsPerOp << " allocations/op\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t opCount = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const int rounds = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    // Keep parser logging out of the measurement
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+
+    std::vector<std::unique_ptr<TextOperation>> operations = makeTypingOperations(opCount);
+
+    std::vector<std::string> textMessages(opCount);
+    std::vector<std::string> binaryMessages(opCount);
+    std::size_t textBytes = 0;
+    std::size_t binaryBytes = 0;
+    for (std::size_t i = 0; i < opCount; i++)
+    {
+        textMessages[i] = operations[i]->serialize();
+        WireCodec::encode(*operations[i], binaryMessages[i]);
+        textBytes += textMessages[i].size();
+        binaryBytes += binaryMessages[i].size();
+    }
+
+    std::size_t sink = 0;
+
+    Measurement textEncode = measure(opCount, rounds, [&]
+    {
+        for (const auto& op : operations)
+            sink += op->serialize().size();
+    });
+
+    // The path a text op took before: parsed for its client id, then deserialized again
+    Measurement textDecodeTwice = measure(opCount, rounds, [&]
+    {
+        for (const std::string& message : textMessages)
+        {
+            ParsedMessage parsed = MessageParser::parseMessage(message);
+            sink += parsed.clientId.size() + Operation::deserialize(message)->pos;
+        }
+    });
+
+    Measurement textDecode = measure(opCount, rounds, [&]
+    {
+        for (const std::string& message : textMessages)
+            sink += MessageParser::parseMessage(message).operation->pos;
+    });
+
+    std::string buffer;
+    buffer.reserve(256);
+    Measurement binaryEncode = measure(opCount, rounds, [&]
+    {
+        for (const auto& op : operations)
+        {
+            WireCodec::encode(*op, buffer);
+            sink += buffer.size();
+        }
+    });
+
+    Measurement binaryDecodeView = measure(opCount, rounds, [&]
+    {
+        WireOperationView view;
+        for (const std::string& message : binaryMessages)
+        {
+            if (WireCodec::decode(message, view))
+                sink += view.pos + view.text.size();
+        }
+    });
+
+    Measurement binaryDecode = measure(opCount, rounds, [&]
+    {
+        for (const std::string& message : binaryMessages)
+            sink += MessageParser::parseMessage(message).operation->pos;
+    });
+
+    out << opCount << " typing ops, " << rounds << " rounds\n";
+    out << "Text: " << static_cast<double>(textBytes) / opCount << " bytes/op\n";
+    report(out, "encode (serialize)", textEncode);
+    report(out, "decode (parse + deserialize)", textDecodeTwice);
+    report(out, "decode (parse once)", textDecode);
+    out << "Binary: " << static_cast<double>(binaryBytes) / opCount << " bytes/op\n";
+    report(out, "encode into reused buffer", binaryEncode);
+    report(out, "decode to view", binaryDecodeView);
+    report(out, "decode to op (parse once)", binaryDecode);
+
+    return sink == 0 ? 1 : 0;
+}
@@ -4,6 +4,8 @@
 #include "./ui/window.h"
 #include "./text_engine/client_text_engine.h"
 #include "./text_engine/server_text_engine.h"
+#include "./text_engine/crdt_text_engine.h"
+#include "./text_engine/crdt_server_text_engine.h"
 #include "./controller/controller.h"
 
 Application::Application()
@@ -11,9 +13,9 @@ Application::Application()
         textEngine(nullptr), clientId("")
 {    
     // Setup window callbacks
-    window.setOnSetupCompletedCallback([this] (AppMode appMode, const uint16_t port, const std::string& serverAddress, const std::string& clientId, const std::string& filePathName)
+    window.setOnSetupCompletedCallback([this] (AppMode appMode, const uint16_t port, const std::string& serverAddress, const std::string& clientId, const std::string& documentName, const std::string& filePathName, TextEngineType engineType)
     {
-        this->onSetupCompleted(appMode, port, serverAddress, clientId, filePathName);
+        this->onSetupCompleted(appMode, port, serverAddress, clientId, documentName, filePathName, engineType);
     });
     
     window.setEditorController(controller.get());
@@ -21,7 +23,7 @@ Application::Application()
     window.render();
 }
 
-void Application::onSetupCompleted(AppMode appMode, const uint16_t port, const std::string& serverAddress, const std::string& clientId, const std::string& filePathName)
+void Application::onSetupCompleted(AppMode appMode, const uint16_t port, const std::string& serverAddress, const std::string& clientId, const std::string& documentName, const std::string& filePathName, TextEngineType engineType)
 {
     this->appMode = appMode;
     this->clientId = clientId;
@@ -29,17 +31,29 @@ void Application::onSetupCompleted(AppMode appMode, const uint16_t port, const s
     switch (appMode)
     {
         case AppMode::CLIENT:
-            client = std::make_unique<Client>(port, serverAddress, controller.get(), clientId);
+            // The document can arrive as soon as the client connects, so the engine has to be set first
+            if (engineType == TextEngineType::CRDT)
+                textEngine = std::make_unique<CrdtTextEngine>();
+            else
+                textEngine = std::make_unique<ClientTextEngine>();
+
+            controller->textEngine = textEngine.get();
+            client = std::make_unique<Client>(port, serverAddress, controller.get(), clientId, documentName);
             controller->client = client.get();
-            textEngine = std::make_unique<ClientTextEngine>();
             break;
         case AppMode::SERVER:
-            server = std::make_unique<Server>(port, serverAddress, controller.get());
-            textEngine = std::make_unique<ServerTextEngine>();
+            if (engineType == TextEngineType::CRDT)
+                textEngine = std::make_unique<CrdtServerTextEngine>();
+            else
+                textEngine = std::make_unique<ServerTextEngine>();
 
             if(filePathName.size() > 0)
                 textEngine->readFile(filePathName);
-            
+
+            // The server hosts this engine as its default document and applies ops to it on a shard thread,
+            // so it has to be set first
+            controller->textEngine = textEngine.get();
+            server = std::make_unique<Server>(port, serverAddress, controller.get());
             break;
         default:
             return;
@@ -5,6 +5,7 @@
 #include "../text_engine/text_engine.h"
 #include "../text_engine/client_text_engine.h"
 #include "../text_engine/server_text_engine.h"
+#include "../text_engine/crdt_text_engine.h"
 #include "../text_engine/operations.h"
 #include "../text_engine/input_events.h"
 #include "../networking/client.h"
@@ -55,6 +56,18 @@ void Controller::processLocalOperation(std::unique_ptr<Operation> operation)
         case OperationType::INSERT:
         {
             auto insertOp = static_cast<InsertOperation*>(operation.get());
+
+            // CRDT edits go out as ops naming the characters around them instead of positions
+            CrdtTextEngine* crdtEngine = dynamic_cast<CrdtTextEngine*>(textEngine);
+            if (crdtEngine)
+            {
+                auto crdtOp = crdtEngine->applyLocalInsert(*insertOp);
+                if (crdtOp)
+                    sendOperationToClient(*crdtOp);
+
+                break;
+            }
+
             textEngine->insertLocal(insertOp);
             
             ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine);
@@ -62,6 +75,8 @@ void Controller::processLocalOperation(std::unique_ptr<Operation> operation)
             {
                 auto pendingOp = std::make_unique<InsertOperation>(*insertOp);
                 clientEngine->addPendingLocalOp(std::move(pendingOp));
+                sendPendingOperation();
+                break;
             }
             
             sendOperationToClient(*insertOp);
@@ -70,13 +85,30 @@ void Controller::processLocalOperation(std::unique_ptr<Operation> operation)
         case OperationType::DELETE:
         {
             auto deleteOp = static_cast<DeleteOperation*>(operation.get());
+
+            CrdtTextEngine* crdtEngine = dynamic_cast<CrdtTextEngine*>(textEngine);
+            if (crdtEngine)
+            {
+                auto crdtOp = crdtEngine->applyLocalDelete(*deleteOp);
+                if (crdtOp)
+                    sendOperationToClient(*crdtOp);
+
+                break;
+            }
+
+            ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine);
+            std::string deletedText;
+            if (clientEngine)
+                deletedText = textEngine->getText(deleteOp->pos, deleteOp->length);
+
             textEngine->deleteLocal(deleteOp);
             
-            ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine);
             if (clientEngine)
             {
                 auto pendingOp = std::make_unique<DeleteOperation>(*deleteOp);
-                clientEngine->addPendingLocalOp(std::move(pendingOp));
+                clientEngine->addPendingLocalOp(std::move(pendingOp), std::move(deletedText));
+                sendPendingOperation();
+                break;
             }
             
             sendOperationToClient(*deleteOp);
@@ -88,10 +120,17 @@ void Controller::processLocalOperation(std::unique_ptr<Operation> operation)
             textEngine->setCursorPosition(cursorOp->pos);
             break;
         }
+        case OperationType::CRDT_INSERT:
+        case OperationType::CRDT_DELETE:
+        {
+            // Local edits are made by position, the CRDT engine turns them into these
+            std::cerr << "Controller: CRDT operations can not be applied as local edits\n";
+            break;
+        }
     }
 }
 
-void Controller::sendOperationToClient(const Operation& operation)
+void Controller::sendOperationToClient(const TextOperation& operation)
 {
     if (!client)
     {
@@ -105,11 +144,20 @@ void Controller::sendOperationToClient(const Operation& operation)
         return;
     }
 
-    std::string serialized = operation.serialize();
-    if (client->sendMessage(serialized))
-        std::cout << "Controller: Sent operation to client: " << serialized << "\n";
-    else
-        std::cerr << "Controller: Failed to send operation to client: " << serialized << "\n";
+    if (!client->sendOperation(operation))
+        std::cerr << "Controller: Failed to send operation to client: " << operation.serialize() << "\n";
+}
+
+void Controller::sendPendingOperation()
+{
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine);
+    if (!clientEngine)
+        return;
+
+    // Waits in the queue while the previous op is in flight, it goes out with that op's ack
+    const TextOperation* op = clientEngine->takeOpToSend();
+    if (op)
+        sendOperationToClient(*op);
 }
 
 std::string Controller::getText() const
@@ -127,13 +175,82 @@ void Controller::setCursorPosition(std::size_t position)
     return textEngine->setCursorPosition(position);
 }
 
-void Controller::setInitialDocument(const std::string& str)
+void Controller::setInitialDocument(const std::string& str, uint64_t docVersion)
 {
+    if (dynamic_cast<CrdtTextEngine*>(textEngine))
+    {
+        std::cerr << "Controller: The server runs the OT engine, restart the client with OT selected\n";
+        return;
+    }
+
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine);
+    if (clientEngine)
+        clientEngine->prepareForServerDocument();
+
     textEngine->readString(str);
-    std::cout << "Controller: Set initial document with " << str.length() << " characters\n";
+
+    if (clientEngine)
+        rebaseUnsentOperations(*clientEngine, docVersion);
+
+    std::cout << "Controller: Set initial document with " << str.length() << " characters at version " << docVersion << "\n";
 }
 
-std::unique_ptr<Operation> Controller::processIncomingMessage(const std::string &message)
+bool Controller::beginInitialDocument(std::size_t length)
+{
+    if (dynamic_cast<CrdtTextEngine*>(textEngine))
+    {
+        std::cerr << "Controller: The server runs the OT engine, restart the client with OT selected\n";
+        return false;
+    }
+
+    if (ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine))
+        clientEngine->prepareForServerDocument();
+
+    textEngine->beginDocument(length);
+    return true;
+}
+
+void Controller::appendInitialDocument(std::string_view text)
+{
+    textEngine->appendDocument(text);
+}
+
+void Controller::finishInitialDocument(uint64_t docVersion)
+{
+    if (ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine))
+        rebaseUnsentOperations(*clientEngine, docVersion);
+
+    std::cout << "Controller: Set initial document with " << textEngine->getDocumentLength() << " characters at version " << docVersion << "\n";
+}
+
+void Controller::rebaseUnsentOperations(ClientTextEngine& clientEngine, uint64_t docVersion)
+{
+    std::size_t rebased = clientEngine.resetToServerVersion(docVersion);
+    if (rebased > 0)
+    {
+        std::cout << "Controller: Rebased " << rebased << " unsent local operations onto the fresh document\n";
+        sendPendingOperation();
+    }
+}
+
+bool Controller::setInitialCrdtState(const std::string& state, uint64_t docVersion)
+{
+    CrdtTextEngine* crdtEngine = dynamic_cast<CrdtTextEngine*>(textEngine);
+    if (!crdtEngine)
+    {
+        std::cerr << "Controller: The server runs the CRDT engine, restart the client with CRDT selected\n";
+        return false;
+    }
+
+    if (!crdtEngine->loadState(state, docVersion))
+        return false;
+
+    std::cout << "Controller: Set initial document with " << crdtEngine->getDocumentLength() << " characters and "
+              << crdtEngine->getSequence().getRunCount() << " runs at version " << docVersion << "\n";
+    return true;
+}
+
+std::unique_ptr<Operation> Controller::processIncomingOperation(std::unique_ptr<TextOperation> textOp)
 {
     if (!textEngine)
     {
@@ -141,9 +258,6 @@ std::unique_ptr<Operation> Controller::processIncomingMessage(const std::string
         return nullptr;
     }
 
-    std::unique_ptr<Operation> op = Operation::deserialize(message);
-    auto textOp = std::unique_ptr<TextOperation>(static_cast<TextOperation*>(op.release()));
-
     ServerTextEngine* serverEngine = dynamic_cast<ServerTextEngine*>(textEngine);
     if (serverEngine)
         return serverEngine->processIncomingOperation(std::move(textOp));
@@ -155,9 +269,35 @@ std::unique_ptr<Operation> Controller::processIncomingMessage(const std::string
         return nullptr;
     }
 
+    CrdtTextEngine* crdtEngine = dynamic_cast<CrdtTextEngine*>(textEngine);
+    if (crdtEngine)
+    {
+        crdtEngine->processIncomingOperation(std::move(textOp));
+        return nullptr;
+    }
+
     return nullptr;
 }
 
+void Controller::processIncomingOperations(std::vector<std::unique_ptr<TextOperation>> operations)
+{
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine);
+    if (clientEngine)
+    {
+        clientEngine->processIncomingOperations(std::move(operations));
+        return;
+    }
+
+    for (auto& operation : operations)
+        processIncomingOperation(std::move(operation));
+}
+
+void Controller::processIncomingMessages()
+{
+    if (client)
+        client->processIncoming();
+}
+
 std::string Controller::getClientId() const
 {
     if (client)
@@ -165,3 +305,27 @@ std::string Controller::getClientId() const
     
     return "Server";
 }
+
+void Controller::updatePresence(const Presence& presence)
+{
+    if (client)
+        client->updatePresence(presence);
+}
+
+bool Controller::getConnectionStats(ConnectionStats& stats) const
+{
+    if (!client)
+        return false;
+
+    stats = client->getConnectionStats();
+    return true;
+}
+
+std::vector<RemotePresence> Controller::getRemotePresences() const
+{
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(textEngine);
+    if (clientEngine)
+        return clientEngine->getRemotePresences();
+
+    return {};
+}
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <stdint.h>
 #include <memory>
 #include <functional>
+#include <vector>
+#include <string>
+#include <string_view>
+
+#include "../text_engine/presence.h"
 
 class TextEngine;
+class ClientTextEngine;
 class Client;
 class Operation;
+class TextOperation;
 class TextInputEvent;
 class CursorInputEvent;
+struct ConnectionStats;
 
 class Controller
 {
@@ -23,11 +32,71 @@ public:
     std::string getText() const;
     std::size_t getCursorPosition() const;
     void setCursorPosition(std::size_t position);
-    void setInitialDocument(const std::string& str);
-    std::unique_ptr<Operation> processIncomingMessage(const std::string& message);
+    void setInitialDocument(const std::string& str, uint64_t docVersion);
+
+    /**
+     * Starts loading a document the server sends in chunks. The text grows with appendInitialDocument().
+     * @param length Length of the whole document
+     * @returns False if the local engine is a CRDT engine
+    */
+    bool beginInitialDocument(std::size_t length);
+    void appendInitialDocument(std::string_view text);
+
+    /**
+     * Completes a document started with beginInitialDocument(), which is at the version the server announced.
+    */
+    void finishInitialDocument(uint64_t docVersion);
+
+    /**
+     * Loads a CRDT document sent by the server.
+     * @returns False if the local engine is not a CRDT engine or the state is malformed
+    */
+    bool setInitialCrdtState(const std::string& state, uint64_t docVersion);
+
+    /**
+     * Applies an op from the network to the local engine.
+     * @returns The transformed op if the engine is the server's, otherwise null
+    */
+    std::unique_ptr<Operation> processIncomingOperation(std::unique_ptr<TextOperation> operation);
+
+    /**
+     * Applies ops someone else made, in the order the server sequenced them, as one batch where the engine can.
+    */
+    void processIncomingOperations(std::vector<std::unique_ptr<TextOperation>> operations);
+
+    /**
+     * Applies everything the server sent since the last call. Called once per frame before the text is read.
+    */
+    void processIncomingMessages();
     std::string getClientId() const;
 
+    /**
+     * Shares the local cursor and selection with other clients. Cheap to call every frame.
+    */
+    void updatePresence(const Presence& presence);
+
+    /**
+     * @returns Cursors and selections of the other clients in current text positions
+    */
+    std::vector<RemotePresence> getRemotePresences() const;
+
+    /**
+     * Latencies and clock offset the client measured, for the status bar.
+     * @returns False if there is no client, e.g. on the server
+    */
+    bool getConnectionStats(ConnectionStats& stats) const;
+
+    /**
+     * Sends the oldest pending local op unless one is already waiting for its ack.
+    */
+    void sendPendingOperation();
+
 private:
     void processLocalOperation(std::unique_ptr<Operation> operation);
-    void sendOperationToClient(const Operation& operation);
+    void sendOperationToClient(const TextOperation& operation);
+
+    /**
+     * Marks the fresh document the server sent as current, then sends the unsent local ops rebased onto it.
+    */
+    void rebaseUnsentOperations(ClientTextEngine& clientEngine, uint64_t docVersion);
 };
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include <iostream>
+#include <tuple>
+#include <utility>
+
+#include "metrics.h"
+
+namespace
+{
+    /**
+     * @returns The labels in braces, with another label appended, or nothing if there are none
+    */
+    std::string formatLabels(const std::string& labels, std::string_view extra = {})
+    {
+        if (labels.empty() && extra.empty())
+            return {};
+
+        std::string formatted = "{" + labels;
+        if (!labels.empty() && !extra.empty())
+            formatted += ",";
+
+        formatted += extra;
+        formatted += "}";
+        return formatted;
+    }
+
+    template <typename Metric>
+    Metric& findOrAdd(std::deque<std::pair<std::string, Metric>>& metrics, std::string_view labels)
+    {
+        for (auto& [metricLabels, metric] : metrics)
+        {
+            if (metricLabels == labels)
+                return metric;
+        }
+
+        return metrics.emplace_back(std::piecewise_construct, std::forward_as_tuple(labels), std::forward_as_tuple()).second;
+    }
+}
+
+uint64_t Counter::getValue() const
+{
+    uint64_t total = 0;
+    for (const Shard& shard : shards)
+        total += shard.value.load(std::memory_order_relaxed);
+
+    return total;
+}
+
+MetricsRegistry& MetricsRegistry::global()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Family* MetricsRegistry::getFamily(std::string_view name, std::string_view help, MetricType type)
+{
+    auto it = familiesByName.find(std::string(name));
+    if (it != familiesByName.end())
+    {
+        if (it->second->type != type)
+        {
+            std::cerr << "MetricsRegistry: " << name << " is already registered as another type\n";
+            return nullptr;
+        }
+
+        return it->second;
+    }
+
+    Family& family = families.emplace_back();
+    family.name = name;
+    family.help = help;
+    family.type = type;
+    familiesByName[family.name] = &family;
+    return &family;
+}
+
+Counter& MetricsRegistry::getCounter(std::string_view name, std::string_view help, std::string_view labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Family* family = getFamily(name, help, MetricType::COUNTER))
+        return findOrAdd(family->counters, labels);
+
+    // Counted, but never exposed
+    static Counter unregistered;
+    return unregistered;
+}
+
+Gauge& MetricsRegistry::getGauge(std::string_view name, std::string_view help, std::string_view labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Family* family = getFamily(name, help, MetricType::GAUGE))
+        return findOrAdd(family->gauges, labels);
+
+    static Gauge unregistered;
+    return unregistered;
+}
+
+LatencyHistogram& MetricsRegistry::getHistogram(std::string_view name, std::string_view help, std::string_view labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Family* family = getFamily(name, help, MetricType::HISTOGRAM))
+        return findOrAdd(family->histograms, labels);
+
+    static LatencyHistogram unregistered;
+    return unregistered;
+}
+
+uint64_t MetricsRegistry::addCollector(Collector collector)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint64_t id = nextCollectorId++;
+    collectors[id] = std::move(collector);
+    return id;
+}
+
+void MetricsRegistry::removeCollector(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    collectors.erase(id);
+}
+
+void MetricsRegistry::appendText(std::string& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Family& family : families)
+    {
+        out += "# HELP " + family.name + " " + family.help + "\n";
+        const char* typeName = family.type == MetricType::COUNTER ? "counter" : family.type == MetricType::GAUGE ? "gauge" : "summary";
+        out += "# TYPE " + family.name + " " + typeName + "\n";
+
+        for (const auto& [labels, counter] : family.counters)
+            out += family.name + formatLabels(labels) + " " + std::to_string(counter.getValue()) + "\n";
+
+        for (const auto& [labels, gauge] : family.gauges)
+            out += family.name + formatLabels(labels) + " " + std::to_string(gauge.getValue()) + "\n";
+
+        for (const auto& [labels, histogram] : family.histograms)
+        {
+            const std::pair<const char*, double> quantiles[] = {{"quantile=\"0.5\"", 50}, {"quantile=\"0.9\"", 90}, {"quantile=\"0.99\"", 99}};
+            for (const auto& [quantile, percentile] : quantiles)
+                out += family.name + formatLabels(labels, quantile) + " " + std::to_string(histogram.getPercentile(percentile)) + "\n";
+
+            out += family.name + "_sum" + formatLabels(labels) + " " + std::to_string(histogram.getSum()) + "\n";
+            out += family.name + "_count" + formatLabels(labels) + " " + std::to_string(histogram.getCount()) + "\n";
+        }
+    }
+
+    for (const auto& [id, collector] : collectors)
+        collector(out);
+}
+
+std::string MetricsRegistry::formatLabel(std::string_view name, std::string_view value)
+{
+    std::string label(name);
+    label += "=\"";
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+            label += '\\';
+
+        if (c == '\n')
+            label += "\\n";
+        else
+            label += c;
+    }
+
+    label += "\"";
+    return label;
+}
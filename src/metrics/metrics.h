@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "../networking/latency_histogram.h"
+
+/**
+ * Counter that many threads bump at once. Every thread adds to one of a few shards on its own cache line, so
+ * threads rarely write to the same line and an increment costs an uncontended atomic add. The shards are only
+ * summed when the counter is read.
+*/
+class Counter
+{
+public:
+    static constexpr std::size_t shardCount = 16;
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> value = 0;
+    };
+
+    Shard shards[shardCount];
+
+public:
+    void add(uint64_t amount = 1)
+    {
+        shards[getThreadShard()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t getValue() const;
+
+private:
+    /**
+     * @returns Shard of the calling thread, handed out round robin the first time a thread asks
+    */
+    static std::size_t getThreadShard()
+    {
+        static std::atomic<std::size_t> nextShard = 0;
+        thread_local const std::size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % shardCount;
+        return shard;
+    }
+};
+
+/**
+ * Value that goes up and down, e.g. a queue depth. Usually written by the one thread that owns what it measures.
+*/
+class Gauge
+{
+private:
+    std::atomic<int64_t> value = 0;
+
+public:
+    void set(int64_t newValue) { value.store(newValue, std::memory_order_relaxed); }
+    void add(int64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+    [[nodiscard]] int64_t getValue() const { return value.load(std::memory_order_relaxed); }
+};
+
+/**
+ * Metrics of the whole process, exposed in the Prometheus text format by a MetricsEndpoint.
+ *
+ * Modules look their metrics up once, e.g. in a static, and keep the reference: it stays valid for the life of
+ * the process. Looking up a name and labels a second time returns the same metric, so several servers or clients
+ * in one process add up. Updating a metric never takes a lock; only lookups and scrapes do.
+ *
+ * Values that are cheaper to read when scraped than to keep up to date, e.g. the bytes queued for all clients,
+ * come from collectors that append their own lines.
+*/
+class MetricsRegistry
+{
+public:
+    // Appends complete metric families, TYPE lines included
+    using Collector = std::function<void(std::string& out)>;
+
+private:
+    enum class MetricType
+    {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    struct Family
+    {
+        std::string name;
+        std::string help;
+        MetricType type;
+
+        // Label set, e.g. shard="0", to its metric in the order they were added. Only one of these is used.
+        std::deque<std::pair<std::string, Counter>> counters;
+        std::deque<std::pair<std::string, Gauge>> gauges;
+        std::deque<std::pair<std::string, LatencyHistogram>> histograms;
+    };
+
+    mutable std::mutex mutex;
+    std::deque<Family> families;
+    std::unordered_map<std::string, Family*> familiesByName;
+    std::unordered_map<uint64_t, Collector> collectors;
+    uint64_t nextCollectorId = 1;
+
+public:
+    /**
+     * @returns The registry of the process
+    */
+    static MetricsRegistry& global();
+
+    /**
+     * @param name Metric name, e.g. reped_server_messages_received_total
+     * @param help One line describing it, taken from the first lookup
+     * @param labels Label set in the exposition syntax, e.g. shard="0", or empty
+    */
+    Counter& getCounter(std::string_view name, std::string_view help, std::string_view labels = {});
+    Gauge& getGauge(std::string_view name, std::string_view help, std::string_view labels = {});
+
+    /**
+     * Histograms are exposed as summaries with the 50th, 90th and 99th percentile.
+    */
+    LatencyHistogram& getHistogram(std::string_view name, std::string_view help, std::string_view labels = {});
+
+    /**
+     * @returns Id to remove the collector with. It must be removed before whatever it reads goes away.
+    */
+    uint64_t addCollector(Collector collector);
+
+    /**
+     * Waits for a scrape running the collector to finish.
+    */
+    void removeCollector(uint64_t id);
+
+    /**
+     * Appends every metric in the Prometheus text format, collectors last.
+    */
+    void appendText(std::string& out) const;
+
+    /**
+     * @returns A label in the exposition syntax, e.g. document="notes", with the value escaped
+    */
+    [[nodiscard]] static std::string formatLabel(std::string_view name, std::string_view value);
+
+private:
+    /**
+     * Finds or creates a family. Caller holds the mutex.
+     * @returns Null if the name was registered with another type
+    */
+    Family* getFamily(std::string_view name, std::string_view help, MetricType type);
+};
@@ -0,0 +1,233 @@
+#include <iostream>
+#include <string_view>
+#include <cerrno>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics_endpoint.h"
+
+namespace
+{
+    // A scraper that stalls longer than this is dropped, so it cannot hold up the next one
+    constexpr int scrapeTimeoutSeconds = 2;
+    constexpr std::size_t maxRequestBytes = 8192;
+
+    int listenOnPort(uint16_t port)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            return -1;
+
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        // Only scrapers on this machine, the metrics name documents and clients
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(fd, 16) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    int listenOnPath(const std::string& path)
+    {
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            return -1;
+
+        memcpy(address.sun_path, path.data(), path.size());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            return -1;
+
+        // A socket file of an endpoint that did not stop cleanly would fail the bind
+        unlink(path.c_str());
+        if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(fd, 16) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    bool sendAll(int fd, std::string_view bytes)
+    {
+        while (!bytes.empty())
+        {
+            ssize_t sent = send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+
+            if (sent <= 0)
+                return false;
+
+            bytes.remove_prefix(static_cast<std::size_t>(sent));
+        }
+
+        return true;
+    }
+}
+
+MetricsEndpoint::MetricsEndpoint(MetricsRegistry& registry)
+    : registry(registry)
+{
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    stop();
+}
+
+bool MetricsEndpoint::start(uint16_t port, const std::string& socketPath)
+{
+    if (running)
+        return true;
+
+    if (port != 0 && (tcpSocket = listenOnPort(port)) == -1)
+    {
+        std::cerr << "MetricsEndpoint: Failed to listen on port " << port << ": " << strerror(errno) << "\n";
+        stop();
+        return false;
+    }
+
+    if (!socketPath.empty())
+    {
+        unixSocket = listenOnPath(socketPath);
+        if (unixSocket == -1)
+        {
+            std::cerr << "MetricsEndpoint: Failed to listen at " << socketPath << ": " << strerror(errno) << "\n";
+            stop();
+            return false;
+        }
+
+        this->socketPath = socketPath;
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd == -1)
+    {
+        std::cerr << "MetricsEndpoint: Failed to create wake-up event\n";
+        stop();
+        return false;
+    }
+
+    running = true;
+    thread = std::thread(&MetricsEndpoint::run, this);
+    return true;
+}
+
+void MetricsEndpoint::stop()
+{
+    if (running)
+    {
+        running = false;
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+            std::cerr << "MetricsEndpoint: Failed to wake the endpoint thread\n";
+
+        thread.join();
+    }
+
+    for (int* fd : {&tcpSocket, &unixSocket, &wakeFd})
+    {
+        if (*fd != -1)
+            close(*fd);
+
+        *fd = -1;
+    }
+
+    if (!socketPath.empty())
+        unlink(socketPath.c_str());
+
+    socketPath.clear();
+}
+
+void MetricsEndpoint::run()
+{
+    struct pollfd fds[3];
+    fds[0] = {wakeFd, POLLIN, 0};
+    fds[1] = {tcpSocket, POLLIN, 0};
+    fds[2] = {unixSocket, POLLIN, 0};
+
+    while (running)
+    {
+        // Negative descriptors are skipped by poll()
+        if (poll(fds, 3, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            std::cerr << "MetricsEndpoint: poll failed with " << errno << "\n";
+            return;
+        }
+
+        for (int i = 1; i < 3 && running; i++)
+        {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            int clientSocket = accept4(fds[i].fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientSocket == -1)
+                continue;
+
+            serve(clientSocket);
+            close(clientSocket);
+        }
+    }
+}
+
+void MetricsEndpoint::serve(int clientSocket)
+{
+    struct timeval timeout = {scrapeTimeoutSeconds, 0};
+    setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(clientSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters, the headers are read so the client does not see a reset
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < maxRequestBytes)
+    {
+        ssize_t received = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+
+        if (received <= 0)
+            return;
+
+        request.append(buffer, static_cast<std::size_t>(received));
+    }
+
+    std::string body;
+    std::string status = "200 OK";
+    const bool scrape = request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0;
+    if (scrape)
+        registry.appendText(body);
+    else
+    {
+        status = "404 Not Found";
+        body = "Metrics are at /metrics\n";
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n";
+    if (sendAll(clientSocket, response))
+        sendAll(clientSocket, body);
+}
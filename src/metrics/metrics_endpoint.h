@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "metrics.h"
+
+/**
+ * Serves a metrics registry to scrapers on this machine over HTTP, on a loopback port, a Unix domain socket or
+ * both: GET /metrics answers with the Prometheus text format. Scrapes are rare and small, so one thread answers
+ * them one at a time, away from the threads that serve clients.
+*/
+class MetricsEndpoint
+{
+private:
+    MetricsRegistry& registry;
+    int tcpSocket = -1;
+    int unixSocket = -1;
+    std::string socketPath;
+    int wakeFd = -1;
+    std::atomic<bool> running = false;
+    std::thread thread;
+
+public:
+    explicit MetricsEndpoint(MetricsRegistry& registry = MetricsRegistry::global());
+    ~MetricsEndpoint();
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    /**
+     * @param port Port to listen on at 127.0.0.1, 0 for none
+     * @param socketPath Unix domain socket to listen at, empty for none
+     * @returns False if one of them could not be bound
+    */
+    bool start(uint16_t port, const std::string& socketPath);
+    void stop();
+
+private:
+    void run();
+
+    /**
+     * Reads one request from a scraper and answers it.
+    */
+    void serve(int clientSocket);
+};
@@ -2,21 +2,36 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <string.h>
-#include <sstream>
+#include <cerrno>
 #include <vector>
+#include <chrono>
+#include <optional>
+#include <algorithm>
 
 #include "client.h"
 #include "../controller/controller.h"
 #include "../text_engine/operations.h"
 #include "../text_engine/client_text_engine.h"
+#include "../text_engine/crdt_text_engine.h"
 #include "message_parser.h"
+#include "framing.h"
 
-Client::Client(const uint16_t port, const std::string& serverAddress, Controller* controller, const std::string& clientId)
-    : port(port), serverAddress(serverAddress), socketFd(0), running(false), controller(controller), clientId(clientId)
+Client::Client(const uint16_t port, const std::string& serverAddress, Controller* controller, const std::string& clientId, const std::string& documentName,
+               WireProtocol wireProtocol)
+    : port(port), serverAddress(serverAddress), documentName(documentName), socketFd(-1), running(false), presenceSent(false),
+      clockOffset(noClockOffset), sendQueue(sendQueueCapacity), connectionId(1), syncedConnectionId(0), wakeFd(-1), networkSleeping(false), inboxApplied(0),
+      knownVersion(noKnownVersion), maxWireProtocol(wireProtocol), wireProtocol(WireProtocol::TEXT), controller(controller),
+      clientId(clientId)
 {
+    publishKnownVersion();
     connect();
 }
 
@@ -27,49 +42,170 @@ Client::~Client()
 
 void Client::connect()
 {
+    if (!openConnection())
+    {
+        std::cerr << "Failed to connect to server at " << serverAddress << ":" << port << " - no server listening\n";
+        return;
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd == -1)
+    {
+        std::cerr << "Client: Failed to create wake-up event\n";
+        close(socketFd);
+        return;
+    }
+
+    // Goes into the outbound buffer, the network thread writes it first
+    sendConnectedMessage();
+    lastReceiveTime = std::chrono::steady_clock::now();
+
+    running = true;
+    networkThread = std::thread(&Client::runNetworkThread, this);
+    std::cout << "Client started on port " << port << " and connected to server at " << serverAddress << "\n";
+}
+
+bool Client::openConnection()
+{
+    if (serverAddress.rfind("unix:", 0) == 0 || serverAddress.rfind("shm:", 0) == 0)
+        return openLocalConnection();
+
     struct addrinfo hints;
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
     struct addrinfo* serverInfo;
 
-    if (int status = getaddrinfo(serverAddress.c_str(), std::to_string(port).c_str(), &hints, &serverInfo) != 0)
+    if (int status = getaddrinfo(serverAddress.c_str(), std::to_string(port).c_str(), &hints, &serverInfo); status != 0)
     {
         std::cerr << "Failed to get server info: " << gai_strerror(status) << "\n";
-        return;
+        return false;
     }
     
-    bool connected = false;
+    bool opened = false;
     for (struct addrinfo* info = serverInfo; info != nullptr; info = info->ai_next)
     {
-        socketFd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
         
-        if (socketFd == -1)
+        if (fd == -1)
             continue;
 
-        if (::connect(socketFd, info->ai_addr, info->ai_addrlen) != -1)
+        if (::connect(fd, info->ai_addr, info->ai_addrlen) != -1)
         {
-            running = true;
-            receiveThread = std::thread(&Client::receiveMessages, this);
-            std::cout << "Client started on port " << port << " and connected to server at " << serverAddress << "\n";
-            connected = true;
-            
-            std::string connectedMsg = MessageParser::createConnectedMessage(clientId);
-            if (sendMessage(connectedMsg))
-                std::cout << "Client: Sent operation to server: " << connectedMsg << "\n";
-            else
-                std::cerr << "Client: Failed to send operation to server: " << connectedMsg << "\n";
+            // Ops are sent as the user types them, not held back until earlier ones are acknowledged
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+            // Only the network thread touches the socket, and it never waits on it outside of poll()
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
+            socketFd = fd;
+            opened = true;
             break;
         }
 
-        close(socketFd);
+        close(fd);
     }
 
-    if (!connected)
-        std::cerr << "Failed to connect to server at " << serverAddress << ":" << port << " - no server listening\n";
-    
     freeaddrinfo(serverInfo);
+    return opened;
+}
+
+bool Client::openLocalConnection()
+{
+    const bool sharedMemory = serverAddress.rfind("shm:", 0) == 0;
+    const std::string path = serverAddress.substr(serverAddress.find(':') + 1);
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Client: Invalid socket path: " << path << "\n";
+        return false;
+    }
+    memcpy(address.sun_path, path.data(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return false;
+
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        close(fd);
+        return false;
+    }
+
+    if (sharedMemory)
+    {
+        channel = SharedMemoryChannel::accept(fd, std::chrono::milliseconds(5000));
+        if (!channel)
+        {
+            std::cerr << "Client: Server at " << path << " did not hand us shared memory\n";
+            close(fd);
+            return false;
+        }
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    socketFd = fd;
+    return true;
+}
+
+bool Client::reconnect()
+{
+    const auto maxBackoff = std::chrono::milliseconds(5000);
+    auto backoff = std::chrono::milliseconds(250);
+
+    while (running)
+    {
+        // Sleep in slices so disconnect() does not wait out the whole backoff
+        auto wakeTime = std::chrono::steady_clock::now() + backoff;
+        while (running && (std::chrono::steady_clock::now() < wakeTime || inboxApplied != inboxPushed))
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        if (!running)
+            break;
+
+        if (openConnection())
+        {
+            if (sendConnectedMessage())
+            {
+                // The server forgot our presence with the old connection
+                presenceSent = false;
+                lastReceiveTime = std::chrono::steady_clock::now();
+                reconnects.add();
+
+                std::cout << "Client: Reconnected to server at " << serverAddress << ":" << port << "\n";
+                return true;
+            }
+
+            channel.reset();
+            close(socketFd);
+            socketFd = -1;
+        }
+
+        backoff = std::min(backoff * 2, maxBackoff);
+    }
+
+    return false;
+}
+
+bool Client::sendConnectedMessage()
+{
+    std::optional<uint64_t> presentedVersion;
+    if (uint64_t version = knownVersion; version != noKnownVersion)
+        presentedVersion = version;
+
+    std::string connectedMsg = MessageParser::createConnectedMessage(clientId, documentName, presentedVersion, maxWireProtocol);
+    if (!sendFrame(connectedMsg))
+    {
+        std::cerr << "Client: Failed to send operation to server: " << connectedMsg << "\n";
+        return false;
+    }
+
+    std::cout << "Client: Sent operation to server: " << connectedMsg << "\n";
+    return true;
 }
 
 void Client::disconnect()
@@ -77,102 +213,775 @@ void Client::disconnect()
     if (running)
     {
         running = false;
+        connectionId++;
+
+        // Wakes the network thread if it is waiting in poll()
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+            shutdown(socketFd, SHUT_RDWR);
+
+        if (networkThread.joinable())
+            networkThread.join();
+
         close(socketFd);
-        
-        if (receiveThread.joinable())
-            receiveThread.join();
+        close(wakeFd);
     }
 }
 
 bool Client::isConnected() const
 {
-    return running;
+    return syncedConnectionId == connectionId;
 }
 
 bool Client::sendMessage(const std::string& message)
 {
-    if (!running)
+    // Read before checking the connection, a frame encoded while it drops is not sent on the next one
+    const uint64_t expectedConnectionId = connectionId;
+    if (syncedConnectionId != expectedConnectionId)
         return false;
     
-    ssize_t bytesSent = send(socketFd, message.c_str(), message.length(), 0);
-    return bytesSent == static_cast<ssize_t>(message.length());
+    return queueFrame(message, false, expectedConnectionId);
+}
+
+bool Client::sendOperation(const TextOperation& operation)
+{
+    if (!isConnected())
+        return false;
+
+    return sendOperationFrame(operation);
+}
+
+bool Client::sendFrame(const std::string& message)
+{
+    return queueFrame(message, false, connectionId);
+}
+
+bool Client::sendOperationFrame(const TextOperation& operation)
+{
+    const uint64_t expectedConnectionId = connectionId;
+    const WireProtocol protocol = wireProtocol;
+    WireCodec::encode(operation, protocol, encodeBuffer);
+
+    // Large pastes go compressed once the server agreed to it
+    if (!queueFrame(encodeBuffer, Framing::shouldCompress(encodeBuffer.size(), protocol), expectedConnectionId))
+        return false;
+
+    // The server counts ops from the start of each connection
+    if (sentConnectionId != expectedConnectionId)
+    {
+        sentConnectionId = expectedConnectionId;
+        acknowledgedOperations = 0;
+        sentOperationIds.clear();
+    }
+
+    sentOperationIds.push_back(operation.operationId);
+    return true;
 }
 
-void Client::receiveMessages()
+bool Client::queueFrame(std::string_view message, bool compress, uint64_t expectedConnectionId)
 {
-    char buffer[4096];
+    if (message.size() > Framing::maxFrameSize)
+    {
+        std::cerr << "Client: Message of " << message.size() << " bytes is too large to send\n";
+        return false;
+    }
+
+    if (isNetworkThread() || !networkThread.joinable())
+    {
+        if (expectedConnectionId != connectionId)
+            return false;
+
+        Framing::appendFrame(outbound, message, compress);
+        framesQueued.add();
+        return true;
+    }
+
+    QueuedFrame* frame = sendQueue.tryBeginPush();
+    if (!frame)
+    {
+        sendQueueFull.add();
+        std::cerr << "Client: Send queue is full, the server is not taking our messages\n";
+        return false;
+    }
+
+    frame->connectionId = expectedConnectionId;
+    frame->bytes.clear();
+    Framing::appendFrame(frame->bytes, message, compress);
+    sendQueue.commitPush();
+    framesQueued.add();
+
+    // Pairs with the fence in runNetworkThread(): either it sees the frame before sleeping or we see it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (networkSleeping.load(std::memory_order_relaxed))
+    {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+            std::cerr << "Client: Failed to wake network thread\n";
+    }
+
+    return true;
+}
+
+bool Client::isNetworkThread() const
+{
+    return std::this_thread::get_id() == networkThread.get_id();
+}
+
+void Client::updatePresence(const Presence& presence)
+{
+    if (!isConnected())
+        return;
+
+    if (presenceSent && presence == lastSentPresence)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (presenceSent && now - lastPresenceSentTime < presenceInterval)
+        return;
+
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine);
+    if (!clientEngine || !clientEngine->getServerVersion() || !clientEngine->getPendingLocalOps().empty())
+        return;
+
+    std::string presenceMsg = MessageParser::createPresenceMessage(clientId, *clientEngine->getServerVersion(), presence);
+    if (sendMessage(presenceMsg))
+    {
+        lastSentPresence = presence;
+        lastPresenceSentTime = now;
+        presenceSent = true;
+    }
+}
+
+void Client::runNetworkThread()
+{
+    FrameReader reader;
     
     while (running)
     {
-        ssize_t bytesReceived = recv(socketFd, buffer, sizeof(buffer) - 1, 0);
-        
+        takeQueuedFrames();
+        bool open = flushOutbound();
+
+        if (open)
+        {
+            // Announce that we sleep before looking at the queue a last time, see queueFrame()
+            networkSleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!sendQueue.empty())
+            {
+                networkSleeping.store(false, std::memory_order_relaxed);
+                continue;
+            }
+
+            struct pollfd fds[2];
+            fds[0].fd = socketFd;
+            // A shared memory peer wakes us over the socket when its ring has room, so it is never polled for writing
+            fds[0].events = POLLIN | (outboundPos < outbound.size() && !channel ? POLLOUT : 0);
+            fds[1].fd = wakeFd;
+            fds[1].events = POLLIN;
+            int ready = poll(fds, 2, getHeartbeatWait());
+            networkSleeping.store(false, std::memory_order_relaxed);
+
+            if (ready < 0 && errno != EINTR)
+            {
+                std::cerr << "Client: poll failed with " << errno << "\n";
+                break;
+            }
+
+            if (ready > 0 && (fds[1].revents & POLLIN))
+            {
+                uint64_t value;
+                if (read(wakeFd, &value, sizeof(value)) != sizeof(value))
+                    std::cerr << "Client: Failed to reset wake-up event\n";
+            }
+
+            if (!running)
+                break;
+
+            if (ready > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+                open = receiveAvailable(reader);
+
+            if (open && !checkHeartbeat())
+            {
+                std::cerr << "Client: No word from the server in " << heartbeatTimeout.count() << " ms\n";
+                open = false;
+            }
+        }
+
+        if (!open)
+        {
+            if (!running)
+                break;
+
+            // Local edits keep going into the pending ops until we are caught up again. Whatever was queued belongs
+            // to the lost connection, the pending ops go again once we caught up.
+            std::cerr << "Client: Lost connection to server, reconnecting\n";
+            connectionId++;
+            channel.reset();
+            close(socketFd);
+            socketFd = -1;
+
+            outbound.clear();
+            outboundPos = 0;
+            takeQueuedFrames();
+
+            // The new connection negotiates again
+            wireProtocol = WireProtocol::TEXT;
+
+            // A frame cut off with the old connection never completes
+            reader.reset();
+            if (!reconnect())
+                break;
+        }
+    }
+}
+
+void Client::takeQueuedFrames()
+{
+    while (QueuedFrame* frame = sendQueue.tryFront())
+    {
+        if (frame->connectionId == connectionId)
+            outbound.append(frame->bytes);
+
+        sendQueue.pop();
+    }
+}
+
+bool Client::flushOutbound()
+{
+    while (outboundPos < outbound.size())
+    {
+        ssize_t sent;
+        if (channel)
+        {
+            struct iovec part = { outbound.data() + outboundPos, outbound.size() - outboundPos };
+            sent = channel->send(&part, 1);
+
+            // The ring is full, the server wakes us once it read from it
+            if (sent == 0)
+                return true;
+        }
+        else
+            sent = send(socketFd, outbound.data() + outboundPos, outbound.size() - outboundPos, MSG_NOSIGNAL);
+
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // The socket's buffer is full, poll() tells us when it has room again
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        outboundPos += static_cast<std::size_t>(sent);
+        sentBytes.add(static_cast<uint64_t>(sent));
+    }
+
+    outbound.clear();
+    outboundPos = 0;
+    return true;
+}
+
+bool Client::receiveAvailable(FrameReader& reader)
+{
+    while (running)
+    {
+        std::size_t space = 0;
+        char* receiveBuffer = reader.prepareReceive(space);
+        ssize_t bytesReceived = channel ? channel->receive(receiveBuffer, space) : recv(socketFd, receiveBuffer, space, 0);
+        if (bytesReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return true;
+
         if (bytesReceived <= 0)
+            return false;
+
+        reader.commitReceive(static_cast<std::size_t>(bytesReceived));
+        lastReceiveTime = std::chrono::steady_clock::now();
+
+        // One read can complete any number of frames
+        std::string_view msg;
+        uint64_t messages = 0;
+        while (reader.nextFrame(msg))
         {
-            running = false;
-            break;
+            messages++;
+            InboxEntry entry;
+            entry.connectionId = connectionId;
+            entry.message = MessageParser::parseMessage(msg);
+
+            // Ops that follow are encoded in the protocol, it cannot wait for the next frame
+            if (entry.message.type == MessageType::PROTOCOL)
+            {
+                wireProtocol = entry.message.wireProtocol;
+                nextHeartbeatTime = lastReceiveTime;
+                continue;
+            }
+
+            // The round trip must not include the time the answer waits in the inbox
+            if (entry.message.type == MessageType::PONG)
+            {
+                handlePong(entry.message);
+                continue;
+            }
+
+            inbox.push(std::move(entry));
+            inboxPushed++;
         }
 
-        buffer[bytesReceived] = '\0';
-        std::string msg(buffer);
-        
-        std::cout << "Received: " << msg << "\n";
+        messagesReceived.add(messages);
+
+        // Nothing after a corrupt header can be trusted
+        if (reader.isCorrupt())
+            return false;
+    }
 
-        ParsedMessage parsedMsg = MessageParser::parseMessage(msg);
+    return true;
+}
+
+void Client::processIncoming()
+{
+    std::vector<std::unique_ptr<TextOperation>> batch;
+    uint64_t applied = 0;
+    InboxEntry entry;
+    while (inbox.tryPop(entry))
+    {
+        applied++;
+        if (entry.connectionId != appliedConnectionId)
+        {
+            // A document cut off with its connection never completes
+            appliedConnectionId = entry.connectionId;
+            receivingDocument = false;
+        }
+
+        ParsedMessage& parsedMsg = entry.message;
+        if (parsedMsg.type == MessageType::OPERATION && parsedMsg.operation && parsedMsg.operation->clientId != clientId)
+        {
+            if (std::optional<uint64_t> sinceSequenced = getTimeSinceSequenced(parsedMsg.sequencedAt))
+                downlinkLatency.record(*sinceSequenced);
+
+            batch.push_back(std::move(parsedMsg.operation));
+            continue;
+        }
+
+        // Anything else may depend on the ops before it
+        applyOperations(batch);
         handleParsedMessage(parsedMsg);
     }
+
+    applyOperations(batch);
+
+    if (applied > 0)
+    {
+        publishKnownVersion();
+        inboxApplied.fetch_add(applied, std::memory_order_release);
+    }
+
+    // Edits are made between calls, so this is published even when nothing arrived
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine);
+    unsentOperations.store(clientEngine ? clientEngine->getPendingLocalOps().size() : 0, std::memory_order_relaxed);
 }
 
-void Client::handleParsedMessage(const ParsedMessage& parsedMsg)
+void Client::applyOperations(std::vector<std::unique_ptr<TextOperation>>& operations)
+{
+    if (operations.empty())
+        return;
+
+    controller->processIncomingOperations(std::move(operations));
+    operations.clear();
+}
+
+void Client::markSynced()
+{
+    syncedConnectionId = appliedConnectionId;
+}
+
+void Client::publishKnownVersion()
+{
+    uint64_t version = noKnownVersion;
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine);
+    if (clientEngine && clientEngine->getServerVersion() && !receivingDocument)
+        version = *clientEngine->getServerVersion();
+
+    knownVersion = version;
+}
+
+void Client::handleParsedMessage(ParsedMessage& parsedMsg)
 {
     if (parsedMsg.type == MessageType::INIT_DOCUMENT)
     {
-        std::string initialContent = parsedMsg.content.substr(14);
-        controller->setInitialDocument(initialContent);
+        uint64_t docVersion = 0;
+        std::string initialContent;
+        if (!MessageParser::parseInitDocumentMessage(parsedMsg.content, docVersion, initialContent))
+        {
+            std::cerr << "Client: Malformed document message from server\n";
+            return;
+        }
+
+        controller->setInitialDocument(initialContent, docVersion);
+        markSynced();
+    }
+    else if (parsedMsg.type == MessageType::INIT_BEGIN)
+    {
+        handleInitBeginMessage(parsedMsg);
+    }
+    else if (parsedMsg.type == MessageType::INIT_CHUNK)
+    {
+        handleInitChunkMessage(parsedMsg);
+    }
+    else if (parsedMsg.type == MessageType::INIT_CRDT)
+    {
+        uint64_t docVersion = 0;
+        std::string state;
+        if (!MessageParser::parseInitCrdtMessage(parsedMsg.content, docVersion, state))
+        {
+            std::cerr << "Client: Malformed document message from server\n";
+            return;
+        }
+
+        if (!controller->setInitialCrdtState(state, docVersion))
+            return;
+
+        markSynced();
+
+        // Edits made while disconnected merge into whatever the others did, nothing has to be dropped
+        CrdtTextEngine* crdtEngine = dynamic_cast<CrdtTextEngine*>(controller->textEngine);
+        std::size_t resent = 0;
+        for (const auto& pendingOp : crdtEngine->getUnacknowledgedOps())
+        {
+            if (sendOperation(*pendingOp))
+                resent++;
+        }
+
+        if (resent > 0)
+            std::cout << "Client: Resent " << resent << " local operations\n";
+    }
+    else if (parsedMsg.type == MessageType::CATCH_UP)
+    {
+        handleCatchUpMessage(parsedMsg.content);
+        markSynced();
+    }
+    else if (parsedMsg.type == MessageType::PRESENCE || parsedMsg.type == MessageType::PRESENCE_LEFT)
+    {
+        handlePresenceMessage(parsedMsg);
     }
-    else if (isAckMessage(parsedMsg.content))
+    else if (parsedMsg.type == MessageType::OPERATION && parsedMsg.operation)
     {
-        handleAckMessage(parsedMsg.content);            
+        handleOperation(std::move(parsedMsg.operation), parsedMsg.sequencedAt);
+    }
+    else if (parsedMsg.type == MessageType::ACK)
+    {
+        handleAckMessage(parsedMsg);
     }
     else
     {
-        controller->processIncomingMessage(parsedMsg.content);
+        std::cerr << "Client: Unknown or malformed message from server\n";
     }
 }
 
-bool Client::isAckMessage(const std::string& message) const
+void Client::handleInitBeginMessage(const ParsedMessage& parsedMsg)
 {
-    std::istringstream ss(message);
-    std::string token;
-    std::vector<std::string> parts;
-    
-    while (std::getline(ss, token, ':')) {
-        parts.push_back(token);
+    uint64_t docVersion = 0;
+    uint64_t length = 0;
+    if (!MessageParser::parseInitBeginMessage(parsedMsg.content, docVersion, length))
+    {
+        std::cerr << "Client: Malformed document message from server\n";
+        return;
     }
-    
-    if (parts.size() >= 2) {
-        std::string messageClientId = parts[1];
-        return messageClientId == this->clientId;
+
+    if (!controller->beginInitialDocument(length))
+        return;
+
+    receivingDocument = true;
+    incomingVersion = docVersion;
+    incomingRemaining = length;
+
+    if (incomingRemaining == 0)
+        finishIncomingDocument();
+}
+
+void Client::handleInitChunkMessage(const ParsedMessage& parsedMsg)
+{
+    std::string_view text = MessageParser::getInitChunkText(parsedMsg.content);
+    if (!receivingDocument || text.size() > incomingRemaining)
+    {
+        std::cerr << "Client: Unexpected document chunk from server\n";
+        return;
     }
-    
-    return false;
+
+    controller->appendInitialDocument(text);
+    incomingRemaining -= text.size();
+
+    if (incomingRemaining == 0)
+        finishIncomingDocument();
 }
 
-void Client::handleAckMessage(const std::string& message)
+void Client::finishIncomingDocument()
 {
-    std::cout << "Received ACK: " << message << "\n";
-    
-    auto operation = Operation::deserialize(message);
-    if (!operation) {
-        std::cerr << "Failed to deserialize ACK message: " << message << "\n";
+    receivingDocument = false;
+    controller->finishInitialDocument(incomingVersion);
+    markSynced();
+}
+
+void Client::handleOperation(std::unique_ptr<TextOperation> operation, uint64_t sequencedAt)
+{
+    if (operation->clientId != clientId)
+    {
+        controller->processIncomingOperation(std::move(operation));
         return;
     }
-    
-    if (operation->type == OperationType::INSERT || operation->type == OperationType::DELETE)
+
+    // Sent back whole instead of acknowledged, the ops we sent before it were acknowledged already
+    if (appliedConnectionId == sentConnectionId)
     {
-        auto textOp = static_cast<TextOperation*>(operation.get());
-        
-        ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine);
-        if (clientEngine)
-            clientEngine->acknowledgePendingOp(textOp);
+        auto it = std::find(sentOperationIds.begin(), sentOperationIds.end(), operation->operationId);
+        if (it != sentOperationIds.end())
+        {
+            acknowledgedOperations += static_cast<uint64_t>(it - sentOperationIds.begin()) + 1;
+            sentOperationIds.erase(sentOperationIds.begin(), it + 1);
+        }
+    }
+
+    // Ours, but a fresh document from the server replaced the text it was made in
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine);
+    if (clientEngine && clientEngine->takeDroppedOp(*operation))
+    {
+        controller->processIncomingOperation(std::move(operation));
+        return;
+    }
+
+    if (std::optional<std::chrono::steady_clock::time_point> appliedAt = handleAck(operation->operationId, operation->docVersion))
+        recordAckLatency(*appliedAt, sequencedAt);
+}
+
+void Client::handleAckMessage(const ParsedMessage& parsedMsg)
+{
+    uint64_t docVersion = 0;
+    uint64_t operations = 0;
+    uint64_t sequencedAt = 0;
+    if (!MessageParser::parseAckMessage(parsedMsg.content, docVersion, operations, sequencedAt))
+    {
+        std::cerr << "Client: Malformed ack from server\n";
+        return;
+    }
+
+    // Ops sent on a lost connection are acknowledged by the catch-up of the next one
+    if (appliedConnectionId != sentConnectionId)
+        return;
+
+    // Only the last op's version is sent. The server ends a run at anyone else's op, so the ops it confirms were
+    // sequenced back to back and each one's version counts back from it.
+    while (acknowledgedOperations < operations && !sentOperationIds.empty())
+    {
+        const uint64_t operationId = sentOperationIds.front();
+        sentOperationIds.pop_front();
+        const uint64_t laterOperations = operations - acknowledgedOperations - 1;
+        const uint64_t sequencedVersion = docVersion >= laterOperations ? docVersion - laterOperations : 0;
+        acknowledgedOperations++;
+
+        if (std::optional<std::chrono::steady_clock::time_point> appliedAt = handleAck(operationId, sequencedVersion))
+            recordAckLatency(*appliedAt, sequencedAt);
+    }
+}
+
+void Client::handleCatchUpMessage(const std::string& message)
+{
+    uint64_t docVersion = 0;
+    std::vector<std::string> missedOperations;
+    if (!MessageParser::parseCatchUpMessage(message, docVersion, missedOperations))
+    {
+        std::cerr << "Client: Malformed catch-up message from server\n";
+        return;
+    }
+
+    // Our own ops among them were sequenced but their acks were lost with the connection
+    std::vector<std::unique_ptr<TextOperation>> batch;
+    for (const std::string& operation : missedOperations)
+    {
+        ParsedMessage parsedOp = MessageParser::parseMessage(operation);
+        if (!parsedOp.operation)
+        {
+            std::cerr << "Client: Malformed operation in catch-up message from server\n";
+        }
+        else if (parsedOp.operation->clientId != clientId)
+        {
+            batch.push_back(std::move(parsedOp.operation));
+        }
+        else
+        {
+            applyOperations(batch);
+            handleAck(parsedOp.operation->operationId, parsedOp.operation->docVersion);
+        }
+    }
+
+    applyOperations(batch);
+
+    // Whatever was in flight never reached the server, it goes again based on the version we caught up to
+    std::size_t pending = 0;
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine);
+    if (clientEngine)
+    {
+        pending = clientEngine->getPendingLocalOps().size();
+        clientEngine->requeueInFlightOp();
+
+        const TextOperation* pendingOp = clientEngine->takeOpToSend();
+        if (pendingOp)
+        {
+            if (!sendOperationFrame(*pendingOp))
+                clientEngine->requeueInFlightOp();
+        }
+    }
+
+    std::cout << "Client: Caught up to version " << docVersion << " with " << missedOperations.size()
+              << " missed operations, " << pending << " local operations pending\n";
+}
+
+void Client::handlePresenceMessage(const ParsedMessage& parsedMsg)
+{
+    ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine);
+    if (!clientEngine || parsedMsg.clientId == clientId)
+        return;
+
+    if (parsedMsg.type == MessageType::PRESENCE_LEFT)
+    {
+        clientEngine->removeRemotePresence(parsedMsg.clientId);
+        return;
+    }
+
+    std::string presenceClientId;
+    uint64_t docVersion = 0;
+    Presence presence;
+    if (MessageParser::parsePresenceMessage(parsedMsg.content, presenceClientId, docVersion, presence))
+        clientEngine->setRemotePresence(presenceClientId, docVersion, presence);
+}
+
+std::optional<std::chrono::steady_clock::time_point> Client::handleAck(uint64_t operationId, uint64_t sequencedVersion)
+{
+    std::optional<std::chrono::steady_clock::time_point> appliedAt;
+    if (ClientTextEngine* clientEngine = dynamic_cast<ClientTextEngine*>(controller->textEngine))
+    {
+        appliedAt = clientEngine->acknowledgePendingOp(operationId, sequencedVersion);
+        controller->sendPendingOperation();
+    }
+    else if (CrdtTextEngine* crdtEngine = dynamic_cast<CrdtTextEngine*>(controller->textEngine))
+    {
+        crdtEngine->acknowledge(operationId, sequencedVersion);
+    }
+
+    return appliedAt;
+}
+
+bool Client::checkHeartbeat()
+{
+    if (!sendsHeartbeats())
+        return true;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastReceiveTime > heartbeatTimeout)
+        return false;
+
+    if (now >= nextHeartbeatTime)
+    {
+        uint64_t sentTime = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+        std::optional<uint64_t> version;
+        if (uint64_t known = knownVersion; known != noKnownVersion)
+            version = known;
+
+        if (!sendFrame(MessageParser::createPingMessage(sentTime, version, unsentOperations.load(std::memory_order_relaxed))))
+            std::cerr << "Client: Failed to send heartbeat\n";
+
+        nextHeartbeatTime = now + heartbeatInterval;
+    }
+
+    return true;
+}
+
+int Client::getHeartbeatWait() const
+{
+    if (!sendsHeartbeats())
+        return -1;
+
+    auto deadline = std::min(nextHeartbeatTime, lastReceiveTime + heartbeatTimeout);
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+
+    // Rounded up, waking a little early would only spin until the deadline
+    return static_cast<int>(std::max<int64_t>(0, wait.count() + 1));
+}
+
+void Client::handlePong(const ParsedMessage& parsedMsg)
+{
+    uint64_t sentTime = 0;
+    uint64_t serverTime = 0;
+    if (!MessageParser::parsePongMessage(parsedMsg.content, sentTime, serverTime))
+    {
+        std::cerr << "Client: Malformed heartbeat answer from server\n";
+        return;
+    }
+
+    const uint64_t wallTime = getWallClockMicros();
+    const uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (sentTime > now)
+        return;
+
+    // The server read its clock about halfway through the round trip
+    const uint64_t roundTrip = now - sentTime;
+    roundTripLatency.record(roundTrip);
+    clockSamples[clockSampleCount++ % clockSamples.size()] = {roundTrip, static_cast<int64_t>(serverTime) - static_cast<int64_t>(wallTime - roundTrip / 2)};
+
+    const std::size_t sampleCount = std::min(clockSampleCount, clockSamples.size());
+    auto fastest = std::min_element(clockSamples.begin(), clockSamples.begin() + sampleCount, [] (const ClockSample& a, const ClockSample& b)
+    {
+        return a.roundTrip < b.roundTrip;
+    });
+    clockOffset.store(fastest->offset, std::memory_order_relaxed);
+}
+
+std::optional<uint64_t> Client::getTimeSinceSequenced(uint64_t sequencedAt) const
+{
+    const int64_t offset = clockOffset.load(std::memory_order_relaxed);
+    if (sequencedAt == 0 || offset == noClockOffset)
+        return std::nullopt;
+
+    // An offset that is a little off can put the server's time ahead of ours
+    const int64_t serverNow = static_cast<int64_t>(getWallClockMicros()) + offset;
+    return static_cast<uint64_t>(std::max<int64_t>(0, serverNow - static_cast<int64_t>(sequencedAt)));
+}
+
+void Client::recordAckLatency(std::chrono::steady_clock::time_point appliedAt, uint64_t sequencedAt)
+{
+    auto now = std::chrono::steady_clock::now();
+    ackLatency.record(appliedAt, now);
+
+    std::optional<uint64_t> sinceSequenced = getTimeSinceSequenced(sequencedAt);
+    if (!sinceSequenced || now < appliedAt)
+        return;
+
+    const uint64_t total = std::chrono::duration_cast<std::chrono::microseconds>(now - appliedAt).count();
+    uplinkLatency.record(total > *sinceSequenced ? total - *sinceSequenced : 0);
+    downlinkLatency.record(std::min(*sinceSequenced, total));
+}
+
+ConnectionStats Client::getConnectionStats() const
+{
+    ConnectionStats stats;
+    stats.connected = isConnected();
+    if (int64_t offset = clockOffset.load(std::memory_order_relaxed); offset != noClockOffset)
+        stats.clockOffset = offset;
+
+    stats.roundTrip = roundTripLatency.getSummary();
+    stats.ack = ackLatency.getSummary();
+    stats.uplink = uplinkLatency.getSummary();
+    stats.downlink = downlinkLatency.getSummary();
+    return stats;
+}
+
+void Client::appendMetrics(std::string& out) const
+{
+    roundTripLatency.appendMetrics(out, "reped_client_round_trip_microseconds");
+    ackLatency.appendMetrics(out, "reped_client_ack_microseconds");
+    uplinkLatency.appendMetrics(out, "reped_client_uplink_microseconds");
+    downlinkLatency.appendMetrics(out, "reped_client_downlink_microseconds");
+
+    if (int64_t offset = clockOffset.load(std::memory_order_relaxed); offset != noClockOffset)
+    {
+        out += "# TYPE reped_client_clock_offset_microseconds gauge\n";
+        out += "reped_client_clock_offset_microseconds " + std::to_string(offset) + "\n";
     }
 }
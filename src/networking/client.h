@@ -4,49 +4,377 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <string_view>
+#include <vector>
+#include <memory>
 #include <functional>
+#include <chrono>
+#include <array>
+#include <optional>
+#include <deque>
+
+#include "../text_engine/presence.h"
+#include "wire_codec.h"
+#include "spsc_queue.h"
+#include "mpsc_queue.h"
+#include "message_parser.h"
+#include "latency_histogram.h"
+#include "shared_memory_channel.h"
+#include "../metrics/metrics.h"
 
 class Controller;
-struct ParsedMessage;
+class TextOperation;
+class FrameReader;
+
+// What the client measured about its connection, latencies in microseconds
+struct ConnectionStats
+{
+    bool connected = false;
+
+    // Server's wall clock minus ours, unset until a heartbeat was answered
+    std::optional<int64_t> clockOffset;
 
+    LatencySummary roundTrip;   // Heartbeat sent to answer received
+    LatencySummary ack;         // Local edit applied to its ack applied
+    LatencySummary uplink;      // Local edit applied to sequenced by the server
+    LatencySummary downlink;    // Sequenced by the server to applied here, our own ops and everyone else's
+};
+
+/**
+ * Connection to the server. A network thread owns the socket: it reads and parses what the server sends into an
+ * inbox and writes whatever is queued with non-blocking sends. The thread that edits, in the editor the UI thread,
+ * applies the inbox with processIncoming() and queues what it sends, so it alone touches the text engine and a
+ * stalled link never blocks it. Only that one thread may call the public methods.
+*/
 class Client
 {
 public:
+    static constexpr std::size_t sendQueueCapacity = 4096;
+
     std::string clientId;
 
 private:
     const uint16_t port;
     const std::string serverAddress;
-    int socketFd;
+    const std::string documentName;
+    std::atomic<int> socketFd;
     std::atomic<bool> running;
-    std::thread receiveThread;
+
+
+    // Presence is sent at most once per interval; changes in between are coalesced into the next send
+    static constexpr std::chrono::milliseconds presenceInterval = std::chrono::milliseconds(50);
+    Presence lastSentPresence;
+    std::chrono::steady_clock::time_point lastPresenceSentTime;
+    std::atomic<bool> presenceSent;
+
+    // Heartbeats go out while the server speaks WireProtocol::TIMED. A connection it has not sent anything on for
+    // heartbeatTimeout counts as lost instead of waiting for TCP to give up on it. Network thread only.
+    static constexpr std::chrono::milliseconds heartbeatInterval = std::chrono::milliseconds(1000);
+    static constexpr std::chrono::milliseconds heartbeatTimeout = std::chrono::milliseconds(5000);
+    std::chrono::steady_clock::time_point lastReceiveTime;
+    std::chrono::steady_clock::time_point nextHeartbeatTime;
+
+    // Round trip and clock offset of the recent heartbeats. The offset of the fastest one is the most accurate,
+    // the least time passed on the way where it could not be seen. Network thread only.
+    struct ClockSample
+    {
+        uint64_t roundTrip = 0;
+        int64_t offset = 0;
+    };
+    std::array<ClockSample, 8> clockSamples;
+    std::size_t clockSampleCount = 0;
+
+    // Server's wall clock minus ours in microseconds, published by the network thread
+    static constexpr int64_t noClockOffset = INT64_MIN;
+    std::atomic<int64_t> clockOffset;
+
+    LatencyHistogram roundTripLatency;
+    LatencyHistogram ackLatency;
+    LatencyHistogram uplinkLatency;
+    LatencyHistogram downlinkLatency;
+
+    // Shared by the clients of the process, e.g. the bots of a load generator
+    Counter& framesQueued = MetricsRegistry::global().getCounter("reped_client_frames_queued_total", "Frames queued for the server");
+    Counter& sendQueueFull = MetricsRegistry::global().getCounter("reped_client_send_queue_full_total",
+        "Frames dropped because the network thread fell behind");
+    Counter& sentBytes = MetricsRegistry::global().getCounter("reped_client_sent_bytes_total", "Bytes written to the server");
+    Counter& messagesReceived = MetricsRegistry::global().getCounter("reped_client_messages_received_total", "Frames received from the server");
+    Counter& reconnects = MetricsRegistry::global().getCounter("reped_client_reconnects_total", "Connections restored after they dropped");
+
+    // A frame queued by another thread for the connection it was encoded for
+    struct QueuedFrame
+    {
+        uint64_t connectionId = 0;
+        std::string bytes;  // Framed, headers included
+    };
+
+    // Frames from the sending thread. The slots keep their capacity, so queuing an op does not allocate.
+    SpscQueue<QueuedFrame> sendQueue;
+
+    // Counts connections, so frames encoded for a lost connection are dropped instead of sent on the next one
+    std::atomic<uint64_t> connectionId;
+
+    // Connection whose document or catch-up was applied. We count as connected while it is the current one.
+    std::atomic<uint64_t> syncedConnectionId;
+
+    // eventfd that wakes the network thread, only signalled when it sleeps
+    int wakeFd;
+    std::atomic<bool> networkSleeping;
+
+    // Bytes the socket has not taken yet, coalesced from all queued frames. Network thread only.
+    std::string outbound;
+    std::size_t outboundPos = 0;
+
+    // Rings the bytes go through instead of the socket when connected with shm:<path>. Network thread only.
+    std::unique_ptr<SharedMemoryChannel> channel;
+
+    // Ops are encoded into this buffer so sending one does not allocate
+    std::string encodeBuffer;
+
+    // A message the network thread received on a connection
+    struct InboxEntry
+    {
+        uint64_t connectionId = 0;
+        ParsedMessage message;
+    };
+
+    // Filled by the network thread, applied by processIncoming()
+    MpscQueue<InboxEntry> inbox;
+    uint64_t inboxPushed = 0;   // Network thread only
+    std::atomic<uint64_t> inboxApplied;
+
+    // Server version the applied messages brought the text to, presented when reconnecting. Published by
+    // processIncoming() before inboxApplied.
+    static constexpr uint64_t noKnownVersion = UINT64_MAX;
+    std::atomic<uint64_t> knownVersion;
+
+    // Local edits the server has not acknowledged, reported in heartbeats with knownVersion so the server only
+    // sends a client that fell behind a fresh document when that drops nothing. Published by processIncoming().
+    std::atomic<uint64_t> unsentOperations = 0;
+
+    // Highest protocol we offer, and the one the server chose for this connection. Text until it tells us.
+    const WireProtocol maxWireProtocol;
+    std::atomic<WireProtocol> wireProtocol;
+    std::thread networkThread;
     Controller* controller;
 
+    // Connection of the last applied message, and the document arriving in INIT_CHUNK messages on it.
+    // processIncoming() only.
+    uint64_t appliedConnectionId = 0;
+    bool receivingDocument = false;
+    uint64_t incomingVersion = 0;
+    uint64_t incomingRemaining = 0;
+
+    // Ids of the ops sent on sentConnectionId the server has not acknowledged yet, oldest first. The server counts
+    // a connection's ops as they arrive and an ACK confirms every op up to its count. Thread that sends ops only.
+    uint64_t sentConnectionId = 0;
+    uint64_t acknowledgedOperations = 0;
+    std::deque<uint64_t> sentOperationIds;
+
 public:
-    Client(const uint16_t port, const std::string& serverAddress, Controller* controller, const std::string& clientId);
+    /**
+     * @param serverAddress Host name or IP address, unix:<path> for a Unix domain socket on this machine or
+     * shm:<path> to exchange frames through shared memory with a server listening there. Local addresses ignore
+     * the port.
+     * @param wireProtocol Highest protocol to offer the server, TEXT to see every op in readable form
+    */
+    Client(const uint16_t port, const std::string& serverAddress, Controller* controller, const std::string& clientId, const std::string& documentName,
+           WireProtocol wireProtocol = latestWireProtocol);
     ~Client();
 
     [[nodiscard]] bool isConnected() const;
 
     /**
-     * Sends a message to the server.
-     * @returns True if the entire message was sent successfully.
+     * Queues a message for the server.
+     * @returns False if we are not connected or the send queue is full
     */
     [[nodiscard]] bool sendMessage(const std::string& message);
 
+    /**
+     * Queues an op encoded in the protocol negotiated with the server.
+     * @returns False if we are not connected or the send queue is full
+    */
+    [[nodiscard]] bool sendOperation(const TextOperation& operation);
+
+    /**
+     * Applies the messages received since the last call. Ops someone else made in a row are applied as one batch.
+     * Called once per frame by the thread that edits.
+    */
+    void processIncoming();
+
+    /**
+     * Safe to call from any thread.
+    */
+    [[nodiscard]] ConnectionStats getConnectionStats() const;
+
+    /**
+     * Appends the latencies and the clock offset in the Prometheus text format. Safe to call from any thread.
+    */
+    void appendMetrics(std::string& out) const;
+
+    // The histograms behind getConnectionStats(), e.g. to merge those of many clients
+    [[nodiscard]] const LatencyHistogram& getRoundTripLatency() const { return roundTripLatency; }
+    [[nodiscard]] const LatencyHistogram& getAckLatency() const { return ackLatency; }
+    [[nodiscard]] const LatencyHistogram& getUplinkLatency() const { return uplinkLatency; }
+    [[nodiscard]] const LatencyHistogram& getDownlinkLatency() const { return downlinkLatency; }
+
+    /**
+     * Shares our cursor and selection with the other clients. Meant to be called every frame; it only sends when
+     * the presence changed, the presence interval elapsed and all local ops were acknowledged, so the positions
+     * refer to a server version.
+    */
+    void updatePresence(const Presence& presence);
+
 private:
     void connect();
     void disconnect();
 
     /**
-     * Continuously receives messages from the server and invokes the message callback for each received message.
-     * Runs in a separate thread when the client connects.
+     * Resolves the server address and connects to the first address that accepts.
+     * @returns True if socketFd is connected. It is non-blocking from then on.
+    */
+    bool openConnection();
+
+    /**
+     * Connects to a server's Unix domain socket and, for shm:<path>, waits for the rings it passes.
+     * @returns True if socketFd is connected
+    */
+    bool openLocalConnection();
+
+    /**
+     * Reconnects with exponential backoff until it succeeds or the client is shut down, then rejoins the document
+     * presenting the last version we have so the server only sends what we missed. Waits for the messages of the
+     * lost connection to be applied first, the version has to include them.
+     * @returns False if the client was shut down first.
+    */
+    bool reconnect();
+
+    /**
+     * Joins the document. Sent before we count as connected, so it goes out directly.
+    */
+    bool sendConnectedMessage();
+
+    /**
+     * Sends one frame on the current connection, whether or not we count as connected.
     */
-    void receiveMessages();
+    [[nodiscard]] bool sendFrame(const std::string& message);
+
+    /**
+     * Encodes and sends an op on the current connection, whether or not we count as connected.
+    */
+    [[nodiscard]] bool sendOperationFrame(const TextOperation& operation);
+
+    /**
+     * Frames a message and hands it to the network thread. On the network thread itself, or before it started,
+     * the frame goes straight into the outbound buffer.
+     * @param expectedConnectionId Connection the message was encoded for
+     * @returns False if the send queue is full
+    */
+    [[nodiscard]] bool queueFrame(std::string_view message, bool compress, uint64_t expectedConnectionId);
+
+    [[nodiscard]] bool isNetworkThread() const;
+
+    /**
+     * Moves the frames other threads queued for the current connection into the outbound buffer. Network thread only.
+    */
+    void takeQueuedFrames();
+
+    /**
+     * Writes the outbound buffer until the socket stops taking bytes. Network thread only.
+     * @returns False if the connection failed
+    */
+    bool flushOutbound();
+
+    /**
+     * Reads everything the socket has and puts the complete messages into the inbox. Network thread only.
+     * @returns False if the connection was closed or failed
+    */
+    bool receiveAvailable(FrameReader& reader);
+
+    [[nodiscard]] bool sendsHeartbeats() const { return wireProtocol >= WireProtocol::TIMED; }
+
+    /**
+     * Sends a heartbeat when one is due. Network thread only.
+     * @returns False if the server has been silent for longer than heartbeatTimeout
+    */
+    bool checkHeartbeat();
+
+    /**
+     * @returns Milliseconds until checkHeartbeat() has something to do, -1 if heartbeats are off
+    */
+    [[nodiscard]] int getHeartbeatWait() const;
+
+    /**
+     * Records the round trip of an answered heartbeat and updates the clock offset. Network thread only.
+    */
+    void handlePong(const ParsedMessage& parsedMsg);
+
+    /**
+     * @param sequencedAt Server's wall-clock microseconds an op was sequenced at
+     * @returns Microseconds since then on our clock, unset if the op was not stamped or the clock offset is unknown
+    */
+    [[nodiscard]] std::optional<uint64_t> getTimeSinceSequenced(uint64_t sequencedAt) const;
+
+    /**
+     * Records how long one of our own ops took to be acknowledged, and to reach the server if it was stamped.
+    */
+    void recordAckLatency(std::chrono::steady_clock::time_point appliedAt, uint64_t sequencedAt);
+
+    /**
+     * Owns the socket: receives messages, writes queued frames, and reconnects when the connection drops. Runs
+     * from connect() until disconnect().
+    */
+    void runNetworkThread();
     
-    void handleParsedMessage(const ParsedMessage& parsedMsg);
-    bool isAckMessage(const std::string& message) const;
-    void handleAckMessage(const std::string& message);
+    void handleParsedMessage(ParsedMessage& parsedMsg);
+
+    /**
+     * Applies a batch of ops someone else made and empties it.
+    */
+    void applyOperations(std::vector<std::unique_ptr<TextOperation>>& operations);
+
+    /**
+     * Counts us as connected once the connection's document or catch-up was applied.
+    */
+    void markSynced();
+
+    /**
+     * Publishes the server version the text is at, for the next reconnect.
+    */
+    void publishKnownVersion();
+
+    /**
+     * Takes an op from the server as the ack of our own op or applies someone else's.
+     * @param sequencedAt Time the server sequenced the op at, 0 if it did not say
+    */
+    void handleOperation(std::unique_ptr<TextOperation> operation, uint64_t sequencedAt);
+
+    /**
+     * Acknowledges the ops sent on the connection up to the count in an ACK message.
+    */
+    void handleAckMessage(const ParsedMessage& parsedMsg);
+
+    /**
+     * Applies the ops we missed while disconnected, batched like live ones, then resends the oldest local op the
+     * server never sequenced. It was rebased onto the missed ops as those were applied; the rest follow one per ack.
+    */
+    void handleCatchUpMessage(const std::string& message);
+
+    void handleInitBeginMessage(const ParsedMessage& parsedMsg);
+    void handleInitChunkMessage(const ParsedMessage& parsedMsg);
+
+    /**
+     * Takes the document announced by INIT_BEGIN once all of its text arrived.
+    */
+    void finishIncomingDocument();
+
+    void handlePresenceMessage(const ParsedMessage& parsedMsg);
+
+    /**
+     * @param sequencedVersion Version the server sequenced the op at
+     * @returns When the acknowledged op's oldest edit was applied to the text, unset if it was not pending
+    */
+    std::optional<std::chrono::steady_clock::time_point> handleAck(uint64_t operationId, uint64_t sequencedVersion);
 
 public:
     std::string getClientId() const
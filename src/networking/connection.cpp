@@ -0,0 +1,286 @@
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "connection.h"
+
+namespace
+{
+    // Queued frames handed to one sendmsg when flushing
+    constexpr std::size_t maxFlushParts = 64;
+
+    /**
+     * @returns Bytes written, 0 if the socket would block, -1 if the connection failed
+    */
+    ssize_t sendNonBlocking(int socket, struct iovec* parts, std::size_t partCount)
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = parts;
+        msg.msg_iovlen = partCount;
+
+        while (true)
+        {
+            ssize_t sent = sendmsg(socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent >= 0)
+                return sent;
+            if (errno == EINTR)
+                continue;
+
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+    }
+}
+
+ssize_t Connection::write(struct iovec* parts, std::size_t partCount)
+{
+    if (channel)
+        return channel->send(parts, partCount);
+
+    return sendNonBlocking(socket, parts, partCount);
+}
+
+ssize_t Connection::receive(char* buffer, std::size_t space)
+{
+    if (channel)
+        return channel->receive(buffer, space);
+
+    return recv(socket, buffer, space, 0);
+}
+
+bool Connection::send(std::string_view message)
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (failed)
+        return false;
+
+    // Frames must not overtake queued ones
+    if (hasQueuedBytesLocked())
+    {
+        SharedFrame frame = Framing::makeSharedFrame(message);
+        return enqueueLocked({frame, *frame}, 0);
+    }
+
+    char header[Framing::headerSize];
+    Framing::writeHeader(header, message.size());
+
+    struct iovec parts[2];
+    parts[0].iov_base = header;
+    parts[0].iov_len = Framing::headerSize;
+    parts[1].iov_base = const_cast<char*>(message.data());
+    parts[1].iov_len = message.size();
+
+    ssize_t sent = write(parts, 2);
+    if (sent < 0)
+    {
+        failed = true;
+        return false;
+    }
+
+    // The message is only borrowed, so a frame is only made when the socket did not take all of it
+    std::size_t written = static_cast<std::size_t>(sent);
+    if (written == Framing::headerSize + message.size())
+        return true;
+
+    SharedFrame frame = Framing::makeSharedFrame(message);
+    return enqueueLocked({frame, *frame}, written);
+}
+
+bool Connection::send(const SharedFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    return sendLocked(frame);
+}
+
+bool Connection::send(std::shared_ptr<FrameSource> source)
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (failed)
+        return false;
+
+    outbound.push_back({OutboundBytes(), std::move(source)});
+
+    // Nothing else to wait for, the first chunks go out right away
+    return outbound.size() > 1 || flushLocked();
+}
+
+bool Connection::sendLocked(const SharedFrame& frame)
+{
+    if (failed)
+        return false;
+
+    if (hasQueuedBytesLocked())
+        return enqueueLocked({frame, *frame}, 0);
+
+    struct iovec part;
+    part.iov_base = const_cast<char*>(frame->data());
+    part.iov_len = frame->size();
+
+    return completeSendLocked(frame, write(&part, 1));
+}
+
+bool Connection::completeSendLocked(const SharedFrame& frame, ssize_t sent)
+{
+    if (sent < 0)
+    {
+        failed = true;
+        return false;
+    }
+
+    std::size_t written = static_cast<std::size_t>(sent);
+    if (written == frame->size())
+        return true;
+
+    return enqueueLocked({frame, *frame}, written);
+}
+
+bool Connection::enqueueLocked(OutboundBytes data, std::size_t offset)
+{
+    // The frame being written does not count, so a document larger than the limit can still be sent whole
+    std::size_t behind = outbound.empty() ? 0 : queuedBytes - (outbound.front().data.bytes.size() - outboundPos) + data.bytes.size();
+    if (behind > maxQueuedBytes)
+    {
+        std::cerr << "Connection: Client " << socket << " fell " << behind << " bytes behind, disconnecting it\n";
+        failed = true;
+        outbound.clear();
+        outboundPos = 0;
+        queuedBytes = 0;
+
+        // The reactor sees the hang-up and drops the client, which catches up from its last version on reconnect
+        shutdown(socket, SHUT_RDWR);
+        return false;
+    }
+
+    if (outbound.empty())
+        outboundPos = offset;
+
+    queuedBytes += data.bytes.size() - offset;
+    outbound.push_back({std::move(data), nullptr});
+    return true;
+}
+
+void Connection::produceLocked()
+{
+    std::vector<OutboundBytes> chunk;
+    std::shared_ptr<FrameSource> source = outbound.front().source;
+    if (!source->produce(chunk))
+        outbound.pop_front();
+
+    for (auto it = chunk.rbegin(); it != chunk.rend(); ++it)
+    {
+        queuedBytes += it->bytes.size();
+        outbound.push_front({std::move(*it), nullptr});
+    }
+
+    outboundPos = 0;
+}
+
+bool Connection::flush()
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    return flushLocked();
+}
+
+bool Connection::flushLocked()
+{
+    while (!failed && !outbound.empty())
+    {
+        if (outbound.front().source)
+        {
+            produceLocked();
+            continue;
+        }
+
+        // Queued frames go out together, like the bytes of one buffer, up to the next stream
+        struct iovec parts[maxFlushParts];
+        std::size_t partCount = 0;
+        for (; partCount < std::min(outbound.size(), maxFlushParts) && !outbound[partCount].source; partCount++)
+        {
+            std::string_view bytes = outbound[partCount].data.bytes.substr(partCount == 0 ? outboundPos : 0);
+            parts[partCount].iov_base = const_cast<char*>(bytes.data());
+            parts[partCount].iov_len = bytes.size();
+        }
+
+        ssize_t sent = write(parts, partCount);
+        if (sent < 0)
+        {
+            failed = true;
+            return false;
+        }
+
+        // The next writable edge brings us back, or the client waking us once it read from a full ring
+        if (sent == 0)
+            return true;
+
+        // Release the frames written completely
+        std::size_t written = static_cast<std::size_t>(sent);
+        queuedBytes -= written;
+        while (written > 0)
+        {
+            std::size_t remaining = outbound.front().data.bytes.size() - outboundPos;
+            if (written < remaining)
+            {
+                outboundPos += written;
+                break;
+            }
+
+            written -= remaining;
+            outbound.pop_front();
+            outboundPos = 0;
+        }
+    }
+
+    return !failed;
+}
+
+void Connection::closeSocket()
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (closed)
+        return;
+
+    closed = true;
+    failed = true;
+    ::close(socket);
+}
+
+void Connection::shutdownSocket()
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (!closed)
+        ::shutdown(socket, SHUT_RDWR);
+}
+
+std::optional<std::size_t> Connection::discardQueued()
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    for (const Outbound& entry : outbound)
+    {
+        if (entry.source)
+            return std::nullopt;
+    }
+
+    const std::size_t queuedBefore = queuedBytes;
+    if (outboundPos > 0)
+    {
+        outbound.resize(1);
+        queuedBytes = outbound.front().data.bytes.size() - outboundPos;
+    }
+    else
+    {
+        outbound.clear();
+        queuedBytes = 0;
+    }
+
+    return queuedBefore - queuedBytes;
+}
+
+std::size_t Connection::getQueuedBytes()
+{
+    std::lock_guard<std::mutex> lock(sendMutex);
+    return queuedBytes;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <sys/types.h>
+
+#include "framing.h"
+#include "shared_memory_channel.h"
+
+class ServerDocument;
+class SendBatch;
+
+// Bytes to write to a connection, kept alive by their owner
+struct OutboundBytes
+{
+    std::shared_ptr<const void> owner;
+    std::string_view bytes;
+};
+
+/**
+ * A long stream of frames written to a connection a chunk at a time as the socket takes it, so it is never queued
+ * whole. Chunks are produced on whichever thread flushes the connection, so a source may only read state it owns.
+*/
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+
+    /**
+     * Produces the next chunk, at least one byte unless the stream already ended.
+     * @param out Receives byte ranges to write in order
+     * @returns False once the stream ended with this chunk
+    */
+    virtual bool produce(std::vector<OutboundBytes>& out) = 0;
+};
+
+/**
+ * Server side of one client's non-blocking socket. The reactor thread the socket is registered with reads into
+ * the frame reader and tracks the document; any thread may send.
+ *
+ * Sends write straight to the socket while nothing is queued. Whatever the socket does not take is queued and
+ * written by flush() once the reactor sees the socket writable again, so a slow client never blocks a shard.
+ * Broadcast frames are queued by reference, not copied, and streams are only asked for their next chunk when the
+ * queue reached them. A client that falls more than maxQueuedBytes behind is disconnected instead of growing its
+ * queue without bound; it catches up from its last version when it reconnects.
+ *
+ * A client on the same machine may exchange its frames through a SharedMemoryChannel instead. Its socket then only
+ * carries wake-ups, and the rings take the place of the socket's buffers for sending, queueing and receiving.
+*/
+class Connection
+{
+    friend class SendBatch;
+
+public:
+    const int socket;
+
+    // Reactor thread only
+    FrameReader reader;
+    ServerDocument* document = nullptr;
+    bool closing = false;
+    uint64_t operationsReceived = 0;
+
+    // When the client last sent anything, and whether it sends heartbeats so silence means it is gone. Written by
+    // the reactor thread, read by the server's heartbeat monitor.
+    std::atomic<std::chrono::steady_clock::time_point> lastReceiveTime;
+    std::atomic<bool> sendsHeartbeats = false;
+
+    // How far the client got, as its last heartbeat reported: the server version its text is at and whether it
+    // has edits the server did not acknowledge yet. Unsent edits are assumed until a heartbeat says otherwise.
+    // Written by the reactor thread.
+    static constexpr uint64_t noVersion = UINT64_MAX;
+    std::atomic<uint64_t> acknowledgedVersion = noVersion;
+    std::atomic<bool> hasUnsentEdits = true;
+
+    // Version of the last ops or document sent to the client. Written by its document's shard.
+    std::atomic<uint64_t> sentVersion = 0;
+
+    // Version of the last document sent to the client. It is not resynced again before it applied that one.
+    // Shard thread only.
+    uint64_t resyncVersion = 0;
+
+private:
+    const std::size_t maxQueuedBytes;
+    const std::unique_ptr<SharedMemoryChannel> channel;
+
+    struct Outbound
+    {
+        OutboundBytes data;
+        std::shared_ptr<FrameSource> source;    // Set instead of data for a stream that has chunks left
+    };
+
+    std::mutex sendMutex;
+    std::deque<Outbound> outbound;      // Bytes the socket did not take completely yet
+    std::size_t outboundPos = 0;        // Bytes of the front entry already written
+    std::size_t queuedBytes = 0;        // Bytes of the queued entries not written yet
+    bool failed = false;
+    bool closed = false;
+
+public:
+    /**
+     * @param maxQueuedBytes Bytes that may wait behind the frame being written before the client is dropped
+    */
+    Connection(int socket, std::size_t maxQueuedBytes, std::unique_ptr<SharedMemoryChannel> channel = nullptr)
+        : socket(socket), lastReceiveTime(std::chrono::steady_clock::now()), maxQueuedBytes(maxQueuedBytes),
+          channel(std::move(channel))
+    {}
+
+    /**
+     * @returns True if frames go through shared memory and the socket only wakes us
+    */
+    [[nodiscard]] bool usesSharedMemory() const { return channel != nullptr; }
+
+    /**
+     * Reads what the client sent, like a non-blocking recv. Reactor thread only.
+     * @returns Bytes read, 0 once the client closed the connection, -1 with errno EAGAIN if there is nothing yet
+    */
+    ssize_t receive(char* buffer, std::size_t space);
+
+    /**
+     * Sends a message as one frame, queueing what the socket cannot take right now.
+     * @returns False once the connection failed. The reactor notices and drops the client.
+    */
+    bool send(std::string_view message);
+
+    /**
+     * Sends a frame made by Framing::makeSharedFrame(), queueing a reference if the socket cannot take it now.
+     * @returns False once the connection failed
+    */
+    bool send(const SharedFrame& frame);
+
+    /**
+     * Queues a stream behind everything sent so far and starts writing it. Frames sent afterwards follow once the
+     * stream ended. Its chunks do not count against maxQueuedBytes.
+     * @returns False once the connection failed
+    */
+    bool send(std::shared_ptr<FrameSource> source);
+
+    /**
+     * Writes queued bytes until the socket would block. Called by the reactor when the socket became writable.
+     * @returns False once the connection failed
+    */
+    bool flush();
+
+    [[nodiscard]] std::size_t getQueuedBytes();
+
+    /**
+     * @returns Ops sent to the client that it has not applied yet, 0 until it reported its version
+    */
+    [[nodiscard]] uint64_t getLag() const
+    {
+        const uint64_t sent = sentVersion.load(std::memory_order_relaxed);
+        const uint64_t acknowledged = acknowledgedVersion.load(std::memory_order_relaxed);
+        return acknowledged != noVersion && sent > acknowledged ? sent - acknowledged : 0;
+    }
+
+    /**
+     * Drops the queued frames the socket has not started writing, e.g. ops a client that fell behind gets the
+     * whole document instead of. A frame that is partly written stays so the stream stays intact.
+     * @returns Bytes dropped, unset if a stream is queued since it cannot be cut short
+    */
+    std::optional<std::size_t> discardQueued();
+
+    /**
+     * Closes the socket. Sends racing with this fail instead of writing to a descriptor that may be reused.
+    */
+    void closeSocket();
+
+    /**
+     * Shuts the socket down without closing it, so its reactor sees it hang up and drops the client the usual
+     * way. Safe to call from any thread.
+    */
+    void shutdownSocket();
+
+private:
+    /**
+     * Writes bytes to the socket or the outbound ring without blocking. Caller holds sendMutex.
+     * @returns Bytes written, 0 if there is no room right now, -1 if the connection failed
+    */
+    ssize_t write(struct iovec* parts, std::size_t partCount);
+
+    /**
+     * Sends a frame or queues it behind frames already queued. Caller holds sendMutex.
+    */
+    bool sendLocked(const SharedFrame& frame);
+
+    /**
+     * Queues what a send of a frame did not write. Caller holds sendMutex.
+     * @param sent Bytes written, 0 if the socket would block, negative if the connection failed
+    */
+    bool completeSendLocked(const SharedFrame& frame, ssize_t sent);
+
+    /**
+     * Queues bytes, or drops the client if that put it too far behind. Caller holds sendMutex.
+     * @param offset Bytes already written, only if nothing else is queued
+     * @returns False if the connection failed
+    */
+    bool enqueueLocked(OutboundBytes data, std::size_t offset);
+
+    /**
+     * Puts the next chunk of the stream at the front of the queue in front of it, and drops the stream once it
+     * ended. Caller holds sendMutex.
+    */
+    void produceLocked();
+
+    [[nodiscard]] bool hasQueuedBytesLocked() const { return !outbound.empty(); }
+
+    /**
+     * Writes queued bytes until the socket would block. Caller holds sendMutex.
+    */
+    bool flushLocked();
+};
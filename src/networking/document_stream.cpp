@@ -0,0 +1,73 @@
+#include <string>
+#include <algorithm>
+
+#include "document_stream.h"
+#include "message_parser.h"
+#include "framing.h"
+
+DocumentStream::DocumentStream(PieceTableView view, uint64_t docVersion, bool compress)
+    : view(std::make_shared<const PieceTableView>(std::move(view))), docVersion(docVersion), compress(compress)
+{
+}
+
+bool DocumentStream::produce(std::vector<OutboundBytes>& out)
+{
+    if (!begun)
+    {
+        begun = true;
+        SharedFrame frame = Framing::makeSharedFrame(MessageParser::createInitBeginMessage(docVersion, view->documentLength));
+        out.push_back({frame, *frame});
+        return view->documentLength > 0;
+    }
+
+    std::vector<std::string_view> spans;
+    std::size_t length = 0;
+    takeSpans(spans, length);
+
+    const std::string_view prefix = MessageParser::initChunkPrefix;
+    if (compress)
+    {
+        auto frame = std::make_shared<std::string>();
+        FrameCompressor compressor(*frame);
+        compressor.append(prefix);
+        for (std::string_view span : spans)
+            compressor.append(span);
+
+        compressor.finish();
+        out.push_back({frame, *frame});
+    }
+    else
+    {
+        // Only the header and prefix are written out, the text goes from the snapshot to the socket
+        auto head = std::make_shared<std::string>(Framing::headerSize, '\0');
+        Framing::writeHeader(head->data(), prefix.size() + length);
+        head->append(prefix);
+        out.push_back({head, *head});
+
+        for (std::string_view span : spans)
+            out.push_back({view, span});
+    }
+
+    return pieceIndex < view->pieces.size();
+}
+
+void DocumentStream::takeSpans(std::vector<std::string_view>& spans, std::size_t& length)
+{
+    while (length < chunkSize && pieceIndex < view->pieces.size())
+    {
+        const Piece& piece = view->pieces[pieceIndex];
+        std::string_view buffer = piece.bufferType == BufferType::ADD ? std::string_view(view->addBuffer) : view->originalBuffer;
+
+        std::size_t take = std::min(piece.length - pieceOffset, chunkSize - length);
+        if (take > 0)
+            spans.push_back(buffer.substr(piece.start + pieceOffset, take));
+
+        length += take;
+        pieceOffset += take;
+        if (pieceOffset == piece.length)
+        {
+            pieceIndex++;
+            pieceOffset = 0;
+        }
+    }
+}
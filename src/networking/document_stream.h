@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <string_view>
+
+#include "connection.h"
+#include "../piece_table/piece_table.h"
+
+/**
+ * Sends a document to one client as INIT_BEGIN followed by INIT_CHUNK messages of at most chunkSize bytes of text,
+ * read straight from the pieces of a snapshot of the document. Chunks are only produced as the socket drains, so
+ * neither side ever buffers more than a chunk of the transfer. Uncompressed chunks are gathered from the
+ * snapshot's buffers without copying the text; compressed ones are compressed one at a time.
+*/
+class DocumentStream : public FrameSource
+{
+public:
+    static constexpr std::size_t chunkSize = 64 * 1024;
+
+private:
+    std::shared_ptr<const PieceTableView> view;     // Owner of the spans handed out
+    const uint64_t docVersion;
+    const bool compress;
+    bool begun = false;
+    std::size_t pieceIndex = 0;
+    std::size_t pieceOffset = 0;                    // Bytes of the current piece already sent
+
+public:
+    /**
+     * @param compress Compress the chunks, for clients that speak WireProtocol::COMPRESSED
+    */
+    DocumentStream(PieceTableView view, uint64_t docVersion, bool compress);
+
+    bool produce(std::vector<OutboundBytes>& out) override;
+
+private:
+    /**
+     * Takes the next spans of text, up to chunkSize bytes in total.
+    */
+    void takeSpans(std::vector<std::string_view>& spans, std::size_t& length);
+};
@@ -0,0 +1,358 @@
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "framing.h"
+#include "lz4.h"
+
+namespace
+{
+    uint32_t read32(const char* bytes)
+    {
+        const auto* data = reinterpret_cast<const unsigned char*>(bytes);
+        return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+               (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+    }
+
+    void write32(char* bytes, uint32_t value)
+    {
+        bytes[0] = static_cast<char>((value >> 24) & 0xFF);
+        bytes[1] = static_cast<char>((value >> 16) & 0xFF);
+        bytes[2] = static_cast<char>((value >> 8) & 0xFF);
+        bytes[3] = static_cast<char>(value & 0xFF);
+    }
+
+    std::size_t readHeader(const char* header)
+    {
+        return read32(header) & ~Framing::compressedFlag;
+    }
+
+    bool isCompressed(const char* header)
+    {
+        return read32(header) & Framing::compressedFlag;
+    }
+}
+
+void Framing::writeHeader(char* header, std::size_t length, bool compressed)
+{
+    write32(header, static_cast<uint32_t>(length) | (compressed ? compressedFlag : 0));
+}
+
+void Framing::appendFrame(std::string& out, std::string_view message, bool compress)
+{
+    if (compress)
+    {
+        FrameCompressor compressor(out);
+        compressor.append(message);
+        compressor.finish();
+        return;
+    }
+
+    char header[headerSize];
+    writeHeader(header, message.size());
+    out.append(header, headerSize);
+    out.append(message);
+}
+
+SharedFrame Framing::makeSharedFrame(std::string_view message, bool compress)
+{
+    std::string frame;
+    if (!compress)
+        frame.reserve(headerSize + message.size());
+
+    appendFrame(frame, message, compress);
+    return std::make_shared<const std::string>(std::move(frame));
+}
+
+bool Framing::sendFrame(int socket, std::string_view message, bool compress)
+{
+    if (message.size() > maxFrameSize)
+    {
+        std::cerr << "Framing: Message of " << message.size() << " bytes is too large to send\n";
+        return false;
+    }
+
+    char header[headerSize];
+    writeHeader(header, message.size());
+
+    struct iovec parts[2];
+    parts[0].iov_base = header;
+    parts[0].iov_len = headerSize;
+    parts[1].iov_base = const_cast<char*>(message.data());
+    parts[1].iov_len = message.size();
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = parts;
+    msg.msg_iovlen = 2;
+
+    // A compressed frame is built with its header
+    std::string compressed;
+    if (compress)
+    {
+        appendFrame(compressed, message, true);
+        parts[0].iov_base = compressed.data();
+        parts[0].iov_len = compressed.size();
+        msg.msg_iovlen = 1;
+    }
+
+    // Large frames can be written partially, continue where the socket stopped
+    while (msg.msg_iovlen > 0)
+    {
+        ssize_t sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        std::size_t remaining = static_cast<std::size_t>(sent);
+        while (msg.msg_iovlen > 0 && remaining >= msg.msg_iov[0].iov_len)
+        {
+            remaining -= msg.msg_iov[0].iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov[0].iov_base = static_cast<char*>(msg.msg_iov[0].iov_base) + remaining;
+            msg.msg_iov[0].iov_len -= remaining;
+        }
+    }
+
+    return true;
+}
+
+FrameCompressor::FrameCompressor(std::string& out)
+    : out(out), frameStart(out.size())
+{
+    out.append(Framing::headerSize, '\0');
+}
+
+void FrameCompressor::append(std::string_view bytes)
+{
+    messageSize += bytes.size();
+
+    // Fill the block that was started, then compress whole blocks straight from the input
+    if (!block.empty())
+    {
+        std::size_t length = std::min(bytes.size(), blockSize - block.size());
+        block.append(bytes.substr(0, length));
+        bytes.remove_prefix(length);
+        if (block.size() < blockSize)
+            return;
+
+        compressBlock(block);
+        block.clear();
+    }
+
+    while (bytes.size() >= blockSize)
+    {
+        compressBlock(bytes.substr(0, blockSize));
+        bytes.remove_prefix(blockSize);
+    }
+
+    block.append(bytes);
+}
+
+void FrameCompressor::finish()
+{
+    if (!block.empty())
+        compressBlock(block);
+
+    block.clear();
+    Framing::writeHeader(out.data() + frameStart, out.size() - frameStart - Framing::headerSize, true);
+}
+
+void FrameCompressor::compressBlock(std::string_view bytes)
+{
+    const std::size_t blockStart = out.size();
+    out.resize(blockStart + blockHeaderSize + Lz4::getMaxCompressedSize(bytes.size()));
+    char* target = out.data() + blockStart + blockHeaderSize;
+
+    std::size_t size = Lz4::compress(bytes.data(), bytes.size(), target);
+
+    // Blocks that do not shrink are stored, so the frame is never much larger than the message
+    uint32_t flags = 0;
+    if (size >= bytes.size())
+    {
+        memcpy(target, bytes.data(), bytes.size());
+        size = bytes.size();
+        flags = storedFlag;
+    }
+
+    write32(out.data() + blockStart, static_cast<uint32_t>(size) | flags);
+    write32(out.data() + blockStart + 4, static_cast<uint32_t>(bytes.size()));
+    out.resize(blockStart + blockHeaderSize + size);
+}
+
+bool FrameCompressor::decompress(std::string_view frame, std::string& message)
+{
+    message.clear();
+    while (!frame.empty())
+    {
+        if (frame.size() < blockHeaderSize)
+            return false;
+
+        const uint32_t sizeField = read32(frame.data());
+        const std::size_t size = sizeField & ~storedFlag;
+        const std::size_t rawSize = read32(frame.data() + 4);
+        frame.remove_prefix(blockHeaderSize);
+
+        if (size > frame.size() || rawSize > blockSize || message.size() + rawSize > Framing::maxFrameSize)
+            return false;
+
+        const std::size_t offset = message.size();
+        message.resize(offset + rawSize);
+        if (sizeField & storedFlag)
+        {
+            if (size != rawSize)
+                return false;
+
+            memcpy(message.data() + offset, frame.data(), size);
+        }
+        else if (!Lz4::decompress(frame.data(), size, message.data() + offset, rawSize))
+        {
+            return false;
+        }
+
+        frame.remove_prefix(size);
+    }
+
+    return true;
+}
+
+char* FrameReader::prepareReceive(std::size_t& space)
+{
+    std::size_t unread = writePos - readPos;
+
+    // Views of the last compressed frame end here, give back what a large one made the buffer grow to
+    if (inflated.capacity() > FrameCompressor::blockSize)
+        std::string().swap(inflated);
+
+    // A drained buffer starts over at the front, and gives back what a large frame made it grow to
+    if (unread == 0)
+    {
+        readPos = 0;
+        writePos = 0;
+        if (capacity > initialCapacity)
+        {
+            buffer.reset();
+            capacity = 0;
+        }
+    }
+
+    if (!buffer)
+    {
+        buffer.reset(new char[initialCapacity]);
+        capacity = initialCapacity;
+    }
+
+    // Room for a few small frames, or for the rest of the frame we are waiting for. That room is at most as much
+    // again as what arrived of the frame, so a header alone from a peer cannot make the buffer large.
+    std::size_t frameLength = peekFrameLength();
+    std::size_t wanted = unread + initialCapacity / 4;
+    if (frameLength > 0)
+        wanted = std::max(wanted, std::min(Framing::headerSize + frameLength, unread * 2));
+
+    if (capacity - readPos < wanted)
+    {
+        if (capacity < wanted)
+        {
+            // Doubles with the bytes that arrived, and stops at the frame's size
+            std::size_t newCapacity = frameLength > 0 ? wanted : std::max(wanted, capacity * 2);
+            // Left uninitialized, recv() fills it
+            std::unique_ptr<char[]> newBuffer(new char[newCapacity]);
+            memcpy(newBuffer.get(), buffer.get() + readPos, unread);
+            buffer = std::move(newBuffer);
+            capacity = newCapacity;
+        }
+        else
+        {
+            memmove(buffer.get(), buffer.get() + readPos, unread);
+        }
+
+        readPos = 0;
+        writePos = unread;
+    }
+
+    space = capacity - writePos;
+    return buffer.get() + writePos;
+}
+
+void FrameReader::commitReceive(std::size_t length)
+{
+    writePos = std::min(writePos + length, capacity);
+}
+
+void FrameReader::receive(std::string_view data)
+{
+    while (!data.empty())
+    {
+        std::size_t space = 0;
+        char* target = prepareReceive(space);
+        std::size_t length = std::min(space, data.size());
+        memcpy(target, data.data(), length);
+        commitReceive(length);
+        data.remove_prefix(length);
+    }
+}
+
+bool FrameReader::nextFrame(std::string_view& frame)
+{
+    if (corrupt || writePos - readPos < Framing::headerSize)
+        return false;
+
+    std::size_t frameLength = readHeader(buffer.get() + readPos);
+    if (frameLength > Framing::maxFrameSize)
+    {
+        std::cerr << "FrameReader: Frame header claims " << frameLength << " bytes, dropping the stream\n";
+        corrupt = true;
+        return false;
+    }
+
+    if (writePos - readPos < Framing::headerSize + frameLength)
+        return false;
+
+    frame = std::string_view(buffer.get() + readPos + Framing::headerSize, frameLength);
+    const bool compressed = isCompressed(buffer.get() + readPos);
+    readPos += Framing::headerSize + frameLength;
+
+    if (compressed)
+    {
+        if (!FrameCompressor::decompress(frame, inflated))
+        {
+            std::cerr << "FrameReader: Compressed frame is malformed, dropping the stream\n";
+            corrupt = true;
+            return false;
+        }
+
+        frame = inflated;
+    }
+
+    return true;
+}
+
+void FrameReader::reset()
+{
+    std::string().swap(inflated);
+    buffer.reset();
+    capacity = 0;
+    readPos = 0;
+    writePos = 0;
+    corrupt = false;
+}
+
+std::size_t FrameReader::peekFrameLength() const
+{
+    if (writePos - readPos < Framing::headerSize)
+        return 0;
+
+    return std::min(readHeader(buffer.get() + readPos), Framing::maxFrameSize);
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <memory>
+
+#include "wire_codec.h"
+
+// One or more framed messages, headers included. Shared by every connection it is queued on, so a broadcast is
+// serialized once however many clients it goes to.
+using SharedFrame = std::shared_ptr<const std::string>;
+
+/**
+ * Every message on a connection travels as one frame: the message length as a 4-byte big-endian number followed
+ * by the message bytes. TCP may split a frame over many reads or put many frames into one.
+ *
+ * On connections that negotiated WireProtocol::COMPRESSED, large messages may travel compressed instead. Their
+ * header has compressedFlag set and the length counts the compressed bytes, see FrameCompressor.
+*/
+class Framing
+{
+public:
+    static constexpr std::size_t headerSize = 4;
+
+    // Larger lengths only come from a corrupt or hostile stream
+    static constexpr std::size_t maxFrameSize = 256 * 1024 * 1024;
+
+    static constexpr uint32_t compressedFlag = 0x80000000;
+
+    // Smaller messages are sent as they are, compressing them saves too little to be worth it
+    static constexpr std::size_t compressionThreshold = 2048;
+
+    /**
+     * Writes the headerSize bytes announcing a frame of the given length.
+    */
+    static void writeHeader(char* header, std::size_t length, bool compressed = false);
+
+    /**
+     * @returns True if a message of this size is compressed on a connection speaking the protocol
+    */
+    [[nodiscard]] static bool shouldCompress(std::size_t messageSize, WireProtocol wireProtocol)
+    {
+        return wireProtocol >= WireProtocol::COMPRESSED && messageSize >= compressionThreshold;
+    }
+
+    /**
+     * Appends a message as a frame.
+     * @param compress Compress the message, for connections that negotiated it
+    */
+    static void appendFrame(std::string& out, std::string_view message, bool compress = false);
+
+    /**
+     * Frames a message into a buffer that can be queued on many connections.
+    */
+    [[nodiscard]] static SharedFrame makeSharedFrame(std::string_view message, bool compress = false);
+
+    /**
+     * Sends a message as one frame. Header and message go out in one sendmsg, the message is not copied unless
+     * it is compressed.
+     * @returns False if the connection failed before the whole frame was written
+    */
+    [[nodiscard]] static bool sendFrame(int socket, std::string_view message, bool compress = false);
+};
+
+/**
+ * Writes one compressed frame from a message handed over in pieces. Each block is compressed as soon as it is
+ * full, so a large message never has to exist uncompressed in one piece. The frame holds a series of blocks:
+ *
+ *   size      4 bytes big-endian, the compressed size with storedFlag set if the block is stored as it is
+ *   rawSize   4 bytes big-endian, at most blockSize
+ *   bytes     see Lz4
+*/
+class FrameCompressor
+{
+public:
+    static constexpr std::size_t blockSize = 64 * 1024;
+    static constexpr std::size_t blockHeaderSize = 8;
+    static constexpr uint32_t storedFlag = 0x80000000;
+
+private:
+    std::string& out;
+    std::size_t frameStart;
+    std::string block;          // Bytes of the block being filled
+    std::size_t messageSize = 0;
+
+public:
+    /**
+     * @param out Buffer the frame is appended to
+    */
+    explicit FrameCompressor(std::string& out);
+
+    void append(std::string_view bytes);
+
+    /**
+     * Compresses what is left and writes the frame header. Nothing may be appended afterwards.
+    */
+    void finish();
+
+    /**
+     * Decompresses the blocks of a compressed frame.
+     * @param message Receives the message
+     * @returns False if the frame is malformed or its message would be larger than Framing::maxFrameSize
+    */
+    [[nodiscard]] static bool decompress(std::string_view frame, std::string& message);
+
+private:
+    void compressBlock(std::string_view bytes);
+};
+
+/**
+ * Receive buffer of one connection. recv() writes straight into it and complete frames are handed out as views
+ * into it, so a read that delivers many frames costs no copies. While a large frame arrives the buffer doubles with
+ * the bytes received, up to the frame's size, so a header alone never makes it large. It drops back to its initial
+ * size once it is drained.
+*/
+class FrameReader
+{
+public:
+    static constexpr std::size_t initialCapacity = 4096;
+
+private:
+    std::unique_ptr<char[]> buffer;
+    std::size_t capacity = 0;
+    std::size_t readPos = 0;    // Start of the bytes no frame was handed out for yet
+    std::size_t writePos = 0;   // End of the received bytes
+    bool corrupt = false;
+
+    // Message of the last compressed frame handed out
+    std::string inflated;
+
+public:
+    /**
+     * Makes room for the next recv(). Moves unread bytes, so views from nextFrame() are invalid afterwards.
+     * @param space Receives how many bytes may be written
+     * @returns Where to write received bytes
+    */
+    char* prepareReceive(std::size_t& space);
+
+    /**
+     * Marks bytes written after prepareReceive() as received.
+    */
+    void commitReceive(std::size_t length);
+
+    /**
+     * Appends bytes received by someone else, e.g. into an io_uring provided buffer.
+    */
+    void receive(std::string_view data);
+
+    /**
+     * Takes the next complete frame off the buffer, decompressing it if it is compressed.
+     * @param frame Receives the message, valid until the next prepareReceive(), or the next nextFrame() if the
+     * frame was compressed
+     * @returns False if no complete frame is buffered or the stream is corrupt
+    */
+    [[nodiscard]] bool nextFrame(std::string_view& frame);
+
+    /**
+     * @returns True once a frame header claimed more than Framing::maxFrameSize or a compressed frame was malformed.
+     * The connection has to be dropped.
+    */
+    [[nodiscard]] bool isCorrupt() const { return corrupt; }
+
+    /**
+     * @returns True if bytes no frame was handed out for are buffered
+    */
+    [[nodiscard]] bool hasBufferedBytes() const { return writePos > readPos; }
+
+    /**
+     * Drops everything buffered and frees the buffer, e.g. when the connection is replaced or goes idle.
+    */
+    void reset();
+
+    [[nodiscard]] std::size_t getCapacity() const { return capacity; }
+
+private:
+    /**
+     * @returns Length of the frame at readPos, or 0 if its header is not complete yet
+    */
+    [[nodiscard]] std::size_t peekFrameLength() const;
+};
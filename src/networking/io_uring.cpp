@@ -0,0 +1,282 @@
+#include <cerrno>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "io_uring.h"
+
+namespace
+{
+    int setupRing(unsigned entries, io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int enterRing(int ringFd, unsigned toSubmit, unsigned waitFor, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, flags, nullptr, 0));
+    }
+
+    int registerRing(int ringFd, unsigned opcode, void* arg, unsigned argCount)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, ringFd, opcode, arg, argCount));
+    }
+
+    // The rings are shared with the kernel, which reads and writes their indices concurrently
+    unsigned loadAcquire(const unsigned* index)
+    {
+        return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+    }
+
+    void storeRelease(unsigned* index, unsigned value)
+    {
+        __atomic_store_n(index, value, __ATOMIC_RELEASE);
+    }
+
+    void* mapRing(int ringFd, std::size_t size, off_t offset)
+    {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+
+    bool probe()
+    {
+        IoUring ring;
+        if (!ring.init(4) || !ring.initBuffers(2, 64))
+            return false;
+
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1)
+            return false;
+
+        // A kernel without multishot receives fails the request or completes it without IORING_CQE_F_MORE
+        io_uring_sqe* sqe = ring.getSubmission();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = pair[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = IoUring::bufferGroup;
+        ring.publish();
+
+        io_uring_cqe completion = {};
+        bool supported = ring.submit() == 1 && write(pair[1], "x", 1) == 1 && ring.submit(1) >= 0 &&
+                         ring.takeCompletions(&completion, 1) == 1 && completion.res == 1 &&
+                         (completion.flags & IORING_CQE_F_BUFFER) && (completion.flags & IORING_CQE_F_MORE);
+
+        ::close(pair[0]);
+        ::close(pair[1]);
+        return supported;
+    }
+}
+
+IoUring::~IoUring()
+{
+    close();
+}
+
+bool IoUring::init(unsigned entries, unsigned flags)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = flags | IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    ringFd = setupRing(entries, &params);
+    if (ringFd < 0)
+    {
+        ringFd = -1;
+        return false;
+    }
+
+    ringMemorySize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionMemorySize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping)
+        ringMemorySize = std::max(ringMemorySize, completionMemorySize);
+
+    ringMemory = mapRing(ringFd, ringMemorySize, IORING_OFF_SQ_RING);
+    if (!ringMemory)
+    {
+        close();
+        return false;
+    }
+
+    if (singleMapping)
+    {
+        completionMemory = ringMemory;
+    }
+    else
+    {
+        completionMemory = mapRing(ringFd, completionMemorySize, IORING_OFF_CQ_RING);
+        if (!completionMemory)
+        {
+            close();
+            return false;
+        }
+    }
+
+    submissionsSize = params.sq_entries * sizeof(io_uring_sqe);
+    submissions = static_cast<io_uring_sqe*>(mapRing(ringFd, submissionsSize, IORING_OFF_SQES));
+    if (!submissions)
+    {
+        close();
+        return false;
+    }
+
+    char* ring = static_cast<char*>(ringMemory);
+    submissionHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    submissionTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    submissionMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    submissionEntries = params.sq_entries;
+    localTail = *submissionTail;
+
+    // Slot i always holds entry i, so entries are published by moving the tail alone
+    unsigned* submissionArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    for (unsigned i = 0; i < submissionEntries; i++)
+        submissionArray[i] = i;
+
+    char* completionRing = static_cast<char*>(completionMemory);
+    completionHead = reinterpret_cast<unsigned*>(completionRing + params.cq_off.head);
+    completionTail = reinterpret_cast<unsigned*>(completionRing + params.cq_off.tail);
+    completionMask = *reinterpret_cast<unsigned*>(completionRing + params.cq_off.ring_mask);
+    completions = reinterpret_cast<io_uring_cqe*>(completionRing + params.cq_off.cqes);
+
+    return true;
+}
+
+bool IoUring::initBuffers(unsigned count, unsigned size)
+{
+    bufferRingSize = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+
+    bufferRing = static_cast<io_uring_buf_ring*>(ring);
+    bufferMemory = new char[static_cast<std::size_t>(count) * size];
+    bufferCount = count;
+    bufferSize = size;
+
+    io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+    registration.ring_entries = count;
+    registration.bgid = bufferGroup;
+    if (registerRing(ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0)
+    {
+        munmap(bufferRing, bufferRingSize);
+        delete[] bufferMemory;
+        bufferRing = nullptr;
+        bufferMemory = nullptr;
+        return false;
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        io_uring_buf& buffer = getBufferEntries()[i];
+        buffer.addr = reinterpret_cast<uint64_t>(getBuffer(static_cast<uint16_t>(i)));
+        buffer.len = size;
+        buffer.bid = static_cast<uint16_t>(i);
+    }
+
+    __atomic_store_n(&bufferRing->tail, static_cast<uint16_t>(count), __ATOMIC_RELEASE);
+    return true;
+}
+
+io_uring_sqe* IoUring::getSubmission()
+{
+    if (localTail - loadAcquire(submissionHead) >= submissionEntries)
+        return nullptr;
+
+    io_uring_sqe* sqe = &submissions[localTail & submissionMask];
+    memset(sqe, 0, sizeof(*sqe));
+    localTail++;
+    return sqe;
+}
+
+void IoUring::publish()
+{
+    storeRelease(submissionTail, localTail);
+}
+
+void IoUring::discardUnsubmitted()
+{
+    // Without a kernel polling thread entries are only read while we are in io_uring_enter
+    localTail = loadAcquire(submissionHead);
+    publish();
+}
+
+int IoUring::submit(unsigned waitFor)
+{
+    unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true)
+    {
+        // The kernel skips the wait if it could not submit as many entries as it was told
+        unsigned pending = *submissionTail - loadAcquire(submissionHead);
+        int submitted = enterRing(ringFd, pending, waitFor, flags);
+        if (submitted >= 0 || errno != EINTR)
+            return submitted >= 0 ? submitted : -errno;
+
+        // Interrupted while waiting, the entries themselves went in
+        flags = IORING_ENTER_GETEVENTS;
+        if (waitFor == 0)
+            return 0;
+    }
+}
+
+unsigned IoUring::takeCompletions(io_uring_cqe* out, unsigned maxCount)
+{
+    unsigned head = *completionHead;
+    unsigned available = loadAcquire(completionTail) - head;
+    unsigned count = std::min(available, maxCount);
+
+    for (unsigned i = 0; i < count; i++)
+        out[i] = completions[(head + i) & completionMask];
+
+    storeRelease(completionHead, head + count);
+    return count;
+}
+
+void IoUring::recycleBuffer(uint16_t bufferId)
+{
+    // The tail shares its bytes with the first entry's reserved field, so entries are written field by field
+    uint16_t tail = bufferRing->tail;
+    io_uring_buf& buffer = getBufferEntries()[tail & (bufferCount - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(getBuffer(bufferId));
+    buffer.len = bufferSize;
+    buffer.bid = bufferId;
+    __atomic_store_n(&bufferRing->tail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
+
+bool IoUring::isSupported()
+{
+    static const bool supported = probe();
+    return supported;
+}
+
+void IoUring::close()
+{
+    // Closing the ring cancels whatever is still in flight and unregisters the buffers
+    if (ringFd != -1)
+        ::close(ringFd);
+    if (submissions)
+        munmap(submissions, submissionsSize);
+    if (completionMemory && completionMemory != ringMemory)
+        munmap(completionMemory, completionMemorySize);
+    if (ringMemory)
+        munmap(ringMemory, ringMemorySize);
+    if (bufferRing)
+        munmap(bufferRing, bufferRingSize);
+
+    delete[] bufferMemory;
+
+    ringFd = -1;
+    submissions = nullptr;
+    completionMemory = nullptr;
+    ringMemory = nullptr;
+    bufferRing = nullptr;
+    bufferMemory = nullptr;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <linux/io_uring.h>
+
+/**
+ * Minimal io_uring over the raw system calls: the submission and completion rings and one ring of provided
+ * receive buffers. Not thread safe; requests are cancelled when the thread that submitted them exits, so a ring
+ * that receives into its buffers should be submitted to by one thread only.
+*/
+class IoUring
+{
+public:
+    static constexpr uint16_t bufferGroup = 0;
+
+private:
+    int ringFd = -1;
+
+    void* ringMemory = nullptr;
+    std::size_t ringMemorySize = 0;
+    void* completionMemory = nullptr;     // Same mapping as ringMemory on kernels with IORING_FEAT_SINGLE_MMAP
+    std::size_t completionMemorySize = 0;
+    io_uring_sqe* submissions = nullptr;
+    std::size_t submissionsSize = 0;
+
+    unsigned* submissionHead = nullptr;
+    unsigned* submissionTail = nullptr;
+    unsigned submissionMask = 0;
+    unsigned submissionEntries = 0;
+    unsigned localTail = 0;     // Tail including submissions not published yet
+
+    unsigned* completionHead = nullptr;
+    unsigned* completionTail = nullptr;
+    unsigned completionMask = 0;
+    io_uring_cqe* completions = nullptr;
+
+    io_uring_buf_ring* bufferRing = nullptr;
+    std::size_t bufferRingSize = 0;
+    char* bufferMemory = nullptr;
+    unsigned bufferCount = 0;
+    unsigned bufferSize = 0;
+
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * Creates the rings. The completion ring holds four completions per submission entry.
+     * @param entries Submission ring size, rounded up to a power of two by the kernel
+     * @param flags IORING_SETUP_* flags besides IORING_SETUP_CQSIZE
+     * @returns False if the kernel has no io_uring, it is disabled or does not know a flag
+    */
+    [[nodiscard]] bool init(unsigned entries, unsigned flags = 0);
+
+    /**
+     * Registers bufferCount buffers of bufferSize bytes that receives with IOSQE_BUFFER_SELECT pick from.
+     * @param bufferCount Power of two
+     * @returns False if the kernel has no provided buffer rings (before 5.19)
+    */
+    [[nodiscard]] bool initBuffers(unsigned bufferCount, unsigned bufferSize);
+
+    /**
+     * @returns A cleared submission entry, or null if the ring is full. It is submitted by the next submit() after
+     * publish().
+    */
+    io_uring_sqe* getSubmission();
+
+    /**
+     * Makes the entries filled since the last call visible to the kernel.
+    */
+    void publish();
+
+    /**
+     * Drops entries that were not submitted, e.g. after submit() failed.
+    */
+    void discardUnsubmitted();
+
+    /**
+     * Submits published entries and waits for completions.
+     * @param waitFor Completions to wait for, 0 to return right away
+     * @returns Entries submitted, or -errno
+    */
+    int submit(unsigned waitFor = 0);
+
+    /**
+     * Copies up to maxCount completions and removes them from the ring.
+     * @returns Number of completions copied
+    */
+    unsigned takeCompletions(io_uring_cqe* out, unsigned maxCount);
+
+    [[nodiscard]] const char* getBuffer(uint16_t bufferId) const { return bufferMemory + static_cast<std::size_t>(bufferId) * bufferSize; }
+
+    /**
+     * Hands a provided buffer back to the kernel once its data was consumed.
+    */
+    void recycleBuffer(uint16_t bufferId);
+
+    /**
+     * @returns True if this kernel supports everything the server's io_uring backend uses: provided buffer rings
+     * and multishot receives (Linux 6.0). Checked once by receiving through a socket pair.
+    */
+    [[nodiscard]] static bool isSupported();
+
+private:
+    void close();
+
+    /**
+     * The entries start at the ring itself. Not bufferRing->bufs, which C++ puts behind the one byte of the
+     * empty struct in the header's flexible array declaration.
+    */
+    io_uring_buf* getBufferEntries() { return reinterpret_cast<io_uring_buf*>(bufferRing); }
+};
@@ -0,0 +1,308 @@
+#include <iostream>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "io_uring_reactor.h"
+
+namespace
+{
+    using RequestKind = IoUringReactor::RequestKind;
+
+    // Generations wrap after 2^24 reuses of a descriptor, long after its old completions were delivered
+    constexpr uint32_t generationMask = 0xFFFFFF;
+
+    uint64_t makeUserData(RequestKind kind, int fd, uint32_t generation)
+    {
+        return (static_cast<uint64_t>(generation & generationMask) << 40) |
+               (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 8) | static_cast<uint64_t>(kind);
+    }
+
+    RequestKind getKind(uint64_t userData) { return static_cast<RequestKind>(userData & 0xFF); }
+    int getFd(uint64_t userData) { return static_cast<int>(static_cast<uint32_t>(userData >> 8)); }
+    uint32_t getGeneration(uint64_t userData) { return static_cast<uint32_t>(userData >> 40); }
+}
+
+IoUringReactor::IoUringReactor(EventCallback callback)
+    : callback(std::move(callback)), wakeFd(-1), running(false)
+{
+}
+
+IoUringReactor::~IoUringReactor()
+{
+    stop();
+}
+
+bool IoUringReactor::start(int cpu)
+{
+    if (running)
+        return true;
+
+    // Completions are only needed when the reactor waits, so the kernel does not have to interrupt it for them
+    bool ringReady = ring.init(ringEntries, IORING_SETUP_COOP_TASKRUN) || ring.init(ringEntries);
+    if (!ringReady || !ring.initBuffers(bufferCount, bufferSize))
+    {
+        std::cerr << "IoUringReactor: Failed to set up the ring\n";
+        return false;
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd == -1)
+    {
+        std::cerr << "IoUringReactor: Failed to create wake-up event\n";
+        return false;
+    }
+
+    running = true;
+    reactorThread = std::thread(&IoUringReactor::run, this);
+
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        if (pthread_setaffinity_np(reactorThread.native_handle(), sizeof(cpuSet), &cpuSet) != 0)
+            std::cerr << "IoUringReactor: Failed to pin thread to core " << cpu << "\n";
+    }
+#endif
+
+    return true;
+}
+
+void IoUringReactor::stop()
+{
+    if (running)
+    {
+        running = false;
+
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+            std::cerr << "IoUringReactor: Failed to wake reactor thread\n";
+
+        // The kernel cancels the thread's requests when it exits, so no receive writes to the buffers afterwards
+        if (reactorThread.joinable())
+            reactorThread.join();
+    }
+
+    if (wakeFd != -1)
+        close(wakeFd);
+
+    wakeFd = -1;
+}
+
+bool IoUringReactor::add(int fd, uint32_t events)
+{
+    if (!running)
+        return false;
+
+    if (std::this_thread::get_id() == reactorThread.get_id())
+    {
+        watch(fd, events);
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pendingSockets.emplace_back(fd, events);
+    }
+
+    uint64_t one = 1;
+    return write(wakeFd, &one, sizeof(one)) == sizeof(one);
+}
+
+bool IoUringReactor::addListener(int fd)
+{
+    return add(fd, 0);
+}
+
+void IoUringReactor::remove(int fd)
+{
+    if (fd < 0 || static_cast<std::size_t>(fd) >= generations.size())
+        return;
+
+    // Cancel by user data, the descriptor number may belong to another socket by the time the kernel looks
+    uint32_t generation = generations[fd];
+    cancel(makeUserData(RequestKind::RECEIVE, fd, generation));
+    cancel(makeUserData(RequestKind::WRITABLE, fd, generation));
+    cancel(makeUserData(RequestKind::READABLE, fd, generation));
+    generations[fd]++;
+}
+
+void IoUringReactor::run()
+{
+    armWake();
+
+    io_uring_cqe completions[maxCompletionsPerWait];
+    while (running)
+    {
+        // Submits everything the callbacks queued and waits for the next completion in one call
+        int result = ring.submit(1);
+        if (result < 0 && result != -EBUSY && result != -EAGAIN && result != -ETIME)
+        {
+            std::cerr << "IoUringReactor: io_uring_enter failed with " << -result << "\n";
+            break;
+        }
+
+        unsigned count;
+        while (running && (count = ring.takeCompletions(completions, maxCompletionsPerWait)) > 0)
+        {
+            for (unsigned i = 0; i < count && running; i++)
+                handleCompletion(completions[i]);
+        }
+    }
+}
+
+void IoUringReactor::watch(int fd, uint32_t events)
+{
+    if (static_cast<std::size_t>(fd) >= generations.size())
+        generations.resize(static_cast<std::size_t>(fd) + 1, 0);
+
+    uint32_t generation = generations[fd];
+    if (events == 0)
+        armPoll(RequestKind::READABLE, fd, generation);
+    if (events & EPOLLIN)
+        armReceive(fd, generation);
+    if (events & EPOLLOUT)
+        armPoll(RequestKind::WRITABLE, fd, generation);
+}
+
+void IoUringReactor::armReceive(int fd, uint32_t generation)
+{
+    io_uring_sqe* sqe = getSubmission();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IoUring::bufferGroup;
+    sqe->user_data = makeUserData(RequestKind::RECEIVE, fd, generation);
+    ring.publish();
+}
+
+void IoUringReactor::armPoll(RequestKind kind, int fd, uint32_t generation)
+{
+    // Edge-triggered unless IORING_POLL_ADD_LEVEL is set, and only woken for the events asked for
+    io_uring_sqe* sqe = getSubmission();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = kind == RequestKind::WRITABLE ? POLLOUT : POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = makeUserData(kind, fd, generation);
+    ring.publish();
+}
+
+void IoUringReactor::armWake()
+{
+    io_uring_sqe* sqe = getSubmission();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakeFd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = makeUserData(RequestKind::WAKE, wakeFd, 0);
+    ring.publish();
+}
+
+void IoUringReactor::cancel(uint64_t userData)
+{
+    io_uring_sqe* sqe = getSubmission();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = makeUserData(RequestKind::CANCEL, -1, 0);
+    ring.publish();
+}
+
+io_uring_sqe* IoUringReactor::getSubmission()
+{
+    io_uring_sqe* sqe = ring.getSubmission();
+    while (!sqe)
+    {
+        (void)ring.submit();
+        sqe = ring.getSubmission();
+    }
+
+    return sqe;
+}
+
+void IoUringReactor::handleCompletion(const io_uring_cqe& completion)
+{
+    const RequestKind kind = getKind(completion.user_data);
+    const int fd = getFd(completion.user_data);
+    const uint32_t generation = getGeneration(completion.user_data);
+    const bool more = completion.flags & IORING_CQE_F_MORE;
+
+    switch (kind)
+    {
+        case RequestKind::RECEIVE:
+        {
+            if (completion.flags & IORING_CQE_F_BUFFER)
+            {
+                uint16_t bufferId = static_cast<uint16_t>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+                if (completion.res > 0 && isCurrent(fd, generation))
+                    callback(fd, EPOLLIN, std::string_view(ring.getBuffer(bufferId), static_cast<std::size_t>(completion.res)));
+
+                ring.recycleBuffer(bufferId);
+            }
+            else if (completion.res != -ENOBUFS && completion.res != -ECANCELED && isCurrent(fd, generation))
+            {
+                callback(fd, completion.res == 0 ? EPOLLRDHUP | EPOLLHUP : EPOLLERR | EPOLLHUP, std::string_view());
+            }
+
+            // A multishot receive also ends when it ran out of buffers, or when the kernel decides to end it
+            if (!more && (completion.res > 0 || completion.res == -ENOBUFS) && isCurrent(fd, generation))
+                armReceive(fd, generation);
+
+            break;
+        }
+        case RequestKind::READABLE:
+        case RequestKind::WRITABLE:
+        {
+            // Hang-ups and errors of connections reach the callback through the receive
+            const uint32_t wanted = kind == RequestKind::WRITABLE ? EPOLLOUT : EPOLLIN;
+            if (completion.res > 0 && (completion.res & wanted) && isCurrent(fd, generation))
+                callback(fd, wanted, std::string_view());
+
+            if (!more && completion.res >= 0 && isCurrent(fd, generation))
+                armPoll(kind, fd, generation);
+
+            break;
+        }
+        case RequestKind::WAKE:
+        {
+            handleWake();
+            if (!more && running)
+                armWake();
+
+            break;
+        }
+        case RequestKind::CANCEL:
+            break;
+    }
+}
+
+void IoUringReactor::handleWake()
+{
+    uint64_t value;
+    if (read(wakeFd, &value, sizeof(value)) != sizeof(value))
+        return;
+
+    std::vector<std::pair<int, uint32_t>> sockets;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        sockets.swap(pendingSockets);
+    }
+
+    for (const auto& [fd, events] : sockets)
+        watch(fd, events);
+}
+
+bool IoUringReactor::isCurrent(int fd, uint32_t generation) const
+{
+    return fd >= 0 && static_cast<std::size_t>(fd) < generations.size() && (generations[fd] & generationMask) == generation;
+}
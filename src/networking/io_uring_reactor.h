@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <utility>
+
+#include "reactor.h"
+#include "io_uring.h"
+
+/**
+ * Reactor on io_uring. Each socket has one multishot receive picking from a ring of provided buffers and one
+ * multishot poll for writability, so neither is re-armed per event, and everything the callbacks submit goes to
+ * the kernel with the next wait. Received bytes are handed to the callback with EPOLLIN. The end of the stream
+ * or an error is reported with EPOLLHUP, after which the socket is no longer watched. Listening sockets get a
+ * multishot poll for readability instead of the receive.
+*/
+class IoUringReactor : public Reactor
+{
+public:
+    enum class RequestKind : uint8_t
+    {
+        RECEIVE,
+        READABLE,   // Listening sockets
+        WRITABLE,
+        WAKE,
+        CANCEL
+    };
+
+    static constexpr unsigned ringEntries = 4096;
+    static constexpr unsigned bufferCount = 2048;
+    static constexpr unsigned bufferSize = 4096;
+    static constexpr unsigned maxCompletionsPerWait = 256;
+
+private:
+    EventCallback callback;
+    IoUring ring;       // Submitted to by the reactor thread only, its requests end with the thread
+    int wakeFd;         // eventfd signalled when another thread added a socket or the reactor is stopped
+    std::atomic<bool> running;
+    std::thread reactorThread;
+
+    // Sockets added by other threads, watched once the reactor thread wakes up. Listeners are added with 0 events.
+    std::mutex pendingMutex;
+    std::vector<std::pair<int, uint32_t>> pendingSockets;
+
+    // Generation of each watched descriptor. Completions of an older generation belong to a removed socket,
+    // possibly one whose descriptor number was reused since. Reactor thread only.
+    std::vector<uint32_t> generations;
+
+public:
+    explicit IoUringReactor(EventCallback callback);
+    ~IoUringReactor() override;
+
+    IoUringReactor(const IoUringReactor&) = delete;
+    IoUringReactor& operator=(const IoUringReactor&) = delete;
+
+    /**
+     * @returns True if the kernel has multishot receives and provided buffer rings (Linux 6.0)
+    */
+    [[nodiscard]] static bool isSupported() { return IoUring::isSupported(); }
+
+    [[nodiscard]] bool start(int cpu = -1) override;
+    void stop() override;
+    [[nodiscard]] bool add(int fd, uint32_t events) override;
+    [[nodiscard]] bool addListener(int fd) override;
+    void remove(int fd) override;
+
+private:
+    void run();
+
+    /**
+     * Arms the socket's requests, a readability poll if events is 0. Reactor thread only.
+    */
+    void watch(int fd, uint32_t events);
+
+    void armReceive(int fd, uint32_t generation);
+    void armPoll(RequestKind kind, int fd, uint32_t generation);
+    void armWake();
+    void cancel(uint64_t userData);
+
+    /**
+     * @returns A submission entry, submitting what is queued first if the ring is full
+    */
+    io_uring_sqe* getSubmission();
+
+    void handleCompletion(const io_uring_cqe& completion);
+    void handleWake();
+
+    [[nodiscard]] bool isCurrent(int fd, uint32_t generation) const;
+};
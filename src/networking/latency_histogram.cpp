@@ -0,0 +1,118 @@
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+#include "latency_histogram.h"
+
+LatencyHistogram::LatencyHistogram()
+    : count(0), sum(0), max(0)
+{
+    for (std::atomic<uint64_t>& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+std::size_t LatencyHistogram::getBucketIndex(uint64_t value)
+{
+    value = std::min(value, maxValue);
+    if (value < subBucketCount)
+        return static_cast<std::size_t>(value);
+
+    // Shifting the value down to subBucketBits + 1 bits leaves the sub-bucket with its top bit set
+    unsigned int bits = 64 - static_cast<unsigned int>(__builtin_clzll(value));
+    unsigned int shift = bits - subBucketBits - 1;
+    uint64_t subBucket = (value >> shift) - subBucketCount;
+    return static_cast<std::size_t>(subBucketCount + shift * subBucketCount + subBucket);
+}
+
+uint64_t LatencyHistogram::getBucketLimit(std::size_t index)
+{
+    if (index < subBucketCount)
+        return index;
+
+    uint64_t shift = (index - subBucketCount) / subBucketCount;
+    uint64_t subBucket = subBucketCount + (index - subBucketCount) % subBucketCount;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros)
+{
+    buckets[getBucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(micros, std::memory_order_relaxed);
+
+    uint64_t previous = max.load(std::memory_order_relaxed);
+    while (micros > previous && !max.compare_exchange_weak(previous, micros, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    if (end < start)
+        return;
+
+    record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other)
+{
+    for (std::size_t i = 0; i < bucketCount; i++)
+    {
+        if (uint64_t values = other.buckets[i].load(std::memory_order_relaxed))
+            buckets[i].fetch_add(values, std::memory_order_relaxed);
+    }
+
+    count.fetch_add(other.getCount(), std::memory_order_relaxed);
+    sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    uint64_t otherMax = other.getMax();
+    uint64_t previous = max.load(std::memory_order_relaxed);
+    while (otherMax > previous && !max.compare_exchange_weak(previous, otherMax, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const
+{
+    const uint64_t total = getCount();
+    if (total == 0)
+        return 0;
+
+    // The rank of the value we are after, the first one for the 0th percentile
+    double share = std::clamp(percentile, 0.0, 100.0) / 100.0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(share * static_cast<double>(total))));
+
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucketCount; i++)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(getBucketLimit(i), getMax());
+    }
+
+    // Recordings that raced with us counted in total but not in the buckets yet
+    return getMax();
+}
+
+LatencySummary LatencyHistogram::getSummary() const
+{
+    LatencySummary summary;
+    summary.count = getCount();
+    summary.p50 = getPercentile(50);
+    summary.p90 = getPercentile(90);
+    summary.p99 = getPercentile(99);
+    summary.max = getMax();
+    return summary;
+}
+
+void LatencyHistogram::appendMetrics(std::string& out, std::string_view name) const
+{
+    const std::string metric(name);
+    out += "# TYPE " + metric + " summary\n";
+    const std::pair<const char*, double> quantiles[] = {{"0.5", 50}, {"0.9", 90}, {"0.99", 99}};
+    for (const auto& [quantile, percentile] : quantiles)
+        out += metric + "{quantile=\"" + quantile + "\"} " + std::to_string(getPercentile(percentile)) + "\n";
+
+    out += metric + "_sum " + std::to_string(sum.load(std::memory_order_relaxed)) + "\n";
+    out += metric + "_count " + std::to_string(getCount()) + "\n";
+}
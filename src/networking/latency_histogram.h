@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <chrono>
+
+/**
+ * @returns Microseconds since the Unix epoch. Heartbeats and the times the server sequenced ops at are stamped
+ * with it, so the two sides can compare them once the clock offset between them is known.
+*/
+inline uint64_t getWallClockMicros()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// Percentiles of a histogram in microseconds
+struct LatencySummary
+{
+    uint64_t count = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t max = 0;
+};
+
+/**
+ * Histogram of latencies in microseconds with buckets in the style of HdrHistogram: values below
+ * subBucketCount each get a bucket, above that every power of two is split into subBucketCount buckets of
+ * equal width. Percentiles are accurate to within 1 / subBucketCount of the value however far apart the
+ * recorded values are, and the histogram never grows.
+ *
+ * Recording is lock-free and does not allocate, so any thread may record while another one reads. A reader
+ * racing with a recording may see it in some counts but not yet in others.
+*/
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned int subBucketBits = 5;
+    static constexpr uint64_t subBucketCount = uint64_t(1) << subBucketBits;
+
+    // Larger values, about 12 days, are recorded as this
+    static constexpr uint64_t maxValue = (uint64_t(1) << 40) - 1;
+
+private:
+    static constexpr std::size_t bucketCount = subBucketCount + (40 - subBucketBits) * subBucketCount;
+
+    std::atomic<uint64_t> buckets[bucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+public:
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t micros);
+
+    /**
+     * Records the time elapsed between two points of the steady clock, nothing if end is before start.
+    */
+    void record(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    /**
+     * Adds everything another histogram recorded, e.g. to report the latencies of many clients together.
+    */
+    void add(const LatencyHistogram& other);
+
+    [[nodiscard]] uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getMax() const { return max.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getSum() const { return sum.load(std::memory_order_relaxed); }
+
+    /**
+     * @param percentile Between 0 and 100
+     * @returns The value at or below which the given share of the recorded values lies, 0 if none were recorded
+    */
+    [[nodiscard]] uint64_t getPercentile(double percentile) const;
+
+    [[nodiscard]] LatencySummary getSummary() const;
+
+    /**
+     * Appends the histogram in the Prometheus text format as a summary with the 50th, 90th and 99th percentile.
+     * @param name Metric name, e.g. reped_client_round_trip_microseconds
+    */
+    void appendMetrics(std::string& out, std::string_view name) const;
+
+    /**
+     * @returns Index of the bucket holding the value
+    */
+    [[nodiscard]] static std::size_t getBucketIndex(uint64_t value);
+
+    /**
+     * @returns Largest value the bucket holds
+    */
+    [[nodiscard]] static uint64_t getBucketLimit(std::size_t index);
+};
@@ -0,0 +1,176 @@
+#include <cstring>
+
+#include "lz4.h"
+
+namespace
+{
+    constexpr unsigned hashLog = 12;
+
+    // Scanning speeds up the longer no match was found, so data that does not compress passes quickly
+    constexpr unsigned skipShift = 6;
+
+    uint32_t read32(const unsigned char* bytes)
+    {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    uint32_t hash(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - hashLog);
+    }
+
+    unsigned char* writeLength(unsigned char* out, std::size_t length)
+    {
+        while (length >= 255)
+        {
+            *out++ = 255;
+            length -= 255;
+        }
+
+        *out++ = static_cast<unsigned char>(length);
+        return out;
+    }
+
+    /**
+     * @param matchLength 0 for the literals that end the block
+    */
+    unsigned char* writeSequence(unsigned char* out, const unsigned char* literals, std::size_t literalLength,
+                                 std::size_t offset, std::size_t matchLength)
+    {
+        unsigned char* token = out++;
+        *token = static_cast<unsigned char>((literalLength < 15 ? literalLength : 15) << 4);
+        if (literalLength >= 15)
+            out = writeLength(out, literalLength - 15);
+
+        memcpy(out, literals, literalLength);
+        out += literalLength;
+
+        if (matchLength == 0)
+            return out;
+
+        *out++ = static_cast<unsigned char>(offset & 0xFF);
+        *out++ = static_cast<unsigned char>(offset >> 8);
+
+        std::size_t extra = matchLength - Lz4::minMatch;
+        *token |= static_cast<unsigned char>(extra < 15 ? extra : 15);
+        if (extra >= 15)
+            out = writeLength(out, extra - 15);
+
+        return out;
+    }
+
+    /**
+     * Reads the bytes continuing a length of 15.
+     * @returns False if the block ended before the length did
+    */
+    bool readLength(const unsigned char*& in, const unsigned char* end, std::size_t& length)
+    {
+        unsigned char byte;
+        do
+        {
+            if (in == end)
+                return false;
+
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+
+        return true;
+    }
+}
+
+std::size_t Lz4::compress(const char* source, std::size_t size, char* out)
+{
+    const auto* in = reinterpret_cast<const unsigned char*>(source);
+    auto* output = reinterpret_cast<unsigned char*>(out);
+    unsigned char* op = output;
+
+    std::size_t anchor = 0;     // Start of the literals not written yet
+    if (size > matchStartLimit)
+    {
+        // Positions of the last 4-byte sequences seen, by hash. Stale or colliding entries are caught by comparing.
+        uint32_t table[1 << hashLog] = {};
+
+        const std::size_t matchEnd = size - lastLiterals;
+        std::size_t pos = 1;
+        table[hash(read32(in))] = 0;
+        while (pos < size - matchStartLimit)
+        {
+            const uint32_t sequence = read32(in + pos);
+            const uint32_t h = hash(sequence);
+            const std::size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(pos);
+
+            if (candidate >= pos || pos - candidate > maxOffset || read32(in + candidate) != sequence)
+            {
+                pos += 1 + ((pos - anchor) >> skipShift);
+                continue;
+            }
+
+            std::size_t matchLength = minMatch;
+            while (pos + matchLength < matchEnd && in[candidate + matchLength] == in[pos + matchLength])
+                matchLength++;
+
+            op = writeSequence(op, in + anchor, pos - anchor, pos - candidate, matchLength);
+            pos += matchLength;
+            anchor = pos;
+        }
+    }
+
+    op = writeSequence(op, in + anchor, size - anchor, 0, 0);
+    return static_cast<std::size_t>(op - output);
+}
+
+bool Lz4::decompress(const char* source, std::size_t size, char* out, std::size_t rawSize)
+{
+    const auto* in = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* end = in + size;
+    auto* output = reinterpret_cast<unsigned char*>(out);
+    std::size_t written = 0;
+
+    while (in < end)
+    {
+        const unsigned char token = *in++;
+
+        std::size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(in, end, literalLength))
+            return false;
+        if (literalLength > static_cast<std::size_t>(end - in) || literalLength > rawSize - written)
+            return false;
+
+        memcpy(output + written, in, literalLength);
+        in += literalLength;
+        written += literalLength;
+
+        // The last sequence has no match
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return false;
+
+        const std::size_t offset = in[0] | (static_cast<std::size_t>(in[1]) << 8);
+        in += 2;
+        if (offset == 0 || offset > written)
+            return false;
+
+        std::size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(in, end, matchLength))
+            return false;
+
+        matchLength += minMatch;
+        if (matchLength > rawSize - written)
+            return false;
+
+        // Byte by byte, a match may overlap the bytes it produces
+        const unsigned char* match = output + written - offset;
+        for (std::size_t i = 0; i < matchLength; i++)
+            output[written + i] = match[i];
+
+        written += matchLength;
+    }
+
+    return written == rawSize;
+}
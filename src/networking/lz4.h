@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+/**
+ * Codec for the LZ4 block format: a series of sequences, each a token, literal bytes copied as they are and a
+ * match copied from up to 64 KiB back in the output. Fast enough to compress every large frame on the shard
+ * thread, and text usually shrinks to a third.
+ *
+ *   token               upper 4 bits literal length, lower 4 bits match length - 4; 15 means more bytes follow
+ *   [length bytes]      added to the literal length until one is below 255
+ *   literals
+ *   offset              2 bytes little-endian, not present after the last literals
+ *   [length bytes]      added to the match length the same way
+ *
+ * Blocks are independent, a match never reaches into an earlier block.
+*/
+class Lz4
+{
+public:
+    // The last match ends at least this many bytes before the end of a block, the rest are literals
+    static constexpr std::size_t lastLiterals = 5;
+
+    // Matches start at least this many bytes before the end of a block
+    static constexpr std::size_t matchStartLimit = 12;
+
+    static constexpr std::size_t minMatch = 4;
+    static constexpr std::size_t maxOffset = 65535;
+
+    /**
+     * @returns Most bytes compress() writes for a block of the given size, for data that does not compress
+    */
+    [[nodiscard]] static constexpr std::size_t getMaxCompressedSize(std::size_t size) { return size + size / 255 + 16; }
+
+    /**
+     * @param out Room for getMaxCompressedSize(size) bytes
+     * @returns Bytes written
+    */
+    static std::size_t compress(const char* source, std::size_t size, char* out);
+
+    /**
+     * @param rawSize Exact size of the decompressed block
+     * @returns False if the block is malformed or does not decompress to exactly rawSize bytes
+    */
+    [[nodiscard]] static bool decompress(const char* source, std::size_t size, char* out, std::size_t rawSize);
+};
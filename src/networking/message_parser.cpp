@@ -1,59 +1,409 @@
-#include <sstream>
+#include <string_view>
 #include <vector>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
 
 #include "message_parser.h"
 
-ParsedMessage MessageParser::parseMessage(const std::string& msg)
+namespace
 {
-    ParsedMessage parsedMsg;
-    parsedMsg.content = msg;
+    /**
+     * Parses the unsigned number starting at pos and ending at the next ':'.
+     * @returns False if there is no such number. On success pos points past the ':'.
+    */
+    bool parseNumberField(const std::string& msg, std::size_t& pos, uint64_t& value)
+    {
+        std::size_t end = msg.find(':', pos);
+        if (end == std::string::npos || end == pos)
+            return false;
+
+        for (std::size_t i = pos; i < end; i++)
+        {
+            if (msg[i] < '0' || msg[i] > '9')
+                return false;
+        }
 
-    std::istringstream iss(msg);
-    std::string token;
-    std::vector<std::string> parts;
+        // strtoull() saturates instead of failing on numbers past 64 bits
+        errno = 0;
+        value = std::strtoull(msg.c_str() + pos, nullptr, 10);
+        if (errno == ERANGE)
+            return false;
+
+        pos = end + 1;
+        return true;
+    }
 
-    while (std::getline(iss, token, ':'))
-        parts.push_back(token);
-    
-    if (parts.empty())
+    /**
+     * Splits off the field up to the next ':', or the rest if there is none.
+    */
+    std::string_view takeField(std::string_view& fields)
     {
-        parsedMsg.type = MessageType::UNKNOWN;
-        parsedMsg.clientId = "UNKNOWN";
-        return parsedMsg;
+        std::size_t end = fields.find(':');
+        std::string_view field = fields.substr(0, end);
+        fields = end == std::string_view::npos ? std::string_view() : fields.substr(end + 1);
+        return field;
     }
 
-    if (parts[0] == "CONNECTED")
+    /**
+     * @returns False if the field is not a number
+    */
+    bool parseNumber(std::string_view field, uint64_t& value)
     {
-        parsedMsg.type = MessageType::CONNECTED;
-        parsedMsg.clientId = parts[1];
+        if (field.empty() || field.size() > 20 || field.find_first_not_of("0123456789") != std::string_view::npos)
+            return false;
+
+        errno = 0;
+        value = std::strtoull(std::string(field).c_str(), nullptr, 10);
+        return errno != ERANGE;
+    }
+
+    /**
+     * Protocols newer than ours are answered with ours, the server settles on the lower one anyway.
+    */
+    WireProtocol toWireProtocol(uint64_t version)
+    {
+        return static_cast<WireProtocol>(std::clamp<uint64_t>(version, static_cast<uint64_t>(WireProtocol::TEXT),
+                                                              static_cast<uint64_t>(latestWireProtocol)));
+    }
+
+    /**
+     * Parses a message of the form prefix:docVersion:payload.
+    */
+    bool parseVersionedMessage(const std::string& prefix, const std::string& msg, uint64_t& docVersion, std::string& payload)
+    {
+        if (msg.compare(0, prefix.size(), prefix) != 0)
+            return false;
+
+        std::size_t pos = prefix.size();
+        if (!parseNumberField(msg, pos, docVersion))
+            return false;
+
+        payload = msg.substr(pos);
+        return true;
+    }
+}
+
+ParsedMessage MessageParser::parseMessage(std::string_view msg)
+{
+    ParsedMessage parsedMsg;
+    parsedMsg.type = MessageType::UNKNOWN;
+    parsedMsg.clientId = "UNKNOWN";
+
+    if (WireCodec::isAck(msg))
+    {
+        parsedMsg.type = MessageType::ACK;
+        parsedMsg.content = std::string(msg);
         return parsedMsg;
     }
 
-    if (parts[0] == "INIT_DOCUMENT")
+    if (WireCodec::isBinary(msg))
     {
-        parsedMsg.type = MessageType::INIT_DOCUMENT;
-        parsedMsg.clientId = "UNKNOWN";
+        WireOperationView view;
+        if (WireCodec::decode(msg, view))
+        {
+            parsedMsg.type = MessageType::OPERATION;
+            parsedMsg.clientId = std::string(view.clientId);
+            parsedMsg.operation = WireCodec::toOperation(view);
+            parsedMsg.sequencedAt = view.sequencedAt;
+        }
+
         return parsedMsg;
     }
 
-    if (parts[0] == "INSERT" || parts[0] == "DELETE")
+    parsedMsg.content = std::string(msg);
+
+    // Only the leading fields are split off, the rest can be a whole document
+    std::string_view fields = msg;
+    std::string_view type = takeField(fields);
+    bool hasClientId = type.size() < msg.size() && !fields.empty();
+
+    if (type == "CONNECTED" && hasClientId)
+    {
+        parsedMsg.type = MessageType::CONNECTED;
+        parsedMsg.clientId = std::string(takeField(fields));
+
+        // Clients that do not name a document join the default one
+        std::string_view documentName = takeField(fields);
+        parsedMsg.documentName = documentName.empty() ? defaultDocumentName : std::string(documentName);
+
+        // Reconnecting clients tell us which version they already have
+        uint64_t knownVersion = 0;
+        if (parseNumber(takeField(fields), knownVersion))
+            parsedMsg.knownVersion = knownVersion;
+
+        uint64_t wireProtocol = 0;
+        if (parseNumber(takeField(fields), wireProtocol))
+            parsedMsg.wireProtocol = toWireProtocol(wireProtocol);
+    }
+    else if (type == "PROTOCOL")
+    {
+        uint64_t wireProtocol = 0;
+        if (parseNumber(takeField(fields), wireProtocol))
+        {
+            parsedMsg.type = MessageType::PROTOCOL;
+            parsedMsg.wireProtocol = toWireProtocol(wireProtocol);
+        }
+    }
+    else if (type == "INIT_DOCUMENT")
+    {
+        parsedMsg.type = MessageType::INIT_DOCUMENT;
+    }
+    else if (type == "INIT_CRDT")
+    {
+        parsedMsg.type = MessageType::INIT_CRDT;
+    }
+    else if (type == "INIT_BEGIN")
+    {
+        parsedMsg.type = MessageType::INIT_BEGIN;
+    }
+    else if (type == "INIT_CHUNK")
+    {
+        parsedMsg.type = MessageType::INIT_CHUNK;
+    }
+    else if (type == "CATCH_UP")
+    {
+        parsedMsg.type = MessageType::CATCH_UP;
+    }
+    else if ((type == "PRESENCE" || type == "PRESENCE_LEFT") && hasClientId)
+    {
+        parsedMsg.type = type == "PRESENCE" ? MessageType::PRESENCE : MessageType::PRESENCE_LEFT;
+        parsedMsg.clientId = std::string(takeField(fields));
+    }
+    else if (type == "PING" || type == "PONG")
+    {
+        parsedMsg.type = type == "PING" ? MessageType::PING : MessageType::PONG;
+    }
+    else if (type == "ACK")
+    {
+        parsedMsg.type = MessageType::ACK;
+    }
+    else if ((type == "INSERT" || type == "DELETE" || type == "CRDT_INSERT" || type == "CRDT_DELETE") && hasClientId)
     {
         parsedMsg.type = MessageType::OPERATION;
-        parsedMsg.clientId = parts[1];
-        return parsedMsg;
+        parsedMsg.clientId = std::string(takeField(fields));
+
+        std::unique_ptr<Operation> operation = Operation::deserialize(parsedMsg.content);
+        if (operation)
+            parsedMsg.operation.reset(static_cast<TextOperation*>(operation.release()));
+
+        parsedMsg.content.clear();
     }
 
-    parsedMsg.type = MessageType::UNKNOWN;
-    parsedMsg.clientId = "UNKNOWN";
     return parsedMsg;
 }
 
-std::string MessageParser::createInitDocumentMessage(const std::string& docText)
+std::string MessageParser::createInitDocumentMessage(uint64_t docVersion, const std::string& docText)
+{
+    return createInitDocumentPrefix(docVersion) + docText;
+}
+
+std::string MessageParser::createInitDocumentPrefix(uint64_t docVersion)
+{
+    return "INIT_DOCUMENT:" + std::to_string(docVersion) + ":";
+}
+
+std::string MessageParser::createInitCrdtMessage(uint64_t docVersion, const std::string& state)
+{
+    return createInitCrdtPrefix(docVersion) + state;
+}
+
+std::string MessageParser::createInitCrdtPrefix(uint64_t docVersion)
+{
+    return "INIT_CRDT:" + std::to_string(docVersion) + ":";
+}
+
+std::string MessageParser::createInitBeginMessage(uint64_t docVersion, std::size_t length)
 {
-    return "INIT_DOCUMENT:" + docText;
+    return "INIT_BEGIN:" + std::to_string(docVersion) + ":" + std::to_string(length);
 }
 
-std::string MessageParser::createConnectedMessage(const std::string& clientId)
+std::string MessageParser::createConnectedMessage(const std::string& clientId, const std::string& documentName, std::optional<uint64_t> knownVersion,
+                                                  WireProtocol wireProtocol)
 {
-    return "CONNECTED:" + clientId;
+    std::string msg = "CONNECTED:" + clientId + ":" + documentName;
+    if (knownVersion || wireProtocol != WireProtocol::TEXT)
+        msg += ":" + (knownVersion ? std::to_string(*knownVersion) : std::string());
+    if (wireProtocol != WireProtocol::TEXT)
+        msg += ":" + std::to_string(static_cast<unsigned int>(wireProtocol));
+
+    return msg;
+}
+
+std::string MessageParser::createProtocolMessage(WireProtocol wireProtocol)
+{
+    return "PROTOCOL:" + std::to_string(static_cast<unsigned int>(wireProtocol));
+}
+
+std::string MessageParser::createCatchUpMessage(uint64_t docVersion, const std::vector<std::string>& operations)
+{
+    std::string msg = "CATCH_UP:" + std::to_string(docVersion) + ":" + std::to_string(operations.size()) + ":";
+    for (const std::string& operation : operations)
+    {
+        msg += std::to_string(operation.size());
+        msg += ':';
+        msg += operation;
+    }
+
+    return msg;
+}
+
+bool MessageParser::parseInitDocumentMessage(const std::string& msg, uint64_t& docVersion, std::string& docText)
+{
+    return parseVersionedMessage("INIT_DOCUMENT:", msg, docVersion, docText);
+}
+
+bool MessageParser::parseInitCrdtMessage(const std::string& msg, uint64_t& docVersion, std::string& state)
+{
+    return parseVersionedMessage("INIT_CRDT:", msg, docVersion, state);
+}
+
+bool MessageParser::parseInitBeginMessage(const std::string& msg, uint64_t& docVersion, uint64_t& length)
+{
+    std::string payload;
+    return parseVersionedMessage("INIT_BEGIN:", msg, docVersion, payload) && parseNumber(payload, length);
+}
+
+bool MessageParser::parseCatchUpMessage(const std::string& msg, uint64_t& docVersion, std::vector<std::string>& operations)
+{
+    const std::string prefix = "CATCH_UP:";
+    if (msg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+    std::size_t pos = prefix.size();
+    uint64_t count = 0;
+    if (!parseNumberField(msg, pos, docVersion) || !parseNumberField(msg, pos, count))
+        return false;
+
+    operations.clear();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t length = 0;
+        if (!parseNumberField(msg, pos, length) || length > msg.size() - pos)
+            return false;
+
+        operations.emplace_back(msg, pos, length);
+        pos += length;
+    }
+
+    return pos == msg.size();
+}
+
+std::string MessageParser::createPresenceMessage(const std::string& clientId, uint64_t docVersion, const Presence& presence)
+{
+    return "PRESENCE:" + clientId + ":" + std::to_string(docVersion) + ":" + std::to_string(presence.cursor) + ":" +
+        std::to_string(presence.selectionStart) + ":" + std::to_string(presence.selectionEnd);
+}
+
+std::string MessageParser::createPresenceLeftMessage(const std::string& clientId)
+{
+    return "PRESENCE_LEFT:" + clientId;
+}
+
+bool MessageParser::parsePresenceMessage(const std::string& msg, std::string& clientId, uint64_t& docVersion, Presence& presence)
+{
+    const std::string prefix = "PRESENCE:";
+    if (msg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+    std::size_t pos = prefix.size();
+    std::size_t clientIdEnd = msg.find(':', pos);
+    if (clientIdEnd == std::string::npos)
+        return false;
+
+    clientId = msg.substr(pos, clientIdEnd - pos);
+    pos = clientIdEnd + 1;
+
+    // Terminate the last field like the others so it parses the same way
+    std::string fields = msg.substr(pos) + ":";
+    std::size_t fieldPos = 0;
+    uint64_t cursor = 0;
+    uint64_t selectionStart = 0;
+    uint64_t selectionEnd = 0;
+    if (!parseNumberField(fields, fieldPos, docVersion) || !parseNumberField(fields, fieldPos, cursor) ||
+        !parseNumberField(fields, fieldPos, selectionStart) || !parseNumberField(fields, fieldPos, selectionEnd) ||
+        fieldPos != fields.size())
+        return false;
+
+    presence.cursor = cursor;
+    presence.selectionStart = selectionStart;
+    presence.selectionEnd = selectionEnd;
+    return true;
+}
+
+std::string MessageParser::createPingMessage(uint64_t sentTime, std::optional<uint64_t> knownVersion, uint64_t unsentOperations)
+{
+    std::string msg = "PING:" + std::to_string(sentTime);
+    if (knownVersion)
+        msg += ":" + std::to_string(*knownVersion) + ":" + std::to_string(unsentOperations);
+
+    return msg;
+}
+
+std::string MessageParser::createPongMessage(uint64_t sentTime, uint64_t serverTime)
+{
+    return "PONG:" + std::to_string(sentTime) + ":" + std::to_string(serverTime);
+}
+
+bool MessageParser::parsePingMessage(const std::string& msg, uint64_t& sentTime, std::optional<uint64_t>& knownVersion,
+                                     uint64_t& unsentOperations)
+{
+    const std::string prefix = "PING:";
+    if (msg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+    knownVersion.reset();
+    unsentOperations = 0;
+    if (msg.find(':', prefix.size()) == std::string::npos)
+        return parseNumber(std::string_view(msg).substr(prefix.size()), sentTime);
+
+    const std::string fields = msg.substr(prefix.size()) + ":";
+    std::size_t pos = 0;
+    uint64_t version = 0;
+    if (!parseNumberField(fields, pos, sentTime) || !parseNumberField(fields, pos, version) ||
+        !parseNumberField(fields, pos, unsentOperations) || pos != fields.size())
+        return false;
+
+    knownVersion = version;
+    return true;
+}
+
+bool MessageParser::parsePongMessage(const std::string& msg, uint64_t& sentTime, uint64_t& serverTime)
+{
+    std::string payload;
+    return parseVersionedMessage("PONG:", msg, sentTime, payload) && parseNumber(payload, serverTime);
+}
+
+std::string MessageParser::createAckMessage(uint64_t docVersion, uint64_t operations, uint64_t sequencedAt, WireProtocol protocol)
+{
+    if (protocol != WireProtocol::TEXT)
+    {
+        std::string ack;
+        WireCodec::encodeAck(docVersion, operations, sequencedAt, ack);
+        return ack;
+    }
+
+    std::string msg = "ACK:" + std::to_string(docVersion) + ":" + std::to_string(operations);
+    if (sequencedAt != 0)
+        msg += ":" + std::to_string(sequencedAt);
+
+    return msg;
+}
+
+bool MessageParser::parseAckMessage(const std::string& msg, uint64_t& docVersion, uint64_t& operations, uint64_t& sequencedAt)
+{
+    if (WireCodec::isBinary(msg))
+        return WireCodec::decodeAck(msg, docVersion, operations, sequencedAt);
+
+    const std::string prefix = "ACK:";
+    if (msg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+    sequencedAt = 0;
+    const std::string fields = msg.substr(prefix.size()) + ":";
+    std::size_t pos = 0;
+    if (!parseNumberField(fields, pos, docVersion) || !parseNumberField(fields, pos, operations))
+        return false;
+
+    return pos == fields.size() || (parseNumberField(fields, pos, sequencedAt) && pos == fields.size());
 }
@@ -1,27 +1,184 @@
 #pragma once
 
+#include <stdint.h>
 #include <string>
 #include <string_view>
+#include <vector>
+#include <optional>
+#include <memory>
+
+#include "../text_engine/presence.h"
+#include "../text_engine/operations.h"
+#include "wire_codec.h"
+
+// Document joined by clients that do not name one in their CONNECTED message
+inline const std::string defaultDocumentName = "default";
 
 enum class MessageType
 {
     UNKNOWN,
-    CONNECTED,      // CONNECTED:clientId
+    CONNECTED,      // CONNECTED:clientId:documentName[:knownVersion[:wireProtocol]], knownVersion may be empty
+    PROTOCOL,       // PROTOCOL:wireProtocol, the server's choice, sent before the document
     OPERATION,      // INSERT:clientId:operationId:docVersion:pos:text OR DELETE:clientId:operationId:docVersion:pos:length
-    INIT_DOCUMENT   // INIT_DOCUMENT:text
+                    // OR CRDT_INSERT / CRDT_DELETE, see CrdtInsertOperation and CrdtDeleteOperation
+                    // OR any of them binary encoded, see WireCodec
+    INIT_DOCUMENT,  // INIT_DOCUMENT:docVersion:text
+    INIT_CRDT,      // INIT_CRDT:docVersion:state, the encoded CrdtSequence followed by the text
+    INIT_BEGIN,     // INIT_BEGIN:docVersion:length, INIT_CHUNK messages with length bytes of text in total follow
+    INIT_CHUNK,     // INIT_CHUNK:text, the next part of the document announced by INIT_BEGIN
+    CATCH_UP,       // CATCH_UP:docVersion:count:(length:operation)*
+    PRESENCE,       // PRESENCE:clientId:docVersion:cursor:selectionStart:selectionEnd
+    PRESENCE_LEFT,  // PRESENCE_LEFT:clientId
+    PING,           // PING:sentTime[:knownVersion:unsentOperations], a heartbeat stamped with the client's steady clock
+                    // in microseconds, and how far the client got applying ops
+    PONG,           // PONG:sentTime:serverTime, the ping's time and the server's wall clock in microseconds since the epoch
+    ACK             // ACK:docVersion:operations[:sequencedAt], sent to a client instead of its own ops: the first operations
+                    // ops it sent on the connection are sequenced, the last one at docVersion. Binary connections get
+                    // the same fields as varints, see WireCodec::encodeAck
 };
 
 struct ParsedMessage
 {
     MessageType type;
-    std::string content;
+    std::string content;    // The whole message, left empty for ops which are decoded into operation instead
     std::string clientId;
+    std::string documentName;
+    std::optional<uint64_t> knownVersion;
+
+    // Highest protocol the sender of a CONNECTED message speaks, or the server's choice in a PROTOCOL message
+    WireProtocol wireProtocol = WireProtocol::TEXT;
+
+    // Decoded op of an OPERATION message, null if it is malformed
+    std::unique_ptr<TextOperation> operation;
+
+    // Wall-clock microseconds the server sequenced the op at, 0 unless the connection speaks WireProtocol::TIMED
+    uint64_t sequencedAt = 0;
+
+    /**
+     * @returns The message as text for logs
+    */
+    [[nodiscard]] std::string toDisplayString() const
+    {
+        return operation ? operation->serialize() : content;
+    }
 };
 
 class MessageParser
 {
 public:
-    static ParsedMessage parseMessage(const std::string& msg);
-    static std::string createInitDocumentMessage(const std::string& docText);
-    static std::string createConnectedMessage(const std::string& clientId);
+    /**
+     * Parses a text or binary message. Ops are decoded right away, so the message is parsed only once.
+    */
+    static ParsedMessage parseMessage(std::string_view msg);
+    static std::string createInitDocumentMessage(uint64_t docVersion, const std::string& docText);
+    static std::string createInitCrdtMessage(uint64_t docVersion, const std::string& state);
+
+    /**
+     * @returns The start of an INIT_DOCUMENT or INIT_CRDT message, the text or state follows it. For building the
+     * message in pieces, e.g. while compressing it.
+    */
+    static std::string createInitDocumentPrefix(uint64_t docVersion);
+    static std::string createInitCrdtPrefix(uint64_t docVersion);
+
+    /**
+     * Starts a document sent in chunks, for clients that speak WireProtocol::STREAMED.
+     * @param length Bytes of text the INIT_CHUNK messages carry in total
+    */
+    static std::string createInitBeginMessage(uint64_t docVersion, std::size_t length);
+
+    // An INIT_CHUNK message is this prefix followed by the text
+    static constexpr std::string_view initChunkPrefix = "INIT_CHUNK:";
+
+    /**
+     * @returns False if the message is not a well-formed INIT_BEGIN message.
+    */
+    [[nodiscard]] static bool parseInitBeginMessage(const std::string& msg, uint64_t& docVersion, uint64_t& length);
+
+    /**
+     * @returns The text of an INIT_CHUNK message, a view into the message
+    */
+    [[nodiscard]] static std::string_view getInitChunkText(std::string_view msg) { return msg.substr(initChunkPrefix.size()); }
+
+    /**
+     * @param wireProtocol Highest protocol the client speaks. TEXT leaves the field out, like older clients do.
+    */
+    static std::string createConnectedMessage(const std::string& clientId, const std::string& documentName,
+                                              std::optional<uint64_t> knownVersion = std::nullopt,
+                                              WireProtocol wireProtocol = WireProtocol::TEXT);
+    static std::string createProtocolMessage(WireProtocol wireProtocol);
+
+    /**
+     * Bundles the serialized ops a reconnecting client missed into one message. Each op is length-prefixed
+     * since op text may contain any character.
+     * @param docVersion Version the client is at after applying the ops
+    */
+    static std::string createCatchUpMessage(uint64_t docVersion, const std::vector<std::string>& operations);
+
+    /**
+     * @returns False if the message is not a well-formed INIT_DOCUMENT message.
+    */
+    [[nodiscard]] static bool parseInitDocumentMessage(const std::string& msg, uint64_t& docVersion, std::string& docText);
+
+    /**
+     * @returns False if the message is not a well-formed INIT_CRDT message.
+    */
+    [[nodiscard]] static bool parseInitCrdtMessage(const std::string& msg, uint64_t& docVersion, std::string& state);
+
+    /**
+     * @returns False if the message is not a well-formed CATCH_UP message.
+    */
+    [[nodiscard]] static bool parseCatchUpMessage(const std::string& msg, uint64_t& docVersion, std::vector<std::string>& operations);
+
+    /**
+     * @param docVersion Server version the positions refer to
+    */
+    static std::string createPresenceMessage(const std::string& clientId, uint64_t docVersion, const Presence& presence);
+    static std::string createPresenceLeftMessage(const std::string& clientId);
+
+    /**
+     * @returns False if the message is not a well-formed PRESENCE message.
+    */
+    [[nodiscard]] static bool parsePresenceMessage(const std::string& msg, std::string& clientId, uint64_t& docVersion, Presence& presence);
+
+    /**
+     * @param sentTime Client's steady clock in microseconds, echoed back in the PONG
+     * @param knownVersion Server version the client's text is at, unset while it does not have the document
+     * @param unsentOperations Edits of the client's own the server has not acknowledged yet
+    */
+    static std::string createPingMessage(uint64_t sentTime, std::optional<uint64_t> knownVersion = std::nullopt,
+                                         uint64_t unsentOperations = 0);
+
+    /**
+     * @param sentTime Time of the PING being answered
+     * @param serverTime Server's wall clock in microseconds since the epoch
+    */
+    static std::string createPongMessage(uint64_t sentTime, uint64_t serverTime);
+
+    /**
+     * @param knownVersion Unset if the client did not say
+     * @returns False if the message is not a well-formed PING message.
+    */
+    [[nodiscard]] static bool parsePingMessage(const std::string& msg, uint64_t& sentTime, std::optional<uint64_t>& knownVersion,
+                                               uint64_t& unsentOperations);
+
+    /**
+     * @returns False if the message is not a well-formed PONG message.
+    */
+    [[nodiscard]] static bool parsePongMessage(const std::string& msg, uint64_t& sentTime, uint64_t& serverTime);
+
+    /**
+     * @param docVersion Version the last acknowledged op was sequenced at
+     * @param operations Ops the client sent on its connection that are sequenced by now, counted from the first
+     * @param sequencedAt Wall-clock microseconds the last one was sequenced at, 0 to leave it out
+     * @param protocol Encoding of the connection, anything but TEXT gets the binary ACK
+    */
+    static std::string createAckMessage(uint64_t docVersion, uint64_t operations, uint64_t sequencedAt = 0,
+                                        WireProtocol protocol = WireProtocol::TEXT);
+
+    /**
+     * Parses either encoding.
+     * @param sequencedAt Set to 0 if the message does not carry it
+     * @returns False if the message is not a well-formed ACK message or a number does not fit in 64 bits.
+    */
+    [[nodiscard]] static bool parseAckMessage(const std::string& msg, uint64_t& docVersion, uint64_t& operations, uint64_t& sequencedAt);
 };
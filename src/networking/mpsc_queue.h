@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/**
+ * Unbounded lock-free multi-producer single-consumer queue (Vyukov style).
+ * Any thread may push. Only one thread may pop or check for emptiness.
+*/
+template <typename T>
+class MpscQueue
+{
+private:
+    struct Node
+    {
+        std::atomic<Node*> next;
+        T value;
+
+        Node()
+            : next(nullptr), value()
+        {}
+
+        explicit Node(T&& value)
+            : next(nullptr), value(std::move(value))
+        {}
+    };
+
+    alignas(64) std::atomic<Node*> head;
+    alignas(64) Node* tail;
+
+public:
+    MpscQueue()
+    {
+        Node* stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+
+    ~MpscQueue()
+    {
+        T discarded;
+        while (tryPop(discarded)) {}
+
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value)
+    {
+        Node* node = new Node(std::move(value));
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * Pops the oldest item. Consumer thread only.
+     * @returns False if the queue is empty or a push is still being linked in.
+    */
+    bool tryPop(T& out)
+    {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+
+        out = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+    /**
+     * Consumer thread only.
+    */
+    [[nodiscard]] bool empty() const
+    {
+        return tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+};
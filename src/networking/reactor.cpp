@@ -0,0 +1,133 @@
+#include <iostream>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "reactor.h"
+#include "io_uring_reactor.h"
+
+std::unique_ptr<Reactor> Reactor::create(ReactorBackend backend, EventCallback callback)
+{
+    if (backend == ReactorBackend::IO_URING)
+        return std::make_unique<IoUringReactor>(std::move(callback));
+
+    return std::make_unique<EpollReactor>(std::move(callback));
+}
+
+EpollReactor::EpollReactor(EventCallback callback)
+    : callback(std::move(callback)), epollFd(-1), wakeFd(-1), running(false)
+{
+}
+
+EpollReactor::~EpollReactor()
+{
+    stop();
+}
+
+bool EpollReactor::start(int cpu)
+{
+    if (running)
+        return true;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeFd == -1)
+    {
+        std::cerr << "EpollReactor: Failed to create epoll set\n";
+        stop();
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) == -1)
+    {
+        std::cerr << "EpollReactor: Failed to watch wake-up event\n";
+        stop();
+        return false;
+    }
+
+    running = true;
+    reactorThread = std::thread(&EpollReactor::run, this);
+
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        if (pthread_setaffinity_np(reactorThread.native_handle(), sizeof(cpuSet), &cpuSet) != 0)
+            std::cerr << "EpollReactor: Failed to pin thread to core " << cpu << "\n";
+    }
+#endif
+
+    return true;
+}
+
+void EpollReactor::stop()
+{
+    if (running)
+    {
+        running = false;
+
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+            std::cerr << "EpollReactor: Failed to wake reactor thread\n";
+
+        if (reactorThread.joinable())
+            reactorThread.join();
+    }
+
+    if (epollFd != -1)
+        close(epollFd);
+    if (wakeFd != -1)
+        close(wakeFd);
+
+    epollFd = -1;
+    wakeFd = -1;
+}
+
+bool EpollReactor::add(int fd, uint32_t events)
+{
+    struct epoll_event event = {};
+    event.events = events | EPOLLET | EPOLLRDHUP;
+    event.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+void EpollReactor::remove(int fd)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EpollReactor::run()
+{
+    struct epoll_event events[maxEventsPerWait];
+
+    while (running)
+    {
+        int count = epoll_wait(epollFd, events, maxEventsPerWait, -1);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            std::cerr << "EpollReactor: epoll_wait failed\n";
+            break;
+        }
+
+        for (int i = 0; i < count && running; i++)
+        {
+            if (events[i].data.fd == wakeFd)
+                continue;
+
+            callback(events[i].data.fd, events[i].events, std::string_view());
+        }
+    }
+}
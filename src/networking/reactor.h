@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <string_view>
+#include <sys/epoll.h>
+
+enum class ReactorBackend
+{
+    EPOLL,      // Readiness events, the callback reads and writes the socket itself
+    IO_URING    // Multishot receives into provided buffers; falls back to EPOLL on kernels before 6.0
+};
+
+/**
+ * One thread waiting on a set of non-blocking sockets and reporting their events. Events are edge-triggered, so
+ * the callback has to read or write until the socket would block or it will not hear from the socket again.
+*/
+class Reactor
+{
+public:
+    /**
+     * @param events EPOLL* flags. EPOLLHUP means the socket is not watched anymore and has to be dropped once
+     * what it sent before was handled.
+     * @param data Bytes the backend already received for the socket with EPOLLIN. Empty if the callback has to
+     * read them itself. Valid until the callback returns.
+    */
+    using EventCallback = std::function<void(int fd, uint32_t events, std::string_view data)>;
+
+    virtual ~Reactor() = default;
+
+    /**
+     * @returns A reactor of the backend, not started yet. Callers check IoUringReactor::isSupported() first.
+    */
+    static std::unique_ptr<Reactor> create(ReactorBackend backend, EventCallback callback);
+
+    /**
+     * @param cpu Core to pin the reactor thread to, or -1 to leave it unpinned.
+     * @returns False if the backend could not be set up
+    */
+    [[nodiscard]] virtual bool start(int cpu = -1) = 0;
+
+    /**
+     * Wakes the reactor thread and waits for it to return. No callback runs afterwards.
+    */
+    virtual void stop() = 0;
+
+    /**
+     * Watches a socket. Safe to call from any thread.
+     * @param events EPOLLIN, EPOLLOUT or both
+    */
+    [[nodiscard]] virtual bool add(int fd, uint32_t events) = 0;
+
+    /**
+     * Watches a listening socket. The callback gets EPOLLIN when connections are waiting to be accepted.
+    */
+    [[nodiscard]] virtual bool addListener(int fd) = 0;
+
+    /**
+     * Stops watching a socket. Called on the reactor thread. Events already collected may still be delivered
+     * until the callback returns.
+    */
+    virtual void remove(int fd) = 0;
+};
+
+/**
+ * Reactor waiting on an edge-triggered epoll set.
+*/
+class EpollReactor : public Reactor
+{
+public:
+    static constexpr int maxEventsPerWait = 256;
+
+private:
+    EventCallback callback;
+    int epollFd;
+    int wakeFd;     // eventfd that interrupts epoll_wait when the reactor is stopped
+    std::atomic<bool> running;
+    std::thread reactorThread;
+
+public:
+    explicit EpollReactor(EventCallback callback);
+    ~EpollReactor() override;
+
+    EpollReactor(const EpollReactor&) = delete;
+    EpollReactor& operator=(const EpollReactor&) = delete;
+
+    [[nodiscard]] bool start(int cpu = -1) override;
+    void stop() override;
+
+    /**
+     * @param events EPOLLIN, EPOLLOUT or both; EPOLLET and EPOLLRDHUP are added
+    */
+    [[nodiscard]] bool add(int fd, uint32_t events) override;
+    [[nodiscard]] bool addListener(int fd) override { return add(fd, EPOLLIN); }
+    void remove(int fd) override;
+
+private:
+    void run();
+};
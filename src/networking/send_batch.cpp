@@ -0,0 +1,123 @@
+#include <cerrno>
+#include <cstring>
+
+#include "send_batch.h"
+#include "connection.h"
+#include "io_uring.h"
+
+std::unique_ptr<SendBatch> SendBatch::create()
+{
+    if (!IoUring::isSupported())
+        return nullptr;
+
+    // Private constructor
+    std::unique_ptr<SendBatch> batch(new SendBatch());
+    batch->ring = std::make_unique<IoUring>();
+
+    // Every entry is submitted even if one of them fails, each failure completes with its own error
+    if (!batch->ring->init(maxBatchSize, IORING_SETUP_SUBMIT_ALL))
+        return nullptr;
+
+    batch->entries = std::make_unique<Entry[]>(maxBatchSize);
+    return batch;
+}
+
+SendBatch::~SendBatch()
+{
+    submit();
+}
+
+void SendBatch::add(Connection& connection, const SharedFrame& frame)
+{
+    if (entryCount == maxBatchSize)
+        submit();
+
+    std::unique_lock<std::mutex> lock(connection.sendMutex);
+    if (connection.failed)
+        return;
+
+    // Frames must not overtake queued ones
+    if (connection.hasQueuedBytesLocked())
+    {
+        (void)connection.enqueueLocked({frame, *frame}, 0);
+        return;
+    }
+
+    // Copying into shared memory needs no system call to batch
+    if (connection.usesSharedMemory())
+    {
+        (void)connection.sendLocked(frame);
+        return;
+    }
+
+    const unsigned index = entryCount++;
+    Entry& entry = entries[index];
+    entry.connection = &connection;
+    entry.lock = std::move(lock);
+    entry.frame = frame;
+    entry.part.iov_base = const_cast<char*>(frame->data());
+    entry.part.iov_len = frame->size();
+
+    memset(&entry.msg, 0, sizeof(entry.msg));
+    entry.msg.msg_iov = &entry.part;
+    entry.msg.msg_iovlen = 1;
+
+    // Room for every entry, the ring is as large as the batch
+    io_uring_sqe* sqe = ring->getSubmission();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = connection.socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&entry.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+    sqe->user_data = index;
+    ring->publish();
+}
+
+void SendBatch::submit()
+{
+    if (entryCount == 0)
+        return;
+
+    // Non-blocking sends complete while they are submitted, so this waits for nothing in practice
+    unsigned completed = 0;
+    int result = ring->submit(entryCount);
+    if (result < 0)
+    {
+        // Nothing went in, send them one by one instead
+        ring->discardUnsubmitted();
+        for (unsigned i = 0; i < entryCount; i++)
+        {
+            (void)entries[i].connection->sendLocked(entries[i].frame);
+            entries[i].frame.reset();
+            entries[i].lock.unlock();
+        }
+
+        entryCount = 0;
+        return;
+    }
+
+    io_uring_cqe completions[64];
+    while (completed < entryCount)
+    {
+        unsigned count = ring->takeCompletions(completions, 64);
+        if (count == 0)
+        {
+            (void)ring->submit(entryCount - completed);
+            continue;
+        }
+
+        for (unsigned i = 0; i < count; i++)
+        {
+            Entry& entry = entries[completions[i].user_data];
+            int res = completions[i].res;
+            ssize_t sent = res >= 0 ? res : (res == -EAGAIN || res == -EWOULDBLOCK ? 0 : -1);
+            (void)entry.connection->completeSendLocked(entry.frame, sent);
+            entry.frame.reset();
+            entry.lock.unlock();
+        }
+
+        completed += count;
+    }
+
+    entryCount = 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <mutex>
+#include <memory>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "framing.h"
+
+class Connection;
+class IoUring;
+
+/**
+ * Writes one frame to each of many connections with a single io_uring_enter instead of one sendmsg per
+ * connection. Sends complete or fail right away like Connection::send, what a socket does not take is queued on
+ * its connection. Owned by one thread, e.g. a sequencer shard broadcasting a batch.
+*/
+class SendBatch
+{
+public:
+    static constexpr unsigned maxBatchSize = 512;
+
+private:
+    struct Entry
+    {
+        Connection* connection;
+        std::unique_lock<std::mutex> lock;  // The connection's send lock, held until the send completed
+        SharedFrame frame;
+        struct iovec part;
+        struct msghdr msg;
+    };
+
+    std::unique_ptr<IoUring> ring;
+    std::unique_ptr<Entry[]> entries;
+    unsigned entryCount = 0;
+
+public:
+    /**
+     * @returns Null if the kernel has no io_uring
+    */
+    static std::unique_ptr<SendBatch> create();
+
+    ~SendBatch();
+
+    /**
+     * Adds a frame for a connection. Goes straight to the connection's queue if it already has bytes queued.
+     * A connection may only be added once per submit().
+    */
+    void add(Connection& connection, const SharedFrame& frame);
+
+    /**
+     * Sends everything added since the last call and waits for the sends to complete.
+    */
+    void submit();
+
+private:
+    SendBatch() = default;
+};
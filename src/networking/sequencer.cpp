@@ -0,0 +1,414 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "sequencer.h"
+#include "../text_engine/operations.h"
+#include "latency_histogram.h"
+
+Sequencer::Sequencer(std::size_t maxBatchSize)
+    : maxBatchSize(maxBatchSize), broadcastInterval(0), checkpointInterval(0), presenceInterval(0), running(false), parked(false),
+        operationsSequenced(0), batchesProcessed(0), largestBatch(0)
+{
+}
+
+Sequencer::~Sequencer()
+{
+    stop();
+}
+
+void Sequencer::start(int cpu)
+{
+    if (running)
+        return;
+
+    running = true;
+    sequencerThread = std::thread(&Sequencer::run, this);
+
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        if (pthread_setaffinity_np(sequencerThread.native_handle(), sizeof(cpuSet), &cpuSet) != 0)
+            std::cerr << "Sequencer: Failed to pin thread to core " << cpu << "\n";
+    }
+#endif
+}
+
+void Sequencer::stop()
+{
+    if (!running)
+        return;
+
+    running = false;
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        parkCondition.notify_one();
+    }
+
+    if (sequencerThread.joinable())
+        sequencerThread.join();
+}
+
+void Sequencer::submitOperation(ServerDocument* document, int clientSocket, std::unique_ptr<TextOperation> operation,
+                                uint64_t clientSequence)
+{
+    SequencerTask task;
+    task.type = SequencerTaskType::OPERATION;
+    task.document = document;
+    task.clientSocket = clientSocket;
+    task.operation = std::move(operation);
+    task.clientSequence = clientSequence;
+    submit(std::move(task));
+}
+
+void Sequencer::submitJoin(ServerDocument* document, int clientSocket, std::optional<uint64_t> knownVersion, WireProtocol wireProtocol)
+{
+    SequencerTask task;
+    task.type = SequencerTaskType::JOIN;
+    task.document = document;
+    task.clientSocket = clientSocket;
+    task.knownVersion = knownVersion;
+    task.wireProtocol = wireProtocol;
+    submit(std::move(task));
+}
+
+void Sequencer::submitLeave(ServerDocument* document, int clientSocket)
+{
+    SequencerTask task;
+    task.type = SequencerTaskType::LEAVE;
+    task.document = document;
+    task.clientSocket = clientSocket;
+    submit(std::move(task));
+}
+
+void Sequencer::submitPresence(ServerDocument* document, int clientSocket, std::string message)
+{
+    {
+        std::lock_guard<std::mutex> lock(document->incomingPresenceMutex);
+        document->incomingPresence[clientSocket] = std::move(message);
+    }
+
+    if (!document->presenceQueued.exchange(true))
+    {
+        presenceUpdates.push(document);
+        wake();
+    }
+}
+
+void Sequencer::forgetDocument(ServerDocument* document)
+{
+    ServerDocument* queued;
+    while (presenceUpdates.tryPop(queued))
+        presenceDocuments.push_back(queued);
+
+    presenceDocuments.erase(std::remove(presenceDocuments.begin(), presenceDocuments.end(), document), presenceDocuments.end());
+    dirtyDocuments.erase(std::remove(dirtyDocuments.begin(), dirtyDocuments.end(), document), dirtyDocuments.end());
+    heldJoins.erase(std::remove_if(heldJoins.begin(), heldJoins.end(), [document] (const SequencerTask& heldJoin)
+    {
+        return heldJoin.document == document;
+    }), heldJoins.end());
+}
+
+void Sequencer::submit(SequencerTask task)
+{
+    tasksSubmitted.fetch_add(1, std::memory_order_relaxed);
+    tasks.push(std::move(task));
+    wake();
+}
+
+void Sequencer::wake()
+{
+    // Pairs with the fence in waitForTasks() so either we see the parked flag or the sequencer sees the work
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        parkCondition.notify_one();
+    }
+}
+
+SequencerStats Sequencer::getStats() const
+{
+    // Taken before submitted, so a task taken in between cannot make the depth negative
+    const uint64_t taken = tasksTaken.load(std::memory_order_relaxed);
+    return {
+        operationsSequenced.load(std::memory_order_relaxed),
+        batchesProcessed.load(std::memory_order_relaxed),
+        largestBatch.load(std::memory_order_relaxed),
+        tasksSubmitted.load(std::memory_order_relaxed) - taken
+    };
+}
+
+void Sequencer::run()
+{
+    while (running)
+    {
+        waitForTasks();
+
+        SequencerTask task;
+        std::size_t drained = 0;
+        while (drained < maxBatchSize && tasks.tryPop(task))
+        {
+            drained++;
+
+            if (!task.document)
+                continue;
+
+            ServerDocument& document = *task.document;
+
+            switch (task.type)
+            {
+                case SequencerTaskType::JOIN:
+                {
+                    join(task);
+                    break;
+                }
+                case SequencerTaskType::LEAVE:
+                {
+                    flushBatch(document);
+                    heldJoins.erase(std::remove_if(heldJoins.begin(), heldJoins.end(), [&task] (const SequencerTask& heldJoin)
+                    {
+                        return heldJoin.document == task.document && heldJoin.clientSocket == task.clientSocket;
+                    }), heldJoins.end());
+
+                    document.subscribers.erase(task.clientSocket);
+                    document.presence.erase(task.clientSocket);
+                    {
+                        std::lock_guard<std::mutex> lock(document.incomingPresenceMutex);
+                        document.incomingPresence.erase(task.clientSocket);
+                    }
+
+                    if (leaveCallback)
+                        leaveCallback(document, task.clientSocket);
+
+                    break;
+                }
+                case SequencerTaskType::OPERATION:
+                {
+                    if (!task.operation)
+                        break;
+
+                    const uint64_t baseVersion = task.operation->docVersion;
+                    std::unique_ptr<TextOperation> transformedOp = document.textEngine->processIncomingOperation(std::move(task.operation));
+                    if (!transformedOp)
+                        break;
+
+                    if (document.opLog)
+                        document.opLog->append(*transformedOp);
+
+                    if (document.pendingBatch.empty())
+                    {
+                        dirtyDocuments.push_back(&document);
+                        document.broadcastDeadline = std::chrono::steady_clock::now() + broadcastInterval;
+                    }
+
+                    document.pendingBatch.push_back({task.clientSocket, std::move(transformedOp), getWallClockMicros(),
+                                                     task.clientSequence, baseVersion});
+                    break;
+                }
+            }
+        }
+
+        tasksTaken.fetch_add(drained, std::memory_order_relaxed);
+        flushDirtyDocuments(false);
+        flushPresence(tasks.empty());
+    }
+
+    flushDirtyDocuments(true);
+}
+
+void Sequencer::waitForTasks()
+{
+    if (!tasks.empty() || !presenceUpdates.empty())
+        return;
+
+    // Spin briefly before parking since ops tend to arrive in bursts
+    for (int i = 0; i < 64; i++)
+    {
+        std::this_thread::yield();
+        if (!tasks.empty() || !presenceUpdates.empty())
+            return;
+    }
+
+    // Wake up in time for the earliest group commit, broadcast and presence broadcast
+    auto wakeTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    for (ServerDocument* document : dirtyDocuments)
+    {
+        if (document->opLog && document->opLog->hasPendingRecords())
+            wakeTime = std::min(wakeTime, std::max(document->opLog->getCommitDeadline(), document->broadcastDeadline));
+        else if (!document->pendingBatch.empty())
+            wakeTime = std::min(wakeTime, document->broadcastDeadline);
+    }
+    for (ServerDocument* document : presenceDocuments)
+        wakeTime = std::min(wakeTime, document->nextPresenceBroadcast);
+
+    std::unique_lock<std::mutex> lock(parkMutex);
+    parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    while (running && tasks.empty() && presenceUpdates.empty() && std::chrono::steady_clock::now() < wakeTime)
+        parkCondition.wait_until(lock, wakeTime);
+
+    parked.store(false, std::memory_order_relaxed);
+}
+
+void Sequencer::flushDirtyDocuments(bool force)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    auto it = std::remove_if(dirtyDocuments.begin(), dirtyDocuments.end(), [this, force, now] (ServerDocument* document)
+    {
+        if (document->pendingBatch.empty())
+            return true; // Already flushed by a join or leave
+
+        // Keep collecting ops into the same fsync until the window of the oldest one runs out
+        if (!force && document->opLog && document->opLog->hasPendingRecords() && now < document->opLog->getCommitDeadline())
+            return false;
+
+        // Keep collecting ops into the same broadcast until its tick
+        if (!force && now < document->broadcastDeadline)
+            return false;
+
+        if (flushBatch(*document))
+        {
+            joinHeld(*document);
+            return true;
+        }
+
+        // Nothing more can be done about it when stopping
+        if (force)
+            std::cerr << "Sequencer: Dropping " << document->pendingBatch.size() << " uncommitted ops of " << document->name << "\n";
+
+        return force;
+    });
+
+    dirtyDocuments.erase(it, dirtyDocuments.end());
+}
+
+bool Sequencer::flushBatch(ServerDocument& document)
+{
+    if (document.opLog && !document.opLog->commit())
+    {
+        std::cerr << "Sequencer: Failed to commit op log of " << document.name << ", holding back its ops\n";
+        document.broadcastDeadline = std::chrono::steady_clock::now() + commitRetryInterval;
+        return false;
+    }
+
+    std::vector<SequencedOperation>& batch = document.pendingBatch;
+    if (batch.empty())
+        return true;
+
+    operationsSequenced.fetch_add(batch.size(), std::memory_order_relaxed);
+    batchesProcessed.fetch_add(1, std::memory_order_relaxed);
+    if (batch.size() > largestBatch.load(std::memory_order_relaxed))
+        largestBatch.store(batch.size(), std::memory_order_relaxed);
+
+    if (broadcastCallback)
+        broadcastCallback(document, batch);
+
+    document.opsSinceCheckpoint += batch.size();
+    batch.clear();
+
+    if (historyLimit > 0)
+        document.textEngine->trimHistory(historyLimit);
+
+    if (checkpointCallback && checkpointInterval > 0 && document.opsSinceCheckpoint >= checkpointInterval)
+    {
+        document.opsSinceCheckpoint = 0;
+        checkpointCallback(document);
+    }
+
+    return true;
+}
+
+void Sequencer::join(SequencerTask& task)
+{
+    ServerDocument& document = *task.document;
+
+    // Ops sequenced so far are part of the text the client receives, so they have to be durable and go out to
+    // existing subscribers before the new client starts receiving broadcasts
+    if (!flushBatch(document))
+    {
+        heldJoins.push_back(std::move(task));
+        return;
+    }
+
+    joinHeld(document);
+    document.subscribers[task.clientSocket] = task.wireProtocol;
+
+    std::vector<const TextOperation*> missedOperations;
+    if (task.knownVersion && catchUpCallback && document.textEngine->getOperationsSince(*task.knownVersion, missedOperations))
+        catchUpCallback(document, task.clientSocket, missedOperations);
+    else if (joinCallback)
+        joinCallback(document, task.clientSocket);
+}
+
+void Sequencer::joinHeld(ServerDocument& document)
+{
+    auto held = std::stable_partition(heldJoins.begin(), heldJoins.end(), [&document] (const SequencerTask& task)
+    {
+        return task.document != &document;
+    });
+
+    if (held == heldJoins.end())
+        return;
+
+    std::vector<SequencerTask> joins(std::make_move_iterator(held), std::make_move_iterator(heldJoins.end()));
+    heldJoins.erase(held, heldJoins.end());
+    for (SequencerTask& task : joins)
+        join(task);
+}
+
+void Sequencer::flushPresence(bool textIdle)
+{
+    ServerDocument* queued;
+    while (presenceUpdates.tryPop(queued))
+        presenceDocuments.push_back(queued);
+
+    if (presenceDocuments.empty())
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+
+    auto it = std::remove_if(presenceDocuments.begin(), presenceDocuments.end(), [this, textIdle, now] (ServerDocument* document)
+    {
+        if (now < document->nextPresenceBroadcast || (!textIdle && now < document->nextPresenceBroadcast + presenceInterval))
+            return false;
+
+        std::vector<std::pair<int, std::string>> updates;
+        {
+            std::lock_guard<std::mutex> lock(document->incomingPresenceMutex);
+            updates.reserve(document->incomingPresence.size());
+            for (auto& [clientSocket, message] : document->incomingPresence)
+            {
+                // Presence of clients that already left is dropped
+                if (document->subscribers.count(clientSocket))
+                    updates.emplace_back(clientSocket, std::move(message));
+            }
+
+            document->incomingPresence.clear();
+
+            // Cleared under the lock so the next update queues the document again
+            document->presenceQueued = false;
+        }
+
+        for (const auto& [clientSocket, message] : updates)
+            document->presence[clientSocket] = message;
+
+        if (presenceCallback && !updates.empty())
+            presenceCallback(*document, updates);
+
+        document->nextPresenceBroadcast = now + presenceInterval;
+        return true;
+    });
+
+    presenceDocuments.erase(it, presenceDocuments.end());
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <optional>
+
+#include "mpsc_queue.h"
+#include "server_document.h"
+
+class TextOperation;
+
+enum class SequencerTaskType
+{
+    OPERATION,  // Transform and apply an incoming op
+    JOIN,       // Send the current document, or the ops the client missed, to a client and subscribe it
+    LEAVE       // Unsubscribe a disconnected client
+};
+
+struct SequencerTask
+{
+    SequencerTaskType type = SequencerTaskType::OPERATION;
+    ServerDocument* document = nullptr;
+    int clientSocket = -1;
+    std::unique_ptr<TextOperation> operation;
+
+    // Position of the op among those its client sent on the connection, counted from 1
+    uint64_t clientSequence = 0;
+
+    // Version a reconnecting client last saw
+    std::optional<uint64_t> knownVersion;
+
+    // Protocol negotiated with a joining client
+    WireProtocol wireProtocol = WireProtocol::TEXT;
+};
+
+struct SequencerStats
+{
+    uint64_t operationsSequenced;
+    uint64_t batchesProcessed;
+    uint64_t largestBatch;
+    uint64_t queueDepth;    // Tasks submitted and not taken yet
+};
+
+/**
+ * Sequencer for one shard of documents. It is the only thread that touches the engines of the documents
+ * pinned to its shard. Connection threads submit decoded ops through a lock-free MPSC queue; the sequencer
+ * drains them in batches, transforms and applies them in arrival order, appends them to the document's op log
+ * and hands each document's batch to the broadcast stage once the log is committed.
+*/
+class Sequencer
+{
+public:
+    using BroadcastCallback = std::function<void(ServerDocument& document, std::vector<SequencedOperation>& batch)>;
+    // Runs at the client's position in the total order, so whatever it reads of the document is what the client
+    // has to start from
+    using JoinCallback = std::function<void(ServerDocument& document, int clientSocket)>;
+    using CatchUpCallback = std::function<void(ServerDocument& document, int clientSocket, const std::vector<const TextOperation*>& operations)>;
+    using LeaveCallback = std::function<void(ServerDocument& document, int clientSocket)>;
+    using CheckpointCallback = std::function<void(ServerDocument& document)>;
+    using PresenceCallback = std::function<void(ServerDocument& document, const std::vector<std::pair<int, std::string>>& updates)>;
+
+private:
+    MpscQueue<SequencerTask> tasks;
+    std::size_t maxBatchSize;
+
+    BroadcastCallback broadcastCallback;
+    std::chrono::microseconds broadcastInterval;
+    JoinCallback joinCallback;
+    CatchUpCallback catchUpCallback;
+    LeaveCallback leaveCallback;
+    CheckpointCallback checkpointCallback;
+    uint64_t checkpointInterval;
+    std::size_t historyLimit = 0;
+    PresenceCallback presenceCallback;
+    std::chrono::milliseconds presenceInterval;
+
+    // Presence has its own queue so it never sits in front of text ops. Each document is queued at most once
+    // until its coalesced updates are broadcast.
+    MpscQueue<ServerDocument*> presenceUpdates;
+    std::vector<ServerDocument*> presenceDocuments;
+
+    // Documents with sequenced ops that have not been committed and broadcast yet
+    std::vector<ServerDocument*> dirtyDocuments;
+
+    // Joins waiting for their document's op log to commit, as the text they would be sent is not durable yet
+    std::vector<SequencerTask> heldJoins;
+
+    // How long a document whose op log failed to commit waits before it tries again
+    static constexpr std::chrono::milliseconds commitRetryInterval = std::chrono::milliseconds(100);
+
+    std::thread sequencerThread;
+    std::atomic<bool> running;
+
+    // Only used to park the sequencer thread when there is no work
+    std::mutex parkMutex;
+    std::condition_variable parkCondition;
+    std::atomic<bool> parked;
+
+    std::atomic<uint64_t> operationsSequenced;
+    std::atomic<uint64_t> batchesProcessed;
+    std::atomic<uint64_t> largestBatch;
+    std::atomic<uint64_t> tasksSubmitted = 0;
+    std::atomic<uint64_t> tasksTaken = 0;
+
+public:
+    Sequencer(std::size_t maxBatchSize = 256);
+    ~Sequencer();
+
+
+    /**
+     * @param interval How long a document's sequenced ops are collected before they are broadcast as one batch.
+     * With 0 a batch holds what one drain of the queue sequenced, which grows by itself under load.
+    */
+    void setBroadcastCallback(BroadcastCallback callback, std::chrono::microseconds interval = std::chrono::microseconds(0))
+    {
+        broadcastCallback = std::move(callback);
+        broadcastInterval = interval;
+    }
+
+    void setJoinCallback(JoinCallback callback) { joinCallback = std::move(callback); }
+    void setCatchUpCallback(CatchUpCallback callback) { catchUpCallback = std::move(callback); }
+    void setLeaveCallback(LeaveCallback callback) { leaveCallback = std::move(callback); }
+
+    /**
+     * @param interval Number of ops after which a document is checkpointed. The callback runs on the sequencer
+     * thread right after the op log is committed.
+    */
+    void setCheckpointCallback(CheckpointCallback callback, uint64_t interval)
+    {
+        checkpointCallback = std::move(callback);
+        checkpointInterval = interval;
+    }
+
+    /**
+     * @param operations Sequenced ops each document keeps once they were broadcast, 0 for all of them. Clients
+     * joining from a version before what is kept are sent the document instead of the ops they missed.
+    */
+    void setHistoryLimit(std::size_t operations) { historyLimit = operations; }
+
+    /**
+     * @param interval Minimum time between two presence broadcasts of the same document. Updates arriving in
+     * between are coalesced to the latest one per client.
+    */
+    void setPresenceCallback(PresenceCallback callback, std::chrono::milliseconds interval)
+    {
+        presenceCallback = std::move(callback);
+        presenceInterval = interval;
+    }
+
+    /**
+     * @param cpu Core to pin the sequencer thread to, or -1 to leave it unpinned.
+    */
+    void start(int cpu = -1);
+    void stop();
+
+    /**
+     * Queues an op for sequencing. Safe to call from any thread.
+     * @param clientSequence Position of the op among those the client sent on its connection, counted from 1, so
+     * the client can be acknowledged cumulatively. 0 if they are not counted.
+    */
+    void submitOperation(ServerDocument* document, int clientSocket, std::unique_ptr<TextOperation> operation,
+                         uint64_t clientSequence = 0);
+
+    /**
+     * Queues a join so the client receives the document as of its position in the total order.
+     * Safe to call from any thread.
+     * @param knownVersion Version a reconnecting client already has. If the history still reaches back to it the
+     * client only receives the ops it missed through the catch-up callback instead of the whole document.
+     * @param wireProtocol Protocol the client's broadcasts are encoded in
+    */
+    void submitJoin(ServerDocument* document, int clientSocket, std::optional<uint64_t> knownVersion = std::nullopt,
+                    WireProtocol wireProtocol = WireProtocol::TEXT);
+
+    /**
+     * Queues a leave. The leave callback runs once no further broadcasts will reach the client.
+     * Safe to call from any thread.
+    */
+    void submitLeave(ServerDocument* document, int clientSocket);
+
+    /**
+     * Records a client's latest presence. Replaces any update from the same client that was not broadcast yet.
+     * Safe to call from any thread.
+    */
+    void submitPresence(ServerDocument* document, int clientSocket, std::string message);
+
+    /**
+     * Drops what the shard still holds of a document before it is destroyed. Sequencer thread only, e.g. from the
+     * leave callback, once no client can submit anything for the document.
+    */
+    void forgetDocument(ServerDocument* document);
+
+    [[nodiscard]] SequencerStats getStats() const;
+
+private:
+    void submit(SequencerTask task);
+    void wake();
+
+    /**
+     * Sequencer thread loop. Drains up to maxBatchSize tasks at a time and parks when the queue is empty.
+    */
+    void run();
+
+    /**
+     * Parks until there are tasks, the sequencer is stopped or the next group commit or broadcast is due.
+    */
+    void waitForTasks();
+
+    /**
+     * Commits and broadcasts every dirty document whose group commit window and broadcast interval have elapsed.
+     * @param force Flush all dirty documents regardless of their window.
+    */
+    void flushDirtyDocuments(bool force);
+
+    /**
+     * Commits the document's op log and hands its pending batch to the broadcast stage, so clients only see
+     * ops that are durable.
+     * @returns False if the commit failed. The batch is held back and tried again after commitRetryInterval.
+    */
+    bool flushBatch(ServerDocument& document);
+
+    /**
+     * Subscribes a client and sends it the document or the ops it missed, or holds the join back until the ops
+     * sequenced before it are durable.
+    */
+    void join(SequencerTask& task);
+
+    /**
+     * Completes the joins held back for a document, in the order they arrived.
+    */
+    void joinHeld(ServerDocument& document);
+
+    /**
+     * Broadcasts the coalesced presence of every document whose presence interval has elapsed.
+     * @param textIdle Whether there are no text ops waiting. Presence otherwise only goes out once it is a full
+     * interval overdue, so it cannot hold up text but is not starved by it either.
+    */
+    void flushPresence(bool textIdle);
+};
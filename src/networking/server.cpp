@@ -1,20 +1,307 @@
 #include <iostream>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
 #include <netdb.h>
 #include <string.h>
 #include <memory>
 #include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <cctype>
+#include <thread>
+#include <unordered_set>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 #include "server.h"
 #include "../text_engine/operations.h"
 #include "../controller/controller.h"
+#include "../text_engine/server_text_engine.h"
+#include "../text_engine/crdt_server_text_engine.h"
 #include "message_parser.h"
+#include "framing.h"
+#include "connection.h"
+#include "reactor.h"
+#include "io_uring_reactor.h"
+#include "send_batch.h"
+#include "document_stream.h"
+#include "latency_histogram.h"
+#include "sequencer.h"
+#include "../persistence/op_log.h"
+#include "../persistence/snapshot.h"
+#include "../persistence/snapshot_writer.h"
+#include "../metrics/metrics_endpoint.h"
 
-Server::Server(const uint16_t port, const std::string& bindAddress, Controller* controller)
-    : port(port), bindAddress(bindAddress), socketFd(0), running(false), controller(controller)
+namespace
+{
+    // Keeps document names from escaping the data directory
+    constexpr std::size_t maxDocumentNameLength = 128;
+
+    /**
+     * Names are used as file names as they are, so two documents never share their files.
+     * @returns False if the name is empty, too long, starts with a dot or has characters other than letters,
+     * digits, '-', '_' and '.'
+    */
+    bool isValidDocumentName(const std::string& documentName)
+    {
+        if (documentName.empty() || documentName.size() > maxDocumentNameLength || documentName[0] == '.')
+            return false;
+
+        return std::all_of(documentName.begin(), documentName.end(), [] (char c)
+        {
+            return isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.';
+        });
+    }
+
+    /**
+     * @returns The cores the process may run on, empty if they cannot be told
+    */
+    std::vector<int> getAllowedCpus()
+    {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &cpuSet))
+                    cpus.push_back(cpu);
+            }
+        }
+#endif
+        return cpus;
+    }
+
+    std::string getDocumentFileName(const std::string& documentName)
+    {
+        std::string fileName = documentName;
+        for (char& c : fileName)
+        {
+            if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.')
+                c = '_';
+        }
+
+        if (fileName.empty() || fileName[0] == '.')
+            fileName.insert(fileName.begin(), '_');
+
+        return fileName;
+    }
+
+    /**
+     * @returns A non-blocking Unix domain socket listening at the path, -1 if it could not be bound
+    */
+    int listenOnUnixSocket(const std::string& path)
+    {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            std::cerr << "Server: Unix socket path " << path << " is too long\n";
+            return -1;
+        }
+
+        memcpy(address.sun_path, path.c_str(), path.size());
+
+        // A socket file left behind by a server that did not stop cleanly fails the bind, one that still answers
+        // belongs to a running server
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe != -1 && connect(probe, (struct sockaddr*)&address, sizeof(address)) == 0)
+        {
+            std::cerr << "Server: Another server is listening at " << path << "\n";
+            close(probe);
+            return -1;
+        }
+
+        if (probe != -1)
+            close(probe);
+
+        unlink(path.c_str());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1)
+        {
+            std::cerr << "Server: Failed to listen at " << path << ": " << strerror(errno) << "\n";
+            if (fd != -1)
+                close(fd);
+
+            return -1;
+        }
+
+        return fd;
+    }
+
+    void closeUnixSocket(int fd, const std::string& path)
+    {
+        if (fd == -1)
+            return;
+
+        close(fd);
+        unlink(path.c_str());
+    }
+
+    // Log segments are named <document>.<first version>.oplog
+    std::string getLogSegmentPath(const std::string& dataDirectory, const std::string& fileName, uint64_t firstVersion)
+    {
+        return dataDirectory + "/" + fileName + "." + std::to_string(firstVersion) + ".oplog";
+    }
+
+    /**
+     * @returns The document's log segments sorted by the first version they hold.
+    */
+    std::vector<std::pair<uint64_t, std::string>> listLogSegments(const std::string& dataDirectory, const std::string& fileName)
+    {
+        std::vector<std::pair<uint64_t, std::string>> segments;
+        const std::string prefix = fileName + ".";
+        const std::string suffix = ".oplog";
+
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(dataDirectory, error))
+        {
+            std::string name = entry.path().filename().string();
+            if (name.size() <= prefix.size() + suffix.size() ||
+                name.compare(0, prefix.size(), prefix) != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+                continue;
+
+            std::string version = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+            if (version.find_first_not_of("0123456789") != std::string::npos)
+                continue;
+
+            segments.emplace_back(std::stoull(version), entry.path().string());
+        }
+
+        std::sort(segments.begin(), segments.end());
+        return segments;
+    }
+
+    /**
+     * Encodes a batch of ops in one protocol as consecutive frames in one buffer, so a subscriber receives the
+     * whole batch with one write. Ops are stamped with the time they were sequenced at where the protocol has room.
+     * @param frameEnds Set to where each op's frame ends in the buffer
+    */
+    SharedFrame frameBatch(const std::vector<SequencedOperation>& batch, WireProtocol protocol, bool compression,
+                           std::vector<std::size_t>& frameEnds)
+    {
+        std::string frames;
+        std::string message;
+        frameEnds.clear();
+        for (const SequencedOperation& sequencedOp : batch)
+        {
+            WireCodec::encode(*sequencedOp.operation, protocol, message);
+            if (protocol >= WireProtocol::TIMED)
+                WireCodec::appendSequencedAt(message, sequencedOp.sequencedAt);
+
+            Framing::appendFrame(frames, message, compression && Framing::shouldCompress(message.size(), protocol));
+            frameEnds.push_back(frames.size());
+        }
+
+        return std::make_shared<const std::string>(std::move(frames));
+    }
+
+    /**
+     * Frames a batch for a client that sent ops in it, copied from the frames encoded for everyone else. Its own
+     * ops are left out and each run of them is confirmed with one ACK, except for ops made before the last
+     * document it was sent: that document dropped them from its text, so they go out whole.
+     * @param operations Incremented by the ops framed
+    */
+    SharedFrame frameBatchForSender(const std::vector<SequencedOperation>& batch, const Connection& connection,
+                                    WireProtocol protocol, const std::string& frames,
+                                    const std::vector<std::size_t>& frameEnds, std::size_t& operations)
+    {
+        std::string senderFrames;
+        const SequencedOperation* unacknowledged = nullptr;
+        auto acknowledge = [&] ()
+        {
+            if (!unacknowledged)
+                return;
+
+            const uint64_t sequencedAt = protocol >= WireProtocol::TIMED ? unacknowledged->sequencedAt : 0;
+            Framing::appendFrame(senderFrames, MessageParser::createAckMessage(unacknowledged->operation->docVersion,
+                unacknowledged->clientSequence, sequencedAt, protocol), false);
+            unacknowledged = nullptr;
+        };
+
+        for (std::size_t i = 0; i < batch.size(); i++)
+        {
+            const SequencedOperation& sequencedOp = batch[i];
+            const bool own = sequencedOp.clientSocket == connection.socket && sequencedOp.clientSequence != 0;
+            if (own && sequencedOp.baseVersion > connection.resyncVersion)
+            {
+                unacknowledged = &sequencedOp;
+                continue;
+            }
+
+            // The client takes the ops before this one as confirmed
+            acknowledge();
+            const std::size_t frameStart = i == 0 ? 0 : frameEnds[i - 1];
+            senderFrames.append(frames, frameStart, frameEnds[i] - frameStart);
+            operations++;
+        }
+
+        acknowledge();
+        return std::make_shared<const std::string>(std::move(senderFrames));
+    }
+
+    /**
+     * @param labelled False to add the document to the series shared by the documents past the limit
+    */
+    void registerDocumentMetrics(ServerDocument& document, bool labelled)
+    {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        const std::string labels = labelled ? MetricsRegistry::formatLabel("document", document.name) : "overflow=\"true\"";
+        document.versionGauge = &registry.getGauge("reped_document_version", "Ops sequenced in the document", labels);
+        document.historyGauge = &registry.getGauge("reped_document_history_operations",
+            "Ops kept for transforming and catching up clients", labels);
+        document.piecesGauge = &registry.getGauge("reped_document_pieces", "Pieces the document's text is split into", labels);
+    }
+
+    void reportDocumentMetric(Gauge& gauge, int64_t& reported, int64_t value)
+    {
+        gauge.add(value - reported);
+        reported = value;
+    }
+
+    /**
+     * Runs on the document's shard thread. Adds what changed rather than setting the gauges, which the documents
+     * past the limit share.
+    */
+    void updateDocumentMetrics(ServerDocument& document)
+    {
+        if (!document.versionGauge)
+            return;
+
+        reportDocumentMetric(*document.versionGauge, document.reportedVersion,
+            static_cast<int64_t>(document.textEngine->getDocumentVersion()));
+        reportDocumentMetric(*document.historyGauge, document.reportedHistory,
+            static_cast<int64_t>(document.textEngine->getHistorySize()));
+        reportDocumentMetric(*document.piecesGauge, document.reportedPieces,
+            static_cast<int64_t>(document.textEngine->getPieceCount()));
+    }
+
+    /**
+     * Appends the HELP and TYPE lines that start a metric family.
+    */
+    void appendFamily(std::string& out, const char* name, const char* type, const char* help)
+    {
+        out += std::string("# HELP ") + name + " " + help + "\n";
+        out += std::string("# TYPE ") + name + " " + type + "\n";
+    }
+}
+
+Server::Server(const uint16_t port, const std::string& bindAddress, Controller* controller, const ServerConfig& config)
+    : port(port), bindAddress(bindAddress), config(config), socketFd(0), running(false), controller(controller),
+      engineType(TextEngineType::OT)
 {
     start();
 }
@@ -70,14 +357,69 @@ void Server::start()
         return;
     }
 
-    if (listen(socketFd, 10) == -1)
+    struct sockaddr_storage boundAddress = {};
+    socklen_t boundLength = sizeof(boundAddress);
+    if (port == 0 && getsockname(socketFd, (struct sockaddr*)&boundAddress, &boundLength) == 0)
+    {
+        port = ntohs(boundAddress.ss_family == AF_INET6 ? ((struct sockaddr_in6*)&boundAddress)->sin6_port
+            : ((struct sockaddr_in*)&boundAddress)->sin_port);
+    }
+
+    // Thousands of clients may reconnect at once after a restart
+    if (listen(socketFd, SOMAXCONN) == -1 || fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL) | O_NONBLOCK) == -1)
     {
         std::cerr << "Failed to listen on socket\n";
         return;
     }
 
+    ServerTextEngine* serverEngine = dynamic_cast<ServerTextEngine*>(controller->textEngine);
+    if (!serverEngine)
+    {
+        std::cerr << "Server: ServerTextEngine not set\n";
+        close(socketFd);
+        return;
+    }
+
+    // Every document merges edits the same way as the one the server was started with
+    engineType = dynamic_cast<CrdtServerTextEngine*>(serverEngine) ? TextEngineType::CRDT : TextEngineType::OT;
+
+    if (!config.dataDirectory.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(config.dataDirectory, error);
+        if (error)
+            std::cerr << "Server: Failed to create data directory " << config.dataDirectory << ": " << error.message() << "\n";
+    }
+
+    if (!config.dataDirectory.empty() && config.snapshotInterval > 0)
+    {
+        snapshotWriter = std::make_unique<SnapshotWriter>();
+        snapshotWriter->start();
+    }
+
+    startShards();
+
+    // The document loaded through the controller is served under the default name
+    auto defaultDocument = std::make_unique<ServerDocument>(defaultDocumentName, getShardIndex(defaultDocumentName), serverEngine);
+    recoverDocument(*defaultDocument);
+    if (config.documentMetricsLimit > 0)
+        labelledDocumentNames.insert(defaultDocumentName);
+
+    registerDocumentMetrics(*defaultDocument, config.documentMetricsLimit > 0);
+    updateDocumentMetrics(*defaultDocument);
+    documents[defaultDocumentName] = std::move(defaultDocument);
+
     running = true;
-    acceptThread = std::thread(&Server::acceptClients, this);
+    if (!startLocalListeners() || !startReactors())
+    {
+        stop();
+        return;
+    }
+
+    if (config.heartbeatTimeout.count() > 0)
+        heartbeatThread = std::thread(&Server::runHeartbeatMonitor, this);
+
+    startMetrics();
     std::cout << "Server started on port " << port << " at address " << bindAddress << "\n";
 }
 
@@ -86,102 +428,958 @@ void Server::stop()
     if (!running)
         return;
     
-    running = false;
+    // Scrapes read the connections and shards torn down below
+    if (metricsCollector != 0)
+        MetricsRegistry::global().removeCollector(metricsCollector);
+
+    metricsCollector = 0;
+    metricsEndpoint.reset();
+
+    {
+        std::lock_guard<std::mutex> lock(heartbeatMutex);
+        running = false;
+    }
+
+    heartbeatCondition.notify_all();
+    if (heartbeatThread.joinable())
+        heartbeatThread.join();
+
+    // No callback runs once a reactor is stopped, so the connections are ours from here on
+    for (auto& reactor : reactors)
+        reactor->stop();
+
     close(socketFd);
-    
-    if (acceptThread.joinable())
-        acceptThread.join();
+    closeUnixSocket(unixSocketFd, config.unixSocketPath);
+    closeUnixSocket(sharedMemorySocketFd, config.sharedMemorySocketPath);
+
+    // Leave while the shards still run so they stop broadcasting to the sockets before those are closed
+    std::vector<std::shared_ptr<Connection>> remaining;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const auto& [clientSocket, connection] : connections)
+            remaining.push_back(connection);
+    }
+
+    // Ones that disconnected already have their leave queued, a second one would release the document twice
+    for (const auto& connection : remaining)
+    {
+        if (connection->document && !connection->closing)
+            shards[connection->document->shardIndex]->submitLeave(connection->document, connection->socket);
+    }
 
+    for (auto& shard : shards)
+        shard->stop();
+
+    if (snapshotWriter)
+        snapshotWriter->stop();
+
+    // Leaves the shards did not get to before stopping
     std::lock_guard<std::mutex> lock(clientsMutex);
-    for (int clientSocket : clientSockets)
-        close(clientSocket);
+    for (const auto& [clientSocket, connection] : connections)
+        connection->closeSocket();
 
-    clientSockets.clear();
+    clientsClosed.add(connections.size());
+    connections.clear();
     clientIdMap.clear();
 }
 
-void Server::acceptClients()
+void Server::startMetrics()
+{
+    metricsCollector = MetricsRegistry::global().addCollector([this] (std::string& out)
+    {
+        this->appendMetrics(out);
+    });
+
+    if (config.metricsPort == 0 && config.metricsSocketPath.empty())
+        return;
+
+    metricsEndpoint = std::make_unique<MetricsEndpoint>();
+    if (!metricsEndpoint->start(config.metricsPort, config.metricsSocketPath))
+    {
+        std::cerr << "Server: Serving without metrics\n";
+        metricsEndpoint.reset();
+        return;
+    }
+
+    if (config.metricsPort != 0)
+        std::cout << "Server: Serving metrics on 127.0.0.1:" << config.metricsPort << "/metrics\n";
+    if (!config.metricsSocketPath.empty())
+        std::cout << "Server: Serving metrics at " << config.metricsSocketPath << "\n";
+}
+
+void Server::appendMetrics(std::string& out)
+{
+    std::vector<std::shared_ptr<Connection>> clients;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        clients.reserve(connections.size());
+        for (const auto& [clientSocket, connection] : connections)
+            clients.push_back(connection);
+    }
+
+    std::size_t queuedBytes = 0;
+    std::size_t maxQueuedBytes = 0;
+    for (const auto& connection : clients)
+    {
+        const std::size_t connectionBytes = connection->getQueuedBytes();
+        queuedBytes += connectionBytes;
+        maxQueuedBytes = std::max(maxQueuedBytes, connectionBytes);
+    }
+
+    appendFamily(out, "reped_server_connected_clients", "gauge", "Clients connected");
+    out += "reped_server_connected_clients " + std::to_string(clients.size()) + "\n";
+    appendFamily(out, "reped_server_send_queue_bytes", "gauge", "Bytes queued for clients that fell behind");
+    out += "reped_server_send_queue_bytes " + std::to_string(queuedBytes) + "\n";
+    appendFamily(out, "reped_server_send_queue_max_bytes", "gauge", "Bytes queued for the client furthest behind");
+    out += "reped_server_send_queue_max_bytes " + std::to_string(maxQueuedBytes) + "\n";
+
+    std::vector<SequencerStats> shardStats;
+    for (const auto& shard : shards)
+        shardStats.push_back(shard->getStats());
+
+    appendFamily(out, "reped_shard_operations_sequenced_total", "counter", "Ops the shard transformed and applied");
+    for (std::size_t i = 0; i < shardStats.size(); i++)
+        out += "reped_shard_operations_sequenced_total{shard=\"" + std::to_string(i) + "\"} " + std::to_string(shardStats[i].operationsSequenced) + "\n";
+
+    appendFamily(out, "reped_shard_queue_depth", "gauge", "Tasks waiting for the shard's sequencer");
+    for (std::size_t i = 0; i < shardStats.size(); i++)
+        out += "reped_shard_queue_depth{shard=\"" + std::to_string(i) + "\"} " + std::to_string(shardStats[i].queueDepth) + "\n";
+
+    appendFamily(out, "reped_shard_largest_batch", "gauge", "Most ops the shard broadcast in one batch");
+    for (std::size_t i = 0; i < shardStats.size(); i++)
+        out += "reped_shard_largest_batch{shard=\"" + std::to_string(i) + "\"} " + std::to_string(shardStats[i].largestBatch) + "\n";
+
+    uint64_t maxLag = 0;
+    for (const auto& connection : clients)
+        maxLag = std::max(maxLag, connection->getLag());
+
+    appendFamily(out, "reped_server_client_lag_max_operations", "gauge", "Most ops a client was sent and has not applied yet");
+    out += "reped_server_client_lag_max_operations " + std::to_string(maxLag) + "\n";
+    appendFamily(out, "reped_server_resync_backlog_bytes", "gauge", "Queued bytes past which an idle client gets the document again, 0 never");
+    out += "reped_server_resync_backlog_bytes " + std::to_string(config.resyncBacklogBytes) + "\n";
+    appendFamily(out, "reped_server_resync_lag_operations", "gauge", "Ops behind past which an idle client gets the document again, 0 never");
+    out += "reped_server_resync_lag_operations " + std::to_string(config.resyncLagOperations) + "\n";
+    appendFamily(out, "reped_server_max_send_queue_bytes", "gauge", "Queued bytes past which a client is disconnected");
+    out += "reped_server_max_send_queue_bytes " + std::to_string(config.maxSendQueueBytes) + "\n";
+
+    const BroadcastStats broadcastStats = getBroadcastStats();
+    appendFamily(out, "reped_server_operations_broadcast_total", "counter", "Ops delivered, counted once per subscriber");
+    out += "reped_server_operations_broadcast_total " + std::to_string(broadcastStats.operationsBroadcast) + "\n";
+    appendFamily(out, "reped_server_broadcast_writes_total", "counter", "Writes that carried the broadcast ops");
+    out += "reped_server_broadcast_writes_total " + std::to_string(broadcastStats.writes) + "\n";
+}
+
+void Server::startShards()
+{
+    std::size_t shardCount = config.shardCount;
+    if (shardCount == 0)
+        shardCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // A container or taskset may leave us only some of the machine's cores
+    const std::vector<int> allowedCpus = getAllowedCpus();
+
+    for (std::size_t i = 0; i < shardCount; i++)
+    {
+        auto shard = std::make_unique<Sequencer>();
+        shard->setBroadcastCallback([this] (ServerDocument& document, std::vector<SequencedOperation>& batch)
+        {
+            this->broadcastSequencedOperations(document, batch);
+        }, config.broadcastInterval);
+        shard->setJoinCallback([this] (ServerDocument& document, int clientSocket)
+        {
+            this->sendInitialDocument(document, clientSocket);
+        });
+        shard->setCatchUpCallback([this] (ServerDocument& document, int clientSocket, const std::vector<const TextOperation*>& operations)
+        {
+            this->sendCatchUp(document, clientSocket, operations);
+        });
+        shard->setLeaveCallback([this, shard = shard.get()] (ServerDocument& document, int clientSocket)
+        {
+            std::string clientId;
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                auto it = clientIdMap.find(clientSocket);
+                if (it != clientIdMap.end())
+                    clientId = it->second;
+            }
+
+            if (!clientId.empty())
+                this->broadcastToClients(document, MessageParser::createPresenceLeftMessage(clientId), clientSocket);
+
+            this->closeClient(clientSocket);
+            this->releaseDocument(document, *shard);
+        });
+        shard->setPresenceCallback([this] (ServerDocument& document, const std::vector<std::pair<int, std::string>>& updates)
+        {
+            this->broadcastPresence(document, updates);
+        }, config.presenceInterval);
+        shard->setCheckpointCallback([this] (ServerDocument& document)
+        {
+            this->checkpointDocument(document);
+        }, snapshotWriter ? config.snapshotInterval : 0);
+        shard->setHistoryLimit(config.historyOperations);
+
+        // Spread shards over the cores so independent documents scale with them
+        shard->start(allowedCpus.empty() ? -1 : allowedCpus[i % allowedCpus.size()]);
+        shards.push_back(std::move(shard));
+    }
+
+    std::cout << "Server: Started " << shardCount << " document shards\n";
+}
+
+std::size_t Server::getShardIndex(const std::string& documentName) const
+{
+    return std::hash<std::string>{}(documentName) % shards.size();
+}
+
+ServerDocument* Server::getOrCreateDocument(const std::string& documentName)
+{
+    std::lock_guard<std::mutex> lock(documentsMutex);
+
+    auto it = documents.find(documentName);
+    if (it != documents.end())
+    {
+        it->second->connections++;
+        return it->second.get();
+    }
+
+    if (!isValidDocumentName(documentName))
+    {
+        std::cerr << "Server: Refused to create a document with the invalid name " << documentName.substr(0, maxDocumentNameLength) << "\n";
+        return nullptr;
+    }
+
+    if (config.maxDocuments > 0 && documents.size() >= config.maxDocuments)
+    {
+        std::cerr << "Server: Refused to create document " << documentName << ", " << documents.size() << " are loaded already\n";
+        return nullptr;
+    }
+
+    std::unique_ptr<ServerTextEngine> textEngine;
+    if (engineType == TextEngineType::CRDT)
+        textEngine = std::make_unique<CrdtServerTextEngine>();
+    else
+        textEngine = std::make_unique<ServerTextEngine>();
+
+    auto document = std::make_unique<ServerDocument>(documentName, getShardIndex(documentName), std::move(textEngine));
+    recoverDocument(*document);
+
+    bool labelled = labelledDocumentNames.count(documentName) > 0;
+    if (!labelled && labelledDocumentNames.size() < config.documentMetricsLimit)
+    {
+        labelledDocumentNames.insert(documentName);
+        labelled = true;
+    }
+
+    registerDocumentMetrics(*document, labelled);
+    updateDocumentMetrics(*document);
+    document->connections = 1;
+    ServerDocument* documentPtr = document.get();
+    documents[documentName] = std::move(document);
+
+    std::cout << "Server: Created document " << documentName << " on shard " << documentPtr->shardIndex << "\n";
+    return documentPtr;
+}
+
+void Server::releaseDocument(ServerDocument& document, Sequencer& shard)
+{
+    const std::string documentName = document.name;
+    std::unique_ptr<ServerDocument> unloaded;
+    {
+        std::lock_guard<std::mutex> lock(documentsMutex);
+        if (--document.connections > 0 || document.name == defaultDocumentName)
+            return;
+
+        // Ops that failed to commit keep it loaded, it is retried once a client opens it and leaves again
+        if (!document.pendingBatch.empty() || (document.opLog && document.opLog->hasPendingRecords()))
+            return;
+
+        auto it = documents.find(document.name);
+        if (it == documents.end() || it->second.get() != &document)
+            return;
+
+        unloaded = std::move(it->second);
+        documents.erase(it);
+        shard.forgetDocument(&document);
+
+        // Documents past the metrics limit share their gauges, so take back only what this one added
+        if (document.versionGauge)
+        {
+            reportDocumentMetric(*document.versionGauge, document.reportedVersion, 0);
+            reportDocumentMetric(*document.historyGauge, document.reportedHistory, 0);
+            reportDocumentMetric(*document.piecesGauge, document.reportedPieces, 0);
+        }
+
+        // Closed under the lock, a client opening it again recovers it from what is on disk
+        unloaded.reset();
+    }
+
+    std::cout << "Server: Unloaded document " << documentName << "\n";
+}
+
+void Server::recoverDocument(ServerDocument& document)
+{
+    if (config.dataDirectory.empty())
+        return;
+
+    const std::string fileName = getDocumentFileName(document.name);
+    auto startTime = std::chrono::steady_clock::now();
+
+    // A snapshot still being written would delete log segments while we replay them
+    if (snapshotWriter)
+        snapshotWriter->waitFor(config.dataDirectory + "/" + fileName + ".snapshot");
+
+    uint64_t snapshotVersion = 0;
+    LoadedSnapshot snapshot;
+    if (Snapshot::load(config.dataDirectory + "/" + fileName + ".snapshot", snapshot))
+    {
+        // A CRDT sequence is checked against the text once that is loaded, so keep what to fall back to
+        const std::string initialText = engineType == TextEngineType::CRDT ? document.textEngine->getText() : std::string();
+        snapshotVersion = snapshot.docVersion;
+        document.textEngine->loadPieces(std::move(snapshot.pieces), snapshot.buffer, std::move(snapshot.storage), snapshotVersion);
+        if (!document.textEngine->loadSnapshotState(snapshot.engineState))
+        {
+            std::cerr << "Server: Snapshot of " << document.name << " does not fit its engine, replaying the logs alone\n";
+            document.textEngine->readString(initialText);
+            snapshotVersion = 0;
+        }
+    }
+
+    // Segments may still hold ops the snapshot covers if we crashed before deleting them
+    uint64_t replayed = 0;
+    for (const auto& [firstVersion, segmentPath] : listLogSegments(config.dataDirectory, fileName))
+    {
+        replayed += OpLog::replay(segmentPath, [&document, snapshotVersion] (std::unique_ptr<TextOperation> operation)
+        {
+            if (operation->docVersion >= snapshotVersion)
+                document.textEngine->applySequencedOperation(std::move(operation));
+        });
+    }
+
+    auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    if (snapshotVersion > 0 || replayed > 0)
+        std::cout << "Server: Recovered document " << document.name << " at version " << document.textEngine->getDocumentVersion()
+                  << " from snapshot at version " << snapshotVersion << " and " << replayed << " logged ops in " << elapsedMs << " ms\n";
+
+    uint64_t currentVersion = document.textEngine->getDocumentVersion();
+    document.opLog = std::make_unique<OpLog>(getLogSegmentPath(config.dataDirectory, fileName, currentVersion), config.groupCommitWindow);
+    if (!document.opLog->open())
+        document.opLog.reset();
+}
+
+void Server::checkpointDocument(ServerDocument& document)
+{
+    if (!snapshotWriter || !document.opLog)
+        return;
+
+    const std::string fileName = getDocumentFileName(document.name);
+    const uint64_t version = document.textEngine->getDocumentVersion();
+
+    // Ops from here on go to a segment the snapshot does not cover
+    if (!document.opLog->rotate(getLogSegmentPath(config.dataDirectory, fileName, version)))
+    {
+        std::cerr << "Server: Failed to start a new log segment for " << document.name << "\n";
+        return;
+    }
+
+    SnapshotJob job;
+    job.path = config.dataDirectory + "/" + fileName + ".snapshot";
+    job.view = document.textEngine->getPieceTableView();
+    job.docVersion = version;
+    job.engineState = document.textEngine->getSnapshotState();
+    job.onWritten = [dataDirectory = config.dataDirectory, fileName, version] ()
+    {
+        for (const auto& [firstVersion, segmentPath] : listLogSegments(dataDirectory, fileName))
+        {
+            if (firstVersion < version)
+                std::remove(segmentPath.c_str());
+        }
+    };
+
+    snapshotWriter->submit(std::move(job));
+}
+
+bool Server::startReactors()
+{
+    std::size_t reactorCount = config.reactorCount;
+    if (reactorCount == 0)
+        reactorCount = std::max(1u, std::thread::hardware_concurrency() / 4);
+
+    ReactorBackend backend = config.reactorBackend;
+    if (backend == ReactorBackend::IO_URING && !IoUringReactor::isSupported())
+    {
+        std::cerr << "Server: io_uring is not supported by this kernel, falling back to epoll\n";
+        backend = ReactorBackend::EPOLL;
+    }
+
+    for (std::size_t i = 0; i < reactorCount; i++)
+    {
+        auto reactor = Reactor::create(backend, [this, i] (int fd, uint32_t events, std::string_view data)
+        {
+            this->handleEvent(i, fd, events, data);
+        });
+
+        if (!reactor->start())
+            break;
+
+        reactors.push_back(std::move(reactor));
+    }
+
+    if (reactors.empty() || !reactors[0]->addListener(socketFd) ||
+        (unixSocketFd != -1 && !reactors[0]->addListener(unixSocketFd)) ||
+        (sharedMemorySocketFd != -1 && !reactors[0]->addListener(sharedMemorySocketFd)))
+    {
+        std::cerr << "Server: Failed to start reactors\n";
+        for (auto& reactor : reactors)
+            reactor->stop();
+
+        return false;
+    }
+
+    // No client is subscribed yet, so no shard broadcasts while these are created
+    if (backend == ReactorBackend::IO_URING)
+    {
+        for (std::size_t i = 0; i < shards.size(); i++)
+        {
+            if (std::unique_ptr<SendBatch> batch = SendBatch::create())
+                sendBatches.push_back(std::move(batch));
+        }
+
+        if (sendBatches.size() != shards.size())
+            sendBatches.clear();
+    }
+
+    std::cout << "Server: Started " << reactors.size() << (backend == ReactorBackend::IO_URING ? " io_uring" : " epoll") << " reactors\n";
+    return true;
+}
+
+void Server::handleEvent(std::size_t reactorIndex, int fd, uint32_t events, std::string_view data)
+{
+    if (fd == socketFd || fd == unixSocketFd || fd == sharedMemorySocketFd)
+    {
+        acceptClients(fd);
+        return;
+    }
+
+    std::shared_ptr<Connection> connection = findConnection(fd);
+    if (!connection || connection->closing)
+        return;
+
+    bool open = true;
+    if (events & EPOLLOUT)
+        open = connection->flush();
+
+    if (connection->usesSharedMemory())
+    {
+        // The socket only carries wake-ups, so what the reactor read of it is not a message. A wake-up may also
+        // mean the client made room in the ring we write to.
+        if (open && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            open = receiveFromClient(*connection) && connection->flush();
+    }
+    else if (open && !data.empty())
+    {
+        receivedBytes.add(data.size());
+        connection->reader.receive(data);
+        open = handleClientMessages(*connection);
+        if (!connection->reader.hasBufferedBytes())
+            connection->reader.reset();
+    }
+    else if (open && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+    {
+        open = receiveFromClient(*connection);
+    }
+
+    if (events & EPOLLHUP)
+        open = false;
+
+    if (!open)
+        disconnectClient(reactorIndex, *connection);
+}
+
+bool Server::startLocalListeners()
+{
+    if (!config.unixSocketPath.empty())
+    {
+        unixSocketFd = listenOnUnixSocket(config.unixSocketPath);
+        if (unixSocketFd == -1)
+            return false;
+
+        std::cout << "Server: Listening for local clients at " << config.unixSocketPath << "\n";
+    }
+
+    if (!config.sharedMemorySocketPath.empty())
+    {
+        sharedMemorySocketFd = listenOnUnixSocket(config.sharedMemorySocketPath);
+        if (sharedMemorySocketFd == -1)
+            return false;
+
+        std::cout << "Server: Listening for shared memory clients at " << config.sharedMemorySocketPath << "\n";
+    }
+
+    return true;
+}
+
+void Server::acceptClients(int listenSocket)
 {
     while (running)
     {
         struct sockaddr_storage clientAddr;
         socklen_t addrSize = sizeof(clientAddr);
         
-        int clientSocket = accept(socketFd, (struct sockaddr*)&clientAddr, &addrSize);
+        int clientSocket = accept4(listenSocket, (struct sockaddr*)&clientAddr, &addrSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
         
         if (clientSocket == -1)
         {
-            if (running)
-                std::cerr << "Failed to accept client connection\n";
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            // Edge-triggered: everything pending was taken, the next connection raises a new edge
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                std::cerr << "Failed to accept client connection: " << strerror(errno) << "\n";
             
-            continue;
+            return;
         }
 
+        // Small frames go out right away, batching happens explicitly in the broadcast tick
+        int noDelay = 1;
+        if (listenSocket == socketFd && setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) == -1 &&
+            errno != EOPNOTSUPP)
+            std::cerr << "Server: Failed to disable Nagle's algorithm for client " << clientSocket << "\n";
+
+        std::unique_ptr<SharedMemoryChannel> channel;
+        if (listenSocket == sharedMemorySocketFd)
+        {
+            channel = SharedMemoryChannel::create(clientSocket, config.sharedMemoryRingBytes);
+            if (!channel)
+            {
+                close(clientSocket);
+                continue;
+            }
+        }
+
+        auto connection = std::make_shared<Connection>(clientSocket, config.maxSendQueueBytes, std::move(channel));
         {
             std::lock_guard<std::mutex> lock(clientsMutex);
-            clientSockets.push_back(clientSocket);
+            connections[clientSocket] = connection;
         }
 
-        std::thread(&Server::handleClient, this, clientSocket).detach();
+        clientsAccepted.add();
+
+        // Writable edges tell us when a client that fell behind can take its queued frames
+        Reactor& reactor = *reactors[nextReactor++ % reactors.size()];
+        if (!reactor.add(clientSocket, EPOLLIN | EPOLLOUT))
+        {
+            std::cerr << "Server: Failed to watch client " << clientSocket << "\n";
+            closeClient(clientSocket);
+        }
     }
 }
 
-void Server::handleClient(int clientSocket)
+bool Server::receiveFromClient(Connection& connection)
 {
-    char buffer[4096];
-    
-    while (running)
+    FrameReader& reader = connection.reader;
+
+    while (true)
     {
-        ssize_t bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        std::size_t space = 0;
+        char* receiveBuffer = reader.prepareReceive(space);
+        ssize_t bytesReceived = connection.receive(receiveBuffer, space);
         
-        if (bytesReceived <= 0)
-            break;
+        if (bytesReceived == 0)
+            return false;
 
-        buffer[bytesReceived] = '\0';
-        std::string msg(buffer);
-        
+        if (bytesReceived < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            return false;
+        }
+
+        reader.commitReceive(static_cast<std::size_t>(bytesReceived));
+        receivedBytes.add(static_cast<uint64_t>(bytesReceived));
+
+        // One read can complete any number of frames
+        if (!handleClientMessages(connection))
+            return false;
+    }
+
+    // Idle clients hold no receive buffer
+    if (!reader.hasBufferedBytes())
+        reader.reset();
+
+    return true;
+}
+
+bool Server::handleClientMessages(Connection& connection)
+{
+    const int clientSocket = connection.socket;
+    FrameReader& reader = connection.reader;
+    connection.lastReceiveTime.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+
+    std::string_view msg;
+    uint64_t messages = 0;
+    while (reader.nextFrame(msg))
+    {
+        messages++;
         ParsedMessage parsedMsg = MessageParser::parseMessage(msg);
-        
-        std::string displayClientId = parsedMsg.clientId;
-        if (displayClientId == "UNKNOWN")
+        if (parsedMsg.type == MessageType::PING)
         {
-            // Fallback to stored mapping if not found in message
-            std::lock_guard<std::mutex> lock(clientsMutex);
-            auto it = clientIdMap.find(clientSocket);
-            if (it != clientIdMap.end())
-                displayClientId = it->second;
+            handlePing(connection, parsedMsg);
+            continue;
         }
         
-        std::cout << "Received from Client " << clientSocket << " (ID: " << displayClientId << "): " << msg << "\n";
+        // Presence arrives many times a second per client
+        if (config.logMessages && parsedMsg.type != MessageType::PRESENCE)
+        {
+            std::string displayClientId = parsedMsg.clientId;
+            if (displayClientId == "UNKNOWN")
+            {
+                // Fallback to stored mapping if not found in message
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                auto it = clientIdMap.find(clientSocket);
+                if (it != clientIdMap.end())
+                    displayClientId = it->second;
+            }
+
+            std::cout << "Received from Client " << clientSocket << " (ID: " << displayClientId << "): " << parsedMsg.toDisplayString() << "\n";
+        }
+
+        handleParsedMessage(parsedMsg, connection);
+    }
+
+    messagesReceived.add(messages);
+    return !reader.isCorrupt();
+}
+
+void Server::handlePing(Connection& connection, const ParsedMessage& parsedMsg)
+{
+    uint64_t sentTime = 0;
+    std::optional<uint64_t> knownVersion;
+    uint64_t unsentOperations = 0;
+    if (!MessageParser::parsePingMessage(parsedMsg.content, sentTime, knownVersion, unsentOperations))
+    {
+        std::cerr << "Server: Malformed heartbeat from client " << connection.socket << "\n";
+        return;
+    }
+
+    if (knownVersion)
+        connection.acknowledgedVersion.store(*knownVersion, std::memory_order_relaxed);
+
+    connection.hasUnsentEdits.store(!knownVersion || unsentOperations > 0, std::memory_order_relaxed);
+    connection.sendsHeartbeats.store(true, std::memory_order_relaxed);
+    connection.send(MessageParser::createPongMessage(sentTime, getWallClockMicros()));
+}
+
+void Server::runHeartbeatMonitor()
+{
+    std::unique_lock<std::mutex> lock(heartbeatMutex);
+    while (running)
+    {
+        // Checked a few times per timeout, a silent client goes within 1.25 timeouts
+        heartbeatCondition.wait_for(lock, config.heartbeatTimeout / 4);
+        if (!running)
+            break;
 
-        handleParsedMessage(parsedMsg, clientSocket);
+        std::vector<std::shared_ptr<Connection>> silent;
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> clientsLock(clientsMutex);
+            for (const auto& [clientSocket, connection] : connections)
+            {
+                if (connection->sendsHeartbeats.load(std::memory_order_relaxed) &&
+                    now - connection->lastReceiveTime.load(std::memory_order_relaxed) > config.heartbeatTimeout)
+                    silent.push_back(connection);
+            }
+        }
+
+        for (const auto& connection : silent)
+        {
+            std::cerr << "Server: No heartbeat from client " << connection->socket << " in "
+                      << config.heartbeatTimeout.count() << " ms, disconnecting it\n";
+
+            // Until its reactor dropped it, the client is not reported again
+            heartbeatTimeouts.add();
+            connection->sendsHeartbeats.store(false, std::memory_order_relaxed);
+            connection->shutdownSocket();
+        }
     }
+}
+
+void Server::disconnectClient(std::size_t reactorIndex, Connection& connection)
+{
+    connection.closing = true;
+    reactors[reactorIndex]->remove(connection.socket);
 
+    // A subscribed socket is closed by its shard once no more broadcasts can reach it
+    if (connection.document)
+        shards[connection.document->shardIndex]->submitLeave(connection.document, connection.socket);
+    else
+        closeClient(connection.socket);
+}
+
+void Server::closeClient(int clientSocket)
+{
+    std::shared_ptr<Connection> connection;
     {
         std::lock_guard<std::mutex> lock(clientsMutex);
-        auto it = std::find(clientSockets.begin(), clientSockets.end(), clientSocket);
-        if (it != clientSockets.end())
-            clientSockets.erase(it);
-        
+        auto it = connections.find(clientSocket);
+        if (it == connections.end())
+            return; // Already closed by stop()
+
+        connection = std::move(it->second);
+        connections.erase(it);
         clientIdMap.erase(clientSocket);
     }
-    
-    close(clientSocket);
+
+    clientsClosed.add();
+
+    connection->closeSocket();
 }
 
-void Server::broadcastToClients(const std::string& message, int excludeSocket)
+std::shared_ptr<Connection> Server::findConnection(int clientSocket)
 {
     std::lock_guard<std::mutex> lock(clientsMutex);
-    
-    for (int clientSocket : clientSockets)
+    auto it = connections.find(clientSocket);
+    return it != connections.end() ? it->second : nullptr;
+}
+
+void Server::sendToClient(int clientSocket, std::string_view message)
+{
+    // A failed send is noticed by the client's reactor, which drops the client
+    if (std::shared_ptr<Connection> connection = findConnection(clientSocket))
+        connection->send(message);
+}
+
+void Server::sendToClient(int clientSocket, const SharedFrame& frame)
+{
+    if (std::shared_ptr<Connection> connection = findConnection(clientSocket))
+        connection->send(frame);
+}
+
+void Server::broadcastToClients(const ServerDocument& document, const std::string& message, int excludeSocket)
+{
+    SharedFrame frame = Framing::makeSharedFrame(message);
+    for (const auto& [clientSocket, wireProtocol] : document.subscribers)
+    {
+        if (clientSocket == excludeSocket)
+            continue;
+
+        if (std::shared_ptr<Connection> connection = findConnection(clientSocket))
+            connection->send(frame);
+    }
+}
+
+void Server::broadcastSequencedOperations(ServerDocument& document, std::vector<SequencedOperation>& batch)
+{
+    // Subscribers are looked up once per batch instead of once per op
+    std::vector<std::pair<std::shared_ptr<Connection>, WireProtocol>> subscribers;
+    subscribers.reserve(document.subscribers.size());
+    for (const auto& [clientSocket, wireProtocol] : document.subscribers)
+    {
+        if (std::shared_ptr<Connection> connection = findConnection(clientSocket))
+            subscribers.emplace_back(std::move(connection), wireProtocol);
+    }
+
+    // On io_uring each op goes to every subscriber with one system call
+    SendBatch* sendBatch = sendBatches.empty() ? nullptr : sendBatches[document.shardIndex].get();
+
+    // Senders are acknowledged instead of being sent their own ops back
+    std::unordered_set<int> senders;
+    for (const SequencedOperation& sequencedOp : batch)
+        senders.insert(sequencedOp.clientSocket);
+
+    // The whole batch goes to each subscriber as one write, encoded at most once per protocol
+    const uint64_t docVersion = document.textEngine->getDocumentVersion();
+    SharedFrame framesByProtocol[static_cast<std::size_t>(latestWireProtocol)];
+    std::vector<std::size_t> frameEndsByProtocol[static_cast<std::size_t>(latestWireProtocol)];
+    std::size_t operations = 0;
+    std::size_t writes = 0;
+    for (const auto& [connection, wireProtocol] : subscribers)
+    {
+        if (resyncIfBehind(document, *connection))
+            continue;
+
+        connection->sentVersion.store(docVersion, std::memory_order_relaxed);
+        const std::size_t protocolIndex = static_cast<std::size_t>(wireProtocol) - 1;
+        SharedFrame frames = framesByProtocol[protocolIndex];
+        if (!frames)
+            frames = framesByProtocol[protocolIndex] = frameBatch(batch, wireProtocol, config.compression, frameEndsByProtocol[protocolIndex]);
+
+        if (senders.count(connection->socket))
+            frames = frameBatchForSender(batch, *connection, wireProtocol, *frames, frameEndsByProtocol[protocolIndex], operations);
+        else
+            operations += batch.size();
+
+        if (sendBatch)
+            sendBatch->add(*connection, frames);
+        else
+            connection->send(frames);
+
+        writes++;
+    }
+
+    if (sendBatch)
+        sendBatch->submit();
+
+    // Resynced subscribers got the document instead, which is not a write of the batch
+    operationsBroadcast.fetch_add(operations, std::memory_order_relaxed);
+    broadcastWrites.fetch_add(writes, std::memory_order_relaxed);
+    updateDocumentMetrics(document);
+
+    if (config.logMessages)
+    {
+        std::cout << "Server: Broadcasted " << batch.size() << " transformed operations on " << document.name << " to "
+                  << writes << " subscribers with one write each\n";
+    }
+}
+
+bool Server::resyncIfBehind(ServerDocument& document, Connection& connection)
+{
+    // Still applying the document it was sent last
+    const uint64_t acknowledged = connection.acknowledgedVersion.load(std::memory_order_relaxed);
+    if (connection.hasUnsentEdits.load(std::memory_order_relaxed) || acknowledged < connection.resyncVersion)
+        return false;
+
+    const std::size_t backlog = connection.getQueuedBytes();
+    const uint64_t lag = connection.getLag();
+    const bool backlogged = config.resyncBacklogBytes > 0 && backlog > config.resyncBacklogBytes &&
+                            backlog > document.textEngine->getDocumentLength();
+    const bool lagging = config.resyncLagOperations > 0 && lag > config.resyncLagOperations;
+    if (!backlogged && !lagging)
+        return false;
+
+    // A document on its way already brings it up to date
+    std::optional<std::size_t> discarded = connection.discardQueued();
+    if (!discarded)
+        return false;
+
+    std::cout << "Server: Client " << connection.socket << " is " << lag << " ops and " << backlog << " bytes behind on "
+              << document.name << ", sending it the document again\n";
+
+    resyncs.add();
+    resyncDiscardedBytes.add(*discarded);
+    sendInitialDocument(document, connection.socket);
+    return true;
+}
+
+BroadcastStats Server::getBroadcastStats() const
+{
+    return {
+        operationsBroadcast.load(std::memory_order_relaxed),
+        broadcastWrites.load(std::memory_order_relaxed)
+    };
+}
+
+std::size_t Server::getDocumentCount()
+{
+    std::lock_guard<std::mutex> lock(documentsMutex);
+    return documents.size();
+}
+
+void Server::sendInitialDocument(ServerDocument& document, int clientSocket)
+{
+    const uint64_t docVersion = document.textEngine->getDocumentVersion();
+    const WireProtocol wireProtocol = document.subscribers[clientSocket];
+    sendProtocol(document, clientSocket);
+    markDocumentSent(clientSocket, docVersion);
+
+    if (engineType == TextEngineType::OT && wireProtocol >= WireProtocol::STREAMED)
+    {
+        // Only the pieces and the add buffer are copied, the text is read from the snapshot as the socket drains
+        PieceTableView view = document.textEngine->getPieceTableView();
+        std::cout << "Server: Streaming document " << document.name << " with " << view.documentLength
+                  << " characters to client " << clientSocket << "\n";
+
+        auto stream = std::make_shared<DocumentStream>(std::move(view), docVersion, shouldCompress(DocumentStream::chunkSize, wireProtocol));
+        if (std::shared_ptr<Connection> connection = findConnection(clientSocket))
+            connection->send(std::move(stream));
+    }
+    else
+    {
+        const std::string state = document.textEngine->getDocumentState();
+        const std::string prefix = engineType == TextEngineType::CRDT ? MessageParser::createInitCrdtPrefix(docVersion)
+                                                                      : MessageParser::createInitDocumentPrefix(docVersion);
+
+        const std::size_t messageSize = prefix.size() + state.size();
+        if (shouldCompress(messageSize, wireProtocol))
+        {
+            // Compressed straight from the state, the plain message is never built
+            auto frame = std::make_shared<std::string>();
+            FrameCompressor compressor(*frame);
+            compressor.append(prefix);
+            compressor.append(state);
+            compressor.finish();
+
+            std::cout << "Server: Sent document " << document.name << " to client " << clientSocket << ", compressed "
+                      << messageSize << " bytes to " << frame->size() << "\n";
+            sendToClient(clientSocket, std::move(frame));
+        }
+        else
+        {
+            sendToClient(clientSocket, prefix + state);
+            std::cout << "Server: Sent document " << document.name << " to client " << clientSocket << "\n";
+        }
+    }
+
+    sendPresence(document, clientSocket);
+}
+
+void Server::sendCatchUp(ServerDocument& document, int clientSocket, const std::vector<const TextOperation*>& operations)
+{
+    // The client switches protocols before it reads the ops bundled here
+    sendProtocol(document, clientSocket);
+    const WireProtocol wireProtocol = document.subscribers[clientSocket];
+
+    std::vector<std::string> serialized(operations.size());
+    for (std::size_t i = 0; i < operations.size(); i++)
+        WireCodec::encode(*operations[i], wireProtocol, serialized[i]);
+
+    const uint64_t docVersion = document.textEngine->getDocumentVersion();
+    markDocumentSent(clientSocket, docVersion);
+    std::string catchUpMsg = MessageParser::createCatchUpMessage(docVersion, serialized);
+    sendToClient(clientSocket, Framing::makeSharedFrame(catchUpMsg, shouldCompress(catchUpMsg.size(), wireProtocol)));
+    std::cout << "Server: Caught up client " << clientSocket << " on document " << document.name << " with "
+              << operations.size() << " ops\n";
+
+    sendPresence(document, clientSocket);
+}
+
+void Server::markDocumentSent(int clientSocket, uint64_t docVersion)
+{
+    if (std::shared_ptr<Connection> connection = findConnection(clientSocket))
     {
-        if (clientSocket != excludeSocket)
-            send(clientSocket, message.c_str(), message.length(), 0);
+        connection->sentVersion.store(docVersion, std::memory_order_relaxed);
+        connection->resyncVersion = docVersion;
     }
 }
 
-void Server::handleParsedMessage(const ParsedMessage& parsedMsg, int clientSocket)
+void Server::sendProtocol(ServerDocument& document, int clientSocket)
+{
+    sendToClient(clientSocket, MessageParser::createProtocolMessage(document.subscribers[clientSocket]));
+}
+
+void Server::sendPresence(ServerDocument& document, int clientSocket)
+{
+    for (const auto& [presenceSocket, message] : document.presence)
+    {
+        if (presenceSocket != clientSocket)
+            sendToClient(clientSocket, message);
+    }
+}
+
+void Server::broadcastPresence(ServerDocument& document, const std::vector<std::pair<int, std::string>>& updates)
+{
+    for (const auto& [clientSocket, message] : updates)
+        broadcastToClients(document, message, clientSocket);
+}
+
+void Server::handleParsedMessage(ParsedMessage& parsedMsg, Connection& connection)
 {
+    const int clientSocket = connection.socket;
+    ServerDocument*& document = connection.document;
     switch (parsedMsg.type)
     {
         case MessageType::CONNECTED:
@@ -190,35 +1388,60 @@ void Server::handleParsedMessage(const ParsedMessage& parsedMsg, int clientSocke
                 std::lock_guard<std::mutex> lock(clientsMutex);
                 clientIdMap[clientSocket] = parsedMsg.clientId;
             }
-            std::cout << "Client " << clientSocket << " connected with ID: " << parsedMsg.clientId << "\n";
+            if (document)
+            {
+                std::cerr << "Client " << clientSocket << " already joined document " << document->name << "\n";
+                break;
+            }
+
+            document = getOrCreateDocument(parsedMsg.documentName);
+            if (!document)
+            {
+                connection.shutdownSocket();
+                break;
+            }
+
+            // Both sides speak every protocol up to the one they announce
+            WireProtocol wireProtocol = std::min(parsedMsg.wireProtocol, config.wireProtocol);
+            std::cout << "Client " << clientSocket << " connected with ID: " << parsedMsg.clientId << " to document " << document->name
+                      << " using wire protocol " << static_cast<unsigned int>(wireProtocol) << "\n";
             
-            std::string text = controller->getText();
-            std::string initMsg = MessageParser::createInitDocumentMessage(text);
-            send(clientSocket, initMsg.c_str(), initMsg.length(), 0);
-            std::cout << "Server: Sent initial document to client " << parsedMsg.clientId << "\n";
+            shards[document->shardIndex]->submitJoin(document, clientSocket, parsedMsg.knownVersion, wireProtocol);
             break;
         }
         
         case MessageType::OPERATION:
         {
-            std::unique_ptr<Operation> operation = Operation::deserialize(parsedMsg.content);
-            if (!operation)
+            // Counted even when dropped, so the client's count of ops sent on the connection stays in step
+            const uint64_t clientSequence = ++connection.operationsReceived;
+            if (!document)
             {
-                std::cerr << "Failed to deserialize operation: " << parsedMsg.content << " from client: " << parsedMsg.clientId << "\n";
+                std::cerr << "Operation from client " << clientSocket << " before joining a document\n";
                 return;
             }
 
-            // Apply to authoritative document
-            std::unique_ptr<Operation> transformedOp = controller->processIncomingMessage(parsedMsg.content);
-            if (transformedOp) {
-                std::string opMsg = transformedOp->serialize();
-                
-                broadcastToClients(opMsg, -1);
-                std::cout << "Server: Broadcasted transformed operation: " << opMsg << "\n";
+            // Decoded by the parser already
+            if (!parsedMsg.operation)
+            {
+                std::cerr << "Failed to deserialize operation from client: " << parsedMsg.clientId << "\n";
+                return;
             }
+
+            // The sequencer transforms and applies it to the authoritative document and broadcasts the result
+            operationsReceived.add();
+            shards[document->shardIndex]->submitOperation(document, clientSocket, std::move(parsedMsg.operation), clientSequence);
             break;
         }
         
+        case MessageType::PRESENCE:
+        {
+            // Presence before joining has no one to go to
+            if (document)
+                shards[document->shardIndex]->submitPresence(document, clientSocket, parsedMsg.content);
+
+            break;
+        }
+
         default:
             std::cerr << "Unknown message type received from client " << clientSocket << "\n";
             break;
@@ -3,54 +3,386 @@
 #include <stdint.h>
 #include <vector>
 #include <string>
-#include <thread>
+#include <string_view>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <atomic>
 #include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <chrono>
+
+#include "wire_codec.h"
+#include "framing.h"
+#include "reactor.h"
+#include "shared_memory_channel.h"
+#include "../metrics/metrics.h"
 
 class Controller;
+class Sequencer;
+class Connection;
+class SendBatch;
+class ServerDocument;
+class SnapshotWriter;
+class MetricsEndpoint;
 struct ParsedMessage;
+struct SequencedOperation;
+class TextOperation;
+enum class TextEngineType;
+
+struct ServerConfig
+{
+    // Number of sequencer shards documents are spread over. 0 uses one per core.
+    std::size_t shardCount = 0;
+
+    // Number of reactor threads client sockets are spread over. 0 uses one per four cores.
+    std::size_t reactorCount = 0;
+
+    // IO_URING also sends each broadcast to all subscribers with one system call
+    ReactorBackend reactorBackend = ReactorBackend::EPOLL;
+
+    // Bytes a client may fall behind before it is disconnected. It catches up from its version when it reconnects.
+    std::size_t maxSendQueueBytes = 8 * 1024 * 1024;
+
+    // A client whose send queue grows past this many bytes, more than the document's length, gets the current
+    // document instead of the queued ops. 0 disables it.
+    std::size_t resyncBacklogBytes = 1024 * 1024;
+
+    // A client whose heartbeats report it more ops behind than this gets the current document instead of the ops it
+    // has not applied yet. 0 disables it. Either resync only applies to clients whose heartbeats report no unsent
+    // edits, which a fresh document would drop; others keep receiving ops and are dropped at maxSendQueueBytes.
+    uint64_t resyncLagOperations = 10000;
+
+    // Directory holding each document's op log. Empty runs without durability.
+    std::string dataDirectory;
+
+    // How long a shard may hold sequenced ops so they share one fsync
+    std::chrono::microseconds groupCommitWindow = std::chrono::microseconds(2000);
+
+    // Ops after which a document is snapshotted and its older log segments are deleted. 0 disables snapshots.
+    uint64_t snapshotInterval = 10000;
+
+    // Sequenced ops each document keeps in memory to transform late ops against and to catch reconnecting clients
+    // up with. Clients further behind are sent the document instead. 0 keeps every op for the life of the process.
+    std::size_t historyOperations = 10000;
+
+    // How long a shard collects a document's ops before broadcasting them together, e.g. 5-16 ms to trade a tick of
+    // latency for far fewer writes under heavy typing. 0 broadcasts each drain of the shard's queue right away,
+    // which batches by itself as load grows.
+    std::chrono::microseconds broadcastInterval = std::chrono::microseconds(0);
+
+    // Minimum time between presence broadcasts of a document
+    std::chrono::milliseconds presenceInterval = std::chrono::milliseconds(50);
+
+    // Compress large messages for clients that speak WireProtocol::COMPRESSED. Off saves the CPU on fast links.
+    bool compression = true;
+
+    // Highest protocol offered to clients. TEXT keeps every op readable in logs and packet captures.
+    WireProtocol wireProtocol = latestWireProtocol;
+
+    // Log every message received and every batch broadcast. Formatting them costs more than handling them.
+    bool logMessages = false;
+
+    // Clients that send heartbeats and then stay silent this long are dropped instead of waiting for TCP to give up
+    // on them. They send one a second. 0 keeps them until their socket fails.
+    std::chrono::milliseconds heartbeatTimeout = std::chrono::milliseconds(5000);
+
+    // Unix domain socket clients on this machine may connect to with the address unix:<path> instead of going
+    // through TCP. Empty listens on TCP only.
+    std::string unixSocketPath;
+
+    // Unix domain socket for clients on this machine that exchange frames through shared memory rings, connecting
+    // with the address shm:<path>. Suits bots and indexers sending at a high rate. Empty disables it.
+    std::string sharedMemorySocketPath;
+
+    // Bytes of each direction's ring of a shared memory client
+    std::size_t sharedMemoryRingBytes = SharedMemoryChannel::defaultRingBytes;
+
+    // Port on 127.0.0.1 the process's metrics are served on in the Prometheus text format, 0 for none
+    uint16_t metricsPort = 0;
+
+    // Unix domain socket the metrics are also served at. Empty for none.
+    std::string metricsSocketPath;
+
+    // Documents that get metrics labelled with their name. Clients choose the names, so the documents created
+    // after these are summed into one series per metric, labelled overflow="true", instead.
+    std::size_t documentMetricsLimit = 100;
+
+    // Documents loaded at once. Clients opening another one are disconnected. A document is unloaded once its last
+    // client left and its log is committed. 0 for no limit.
+    std::size_t maxDocuments = 10000;
+};
+
+struct BroadcastStats
+{
+    uint64_t operationsBroadcast;   // Ops delivered, counted once per subscriber
+    uint64_t writes;                // Writes that carried them, one per subscriber per batch it was sent
+};
 
 class Server {
 public:
     Controller* controller;
 
 private:
-    const uint16_t port;
+    // The one bound when the server was asked for port 0
+    uint16_t port;
     const std::string bindAddress;
+    const ServerConfig config;
     int socketFd;
-    std::vector<int> clientSockets;
+    int unixSocketFd = -1;
+    int sharedMemorySocketFd = -1;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
     std::unordered_map<int, std::string> clientIdMap;
     std::mutex clientsMutex;
+
+    // Reactor 0 also accepts new clients and hands them out round robin
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::size_t nextReactor = 0;
+
+    // One per shard when running on io_uring, used by the shard's broadcasts only
+    std::vector<std::unique_ptr<SendBatch>> sendBatches;
+
+    std::vector<std::unique_ptr<Sequencer>> shards;
+    std::unordered_map<std::string, std::unique_ptr<ServerDocument>> documents;
+    std::mutex documentsMutex;
+
+    // Documents that got metrics labelled with their name, kept when they are unloaded so the series stay capped
+    std::unordered_set<std::string> labelledDocumentNames;
+    std::unique_ptr<SnapshotWriter> snapshotWriter;
+
+    // Engine of the document the server was started with, used for every document it creates
+    TextEngineType engineType;
     std::atomic<bool> running;
-    std::thread acceptThread;
+
+    // operationsBroadcast / broadcastWrites is the ops per write, their difference the writes batching saved
+    std::atomic<uint64_t> operationsBroadcast = 0;
+    std::atomic<uint64_t> broadcastWrites = 0;
+
+    std::thread heartbeatThread;
+    std::mutex heartbeatMutex;
+    std::condition_variable heartbeatCondition;
+
+    // Counted as it happens. What is cheaper to read on a scrape, e.g. queued bytes, comes from appendMetrics().
+    Counter& messagesReceived = MetricsRegistry::global().getCounter("reped_server_messages_received_total",
+        "Messages received from clients");
+    Counter& receivedBytes = MetricsRegistry::global().getCounter("reped_server_received_bytes_total",
+        "Bytes received from clients");
+    Counter& operationsReceived = MetricsRegistry::global().getCounter("reped_server_operations_received_total",
+        "Ops received from clients and handed to a shard");
+    Counter& clientsAccepted = MetricsRegistry::global().getCounter("reped_server_clients_accepted_total",
+        "Client connections accepted");
+    Counter& clientsClosed = MetricsRegistry::global().getCounter("reped_server_clients_closed_total",
+        "Client connections closed");
+    Counter& heartbeatTimeouts = MetricsRegistry::global().getCounter("reped_server_heartbeat_timeouts_total",
+        "Clients dropped for not sending heartbeats");
+    Counter& resyncs = MetricsRegistry::global().getCounter("reped_server_resyncs_total",
+        "Clients that fell behind and were sent the document instead of the ops they missed");
+    Counter& resyncDiscardedBytes = MetricsRegistry::global().getCounter("reped_server_resync_discarded_bytes_total",
+        "Queued bytes dropped by resyncs");
+
+    std::unique_ptr<MetricsEndpoint> metricsEndpoint;
+    uint64_t metricsCollector = 0;
 
 public:
-    Server(const uint16_t port, const std::string& bindAddress, Controller* controller);
+    Server(const uint16_t port, const std::string& bindAddress, Controller* controller, const ServerConfig& config = ServerConfig());
     ~Server();
 
+    /**
+     * @returns False if the server could not bind, listen or start its reactors
+    */
+    [[nodiscard]] bool isRunning() const { return running; }
+
+    /**
+     * @returns The port the server listens on, the one the kernel picked if it was started with port 0
+    */
+    [[nodiscard]] uint16_t getPort() const { return port; }
+
+    [[nodiscard]] BroadcastStats getBroadcastStats() const;
+
+    /**
+     * @returns Documents loaded at the moment, the default one included
+    */
+    [[nodiscard]] std::size_t getDocumentCount();
+
+    /**
+     * Appends what is read when the metrics are scraped: clients, queued bytes, shard queues and broadcasts.
+     * Safe to call from any thread.
+    */
+    void appendMetrics(std::string& out);
+
 private:
     void start();
     void stop();
 
     /**
-     * Continuously accepts new client connections and adds their sockets to the clientSockets list.
-     * For each new client, it spawns a thread to handle communication with that client.
+     * Registers the server's metrics and starts serving them if a metrics port or socket is configured. The server
+     * keeps running without them if they cannot be served.
+    */
+    void startMetrics();
+
+    /**
+     * Starts one sequencer per shard, each pinned to a core.
+    */
+    void startShards();
+    [[nodiscard]] std::size_t getShardIndex(const std::string& documentName) const;
+
+    /**
+     * Looks up a hosted document by name, creating an empty one on its shard if it does not exist yet, and counts
+     * the connection that asked for it until releaseDocument().
+     * @returns Null if the name is not a valid document name or maxDocuments are loaded already
+    */
+    ServerDocument* getOrCreateDocument(const std::string& documentName);
+
+    /**
+     * Uncounts a connection that left the document, and unloads the document if it was the last one and everything
+     * sequenced is committed. Runs on the document's shard thread after the leave.
+    */
+    void releaseDocument(ServerDocument& document, Sequencer& shard);
+
+    /**
+     * Loads the document's latest snapshot from the data directory, replays the log segments written after it and
+     * opens a new segment for appending. Must run before the document is handed to its shard.
     */
-    void acceptClients();
+    void recoverDocument(ServerDocument& document);
 
     /**
-     * Handles communication with a single client. Receives messages from the client and broadcasts them to all other clients.
-     * Removes the client from the list and closes the socket when the client disconnects.
+     * Starts a new log segment and hands a view of the document to the snapshot writer. Once the snapshot is
+     * durable the segments it covers are deleted. Runs on the document's shard thread.
     */
-    void handleClient(int clientSocket);
+    void checkpointDocument(ServerDocument& document);
 
     /**
-     * Broadcast incoming message to all connected clients except excludeSocket.
+     * Starts the reactor threads and starts watching the listening socket. Falls back to epoll if io_uring was
+     * asked for and the kernel does not support it.
+     * @returns False if no reactor could be started
+    */
+    bool startReactors();
+
+    /**
+     * Dispatches a socket event of one of the reactors. Runs on that reactor's thread.
+     * @param data Bytes the reactor received for the client, empty if they still have to be read
+    */
+    void handleEvent(std::size_t reactorIndex, int fd, uint32_t events, std::string_view data);
+
+    /**
+     * Listens on the Unix domain sockets configured besides the TCP port.
+     * @returns False if one of them could not be bound
+    */
+    bool startLocalListeners();
+
+    /**
+     * Accepts every pending client connection on a listening socket and registers it with a reactor. Clients of
+     * the shared memory socket get their rings first. Runs on reactor 0.
+    */
+    void acceptClients(int listenSocket);
+
+    /**
+     * Reads everything the client sent until the socket would block and hands each message to the shard of the
+     * document it joined.
+     * @returns False if the client disconnected or sent a corrupt stream
+    */
+    bool receiveFromClient(Connection& connection);
+
+    /**
+     * Hands each complete message the client sent to the shard of the document it joined.
+     * @returns False if the client sent a corrupt stream
+    */
+    bool handleClientMessages(Connection& connection);
+
+    /**
+     * Answers a heartbeat right on the reactor thread, so the round trip the client measures does not include a
+     * shard's queue.
+    */
+    void handlePing(Connection& connection, const ParsedMessage& parsedMsg);
+
+    /**
+     * Shuts down the sockets of clients that stopped sending heartbeats, until the server stops.
+    */
+    void runHeartbeatMonitor();
+
+    /**
+     * Stops watching a client's socket and unsubscribes it. Its socket is closed once its shard let go of it.
+    */
+    void disconnectClient(std::size_t reactorIndex, Connection& connection);
+
+    /**
+     * Removes the client from the list and closes its socket.
+    */
+    void closeClient(int clientSocket);
+
+    [[nodiscard]] std::shared_ptr<Connection> findConnection(int clientSocket);
+
+    /**
+     * Sends a message as one frame without blocking. Bytes the socket does not take are queued on the connection.
+    */
+    void sendToClient(int clientSocket, std::string_view message);
+    void sendToClient(int clientSocket, const SharedFrame& frame);
+
+    /**
+     * @returns True if a message of this size goes compressed to a client speaking the protocol
+    */
+    [[nodiscard]] bool shouldCompress(std::size_t messageSize, WireProtocol wireProtocol) const
+    {
+        return config.compression && Framing::shouldCompress(messageSize, wireProtocol);
+    }
+
+    /**
+     * Broadcast incoming message to all subscribers of a document except excludeSocket.
+     * Must run on the document's shard thread.
      * @param message Incoming message.
      * @param excludeSocket Socket to exclude from broadcast (client sending the message).
     */
-    void broadcastToClients(const std::string& message, int excludeSocket = -1);
+    void broadcastToClients(const ServerDocument& document, const std::string& message, int excludeSocket = -1);
+
+    /**
+     * Broadcast stage for the sequencer. Runs on the document's shard thread once per batch and sends each
+     * subscriber the whole batch with one write, with acks in place of the subscriber's own ops.
+    */
+    void broadcastSequencedOperations(ServerDocument& document, std::vector<SequencedOperation>& batch);
 
-    void handleParsedMessage(const ParsedMessage& parsedMsg, int clientSocket);
+    /**
+     * Sends the document again, instead of the ops in its queue, to a subscriber that is too far behind and has no
+     * unsent edits. Runs on the document's shard thread.
+     * @returns True if the client was resynced and must not be sent the current batch
+    */
+    bool resyncIfBehind(ServerDocument& document, Connection& connection);
+
+    /**
+     * Sends the document to a client that was just subscribed to it. Runs on the shard thread so the client sees
+     * exactly the ops sequenced after the text it received. OT documents are streamed in chunks from a snapshot of
+     * their pieces to clients that speak WireProtocol::STREAMED.
+    */
+    void sendInitialDocument(ServerDocument& document, int clientSocket);
+
+    /**
+     * Sends a reconnecting client the ops it missed instead of the whole document. Runs on the shard thread.
+    */
+    void sendCatchUp(ServerDocument& document, int clientSocket, const std::vector<const TextOperation*>& operations);
+
+    /**
+     * Records that the client was sent the document as of a version, so it is not resynced before it applied it.
+     * Runs on the shard thread.
+    */
+    void markDocumentSent(int clientSocket, uint64_t docVersion);
+
+    /**
+     * Tells a joining client which protocol its ops are encoded in from now on. Runs on the shard thread.
+    */
+    void sendProtocol(ServerDocument& document, int clientSocket);
+
+    /**
+     * Sends a joining client where everyone else's cursor is. Runs on the shard thread.
+    */
+    void sendPresence(ServerDocument& document, int clientSocket);
+
+    /**
+     * Forwards coalesced presence updates to every subscriber except their sender. Runs on the shard thread.
+    */
+    void broadcastPresence(ServerDocument& document, const std::vector<std::pair<int, std::string>>& updates);
+
+    /**
+     * @param connection Its document is set when a CONNECTED message is handled. Reactor thread only.
+    */
+    void handleParsedMessage(ParsedMessage& parsedMsg, Connection& connection);
 };
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "../text_engine/server_text_engine.h"
+#include "../text_engine/operations.h"
+#include "../persistence/op_log.h"
+#include "wire_codec.h"
+#include "../metrics/metrics.h"
+
+struct SequencedOperation
+{
+    int clientSocket;
+    std::unique_ptr<TextOperation> operation;
+    uint64_t sequencedAt;       // Wall-clock microseconds, sent along to clients that speak WireProtocol::TIMED
+    uint64_t clientSequence;    // Ops the client sent on its connection up to this one, 0 if not counted
+    uint64_t baseVersion;       // Version the client made the op at, before it was transformed
+};
+
+/**
+ * A shared document hosted by the server. It is pinned to one shard and everything below the name is only
+ * touched by that shard's sequencer thread, except for the incoming presence which connection threads write.
+*/
+class ServerDocument
+{
+public:
+    const std::string name;
+    const std::size_t shardIndex;
+    ServerTextEngine* textEngine;
+
+    // Clients that received the document and get its broadcasts, with the protocol each one's ops are encoded in
+    std::unordered_map<int, WireProtocol> subscribers;
+
+    // Ops sequenced in the current drain that have not been handed to the broadcast stage yet
+    std::vector<SequencedOperation> pendingBatch;
+
+    // When the pending batch is due to go out, one broadcast interval after its first op
+    std::chrono::steady_clock::time_point broadcastDeadline;
+
+    // Write-ahead log of sequenced ops. Null when the server runs without a data directory.
+    std::unique_ptr<OpLog> opLog;
+
+    // Ops broadcast since the last snapshot was scheduled
+    uint64_t opsSinceCheckpoint = 0;
+
+    // Connections that opened the document and have not left it yet. Guarded by the server's documents mutex.
+    std::size_t connections = 0;
+
+    // Size of the document as of its last broadcast, labelled with its name or, past the server's limit on
+    // labelled documents, shared with every other document past it. Set by the shard thread once the server
+    // registered them.
+    Gauge* versionGauge = nullptr;
+    Gauge* historyGauge = nullptr;
+    Gauge* piecesGauge = nullptr;
+
+    // What the document last added to its gauges, taken back out by its next update
+    int64_t reportedVersion = 0;
+    int64_t reportedHistory = 0;
+    int64_t reportedPieces = 0;
+
+    // Latest presence message per client socket that has not been broadcast yet. A newer update replaces the
+    // previous one instead of queueing behind it.
+    std::mutex incomingPresenceMutex;
+    std::unordered_map<int, std::string> incomingPresence;
+    std::atomic<bool> presenceQueued = false;
+
+    // Presence last broadcast per client socket, sent to clients when they join
+    std::unordered_map<int, std::string> presence;
+    std::chrono::steady_clock::time_point nextPresenceBroadcast;
+
+private:
+    std::unique_ptr<ServerTextEngine> ownedTextEngine;
+
+public:
+    /**
+     * @param textEngine Engine to host. If null, the document owns a new empty engine.
+    */
+    ServerDocument(const std::string& name, std::size_t shardIndex, ServerTextEngine* textEngine = nullptr)
+        : name(name), shardIndex(shardIndex), textEngine(textEngine)
+    {
+        if (!this->textEngine)
+        {
+            ownedTextEngine = std::make_unique<ServerTextEngine>();
+            this->textEngine = ownedTextEngine.get();
+        }
+    }
+
+    /**
+     * @param textEngine Engine the document owns, e.g. one of another type than the default
+    */
+    ServerDocument(const std::string& name, std::size_t shardIndex, std::unique_ptr<ServerTextEngine> textEngine)
+        : name(name), shardIndex(shardIndex), textEngine(textEngine.get()), ownedTextEngine(std::move(textEngine))
+    {}
+};
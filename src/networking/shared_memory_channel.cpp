@@ -0,0 +1,372 @@
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "shared_memory_channel.h"
+
+namespace
+{
+    constexpr uint64_t channelMagic = 0x314d534445504552;  // "REPEDSM1"
+    constexpr std::size_t pageSize = 4096;
+
+    uint64_t roundUpToPowerOfTwo(uint64_t value)
+    {
+        uint64_t rounded = pageSize;
+        while (rounded < value)
+            rounded <<= 1;
+
+        return rounded;
+    }
+
+    void copyIntoRing(char* ring, uint64_t ringBytes, uint64_t position, const char* bytes, std::size_t size)
+    {
+        const std::size_t offset = static_cast<std::size_t>(position & (ringBytes - 1));
+        const std::size_t first = std::min<std::size_t>(size, ringBytes - offset);
+        memcpy(ring + offset, bytes, first);
+        memcpy(ring, bytes + first, size - first);
+    }
+
+    void copyFromRing(const char* ring, uint64_t ringBytes, uint64_t position, char* bytes, std::size_t size)
+    {
+        const std::size_t offset = static_cast<std::size_t>(position & (ringBytes - 1));
+        const std::size_t first = std::min<std::size_t>(size, ringBytes - offset);
+        memcpy(bytes, ring + offset, first);
+        memcpy(bytes + first, ring, size - first);
+    }
+
+    /**
+     * Passes a descriptor with a single byte, so the receiver knows where in the stream it arrived.
+    */
+    bool sendDescriptor(int socket, int fd)
+    {
+        char byte = 0;
+        struct iovec part;
+        part.iov_base = &byte;
+        part.iov_len = 1;
+
+        union
+        {
+            char buffer[CMSG_SPACE(sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        memset(&control, 0, sizeof(control));
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &part;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+
+        struct cmsghdr* header = CMSG_FIRSTHDR(&msg);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+        while (true)
+        {
+            ssize_t sent = sendmsg(socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent == 1)
+                return true;
+            if (sent < 0 && errno == EINTR)
+                continue;
+
+            return false;
+        }
+    }
+
+    /**
+     * @returns The descriptor passed with the next byte, -1 on timeout or if there was none
+    */
+    int receiveDescriptor(int socket, std::chrono::milliseconds timeout)
+    {
+        struct pollfd readable;
+        readable.fd = socket;
+        readable.events = POLLIN;
+        int ready;
+        while ((ready = poll(&readable, 1, static_cast<int>(timeout.count()))) < 0 && errno == EINTR)
+        {
+        }
+
+        if (ready <= 0)
+            return -1;
+
+        char byte = 0;
+        struct iovec part;
+        part.iov_base = &byte;
+        part.iov_len = 1;
+
+        union
+        {
+            char buffer[CMSG_SPACE(sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        memset(&control, 0, sizeof(control));
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &part;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+
+        ssize_t received;
+        while ((received = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT)) < 0 && errno == EINTR)
+        {
+        }
+
+        struct cmsghdr* header = CMSG_FIRSTHDR(&msg);
+        if (received != 1 || !header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+            header->cmsg_len != CMSG_LEN(sizeof(int)))
+            return -1;
+
+        int fd;
+        memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        return fd;
+    }
+}
+
+std::size_t SharedMemoryChannel::getMemorySize(uint64_t ringBytes)
+{
+    const std::size_t headerBytes = (sizeof(SharedHeader) + pageSize - 1) / pageSize * pageSize;
+    return headerBytes + 2 * static_cast<std::size_t>(ringBytes);
+}
+
+std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::create(int socket, std::size_t ringBytes)
+{
+    const uint64_t roundedRingBytes = roundUpToPowerOfTwo(ringBytes);
+    const std::size_t memorySize = getMemorySize(roundedRingBytes);
+
+    int memoryFd = memfd_create("reped-channel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memoryFd == -1)
+    {
+        std::cerr << "SharedMemoryChannel: Failed to create shared memory: " << strerror(errno) << "\n";
+        return nullptr;
+    }
+
+    // The client must not shrink the memory while we read it, which would fault instead of failing a read
+    if (ftruncate(memoryFd, static_cast<off_t>(memorySize)) == -1 ||
+        fcntl(memoryFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+    {
+        std::cerr << "SharedMemoryChannel: Failed to size shared memory: " << strerror(errno) << "\n";
+        close(memoryFd);
+        return nullptr;
+    }
+
+    void* memory = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "SharedMemoryChannel: Failed to map shared memory: " << strerror(errno) << "\n";
+        close(memoryFd);
+        return nullptr;
+    }
+
+    SharedHeader* header = new (memory) SharedHeader();
+    header->magic = channelMagic;
+    header->ringBytes = roundedRingBytes;
+
+    // The socket was just accepted, so its buffer has room for the byte
+    const bool sent = sendDescriptor(socket, memoryFd);
+    close(memoryFd);
+    if (!sent)
+    {
+        std::cerr << "SharedMemoryChannel: Failed to pass shared memory to the client\n";
+        munmap(memory, memorySize);
+        return nullptr;
+    }
+
+    return std::unique_ptr<SharedMemoryChannel>(new SharedMemoryChannel(socket, memory, memorySize, true));
+}
+
+std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::accept(int socket, std::chrono::milliseconds timeout)
+{
+    int memoryFd = receiveDescriptor(socket, timeout);
+    if (memoryFd == -1)
+    {
+        std::cerr << "SharedMemoryChannel: The server did not pass shared memory\n";
+        return nullptr;
+    }
+
+    struct stat status;
+    void* memory = MAP_FAILED;
+    std::size_t memorySize = 0;
+    if (fstat(memoryFd, &status) == 0 && static_cast<std::size_t>(status.st_size) > sizeof(SharedHeader))
+    {
+        memorySize = static_cast<std::size_t>(status.st_size);
+        memory = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    }
+
+    close(memoryFd);
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "SharedMemoryChannel: Failed to map shared memory\n";
+        return nullptr;
+    }
+
+    const SharedHeader* header = static_cast<const SharedHeader*>(memory);
+    const uint64_t ringBytes = header->ringBytes;
+    if (header->magic != channelMagic || ringBytes < pageSize || (ringBytes & (ringBytes - 1)) != 0 ||
+        getMemorySize(ringBytes) != memorySize)
+    {
+        std::cerr << "SharedMemoryChannel: The server passed memory that does not hold rings\n";
+        munmap(memory, memorySize);
+        return nullptr;
+    }
+
+    return std::unique_ptr<SharedMemoryChannel>(new SharedMemoryChannel(socket, memory, memorySize, false));
+}
+
+SharedMemoryChannel::SharedMemoryChannel(int socket, void* memory, std::size_t memorySize, bool serverSide)
+    : socket(socket), memory(memory), memorySize(memorySize), ringBytes(static_cast<SharedHeader*>(memory)->ringBytes)
+{
+    SharedHeader* header = static_cast<SharedHeader*>(memory);
+    char* data = static_cast<char*>(memory) + (memorySize - 2 * ringBytes);
+
+    const std::size_t inboundIndex = serverSide ? 0 : 1;
+    inbound = &header->rings[inboundIndex];
+    outbound = &header->rings[1 - inboundIndex];
+    inboundData = data + inboundIndex * ringBytes;
+    outboundData = data + (1 - inboundIndex) * ringBytes;
+
+    inboundHead = inbound->head.load(std::memory_order_acquire);
+    outboundTail = outbound->tail.load(std::memory_order_acquire);
+}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+    munmap(memory, memorySize);
+}
+
+ssize_t SharedMemoryChannel::send(const struct iovec* parts, std::size_t partCount)
+{
+    uint64_t used = outboundTail - outbound->head.load(std::memory_order_acquire);
+    if (used > ringBytes)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    if (used == ringBytes)
+    {
+        // Pairs with receive() storing its head before it looks at the flag: it either sees the flag and wakes
+        // us, or we see the room it made
+        outbound->writerWaiting.store(1, std::memory_order_seq_cst);
+        used = outboundTail - outbound->head.load(std::memory_order_seq_cst);
+        if (used == ringBytes)
+            return 0;
+
+        outbound->writerWaiting.store(0, std::memory_order_relaxed);
+        if (used > ringBytes)
+        {
+            errno = EPROTO;
+            return -1;
+        }
+    }
+
+    const uint64_t room = ringBytes - used;
+    std::size_t written = 0;
+    for (std::size_t i = 0; i < partCount && written < room; i++)
+    {
+        const std::size_t size = std::min<std::size_t>(parts[i].iov_len, room - written);
+        copyIntoRing(outboundData, ringBytes, outboundTail + written, static_cast<const char*>(parts[i].iov_base), size);
+        written += size;
+    }
+
+    if (written == 0)
+        return 0;
+
+    const uint64_t previousTail = outboundTail;
+    outboundTail += written;
+    outbound->tail.store(outboundTail, std::memory_order_seq_cst);
+
+    // Pairs with receive() storing its head before it looks at the tail a last time: it either sees these bytes,
+    // or we see that it read everything before them and may be asleep
+    if (outbound->head.load(std::memory_order_seq_cst) == previousTail && !wakePeer())
+        return -1;
+
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t SharedMemoryChannel::receive(char* buffer, std::size_t space)
+{
+    uint64_t tail = inbound->tail.load(std::memory_order_acquire);
+    if (tail == inboundHead)
+    {
+        // Wake-ups are read before looking a last time, so bytes written after this raise a new edge
+        if (!drainWakeUps())
+            return -1;
+
+        tail = inbound->tail.load(std::memory_order_seq_cst);
+        if (tail == inboundHead)
+        {
+            if (peerClosed)
+                return 0;
+
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    if (tail - inboundHead > ringBytes)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    const std::size_t size = static_cast<std::size_t>(std::min<uint64_t>(space, tail - inboundHead));
+    copyFromRing(inboundData, ringBytes, inboundHead, buffer, size);
+    inboundHead += size;
+    inbound->head.store(inboundHead, std::memory_order_seq_cst);
+
+    if (inbound->writerWaiting.load(std::memory_order_seq_cst) != 0 && inbound->writerWaiting.exchange(0) != 0 && !wakePeer())
+        return -1;
+
+    return static_cast<ssize_t>(size);
+}
+
+bool SharedMemoryChannel::wakePeer()
+{
+    const char wakeUp = 0;
+    while (true)
+    {
+        ssize_t sent = ::send(socket, &wakeUp, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent == 1)
+            return true;
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        // A full socket holds wake-ups the peer did not read yet, and it reads the ring again after reading those
+        return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+bool SharedMemoryChannel::drainWakeUps()
+{
+    char wakeUps[256];
+    while (true)
+    {
+        ssize_t received = recv(socket, wakeUps, sizeof(wakeUps), MSG_DONTWAIT);
+        if (received > 0)
+            continue;
+
+        if (received == 0)
+        {
+            peerClosed = true;
+            return true;
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
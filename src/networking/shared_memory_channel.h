@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * Byte stream between two processes on one machine through a pair of single-producer single-consumer rings in
+ * shared memory, one per direction. It behaves like a non-blocking stream socket, so frames are written and read
+ * exactly as over a socket, but bytes are copied once into memory the peer reads directly.
+ *
+ * A connected Unix domain socket comes along with the rings. The server creates the memory when it accepts the
+ * socket and passes it over the socket; after that the socket carries no data, only a byte now and then to wake
+ * the peer: when a write finds that the peer read everything before it, so it may be asleep, and when a read
+ * makes room for a writer that found its ring full. While the reader is behind, neither side makes a system call.
+ * Closing the socket still tells the peer the connection ended.
+ *
+ * One thread may send and one other thread may receive. Indices read from shared memory are checked, so a peer
+ * that scribbles over the rings breaks its own connection and nothing else.
+*/
+class SharedMemoryChannel
+{
+public:
+    static constexpr std::size_t defaultRingBytes = 1024 * 1024;
+
+private:
+    struct RingHeader
+    {
+        alignas(64) std::atomic<uint64_t> head;            // Bytes read so far, written by the reader
+        alignas(64) std::atomic<uint64_t> tail;            // Bytes written so far, written by the writer
+        alignas(64) std::atomic<uint32_t> writerWaiting;   // Set by a writer that found the ring full
+    };
+
+    struct SharedHeader
+    {
+        uint64_t magic;
+        uint64_t ringBytes;
+        RingHeader rings[2];    // Client to server, then server to client
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "Atomics in shared memory must not need a lock");
+
+    const int socket;
+    void* memory;
+    const std::size_t memorySize;
+    const uint64_t ringBytes;
+
+    RingHeader* inbound;
+    RingHeader* outbound;
+    char* inboundData;
+    char* outboundData;
+
+    // The own side of each ring, so the shared copy is only read to learn what the peer did
+    uint64_t inboundHead = 0;
+    uint64_t outboundTail = 0;
+
+    bool peerClosed = false;
+
+public:
+    /**
+     * Server side. Creates the rings for an accepted socket and passes them to the client.
+     * @param socket Connected non-blocking Unix domain socket, owned by the caller
+     * @param ringBytes Size of each direction's ring, rounded up to a power of two
+     * @returns Null if the memory could not be created or sent
+    */
+    static std::unique_ptr<SharedMemoryChannel> create(int socket, std::size_t ringBytes = defaultRingBytes);
+
+    /**
+     * Client side. Waits for the rings the server passes over a socket it just connected.
+     * @param socket Connected Unix domain socket, owned by the caller
+     * @returns Null on timeout, if the socket closed or did not carry valid rings
+    */
+    static std::unique_ptr<SharedMemoryChannel> accept(int socket, std::chrono::milliseconds timeout);
+
+    ~SharedMemoryChannel();
+
+    SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+    SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+
+    /**
+     * Writes as many of the bytes as the ring has room for, like a non-blocking sendmsg.
+     * @returns Bytes written, 0 if the ring is full and the peer wakes us once it made room, -1 if the connection
+     * failed
+    */
+    ssize_t send(const struct iovec* parts, std::size_t partCount);
+
+    /**
+     * Reads what the peer wrote, like a non-blocking recv.
+     * @returns Bytes read, 0 once the peer closed the socket and everything it wrote was read, -1 with errno
+     * EAGAIN if there is nothing yet and the socket becomes readable when there is, -1 with another errno if the
+     * connection failed
+    */
+    ssize_t receive(char* buffer, std::size_t space);
+
+private:
+    SharedMemoryChannel(int socket, void* memory, std::size_t memorySize, bool serverSide);
+
+    /**
+     * Sends one byte over the socket to wake the peer. A full socket already holds wake-ups it has not read.
+     * @returns False if the socket failed
+    */
+    bool wakePeer();
+
+    /**
+     * Reads the wake-ups waiting on the socket. Only done when the inbound ring is empty, so the next wake-up
+     * raises a new edge.
+    */
+    bool drainWakeUps();
+
+    /**
+     * @returns Bytes of shared memory holding the header and two rings of ringBytes each
+    */
+    [[nodiscard]] static std::size_t getMemorySize(uint64_t ringBytes);
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+
+/**
+ * Bounded lock-free single-producer single-consumer ring. Values are written and read in place and their slots
+ * are reused, so a slot holding e.g. a string keeps its capacity and pushing does not allocate once the ring went
+ * around. One thread may push, one other thread may pop.
+*/
+template <typename T>
+class SpscQueue
+{
+private:
+    const std::size_t capacity;
+    const std::size_t mask;
+    std::unique_ptr<T[]> slots;
+
+    // Producer side: the next slot to write and the consumer's position when the producer last looked
+    alignas(64) std::atomic<std::size_t> head;
+    std::size_t cachedTail;
+
+    // Consumer side: the next slot to read and the producer's position when the consumer last looked
+    alignas(64) std::atomic<std::size_t> tail;
+    std::size_t cachedHead;
+
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two
+    */
+    explicit SpscQueue(std::size_t capacity)
+        : capacity(roundUp(capacity)), mask(roundUp(capacity) - 1), slots(new T[roundUp(capacity)]), head(0), cachedTail(0),
+          tail(0), cachedHead(0)
+    {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     * Producer thread only. The slot still holds whatever was popped from it last, overwrite it and call
+     * commitPush() to hand it to the consumer.
+     * @returns The next free slot, or null if the queue is full
+    */
+    T* tryBeginPush()
+    {
+        const std::size_t position = head.load(std::memory_order_relaxed);
+        if (position - cachedTail == capacity)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position - cachedTail == capacity)
+                return nullptr;
+        }
+
+        return &slots[position & mask];
+    }
+
+    /**
+     * Publishes the slot returned by tryBeginPush(). Producer thread only.
+    */
+    void commitPush()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * Consumer thread only.
+     * @returns The oldest pushed slot, or null if the queue is empty
+    */
+    T* tryFront()
+    {
+        const std::size_t position = tail.load(std::memory_order_relaxed);
+        if (position == cachedHead)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (position == cachedHead)
+                return nullptr;
+        }
+
+        return &slots[position & mask];
+    }
+
+    /**
+     * Hands the slot returned by tryFront() back to the producer. Consumer thread only.
+    */
+    void pop()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * Consumer thread only.
+    */
+    [[nodiscard]] bool empty() const
+    {
+        return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire);
+    }
+
+private:
+    static std::size_t roundUp(std::size_t value)
+    {
+        std::size_t rounded = 1;
+        while (rounded < value)
+            rounded <<= 1;
+
+        return rounded;
+    }
+};
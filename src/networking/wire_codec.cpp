@@ -0,0 +1,409 @@
+#include <cstring>
+
+#include "wire_codec.h"
+
+namespace
+{
+    enum WireTag : uint8_t
+    {
+        INSERT_TAG = 1,
+        DELETE_TAG = 2,
+        CRDT_INSERT_TAG = 3,
+        CRDT_DELETE_TAG = 4,
+        SEQUENCED_AT_TAG = 5,
+        ACK_TAG = 6
+    };
+
+    constexpr uint8_t originLeftBit = 1;
+    constexpr uint8_t originRightBit = 2;
+
+    std::size_t getStringSize(std::string_view value)
+    {
+        return WireCodec::getVarintSize(value.size()) + value.size();
+    }
+
+    char* writeString(char* out, std::string_view value)
+    {
+        out = WireCodec::writeVarint(out, value.size());
+        memcpy(out, value.data(), value.size());
+        return out + value.size();
+    }
+
+    bool readString(std::string_view& in, std::string_view& value)
+    {
+        uint64_t length = 0;
+        if (!WireCodec::readVarint(in, length) || length > in.size())
+            return false;
+
+        value = in.substr(0, length);
+        in.remove_prefix(length);
+        return true;
+    }
+
+    /**
+     * Size of the fields every op starts with, tag included.
+    */
+    std::size_t getHeaderSize(const TextOperation& operation)
+    {
+        return 1 + getStringSize(operation.clientId) + WireCodec::getVarintSize(operation.operationId) +
+               WireCodec::getVarintSize(operation.docVersion);
+    }
+
+    char* writeHeader(char* out, WireTag tag, const TextOperation& operation)
+    {
+        *out++ = static_cast<char>(tag);
+        out = writeString(out, operation.clientId);
+        out = WireCodec::writeVarint(out, operation.operationId);
+        return WireCodec::writeVarint(out, operation.docVersion);
+    }
+}
+
+std::size_t WireCodec::getVarintSize(uint64_t value)
+{
+    std::size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+char* WireCodec::writeVarint(char* out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+
+    *out++ = static_cast<char>(value);
+    return out;
+}
+
+bool WireCodec::readVarint(std::string_view& in, uint64_t& value)
+{
+    value = 0;
+    for (std::size_t i = 0; i < in.size() && i < maxVarintSize; i++)
+    {
+        uint64_t byte = static_cast<unsigned char>(in[i]);
+
+        // The tenth byte only has room for the top bit
+        if (i == maxVarintSize - 1 && byte > 1)
+            return false;
+
+        value |= (byte & 0x7F) << (7 * i);
+        if (byte < 0x80)
+        {
+            in.remove_prefix(i + 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::size_t WireCodec::getEncodedSize(const TextOperation& operation)
+{
+    std::size_t size = getHeaderSize(operation);
+
+    switch (operation.type)
+    {
+        case OperationType::INSERT:
+            return size + getVarintSize(operation.pos) + getStringSize(static_cast<const InsertOperation&>(operation).text);
+
+        case OperationType::DELETE:
+            return size + getVarintSize(operation.pos) + getVarintSize(operation.length);
+
+        case OperationType::CRDT_INSERT:
+        {
+            const auto& insertOp = static_cast<const CrdtInsertOperation&>(operation);
+            size += getVarintSize(insertOp.clock) + 1 + getStringSize(insertOp.text);
+            if (insertOp.originLeft)
+                size += getStringSize(insertOp.originLeft->clientId) + getVarintSize(insertOp.originLeft->clock);
+            if (insertOp.originRight)
+                size += getStringSize(insertOp.originRight->clientId) + getVarintSize(insertOp.originRight->clock);
+
+            return size;
+        }
+
+        case OperationType::CRDT_DELETE:
+        {
+            const auto& deleteOp = static_cast<const CrdtDeleteOperation&>(operation);
+            size += getVarintSize(deleteOp.spans.size());
+            for (const CrdtSpan& span : deleteOp.spans)
+                size += getStringSize(span.clientId) + getVarintSize(span.clock) + getVarintSize(span.length);
+
+            return size;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+char* WireCodec::encode(const TextOperation& operation, char* out)
+{
+    switch (operation.type)
+    {
+        case OperationType::INSERT:
+            out = writeHeader(out, INSERT_TAG, operation);
+            out = writeVarint(out, operation.pos);
+            return writeString(out, static_cast<const InsertOperation&>(operation).text);
+
+        case OperationType::DELETE:
+            out = writeHeader(out, DELETE_TAG, operation);
+            out = writeVarint(out, operation.pos);
+            return writeVarint(out, operation.length);
+
+        case OperationType::CRDT_INSERT:
+        {
+            const auto& insertOp = static_cast<const CrdtInsertOperation&>(operation);
+            out = writeHeader(out, CRDT_INSERT_TAG, operation);
+            out = writeVarint(out, insertOp.clock);
+            *out++ = static_cast<char>((insertOp.originLeft ? originLeftBit : 0) | (insertOp.originRight ? originRightBit : 0));
+            if (insertOp.originLeft)
+            {
+                out = writeString(out, insertOp.originLeft->clientId);
+                out = writeVarint(out, insertOp.originLeft->clock);
+            }
+            if (insertOp.originRight)
+            {
+                out = writeString(out, insertOp.originRight->clientId);
+                out = writeVarint(out, insertOp.originRight->clock);
+            }
+
+            return writeString(out, insertOp.text);
+        }
+
+        case OperationType::CRDT_DELETE:
+        {
+            const auto& deleteOp = static_cast<const CrdtDeleteOperation&>(operation);
+            out = writeHeader(out, CRDT_DELETE_TAG, operation);
+            out = writeVarint(out, deleteOp.spans.size());
+            for (const CrdtSpan& span : deleteOp.spans)
+            {
+                out = writeString(out, span.clientId);
+                out = writeVarint(out, span.clock);
+                out = writeVarint(out, span.length);
+            }
+
+            return out;
+        }
+
+        default:
+            return out;
+    }
+}
+
+void WireCodec::encode(const TextOperation& operation, std::string& out)
+{
+    out.resize(getEncodedSize(operation));
+    encode(operation, out.data());
+}
+
+void WireCodec::encode(const TextOperation& operation, WireProtocol protocol, std::string& out)
+{
+    if (protocol != WireProtocol::TEXT)
+        encode(operation, out);
+    else
+        out = operation.serialize();
+}
+
+void WireCodec::appendSequencedAt(std::string& out, uint64_t micros)
+{
+    char stamp[1 + maxVarintSize];
+    stamp[0] = static_cast<char>(SEQUENCED_AT_TAG);
+    char* end = writeVarint(stamp + 1, micros);
+    out.append(stamp, end - stamp);
+}
+
+void WireCodec::encodeAck(uint64_t docVersion, uint64_t operations, uint64_t sequencedAt, std::string& out)
+{
+    char ack[1 + 2 * maxVarintSize];
+    ack[0] = static_cast<char>(ACK_TAG);
+    char* end = writeVarint(ack + 1, docVersion);
+    end = writeVarint(end, operations);
+    out.assign(ack, end - ack);
+
+    if (sequencedAt != 0)
+        appendSequencedAt(out, sequencedAt);
+}
+
+bool WireCodec::isAck(std::string_view message)
+{
+    return isBinary(message) && static_cast<uint8_t>(message[0]) == ACK_TAG;
+}
+
+bool WireCodec::decodeAck(std::string_view message, uint64_t& docVersion, uint64_t& operations, uint64_t& sequencedAt)
+{
+    if (!isAck(message))
+        return false;
+
+    std::string_view in = message.substr(1);
+    if (!readVarint(in, docVersion) || !readVarint(in, operations))
+        return false;
+
+    sequencedAt = 0;
+    if (!in.empty() && static_cast<uint8_t>(in[0]) == SEQUENCED_AT_TAG)
+    {
+        in.remove_prefix(1);
+        if (!readVarint(in, sequencedAt))
+            return false;
+    }
+
+    return in.empty();
+}
+
+bool WireCodec::decode(std::string_view message, WireOperationView& operation)
+{
+    if (!isBinary(message))
+        return false;
+
+    auto tag = static_cast<uint8_t>(message[0]);
+    std::string_view in = message.substr(1);
+    if (!readString(in, operation.clientId) || !readVarint(in, operation.operationId) || !readVarint(in, operation.docVersion))
+        return false;
+
+    switch (tag)
+    {
+        case INSERT_TAG:
+            operation.type = OperationType::INSERT;
+            if (!readVarint(in, operation.pos) || !readString(in, operation.text))
+                return false;
+
+            operation.length = operation.text.size();
+            break;
+
+        case DELETE_TAG:
+            operation.type = OperationType::DELETE;
+            if (!readVarint(in, operation.pos) || !readVarint(in, operation.length))
+                return false;
+
+            break;
+
+        case CRDT_INSERT_TAG:
+        {
+            operation.type = OperationType::CRDT_INSERT;
+            if (!readVarint(in, operation.clock) || in.empty())
+                return false;
+
+            auto origins = static_cast<uint8_t>(in[0]);
+            in.remove_prefix(1);
+            operation.hasOriginLeft = origins & originLeftBit;
+            operation.hasOriginRight = origins & originRightBit;
+            if (operation.hasOriginLeft && (!readString(in, operation.originLeftClientId) || !readVarint(in, operation.originLeftClock)))
+                return false;
+            if (operation.hasOriginRight && (!readString(in, operation.originRightClientId) || !readVarint(in, operation.originRightClock)))
+                return false;
+            if (!readString(in, operation.text))
+                return false;
+
+            operation.pos = 0;
+            operation.length = operation.text.size();
+            break;
+        }
+
+        case CRDT_DELETE_TAG:
+        {
+            operation.type = OperationType::CRDT_DELETE;
+            if (!readVarint(in, operation.spanCount))
+                return false;
+
+            // Spans are validated now so readers of the view can trust them
+            operation.spans = in;
+            operation.length = 0;
+            for (uint64_t i = 0; i < operation.spanCount; i++)
+            {
+                std::string_view clientId;
+                uint64_t clock = 0;
+                uint64_t length = 0;
+                if (!readSpan(in, clientId, clock, length))
+                    return false;
+
+                operation.length += length;
+            }
+
+            operation.spans = operation.spans.substr(0, operation.spans.size() - in.size());
+            operation.pos = 0;
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    operation.sequencedAt = 0;
+    if (!in.empty() && static_cast<uint8_t>(in[0]) == SEQUENCED_AT_TAG)
+    {
+        in.remove_prefix(1);
+        if (!readVarint(in, operation.sequencedAt))
+            return false;
+    }
+
+    // Trailing bytes mean the sender and we disagree about the format
+    return in.empty();
+}
+
+bool WireCodec::readSpan(std::string_view& spans, std::string_view& clientId, uint64_t& clock, uint64_t& length)
+{
+    return readString(spans, clientId) && readVarint(spans, clock) && readVarint(spans, length);
+}
+
+std::unique_ptr<TextOperation> WireCodec::toOperation(const WireOperationView& view)
+{
+    std::unique_ptr<TextOperation> operation;
+    switch (view.type)
+    {
+        case OperationType::INSERT:
+            operation = std::make_unique<InsertOperation>(std::string(view.text), view.pos, std::string(view.clientId));
+            break;
+
+        case OperationType::DELETE:
+            operation = std::make_unique<DeleteOperation>(view.pos, view.length, std::string(view.clientId));
+            break;
+
+        case OperationType::CRDT_INSERT:
+        {
+            auto insertOp = std::make_unique<CrdtInsertOperation>(std::string(view.text), 0, std::string(view.clientId));
+            insertOp->clock = view.clock;
+            if (view.hasOriginLeft)
+                insertOp->originLeft = CrdtId{std::string(view.originLeftClientId), view.originLeftClock};
+            if (view.hasOriginRight)
+                insertOp->originRight = CrdtId{std::string(view.originRightClientId), view.originRightClock};
+
+            operation = std::move(insertOp);
+            break;
+        }
+
+        case OperationType::CRDT_DELETE:
+        {
+            auto deleteOp = std::make_unique<CrdtDeleteOperation>(0, std::string(view.clientId));
+            deleteOp->spans.reserve(view.spanCount);
+
+            std::string_view spans = view.spans;
+            for (uint64_t i = 0; i < view.spanCount; i++)
+            {
+                std::string_view clientId;
+                CrdtSpan span;
+                if (!readSpan(spans, clientId, span.clock, span.length))
+                    return nullptr;
+
+                span.clientId = std::string(clientId);
+                deleteOp->length += span.length;
+                deleteOp->spans.push_back(std::move(span));
+            }
+
+            operation = std::move(deleteOp);
+            break;
+        }
+
+        default:
+            return nullptr;
+    }
+
+    operation->operationId = view.operationId;
+    operation->docVersion = view.docVersion;
+    return operation;
+}
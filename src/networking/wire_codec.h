@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <memory>
+
+#include "../text_engine/operations.h"
+
+/**
+ * How ops are encoded on a connection. Both sides announce the highest version they speak in the handshake and
+ * the server picks the lower one. Receivers accept either encoding at any time, binary messages start with a
+ * byte no text message starts with.
+*/
+enum class WireProtocol : uint8_t
+{
+    TEXT = 1,       // Colon-delimited, see Operation::serialize. Easy to read in logs and packet captures.
+    BINARY = 2,     // Varint fields and raw text bytes, see WireCodec
+    COMPRESSED = 3, // BINARY, and messages of Framing::compressionThreshold bytes or more go in compressed frames
+    STREAMED = 4,   // COMPRESSED, and documents arrive in chunks as INIT_BEGIN and INIT_CHUNK, see DocumentStream
+    TIMED = 5       // STREAMED, and broadcast ops carry the time the server sequenced them. The client sends heartbeats.
+};
+
+inline constexpr WireProtocol latestWireProtocol = WireProtocol::TIMED;
+
+/**
+ * An op decoded from the binary encoding without copying. Strings are views into the message and spans are
+ * left encoded, read them with WireCodec::readSpan.
+*/
+struct WireOperationView
+{
+    OperationType type = OperationType::INSERT;
+    std::string_view clientId;
+    uint64_t operationId = 0;
+    uint64_t docVersion = 0;
+    uint64_t pos = 0;
+    uint64_t length = 0;        // Deleted characters for DELETE
+    std::string_view text;      // Inserted text for INSERT and CRDT_INSERT
+
+    // CRDT_INSERT
+    uint64_t clock = 0;
+    bool hasOriginLeft = false;
+    std::string_view originLeftClientId;
+    uint64_t originLeftClock = 0;
+    bool hasOriginRight = false;
+    std::string_view originRightClientId;
+    uint64_t originRightClock = 0;
+
+    // CRDT_DELETE
+    uint64_t spanCount = 0;
+    std::string_view spans;
+
+    // Wall-clock microseconds the server sequenced the op at, 0 if the message does not say
+    uint64_t sequencedAt = 0;
+};
+
+/**
+ * Binary encoding of ops. Every message is a tag byte followed by the op's fields: numbers as LEB128 varints,
+ * strings as a varint length and the raw bytes, so text may contain any byte.
+ *
+ *   INSERT       tag clientId operationId docVersion pos text
+ *   DELETE       tag clientId operationId docVersion pos length
+ *   CRDT_INSERT  tag clientId operationId docVersion clock origins [leftClientId leftClock] [rightClientId rightClock] text
+ *   CRDT_DELETE  tag clientId operationId docVersion spanCount (clientId clock length)*
+ *   ACK          tag docVersion operations, see MessageType::ACK
+ *
+ * origins is a bit set: 1 if the left origin follows, 2 if the right one does. Ops the server broadcasts on
+ * WireProtocol::TIMED connections end with a second tag and the wall-clock microseconds they were sequenced at.
+ * Encoding into a buffer with enough room and decoding into a view do not allocate.
+*/
+class WireCodec
+{
+public:
+    // A varint of a 64-bit number takes at most this many bytes
+    static constexpr std::size_t maxVarintSize = 10;
+
+    /**
+     * @returns True if the message is binary encoded. Text messages start with an upper case letter.
+    */
+    [[nodiscard]] static bool isBinary(std::string_view message)
+    {
+        return !message.empty() && static_cast<unsigned char>(message[0]) < 0x20;
+    }
+
+    /**
+     * @returns Exact number of bytes encode() writes for the op
+    */
+    [[nodiscard]] static std::size_t getEncodedSize(const TextOperation& operation);
+
+    /**
+     * Encodes an op into a buffer of at least getEncodedSize() bytes.
+     * @returns Pointer past the last byte written
+    */
+    static char* encode(const TextOperation& operation, char* out);
+
+    /**
+     * Replaces the contents of out with the encoded op. Does not allocate once out has grown to fit.
+    */
+    static void encode(const TextOperation& operation, std::string& out);
+
+    /**
+     * @param operation Receives views into message, valid as long as the message is
+     * @returns False if the message is not a well-formed binary op
+    */
+    [[nodiscard]] static bool decode(std::string_view message, WireOperationView& operation);
+
+    /**
+     * Takes the next span off the encoded spans of a CRDT_DELETE.
+     * @returns False if there is none or it is malformed
+    */
+    [[nodiscard]] static bool readSpan(std::string_view& spans, std::string_view& clientId, uint64_t& clock, uint64_t& length);
+
+    /**
+     * Copies a decoded op into an operation the engines can apply.
+     * @returns Null if a CRDT_DELETE's spans are malformed
+    */
+    [[nodiscard]] static std::unique_ptr<TextOperation> toOperation(const WireOperationView& view);
+
+    /**
+     * Encodes an op in the given protocol.
+    */
+    static void encode(const TextOperation& operation, WireProtocol protocol, std::string& out);
+
+    /**
+     * Replaces the contents of out with a binary ACK, stamped like an op if sequencedAt is not 0.
+    */
+    static void encodeAck(uint64_t docVersion, uint64_t operations, uint64_t sequencedAt, std::string& out);
+
+    /**
+     * @returns True if the message is a binary ACK rather than an op
+    */
+    [[nodiscard]] static bool isAck(std::string_view message);
+
+    /**
+     * @param sequencedAt Set to 0 if the message does not carry it
+     * @returns False if the message is not a well-formed binary ACK
+    */
+    [[nodiscard]] static bool decodeAck(std::string_view message, uint64_t& docVersion, uint64_t& operations, uint64_t& sequencedAt);
+
+    /**
+     * Stamps a binary encoded op with the time the server sequenced it, for WireProtocol::TIMED connections.
+     * @param micros Wall-clock microseconds since the epoch, see getWallClockMicros()
+    */
+    static void appendSequencedAt(std::string& out, uint64_t micros);
+
+    static char* writeVarint(char* out, uint64_t value);
+
+    /**
+     * Takes a varint off the front of in.
+     * @returns False if in ends inside the varint or it does not fit in 64 bits
+    */
+    [[nodiscard]] static bool readVarint(std::string_view& in, uint64_t& value);
+
+    [[nodiscard]] static std::size_t getVarintSize(uint64_t value);
+};
@@ -0,0 +1,33 @@
+#include <array>
+
+#include "checksum.h"
+
+namespace
+{
+    std::array<uint32_t, 256> makeCrcTable()
+    {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+
+            table[i] = value;
+        }
+
+        return table;
+    }
+}
+
+uint32_t crc32(const void* data, std::size_t length, uint32_t crc)
+{
+    static const std::array<uint32_t, 256> table = makeCrcTable();
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < length; i++)
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
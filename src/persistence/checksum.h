@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+/**
+ * CRC-32 (IEEE 802.3, as used by zlib).
+ * @param crc Result of a previous call to continue a running checksum.
+*/
+uint32_t crc32(const void* data, std::size_t length, uint32_t crc = 0);
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+
+#include "op_log.h"
+#include "checksum.h"
+#include "../text_engine/operations.h"
+
+namespace
+{
+    constexpr std::size_t recordHeaderSize = 8;
+
+    void writeUint32(std::string& out, uint32_t value)
+    {
+        char bytes[4] = {
+            static_cast<char>(value & 0xFF),
+            static_cast<char>((value >> 8) & 0xFF),
+            static_cast<char>((value >> 16) & 0xFF),
+            static_cast<char>((value >> 24) & 0xFF)
+        };
+        out.append(bytes, sizeof(bytes));
+    }
+
+    uint32_t readUint32(const char* in)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+        return static_cast<uint32_t>(bytes[0]) |
+                (static_cast<uint32_t>(bytes[1]) << 8) |
+                (static_cast<uint32_t>(bytes[2]) << 16) |
+                (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+
+    int syncFile(int fd)
+    {
+#ifdef __linux__
+        return fdatasync(fd);
+#else
+        return fsync(fd);
+#endif
+    }
+}
+
+OpLog::OpLog(const std::string& path, std::chrono::microseconds groupCommitWindow)
+    : path(path), groupCommitWindow(groupCommitWindow), fd(-1), committedSize(0), pendingRecordCount(0), stats{}
+{
+}
+
+OpLog::~OpLog()
+{
+    if (hasPendingRecords())
+        commit();
+
+    close();
+}
+
+bool OpLog::open()
+{
+    if (fd != -1)
+        return true;
+
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1)
+    {
+        std::cerr << "OpLog: Failed to open " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size == -1)
+    {
+        std::cerr << "OpLog: Failed to find the end of " << path << ": " << strerror(errno) << "\n";
+        close();
+        return false;
+    }
+
+    committedSize = static_cast<uint64_t>(size);
+    return true;
+}
+
+void OpLog::close()
+{
+    if (fd == -1)
+        return;
+
+    ::close(fd);
+    fd = -1;
+}
+
+void OpLog::append(const TextOperation& operation)
+{
+    std::string payload = operation.serialize();
+
+    if (pendingRecordCount == 0)
+        oldestPendingTime = std::chrono::steady_clock::now();
+
+    writeUint32(pendingRecords, static_cast<uint32_t>(payload.size()));
+    writeUint32(pendingRecords, crc32(payload.data(), payload.size()));
+    pendingRecords.append(payload);
+    pendingRecordCount++;
+}
+
+bool OpLog::commit()
+{
+    if (pendingRecordCount == 0)
+        return true;
+
+    if (fd == -1)
+        return false;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::size_t written = 0;
+    while (written < pendingRecords.size())
+    {
+        ssize_t result = ::write(fd, pendingRecords.data() + written, pendingRecords.size() - written);
+        if (result == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            std::cerr << "OpLog: Failed to write " << path << ": " << strerror(errno) << "\n";
+            discardUncommitted();
+            return false;
+        }
+
+        written += static_cast<std::size_t>(result);
+    }
+
+    // A failed sync may have marked the pages clean without writing them, so syncing again would prove nothing.
+    // The records are written again after the cut instead.
+    if (syncFile(fd) == -1)
+    {
+        std::cerr << "OpLog: Failed to sync " << path << ": " << strerror(errno) << "\n";
+        discardUncommitted();
+        return false;
+    }
+
+    uint64_t commitMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+    stats.commits++;
+    stats.recordsCommitted += pendingRecordCount;
+    stats.bytesCommitted += pendingRecords.size();
+    stats.totalCommitMicros += commitMicros;
+    stats.maxCommitMicros = std::max(stats.maxCommitMicros, commitMicros);
+
+    committedSize += pendingRecords.size();
+    pendingRecords.clear();
+    pendingRecordCount = 0;
+    return true;
+}
+
+void OpLog::discardUncommitted()
+{
+    if (ftruncate(fd, static_cast<off_t>(committedSize)) == 0 && syncFile(fd) == 0)
+        return;
+
+    // Records after the cut point could be replayed twice, nothing more may be appended behind them
+    std::cerr << "OpLog: Failed to cut " << path << " back to its last commit: " << strerror(errno) << ", closing it\n";
+    close();
+}
+
+bool OpLog::rotate(const std::string& newPath)
+{
+    if (!commit())
+        return false;
+
+    close();
+    path = newPath;
+    return open();
+}
+
+uint64_t OpLog::replay(const std::string& path, const ReplayCallback& callback)
+{
+    int readFd = ::open(path.c_str(), O_RDWR);
+    if (readFd == -1)
+        return 0;
+
+    std::string contents;
+    char buffer[65536];
+    ssize_t bytesRead;
+    while ((bytesRead = ::read(readFd, buffer, sizeof(buffer))) > 0)
+        contents.append(buffer, bytesRead);
+
+    uint64_t replayed = 0;
+    std::size_t offset = 0;
+    while (offset + recordHeaderSize <= contents.size())
+    {
+        uint32_t payloadLength = readUint32(contents.data() + offset);
+        uint32_t checksum = readUint32(contents.data() + offset + 4);
+
+        if (offset + recordHeaderSize + payloadLength > contents.size())
+            break;
+
+        const char* payload = contents.data() + offset + recordHeaderSize;
+        if (crc32(payload, payloadLength) != checksum)
+            break;
+
+        // Any text op, OT or CRDT, as the log does not know which engine its document runs
+        std::unique_ptr<Operation> op = Operation::deserialize(std::string(payload, payloadLength));
+        if (!op || (op->type != OperationType::INSERT && op->type != OperationType::DELETE &&
+            op->type != OperationType::CRDT_INSERT && op->type != OperationType::CRDT_DELETE))
+        {
+            break;
+        }
+
+        callback(std::unique_ptr<TextOperation>(static_cast<TextOperation*>(op.release())));
+        replayed++;
+        offset += recordHeaderSize + payloadLength;
+    }
+
+    if (offset < contents.size())
+    {
+        std::cerr << "OpLog: Truncating " << contents.size() - offset << " bytes of torn or corrupt records from " << path << "\n";
+        if (ftruncate(readFd, static_cast<off_t>(offset)) == -1)
+            std::cerr << "OpLog: Failed to truncate " << path << ": " << strerror(errno) << "\n";
+    }
+
+    ::close(readFd);
+    return replayed;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+class TextOperation;
+
+struct OpLogStats
+{
+    uint64_t commits;
+    uint64_t recordsCommitted;
+    uint64_t bytesCommitted;
+    uint64_t totalCommitMicros;
+    uint64_t maxCommitMicros;
+};
+
+/**
+ * Append-only, checksummed log of sequenced ops for one document, split into segment files.
+ * Each record is [payload length: u32][crc32 of payload: u32][payload: serialized op], little endian.
+ *
+ * Appends are buffered in memory and made durable by commit(), which writes everything buffered and fsyncs
+ * once. The owner decides when to commit; getCommitDeadline() tells it when the oldest buffered record has
+ * waited for the group commit window. Not thread-safe, owned by the document's sequencer thread.
+*/
+class OpLog
+{
+public:
+    using ReplayCallback = std::function<void(std::unique_ptr<TextOperation> operation)>;
+
+private:
+    std::string path;
+    const std::chrono::microseconds groupCommitWindow;
+    int fd;
+
+    // Size of the file as of the last successful commit. A failed commit cuts the file back to it.
+    uint64_t committedSize;
+
+    std::string pendingRecords;
+    uint64_t pendingRecordCount;
+    std::chrono::steady_clock::time_point oldestPendingTime;
+
+    OpLogStats stats;
+
+public:
+    OpLog(const std::string& path, std::chrono::microseconds groupCommitWindow);
+    ~OpLog();
+
+    OpLog(const OpLog&) = delete;
+    OpLog& operator=(const OpLog&) = delete;
+
+    /**
+     * Opens the log for appending, creating it if needed.
+     * @returns False if the file could not be opened.
+    */
+    [[nodiscard]] bool open();
+    void close();
+
+    void append(const TextOperation& operation);
+
+    /**
+     * Writes all buffered records and fsyncs.
+     * @returns False if the write or sync failed. The file is cut back to where the commit started and the
+     * records stay buffered, so a later commit writes them again instead of after a copy that may have reached
+     * the disk. If the file cannot be cut back the log is closed and every later commit fails.
+    */
+    bool commit();
+
+    /**
+     * Commits what is buffered and continues the log in a new segment file, so older segments can be deleted
+     * once a snapshot covers them.
+     * @returns False if the current segment could not be committed or the new one could not be opened.
+    */
+    [[nodiscard]] bool rotate(const std::string& newPath);
+
+    [[nodiscard]] bool hasPendingRecords() const { return pendingRecordCount > 0; }
+
+    /**
+     * Time by which buffered records should be committed. Only meaningful when there are pending records.
+    */
+    [[nodiscard]] std::chrono::steady_clock::time_point getCommitDeadline() const { return oldestPendingTime + groupCommitWindow; }
+
+    [[nodiscard]] const std::string& getPath() const { return path; }
+    [[nodiscard]] OpLogStats getStats() const { return stats; }
+
+    /**
+     * Reads every intact record of a log in order. Reading stops at the first torn or corrupt record, and the
+     * file is truncated there so later appends continue from a clean tail.
+     * @returns Number of records replayed. 0 if the log does not exist.
+    */
+    static uint64_t replay(const std::string& path, const ReplayCallback& callback);
+
+private:
+    /**
+     * Cuts off what a failed commit wrote. Closes the log if that fails too.
+    */
+    void discardUncommitted();
+};
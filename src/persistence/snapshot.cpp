@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <filesystem>
+#include <cstddef>
+
+#include "snapshot.h"
+#include "checksum.h"
+
+namespace
+{
+    constexpr char snapshotMagic[8] = { 'R', 'E', 'P', 'E', 'D', 'S', 'N', 'P' };
+    constexpr uint32_t snapshotFormatVersion = 2;
+    constexpr uint32_t snapshotByteOrderMark = 0x01020304;
+
+    static_assert(sizeof(SnapshotHeader) % 8 == 0, "Snapshot header must keep the piece array aligned");
+    static_assert(sizeof(SnapshotPiece) % 8 == 0, "Snapshot pieces must keep the buffers aligned");
+
+    bool writeAll(int fd, const void* data, std::size_t length, uint32_t* checksum)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        if (checksum)
+            *checksum = crc32(bytes, length, *checksum);
+
+        while (length > 0)
+        {
+            ssize_t result = ::write(fd, bytes, length);
+            if (result == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                return false;
+            }
+
+            bytes += result;
+            length -= static_cast<std::size_t>(result);
+        }
+
+        return true;
+    }
+
+    class MappedFile
+    {
+    public:
+        void* address;
+        std::size_t length;
+
+        MappedFile(void* address, std::size_t length)
+            : address(address), length(length)
+        {}
+
+        ~MappedFile()
+        {
+            munmap(address, length);
+        }
+    };
+}
+
+bool Snapshot::write(const std::string& path, const PieceTableView& view, uint64_t docVersion, std::string_view engineState)
+{
+    std::string tempPath = path + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        std::cerr << "Snapshot: Failed to create " << tempPath << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    SnapshotHeader header{};
+    memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.formatVersion = snapshotFormatVersion;
+    header.byteOrderMark = snapshotByteOrderMark;
+    header.docVersion = docVersion;
+    header.documentLength = view.documentLength;
+    header.pieceCount = view.pieces.size();
+    header.originalLength = view.originalBuffer.size();
+    header.addLength = view.addBuffer.size();
+    header.stateLength = engineState.size();
+
+    std::vector<SnapshotPiece> pieces;
+    pieces.reserve(view.pieces.size());
+    for (const auto& piece : view.pieces)
+        pieces.push_back({ piece.start, piece.length, static_cast<uint32_t>(piece.bufferType), 0 });
+
+    // Reserve the header, write the body while checksumming it, then fill the header in
+    bool ok = lseek(fd, sizeof(SnapshotHeader), SEEK_SET) != -1;
+    uint32_t bodyChecksum = 0;
+    ok = ok && writeAll(fd, pieces.data(), pieces.size() * sizeof(SnapshotPiece), &bodyChecksum);
+    ok = ok && writeAll(fd, view.originalBuffer.data(), view.originalBuffer.size(), &bodyChecksum);
+    ok = ok && writeAll(fd, view.addBuffer.data(), view.addBuffer.size(), &bodyChecksum);
+    ok = ok && writeAll(fd, engineState.data(), engineState.size(), &bodyChecksum);
+
+    header.bodyChecksum = bodyChecksum;
+    header.headerChecksum = crc32(&header, offsetof(SnapshotHeader, headerChecksum));
+
+    ok = ok && lseek(fd, 0, SEEK_SET) != -1;
+    ok = ok && writeAll(fd, &header, sizeof(header), nullptr);
+    ok = ok && fsync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Snapshot: Failed to write " << path << ": " << strerror(errno) << "\n";
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    int directoryFd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (directoryFd != -1)
+    {
+        fsync(directoryFd);
+        ::close(directoryFd);
+    }
+
+    return true;
+}
+
+bool Snapshot::load(const std::string& path, LoadedSnapshot& snapshot)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || static_cast<std::size_t>(fileStat.st_size) < sizeof(SnapshotHeader))
+    {
+        std::cerr << "Snapshot: " << path << " is too small to be a snapshot\n";
+        ::close(fd);
+        return false;
+    }
+
+    std::size_t fileSize = static_cast<std::size_t>(fileStat.st_size);
+    void* address = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (address == MAP_FAILED)
+    {
+        std::cerr << "Snapshot: Failed to map " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    auto mapping = std::make_shared<MappedFile>(address, fileSize);
+    const char* bytes = static_cast<const char*>(address);
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(bytes);
+
+    if (memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0 ||
+        header->formatVersion != snapshotFormatVersion ||
+        header->byteOrderMark != snapshotByteOrderMark ||
+        header->headerChecksum != crc32(header, offsetof(SnapshotHeader, headerChecksum)))
+    {
+        std::cerr << "Snapshot: " << path << " has an invalid header\n";
+        return false;
+    }
+
+    std::size_t bodySize = fileSize - sizeof(SnapshotHeader);
+    if (header->pieceCount > bodySize / sizeof(SnapshotPiece) || header->originalLength > bodySize ||
+        header->addLength > bodySize || header->stateLength > bodySize ||
+        header->pieceCount * sizeof(SnapshotPiece) + header->originalLength + header->addLength + header->stateLength != bodySize ||
+        crc32(bytes + sizeof(SnapshotHeader), bodySize) != header->bodyChecksum)
+    {
+        std::cerr << "Snapshot: " << path << " is truncated or corrupt\n";
+        return false;
+    }
+
+    const SnapshotPiece* pieces = reinterpret_cast<const SnapshotPiece*>(bytes + sizeof(SnapshotHeader));
+    const char* buffer = bytes + sizeof(SnapshotHeader) + header->pieceCount * sizeof(SnapshotPiece);
+    uint64_t bufferLength = header->originalLength + header->addLength;
+
+    snapshot.pieces.clear();
+    snapshot.pieces.reserve(header->pieceCount);
+
+    uint64_t documentLength = 0;
+    for (uint64_t i = 0; i < header->pieceCount; i++)
+    {
+        const SnapshotPiece& piece = pieces[i];
+
+        // Add buffer pieces point past the original buffer in the combined mapped buffer
+        uint64_t start = piece.start;
+        if (piece.bufferType == static_cast<uint32_t>(BufferType::ADD))
+            start += header->originalLength;
+        else if (piece.bufferType != static_cast<uint32_t>(BufferType::ORIGINAL))
+            start = bufferLength;
+
+        if (start > bufferLength || piece.length > bufferLength - start)
+        {
+            std::cerr << "Snapshot: " << path << " has a piece outside its buffers\n";
+            return false;
+        }
+
+        snapshot.pieces.emplace_back(BufferType::ORIGINAL, start, piece.length);
+        documentLength += piece.length;
+    }
+
+    if (documentLength != header->documentLength)
+    {
+        std::cerr << "Snapshot: " << path << " pieces do not add up to the document length\n";
+        return false;
+    }
+
+    snapshot.docVersion = header->docVersion;
+    snapshot.buffer = std::string_view(buffer, bufferLength);
+    snapshot.engineState = std::string_view(buffer + bufferLength, header->stateLength);
+    snapshot.storage = std::move(mapping);
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+#include "../piece_table/piece_table.h"
+
+/**
+ * On-disk snapshot layout. All fields are native-endian and 8-byte aligned so a mapped file can be used in place:
+ *
+ *   SnapshotHeader
+ *   SnapshotPiece[pieceCount]
+ *   original buffer bytes [originalLength]
+ *   add buffer bytes [addLength]
+ *   engine state bytes [stateLength]
+ *
+ * The add buffer directly follows the original buffer, so on load both become one read-only buffer. The engine
+ * state is whatever the document's engine keeps besides the text, e.g. a CRDT document's sequence, and empty for OT.
+*/
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t byteOrderMark;
+    uint64_t docVersion;
+    uint64_t documentLength;
+    uint64_t pieceCount;
+    uint64_t originalLength;
+    uint64_t addLength;
+    uint64_t stateLength;
+    uint32_t bodyChecksum;      // crc32 of everything after the header
+    uint32_t headerChecksum;    // crc32 of the header up to this field
+};
+
+struct SnapshotPiece
+{
+    uint64_t start;
+    uint64_t length;
+    uint32_t bufferType;
+    uint32_t reserved;
+};
+
+struct LoadedSnapshot
+{
+    uint64_t docVersion;
+    std::vector<Piece> pieces;
+    std::string_view buffer;                // Original and add buffers, back to back
+    std::string_view engineState;           // Points into the mapping as well
+    std::shared_ptr<const void> storage;    // The mapping; unmapped when the last reference goes away
+};
+
+class Snapshot
+{
+public:
+    /**
+     * Writes a snapshot to a temporary file, syncs it and renames it over path, so a crash never leaves a
+     * partially written snapshot behind.
+     * @returns False if any step failed. The previous snapshot at path is left untouched in that case.
+    */
+    [[nodiscard]] static bool write(const std::string& path, const PieceTableView& view, uint64_t docVersion,
+        std::string_view engineState = {});
+
+    /**
+     * Maps a snapshot and validates it. Pieces are rebased onto the mapped buffer; the text itself is not copied.
+     * @returns False if the file does not exist or fails validation.
+    */
+    [[nodiscard]] static bool load(const std::string& path, LoadedSnapshot& snapshot);
+};
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include "snapshot_writer.h"
+#include "snapshot.h"
+
+SnapshotWriter::SnapshotWriter()
+    : running(false)
+{
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    stop();
+}
+
+void SnapshotWriter::start()
+{
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    if (running)
+        return;
+
+    running = true;
+    writerThread = std::thread(&SnapshotWriter::run, this);
+}
+
+void SnapshotWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        if (!running)
+            return;
+
+        running = false;
+    }
+
+    jobsCondition.notify_one();
+    if (writerThread.joinable())
+        writerThread.join();
+}
+
+void SnapshotWriter::submit(SnapshotJob job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push_back(std::move(job));
+    }
+
+    jobsCondition.notify_one();
+}
+
+void SnapshotWriter::waitFor(const std::string& path)
+{
+    std::unique_lock<std::mutex> lock(jobsMutex);
+    writtenCondition.wait(lock, [this, &path]
+    {
+        return writingPath != path && std::none_of(jobs.begin(), jobs.end(), [&path] (const SnapshotJob& job) { return job.path == path; });
+    });
+}
+
+void SnapshotWriter::run()
+{
+    while (true)
+    {
+        SnapshotJob job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsCondition.wait(lock, [this] { return !jobs.empty() || !running; });
+
+            if (jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            writingPath = job.path;
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        if (Snapshot::write(job.path, job.view, job.docVersion, job.engineState))
+        {
+            auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+            std::cout << "SnapshotWriter: Wrote " << job.path << " at version " << job.docVersion << " in " << elapsedMs << " ms\n";
+
+            if (job.onWritten)
+                job.onWritten();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            writingPath.clear();
+        }
+
+        writtenCondition.notify_all();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "../piece_table/piece_table.h"
+
+struct SnapshotJob
+{
+    std::string path;
+    PieceTableView view;
+    uint64_t docVersion;
+
+    // Taken on the shard thread with the view, see Snapshot
+    std::string engineState;
+
+    // Runs on the writer thread after the snapshot is durable
+    std::function<void()> onWritten;
+};
+
+/**
+ * Background thread that writes snapshots so shards never block on snapshot I/O.
+*/
+class SnapshotWriter
+{
+private:
+    std::deque<SnapshotJob> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsCondition;
+
+    // Path of the snapshot being written, empty between jobs
+    std::string writingPath;
+    std::condition_variable writtenCondition;
+    std::thread writerThread;
+    bool running;
+
+public:
+    SnapshotWriter();
+    ~SnapshotWriter();
+
+    void start();
+
+    /**
+     * Writes all queued snapshots, then stops the writer thread.
+    */
+    void stop();
+
+    void submit(SnapshotJob job);
+
+    /**
+     * Blocks until no snapshot of the path is queued or being written, e.g. before the document is loaded again
+     * from the snapshot and the log segments the write is about to delete.
+    */
+    void waitFor(const std::string& path);
+
+private:
+    void run();
+};
@@ -23,7 +23,6 @@ void PieceTable::readFile(const std::string& fileName)
     }
 
     pieces.clear();
-    originalBuffer.clear();
     addBuffer.clear();
     documentLength = 0;
 
@@ -31,30 +30,79 @@ void PieceTable::readFile(const std::string& fileName)
     documentLength = fileStream.tellg();
     fileStream.seekg(0);
 
+    auto fileContents = std::make_shared<std::string>();
     if (documentLength > 0)
     {
-        originalBuffer.resize(documentLength);
-        fileStream.read(&originalBuffer[0], documentLength);
+        fileContents->resize(documentLength);
+        fileStream.read(&(*fileContents)[0], documentLength);
     }
 
+    originalBuffer = *fileContents;
+    originalStorage = std::move(fileContents);
+
     pieces.emplace_back(BufferType::ORIGINAL, 0, documentLength);
 }
 
 void PieceTable::readString(const std::string& str)
 {
     pieces.clear();
-    originalBuffer.clear();
     addBuffer.clear();
     documentLength = 0;
 
+    auto contents = std::make_shared<std::string>(str);
+    originalBuffer = *contents;
+    originalStorage = std::move(contents);
+
     if (!str.empty())
     {
         documentLength = str.size();
-        originalBuffer = str;
         pieces.emplace_back(BufferType::ORIGINAL, 0, documentLength);
     }
 }
 
+void PieceTable::loadBuffer(std::vector<Piece> pieces, std::string_view buffer, std::shared_ptr<const void> storage)
+{
+    this->pieces = std::move(pieces);
+    originalBuffer = buffer;
+    originalStorage = std::move(storage);
+    addBuffer.clear();
+
+    documentLength = 0;
+    for (const auto& piece : this->pieces)
+        documentLength += piece.length;
+}
+
+PieceTableView PieceTable::getView() const
+{
+    return { pieces, originalBuffer, originalStorage, addBuffer, documentLength };
+}
+
+void PieceTable::reset(std::size_t reservedLength)
+{
+    pieces.clear();
+    originalBuffer = std::string_view();
+    originalStorage.reset();
+    documentLength = 0;
+
+    // Reserving on a fresh string, so the old text is freed rather than kept as capacity
+    addBuffer = std::string();
+    addBuffer.reserve(reservedLength);
+}
+
+void PieceTable::append(std::string_view text)
+{
+    if (text.empty())
+        return;
+
+    if (!pieces.empty() && pieces.back().bufferType == BufferType::ADD && pieces.back().start + pieces.back().length == addBuffer.size())
+        pieces.back().length += text.size();
+    else
+        pieces.emplace_back(BufferType::ADD, addBuffer.size(), text.size());
+
+    addBuffer.append(text);
+    documentLength += text.size();
+}
+
 void PieceTable::insert(std::string_view text, const std::size_t index)
 {
     if (text.empty())
@@ -176,8 +224,33 @@ std::string PieceTable::getText() const
     result.reserve(documentLength);
 
     for (const auto& piece : pieces) {
-        const std::string& buffer = (piece.bufferType == BufferType::ORIGINAL) ? originalBuffer : addBuffer;
-        result.append(buffer, piece.start, piece.length);
+        std::string_view buffer = (piece.bufferType == BufferType::ORIGINAL) ? originalBuffer : std::string_view(addBuffer);
+        result.append(buffer.data() + piece.start, piece.length);
+    }
+
+    return result;
+}
+
+std::string PieceTable::getText(std::size_t pos, std::size_t length) const
+{
+    std::string result;
+    std::size_t end = pos + std::min(length, documentLength - std::min(pos, documentLength));
+    result.reserve(end - pos);
+
+    std::size_t pieceStart = 0;
+    for (const auto& piece : pieces) {
+        std::size_t pieceEnd = pieceStart + piece.length;
+        if (pieceStart >= end)
+            break;
+
+        if (pieceEnd > pos) {
+            std::string_view buffer = (piece.bufferType == BufferType::ORIGINAL) ? originalBuffer : std::string_view(addBuffer);
+            std::size_t from = std::max(pos, pieceStart);
+            std::size_t to = std::min(end, pieceEnd);
+            result.append(buffer.data() + piece.start + (from - pieceStart), to - from);
+        }
+
+        pieceStart = pieceEnd;
     }
 
     return result;
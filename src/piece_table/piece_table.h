@@ -1,14 +1,30 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
 
 #include "piece.h"
 
+/**
+ * Immutable copy of a piece table's state that can be read from another thread.
+*/
+struct PieceTableView
+{
+    std::vector<Piece> pieces;
+    std::string_view originalBuffer;
+    std::shared_ptr<const void> originalStorage; // Keeps originalBuffer alive
+    std::string addBuffer;
+    std::size_t documentLength;
+};
+
 class PieceTable
 {
 private:
-    std::string originalBuffer;
+    // Read-only. Points into memory owned by originalStorage, which may be a string or a mapped snapshot.
+    std::string_view originalBuffer;
+    std::shared_ptr<const void> originalStorage;
     std::string addBuffer;
     std::vector<Piece> pieces;
     std::size_t documentLength;
@@ -17,10 +33,41 @@ public:
     PieceTable();
     void readFile(const std::string& fileName);
     void readString(const std::string& str);
+
+    /**
+     * Replaces the contents with pieces that all point into an external read-only buffer.
+     * @param buffer Original buffer, e.g. text inside a mapped snapshot. Must stay valid while storage is alive.
+     * @param storage Owner of the buffer's memory.
+    */
+    void loadBuffer(std::vector<Piece> pieces, std::string_view buffer, std::shared_ptr<const void> storage);
+
+    /**
+     * Copies the current state so it can be serialized off the editing thread. The original buffer is shared,
+     * only the pieces and the add buffer are copied.
+    */
+    [[nodiscard]] PieceTableView getView() const;
+
+    /**
+     * Empties the table, e.g. before a document arrives in chunks.
+     * @param reservedLength Room reserved in the add buffer for the text appended afterwards
+    */
+    void reset(std::size_t reservedLength = 0);
+
+    /**
+     * Adds text at the end. Text appended right after the previous append extends its piece, so a document
+     * appended in chunks stays one piece.
+    */
+    void append(std::string_view text);
     void insert(std::string_view text, const std::size_t index);
     void remove(const std::size_t startIndex, const std::size_t endIndex);
     [[nodiscard]] std::string getText() const;
+
+    /**
+     * @returns Up to length characters starting at pos, without copying the rest of the document
+    */
+    [[nodiscard]] std::string getText(std::size_t pos, std::size_t length) const;
     [[nodiscard]] std::size_t getDocumentLength() const { return documentLength; }
+    [[nodiscard]] std::size_t getPieceCount() const { return pieces.size(); }
 
 private:
     std::tuple<std::size_t, Piece*> findPieceAtIndex(const std::size_t index);
@@ -0,0 +1,217 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <signal.h>
+
+#include "./networking/server.h"
+#include "./text_engine/server_text_engine.h"
+#include "./text_engine/crdt_server_text_engine.h"
+#include "./controller/controller.h"
+
+// Runs the collaboration server without a window, configured by command-line flags, until SIGINT or SIGTERM.
+// Usage: reped_server [--port PORT] [--address ADDRESS] [--engine ot|crdt] ... (--help lists all)
+
+namespace
+{
+    struct Options
+    {
+        uint16_t port = 8080;
+        std::string address = "0.0.0.0";
+        TextEngineType engineType = TextEngineType::OT;
+        std::string filePathName;
+        bool verbose = false;
+        ServerConfig config;
+    };
+
+    void printUsage(std::ostream& out)
+    {
+        const Options defaults;
+        const ServerConfig& config = defaults.config;
+        out << "Usage: reped_server [options]\n"
+            << "  --port PORT                 Port to listen on (" << defaults.port << ")\n"
+            << "  --address ADDRESS           Address to bind to (" << defaults.address << ")\n"
+            << "  --engine ot|crdt            How concurrent edits are merged (ot)\n"
+            << "  --file PATH                 File the default document starts from\n"
+            << "  --data-dir PATH             Directory for op logs and snapshots, none runs without durability\n"
+            << "  --shards N                  Sequencer shards, 0 for one per core (" << config.shardCount << ")\n"
+            << "  --reactors N                Reactor threads, 0 for one per four cores (" << config.reactorCount << ")\n"
+            << "  --reactor-backend NAME      epoll or io_uring (epoll)\n"
+            << "  --max-send-queue BYTES      Bytes a client may fall behind before it is dropped (" << config.maxSendQueueBytes << ")\n"
+            << "  --resync-backlog BYTES      Queued bytes after which an idle client gets the document again, 0 never (" << config.resyncBacklogBytes << ")\n"
+            << "  --resync-lag OPS            Ops behind after which an idle client gets the document again, 0 never (" << config.resyncLagOperations << ")\n"
+            << "  --group-commit-window US    Microseconds ops may wait to share an fsync (" << config.groupCommitWindow.count() << ")\n"
+            << "  --snapshot-interval OPS     Ops between snapshots, 0 disables them (" << config.snapshotInterval << ")\n"
+            << "  --history OPS               Ops each document keeps for late ops and reconnecting clients, 0 all (" << config.historyOperations << ")\n"
+            << "  --broadcast-interval US     Microseconds ops are collected before a broadcast (" << config.broadcastInterval.count() << ")\n"
+            << "  --presence-interval MS      Minimum milliseconds between presence broadcasts (" << config.presenceInterval.count() << ")\n"
+            << "  --heartbeat-timeout MS      Drop clients silent this long, 0 never does (" << config.heartbeatTimeout.count() << ")\n"
+            << "  --unix-socket PATH          Also accept local clients on a Unix domain socket\n"
+            << "  --shm-socket PATH           Also accept local clients that exchange frames through shared memory\n"
+            << "  --shm-ring-bytes BYTES      Size of each direction's shared memory ring (" << config.sharedMemoryRingBytes << ")\n"
+            << "  --metrics-port PORT         Serve Prometheus metrics on 127.0.0.1:PORT/metrics\n"
+            << "  --metrics-socket PATH       Serve Prometheus metrics on a Unix domain socket\n"
+            << "  --document-metrics N        Documents with metrics of their own, the rest share one series (" << config.documentMetricsLimit << ")\n"
+            << "  --max-documents N           Documents loaded at once, 0 for no limit (" << config.maxDocuments << ")\n"
+            << "  --text-protocol             Offer clients only the readable text protocol\n"
+            << "  --no-compression            Never compress messages\n"
+            << "  --verbose                   Log every message and op\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        ServerConfig& config = options.config;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string flag = argv[i];
+            if (flag == "--verbose")
+            {
+                options.verbose = true;
+                config.logMessages = true;
+                continue;
+            }
+
+            if (flag == "--text-protocol")
+            {
+                config.wireProtocol = WireProtocol::TEXT;
+                continue;
+            }
+
+            if (flag == "--no-compression")
+            {
+                config.compression = false;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                std::cerr << "reped_server: Unknown option or missing value: " << flag << "\n";
+                return false;
+            }
+
+            const std::string value = argv[++i];
+            try
+            {
+                if (flag == "--port")
+                    options.port = static_cast<uint16_t>(std::stoul(value));
+                else if (flag == "--address")
+                    options.address = value;
+                else if (flag == "--engine" && (value == "ot" || value == "crdt"))
+                    options.engineType = value == "crdt" ? TextEngineType::CRDT : TextEngineType::OT;
+                else if (flag == "--file")
+                    options.filePathName = value;
+                else if (flag == "--data-dir")
+                    config.dataDirectory = value;
+                else if (flag == "--shards")
+                    config.shardCount = std::stoul(value);
+                else if (flag == "--reactors")
+                    config.reactorCount = std::stoul(value);
+                else if (flag == "--reactor-backend" && (value == "epoll" || value == "io_uring"))
+                    config.reactorBackend = value == "io_uring" ? ReactorBackend::IO_URING : ReactorBackend::EPOLL;
+                else if (flag == "--max-send-queue")
+                    config.maxSendQueueBytes = std::stoul(value);
+                else if (flag == "--resync-backlog")
+                    config.resyncBacklogBytes = std::stoul(value);
+                else if (flag == "--resync-lag")
+                    config.resyncLagOperations = std::stoull(value);
+                else if (flag == "--group-commit-window")
+                    config.groupCommitWindow = std::chrono::microseconds(std::stoll(value));
+                else if (flag == "--snapshot-interval")
+                    config.snapshotInterval = std::stoull(value);
+                else if (flag == "--history")
+                    config.historyOperations = std::stoul(value);
+                else if (flag == "--broadcast-interval")
+                    config.broadcastInterval = std::chrono::microseconds(std::stoll(value));
+                else if (flag == "--presence-interval")
+                    config.presenceInterval = std::chrono::milliseconds(std::stoll(value));
+                else if (flag == "--heartbeat-timeout")
+                    config.heartbeatTimeout = std::chrono::milliseconds(std::stoll(value));
+                else if (flag == "--unix-socket")
+                    config.unixSocketPath = value;
+                else if (flag == "--shm-socket")
+                    config.sharedMemorySocketPath = value;
+                else if (flag == "--shm-ring-bytes")
+                    config.sharedMemoryRingBytes = std::stoul(value);
+                else if (flag == "--metrics-port")
+                    config.metricsPort = static_cast<uint16_t>(std::stoul(value));
+                else if (flag == "--metrics-socket")
+                    config.metricsSocketPath = value;
+                else if (flag == "--document-metrics")
+                    config.documentMetricsLimit = std::stoul(value);
+                else if (flag == "--max-documents")
+                    config.maxDocuments = std::stoul(value);
+                else
+                {
+                    std::cerr << "reped_server: Unknown option or invalid value: " << flag << " " << value << "\n";
+                    return false;
+                }
+            }
+            catch (const std::exception&)
+            {
+                std::cerr << "reped_server: Invalid value for " << flag << ": " << value << "\n";
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h")
+        {
+            printUsage(std::cout);
+            return 0;
+        }
+    }
+
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(std::cerr);
+        return 2;
+    }
+
+    // Logging every op costs more than handling it, so only errors are printed unless asked for
+    std::ostream out(std::cout.rdbuf());
+    if (!options.verbose)
+        std::cout.rdbuf(nullptr);
+
+    // Block the signals before any server thread starts so they inherit the mask and only sigwait() sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::unique_ptr<ServerTextEngine> textEngine;
+    if (options.engineType == TextEngineType::CRDT)
+        textEngine = std::make_unique<CrdtServerTextEngine>();
+    else
+        textEngine = std::make_unique<ServerTextEngine>();
+
+    if (!options.filePathName.empty())
+        textEngine->readFile(options.filePathName);
+
+    // The server hosts this engine as its default document, so it has to be set first
+    Controller controller;
+    controller.textEngine = textEngine.get();
+    Server server(options.port, options.address, &controller, options.config);
+    if (!server.isRunning())
+    {
+        std::cerr << "reped_server: Failed to start on " << options.address << ":" << options.port << "\n";
+        return 1;
+    }
+
+    out << "reped_server: Serving on " << options.address << ":" << options.port << std::endl;
+
+    int received = 0;
+    sigwait(&signals, &received);
+
+    out << "reped_server: Shutting down" << std::endl;
+    return 0;
+}
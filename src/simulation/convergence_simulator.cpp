@@ -0,0 +1,194 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include "convergence_simulator.h"
+
+ConvergenceSimulator::ConvergenceSimulator(const SimulationConfig& config)
+    : config(config), random(config.seed)
+{
+    server.readString(config.initialText);
+
+    for (std::size_t c = 0; c < config.clientCount; c++)
+    {
+        auto client = std::make_unique<SimulatedClient>();
+        client->clientId = "sim" + std::to_string(c);
+        client->engine.readString(config.initialText);
+        client->engine.resetToServerVersion(server.getDocumentVersion());
+        client->editsLeft = config.editsPerClient;
+        clients.push_back(std::move(client));
+
+        if (config.editsPerClient > 0)
+            schedule(draw(0, config.maxEditInterval), EventType::EDIT, c);
+    }
+}
+
+SimulationResult ConvergenceSimulator::run()
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    while (!events.empty())
+    {
+        Event event = events.top();
+        events.pop();
+        now = event.time;
+
+        SimulatedClient& client = *clients[event.client];
+        switch (event.type)
+        {
+            case EventType::EDIT:
+                edit(client, event.client);
+                break;
+            case EventType::DELIVER_TO_SERVER:
+                deliverToServer(client);
+                break;
+            case EventType::DELIVER_TO_CLIENT:
+                deliverToClient(client, event.client);
+                break;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    result.virtualDuration = now;
+    result.serverTransforms = server.getTransformCount();
+    for (const auto& client : clients)
+        result.clientTransforms += client->engine.getTransformCount();
+
+    if (result.messagesDelivered > 0)
+        result.meanClientQueueDepth = clientQueueDepthSum / result.messagesDelivered;
+
+    checkConvergence();
+    return result;
+}
+
+uint64_t ConvergenceSimulator::draw(uint64_t min, uint64_t max)
+{
+    // Plain modulo instead of a distribution, whose output differs between standard libraries
+    return min + random() % (max - min + 1);
+}
+
+void ConvergenceSimulator::schedule(uint64_t time, EventType type, std::size_t client)
+{
+    events.push({time, nextSequence++, type, client});
+}
+
+void ConvergenceSimulator::send(Link& link, EventType type, std::size_t client, std::string message)
+{
+    // A message can be slower than the one before it but never arrive first
+    link.lastDeliveryTime = std::max(link.lastDeliveryTime, now + draw(config.minLatency, config.maxLatency));
+    link.messages.push_back(std::move(message));
+    schedule(link.lastDeliveryTime, type, client);
+}
+
+void ConvergenceSimulator::edit(SimulatedClient& client, std::size_t clientIndex)
+{
+    std::size_t length = client.engine.getDocumentLength();
+    if (random() % 100 < config.jumpPercent)
+        client.engine.setCursorPosition(random() % (length + 1));
+
+    // Same path as Controller::processLocalOperation
+    std::size_t cursor = std::min(client.engine.getCursorPosition(), length);
+    if (length > 0 && random() % 100 < config.deletePercent)
+    {
+        // Backspace, or delete forward at the start of the document
+        std::size_t deleteLength = draw(1, config.maxDeleteLength);
+        std::size_t pos = cursor >= deleteLength ? cursor - deleteLength : 0;
+        deleteLength = std::min(deleteLength, length - pos);
+
+        DeleteOperation deleteOp(pos, deleteLength, client.clientId);
+        std::string deletedText = client.engine.getText(pos, deleteLength);
+        client.engine.deleteLocal(&deleteOp);
+        client.engine.addPendingLocalOp(std::make_unique<DeleteOperation>(deleteOp), std::move(deletedText));
+    }
+    else
+    {
+        std::string text;
+        for (std::size_t i = draw(1, config.maxInsertLength); i > 0; i--)
+            text += static_cast<char>('a' + random() % 26);
+
+        InsertOperation insertOp(text, cursor, client.clientId);
+        client.engine.insertLocal(&insertOp);
+        client.engine.addPendingLocalOp(std::make_unique<InsertOperation>(insertOp));
+    }
+
+    result.edits++;
+    sendPendingOp(client, clientIndex);
+
+    if (--client.editsLeft > 0)
+        schedule(now + draw(1, config.maxEditInterval), EventType::EDIT, clientIndex);
+}
+
+void ConvergenceSimulator::sendPendingOp(SimulatedClient& client, std::size_t clientIndex)
+{
+    if (const TextOperation* op = client.engine.takeOpToSend())
+        send(client.uplink, EventType::DELIVER_TO_SERVER, clientIndex, op->serialize());
+}
+
+void ConvergenceSimulator::deliverToServer(SimulatedClient& client)
+{
+    std::size_t depth = 0;
+    for (const auto& other : clients)
+        depth += other->uplink.messages.size();
+    result.maxServerQueueDepth = std::max(result.maxServerQueueDepth, depth);
+
+    std::string message = std::move(client.uplink.messages.front());
+    client.uplink.messages.pop_front();
+    result.messagesDelivered++;
+
+    std::unique_ptr<Operation> parsed = Operation::deserialize(message);
+    if (!parsed)
+    {
+        std::cerr << "ConvergenceSimulator: Server could not parse " << message << "\n";
+        return;
+    }
+
+    auto sequenced = server.processIncomingOperation(std::unique_ptr<TextOperation>(static_cast<TextOperation*>(parsed.release())));
+    if (!sequenced)
+        return;
+
+    // Everyone gets the sequenced op, the sender takes it as its ack
+    std::string broadcast = sequenced->serialize();
+    for (std::size_t c = 0; c < clients.size(); c++)
+        send(clients[c]->downlink, EventType::DELIVER_TO_CLIENT, c, broadcast);
+}
+
+void ConvergenceSimulator::deliverToClient(SimulatedClient& client, std::size_t clientIndex)
+{
+    result.maxClientQueueDepth = std::max(result.maxClientQueueDepth, client.downlink.messages.size());
+    clientQueueDepthSum += client.downlink.messages.size();
+
+    std::string message = std::move(client.downlink.messages.front());
+    client.downlink.messages.pop_front();
+    result.messagesDelivered++;
+
+    std::unique_ptr<Operation> parsed = Operation::deserialize(message);
+    if (!parsed)
+    {
+        std::cerr << "ConvergenceSimulator: " << client.clientId << " could not parse " << message << "\n";
+        return;
+    }
+
+    auto op = std::unique_ptr<TextOperation>(static_cast<TextOperation*>(parsed.release()));
+    if (op->clientId == client.clientId)
+    {
+        client.engine.acknowledgePendingOp(op->operationId, op->docVersion);
+        sendPendingOp(client, clientIndex);
+    }
+    else
+    {
+        client.engine.processIncomingOperation(std::move(op));
+    }
+}
+
+void ConvergenceSimulator::checkConvergence()
+{
+    result.serverText = server.getText();
+    for (const auto& client : clients)
+    {
+        if (client->engine.getText() != result.serverText || !client->engine.getPendingLocalOps().empty() ||
+            client->engine.getServerVersion() != server.getDocumentVersion())
+            result.divergedClients.push_back(client->clientId);
+    }
+
+    result.converged = result.divergedClients.empty();
+}
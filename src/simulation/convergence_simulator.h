@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <random>
+#include <memory>
+
+#include "client_text_engine.h"
+#include "server_text_engine.h"
+
+// Shape of a simulated editing session. Times are virtual microseconds.
+struct SimulationConfig
+{
+    uint64_t seed = 1;
+    std::size_t clientCount = 4;
+    std::size_t editsPerClient = 100;
+    std::string initialText = "The quick brown fox jumps over the lazy dog";
+
+    // Time between two edits of a client and the latency of each message are drawn uniformly from these ranges
+    uint64_t maxEditInterval = 2000;
+    uint64_t minLatency = 100;
+    uint64_t maxLatency = 5000;
+
+    // Clients type and backspace at their cursor. Some edits first move the cursor somewhere random.
+    unsigned int jumpPercent = 10;
+    unsigned int deletePercent = 30;
+    std::size_t maxInsertLength = 4;
+    std::size_t maxDeleteLength = 6;
+};
+
+struct SimulationResult
+{
+    bool converged = false;
+    std::string serverText;
+
+    // Clients whose text or pending ops disagree with the server after quiescence
+    std::vector<std::string> divergedClients;
+
+    uint64_t edits = 0;
+    uint64_t messagesDelivered = 0;
+    uint64_t serverTransforms = 0;
+    uint64_t clientTransforms = 0;
+    uint64_t virtualDuration = 0;
+    double seconds = 0;
+
+    // Messages waiting on a link when one is delivered, sampled at every delivery
+    std::size_t maxServerQueueDepth = 0;
+    std::size_t maxClientQueueDepth = 0;
+    double meanClientQueueDepth = 0;
+};
+
+/**
+ * Runs clients and a server through the real OT engines in one thread. Every client and the server are joined by
+ * a pair of virtual links that deliver serialized messages in order, each after its own random latency, so
+ * messages on different links are reordered and delayed against each other. A seeded scheduler decides when
+ * clients edit and when messages arrive, so a seed always replays the same session.
+ *
+ * After the last edit the network is left to drain and every client is compared with the server.
+*/
+class ConvergenceSimulator
+{
+private:
+    enum class EventType
+    {
+        EDIT,               // A client makes a local edit
+        DELIVER_TO_SERVER,  // The oldest message on a client's uplink arrives
+        DELIVER_TO_CLIENT   // The oldest message on a client's downlink arrives
+    };
+
+    struct Event
+    {
+        uint64_t time;
+        uint64_t sequence;  // Orders events at the same time by when they were scheduled
+        EventType type;
+        std::size_t client;
+
+        bool operator>(const Event& other) const
+        {
+            return time != other.time ? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    // One direction of a connection. Messages never overtake each other, like on a TCP stream.
+    struct Link
+    {
+        std::deque<std::string> messages;
+        uint64_t lastDeliveryTime = 0;
+    };
+
+    struct SimulatedClient
+    {
+        std::string clientId;
+        ClientTextEngine engine;
+        Link uplink;
+        Link downlink;
+        std::size_t editsLeft = 0;
+    };
+
+    SimulationConfig config;
+    std::mt19937_64 random;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    uint64_t now = 0;
+    uint64_t nextSequence = 0;
+
+    ServerTextEngine server;
+    std::vector<std::unique_ptr<SimulatedClient>> clients;
+    SimulationResult result;
+    double clientQueueDepthSum = 0;
+
+public:
+    explicit ConvergenceSimulator(const SimulationConfig& config);
+
+    /**
+    * Runs the session until every edit was made and every message delivered.
+    */
+    SimulationResult run();
+
+private:
+    [[nodiscard]] uint64_t draw(uint64_t min, uint64_t max);
+    void schedule(uint64_t time, EventType type, std::size_t client);
+    void send(Link& link, EventType type, std::size_t client, std::string message);
+
+    void edit(SimulatedClient& client, std::size_t clientIndex);
+    void sendPendingOp(SimulatedClient& client, std::size_t clientIndex);
+    void deliverToServer(SimulatedClient& client);
+    void deliverToClient(SimulatedClient& client, std::size_t clientIndex);
+    void checkConvergence();
+};
@@ -2,42 +2,142 @@
 #include <algorithm>
 #include <iostream>
 
-void ClientTextEngine::addPendingLocalOp(std::unique_ptr<TextOperation> op)
+namespace
 {
+    /**
+     * Folds a local op into the one made right before it when a single op does both, like typing on or
+     * backspacing over text.
+     * @returns False if the ops have to stay separate
+     */
+    bool compose(TextOperation& first, const TextOperation& second)
+    {
+        if (first.type == OperationType::INSERT && second.type == OperationType::INSERT)
+        {
+            auto& insert1 = static_cast<InsertOperation&>(first);
+            const auto& insert2 = static_cast<const InsertOperation&>(second);
+            if (insert2.pos < insert1.pos || insert2.pos > insert1.pos + insert1.text.size())
+                return false;
+
+            insert1.text.insert(insert2.pos - insert1.pos, insert2.text);
+            insert1.length = insert1.text.size();
+            return true;
+        }
+        else if (first.type == OperationType::INSERT && second.type == OperationType::DELETE)
+        {
+            // Deleting only text that was just typed
+            auto& insert1 = static_cast<InsertOperation&>(first);
+            if (second.pos < insert1.pos || second.pos + second.length > insert1.pos + insert1.text.size())
+                return false;
+
+            insert1.text.erase(second.pos - insert1.pos, second.length);
+            insert1.length = insert1.text.size();
+            return true;
+        }
+        else if (first.type == OperationType::DELETE && second.type == OperationType::DELETE)
+        {
+            if (second.pos + second.length == first.pos)
+            {
+                // Backspace
+                first.pos = second.pos;
+                first.length += second.length;
+                return true;
+            }
+            else if (second.pos == first.pos)
+            {
+                // Forward delete
+                first.length += second.length;
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+void ClientTextEngine::addPendingLocalOp(std::unique_ptr<TextOperation> op, std::string deletedText)
+{
+    // While an op is in flight the ones behind it wait anyway, so typing grows one op instead of queueing many
+    bool lastOpUnsent = !pendingLocalOps.empty() && !(opInFlight && pendingLocalOps.size() == 1);
+    std::size_t lastPos = lastOpUnsent ? pendingLocalOps.back()->pos : 0;
+    if (lastOpUnsent && compose(*pendingLocalOps.back(), *op))
+    {
+        const TextOperation& last = *pendingLocalOps.back();
+        if (last.type == OperationType::INSERT && static_cast<const InsertOperation&>(last).text.empty())
+        {
+            pendingAppliedTimes.erase(last.operationId);
+            pendingLocalOps.pop_back();
+        }
+        else if (last.type == OperationType::DELETE)
+        {
+            // A backspace removed the text before the last delete, a forward delete the text after it
+            std::string& lastDeletedText = pendingDeletedTexts[last.operationId];
+            if (op->pos < lastPos)
+                lastDeletedText.insert(0, deletedText);
+            else
+                lastDeletedText += deletedText;
+        }
+
+        return;
+    }
+
+    if (op->type == OperationType::DELETE)
+        pendingDeletedTexts[op->operationId] = std::move(deletedText);
+
+    pendingAppliedTimes[op->operationId] = std::chrono::steady_clock::now();
     pendingLocalOps.emplace_back(std::move(op));
 }
 
-void ClientTextEngine::acknowledgePendingOp(TextOperation *op)
+std::optional<std::chrono::steady_clock::time_point> ClientTextEngine::acknowledgePendingOp(uint64_t operationId, uint64_t sequencedVersion)
 {
-    auto it = std::find_if(pendingLocalOps.begin(), pendingLocalOps.end(), [op](const std::unique_ptr<TextOperation>& pendingOp)
+    auto it = std::find_if(pendingLocalOps.begin(), pendingLocalOps.end(), [operationId](const std::unique_ptr<TextOperation>& pendingOp)
         {
-            return pendingOp->operationId == op->operationId;
+            return pendingOp->operationId == operationId;
         });
     
+    reachServerVersion(sequencedVersion + 1);
+
     if (it != pendingLocalOps.end())
     {
+        if (it == pendingLocalOps.begin())
+            opInFlight = false;
+
+        pendingDeletedTexts.erase(operationId);
         acknowledgedOps.emplace_back(std::move(*it));
         pendingLocalOps.erase(it);
-        
-        std::cout << "ClientTextEngine: Acknowledged operation " << op->operationId << "\n";
+
+        auto appliedTime = pendingAppliedTimes.find(operationId);
+        if (appliedTime != pendingAppliedTimes.end())
+        {
+            std::chrono::steady_clock::time_point appliedAt = appliedTime->second;
+            pendingAppliedTimes.erase(appliedTime);
+            return appliedAt;
+        }
     }
-    else
+    else if (droppedOpIds.erase(operationId) == 0)
     {
-        std::cerr << "ClientTextEngine: Could not find pending operation " << op->operationId << " to acknowledge\n";
+        // A dropped one was sequenced before the version we reset to, its ack was dropped with the ops in between
+        std::cerr << "ClientTextEngine: Could not find pending operation " << operationId << " to acknowledge\n";
     }
+
+    return std::nullopt;
 }
 
 std::unique_ptr<TextOperation> ClientTextEngine::processIncomingOperation(std::unique_ptr<TextOperation> op) 
 {
-    // Transform incoming op against all pending local ops
-    auto transformedOp = std::move(op);
-    for (const auto& pendingOp : pendingLocalOps)
+    if (op->type != OperationType::INSERT && op->type != OperationType::DELETE)
     {
-        auto newTransformed = transform(transformedOp.get(), pendingOp.get());
-        if (newTransformed)
-            transformedOp = std::move(newTransformed);
+        std::cerr << "ClientTextEngine: Ignored an operation made for another engine: " << op->serialize() << "\n";
+        return nullptr;
     }
 
+    uint64_t sequencedVersion = op->docVersion + 1;
+
+    // Walk the incoming op past the pending ops. Each pending op is rebased onto the incoming op as it was right
+    // before that pending op, since both have to apply to the same text.
+    auto transformedOp = std::move(op);
+    for (auto& pendingOp : pendingLocalOps)
+        rebasePendingOp(pendingOp, transformedOp);
+
     // Apply transformed op to local doc
     if (transformedOp->type == OperationType::INSERT)
     {
@@ -50,15 +150,276 @@ std::unique_ptr<TextOperation> ClientTextEngine::processIncomingOperation(std::u
         deleteIncoming(deleteOp);
     }
 
-    // Retransform all pending local ops against the transformed incoming op
-    for (auto& pendingOp : pendingLocalOps)
+    reachServerVersion(sequencedVersion);
+
+    return transformedOp;
+}
+
+void ClientTextEngine::processIncomingOperations(std::vector<std::unique_ptr<TextOperation>> ops)
+{
+    std::vector<std::unique_ptr<TextOperation>> edits;
+    std::vector<uint64_t> sequencedVersions;
+    for (auto& op : ops)
     {
-        auto retransformed = transform(pendingOp.get(), transformedOp.get());
-        if (retransformed)
+        if (op->type != OperationType::INSERT && op->type != OperationType::DELETE)
         {
-            pendingOp = std::move(retransformed);
+            std::cerr << "ClientTextEngine: Ignored an operation made for another engine: " << op->serialize() << "\n";
+            continue;
         }
+
+        sequencedVersions.push_back(op->docVersion + 1);
+        docVersion = std::max(docVersion, op->docVersion) + 1;
+
+        // The same walk as for a single op, the pending ops end up rebased onto the whole batch
+        auto transformedOp = std::move(op);
+        for (auto& pendingOp : pendingLocalOps)
+            rebasePendingOp(pendingOp, transformedOp);
+
+        // Transformed ops apply one after the other, so consecutive ones can be folded like local typing
+        if (edits.empty() || !compose(*edits.back(), *transformedOp))
+            edits.emplace_back(std::move(transformedOp));
     }
 
-    return transformedOp;
-}
\ No newline at end of file
+    for (const auto& edit : edits)
+    {
+        if (edit->type == OperationType::INSERT)
+        {
+            const auto& insertOp = static_cast<const InsertOperation&>(*edit);
+            if (!insertOp.text.empty())
+                insertText(insertOp.pos, insertOp.text);
+        }
+        else if (edit->length > 0)
+        {
+            if (edit->pos + edit->length <= textBuffer.getDocumentLength())
+                removeText(edit->pos, edit->length);
+            else
+                std::cout << "ClientTextEngine: Delete operation out of bounds - skipping\n";
+        }
+    }
+
+    // The text is only known after the whole batch, presences sent at the versions in between are placed there
+    for (uint64_t version : sequencedVersions)
+        reachServerVersion(version);
+}
+
+const TextOperation* ClientTextEngine::takeOpToSend()
+{
+    if (opInFlight || pendingLocalOps.empty() || !serverVersion)
+        return nullptr;
+
+    // Every op we received has been applied to it, the ones before it in the queue were acknowledged
+    TextOperation* op = pendingLocalOps.front().get();
+    op->docVersion = *serverVersion;
+    opInFlight = true;
+
+    return op;
+}
+
+void ClientTextEngine::prepareForServerDocument()
+{
+    unsentOpsBase.reset();
+
+    std::size_t firstUnsent = opInFlight ? 1 : 0;
+    if (pendingLocalOps.size() <= firstUnsent)
+        return;
+
+    // Undo the unsent ops newest first, the op in flight stays in the text they were made in
+    std::string text = getText();
+    for (std::size_t i = pendingLocalOps.size(); i-- > firstUnsent;)
+    {
+        const TextOperation& pendingOp = *pendingLocalOps[i];
+        if (pendingOp.type == OperationType::INSERT)
+        {
+            const std::string& insertedText = static_cast<const InsertOperation&>(pendingOp).text;
+            if (pendingOp.pos + insertedText.size() > text.size())
+                return;
+
+            text.erase(pendingOp.pos, insertedText.size());
+        }
+        else
+        {
+            auto deletedText = pendingDeletedTexts.find(pendingOp.operationId);
+            if (deletedText == pendingDeletedTexts.end() || deletedText->second.size() != pendingOp.length || pendingOp.pos > text.size())
+                return;
+
+            text.insert(pendingOp.pos, deletedText->second);
+        }
+    }
+
+    unsentOpsBase = std::move(text);
+}
+
+std::size_t ClientTextEngine::resetToServerVersion(uint64_t version)
+{
+    droppedOpIds.clear();
+    if (opInFlight && !pendingLocalOps.empty())
+    {
+        const uint64_t inFlightId = pendingLocalOps.front()->operationId;
+        droppedOpIds.insert(inFlightId);
+        pendingAppliedTimes.erase(inFlightId);
+        pendingDeletedTexts.erase(inFlightId);
+        pendingLocalOps.erase(pendingLocalOps.begin());
+    }
+
+    if (!unsentOpsBase)
+    {
+        // Nothing was held to rebase from, the text they were made in is gone
+        for (const auto& pendingOp : pendingLocalOps)
+            droppedOpIds.insert(pendingOp->operationId);
+
+        pendingLocalOps.clear();
+        pendingAppliedTimes.clear();
+        pendingDeletedTexts.clear();
+    }
+    else if (!pendingLocalOps.empty())
+    {
+        // The document differs from the held text in one stretch at most, replaced by a delete and an insert
+        const std::string& base = *unsentOpsBase;
+        const std::string text = getText();
+        std::size_t prefix = 0;
+        while (prefix < base.size() && prefix < text.size() && base[prefix] == text[prefix])
+            prefix++;
+
+        std::size_t suffix = 0;
+        while (suffix < base.size() - prefix && suffix < text.size() - prefix && base[base.size() - 1 - suffix] == text[text.size() - 1 - suffix])
+            suffix++;
+
+        std::unique_ptr<TextOperation> replaced = std::make_unique<DeleteOperation>(prefix, base.size() - prefix - suffix, "");
+        for (auto& pendingOp : pendingLocalOps)
+            rebasePendingOp(pendingOp, replaced);
+
+        std::unique_ptr<TextOperation> replacement = std::make_unique<InsertOperation>(text.substr(prefix, text.size() - prefix - suffix), prefix, "");
+        for (auto& pendingOp : pendingLocalOps)
+            rebasePendingOp(pendingOp, replacement);
+
+        for (const auto& pendingOp : pendingLocalOps)
+        {
+            if (pendingOp->type == OperationType::INSERT)
+            {
+                const auto& insertOp = static_cast<const InsertOperation&>(*pendingOp);
+                if (!insertOp.text.empty())
+                    insertText(insertOp.pos, insertOp.text);
+            }
+            else if (pendingOp->length > 0 && pendingOp->pos + pendingOp->length <= getDocumentLength())
+            {
+                removeText(pendingOp->pos, pendingOp->length);
+            }
+        }
+    }
+
+    unsentOpsBase.reset();
+    resetVersion = version;
+    acknowledgedOps.clear();
+    opInFlight = false;
+
+    docVersion = version;
+    versionRevisions.clear();
+    reachServerVersion(version);
+
+    // Remote positions have to be matched against the new text again
+    for (auto& [clientId, entry] : remotePresences)
+        entry.revision.reset();
+
+    return pendingLocalOps.size();
+}
+
+bool ClientTextEngine::takeDroppedOp(const TextOperation& op)
+{
+    if (droppedOpIds.erase(op.operationId) == 0)
+        return false;
+
+    // Acks carry the version the op was sequenced at, the document we reset to has everything before it
+    return op.docVersion >= resetVersion;
+}
+
+void ClientTextEngine::setRemotePresence(const std::string& clientId, uint64_t version, const Presence& presence)
+{
+    remotePresences[clientId] = {presence, version, std::nullopt};
+}
+
+void ClientTextEngine::removeRemotePresence(const std::string& clientId)
+{
+    remotePresences.erase(clientId);
+}
+
+std::vector<RemotePresence> ClientTextEngine::getRemotePresences()
+{
+    std::vector<RemotePresence> presences;
+    presences.reserve(remotePresences.size());
+
+    uint64_t currentRevision = getEditRevision();
+    for (auto& [clientId, entry] : remotePresences)
+    {
+        if (!entry.revision)
+        {
+            // The sender's positions line up with our text right after we reached the same version
+            auto it = std::find_if(versionRevisions.begin(), versionRevisions.end(), [&entry] (const auto& versionRevision)
+                {
+                    return versionRevision.first == entry.version;
+                });
+
+            if (it != versionRevisions.end())
+                entry.revision = it->second;
+            else if (!versionRevisions.empty() && entry.version < versionRevisions.front().first)
+                entry.revision = versionRevisions.front().second; // Older than we remember, best effort
+        }
+
+        // Until we catch up to the sender's version its positions are used as they are
+        if (entry.revision && *entry.revision != currentRevision)
+        {
+            entry.presence.cursor = transformPosition(entry.presence.cursor, *entry.revision);
+            entry.presence.selectionStart = transformPosition(entry.presence.selectionStart, *entry.revision);
+            entry.presence.selectionEnd = transformPosition(entry.presence.selectionEnd, *entry.revision);
+            entry.revision = currentRevision;
+        }
+
+        Presence presence = entry.presence;
+        presence.cursor = std::min(presence.cursor, getDocumentLength());
+        presence.selectionStart = std::min(presence.selectionStart, getDocumentLength());
+        presence.selectionEnd = std::min(presence.selectionEnd, getDocumentLength());
+        presences.push_back({clientId, presence});
+    }
+
+    return presences;
+}
+
+void ClientTextEngine::rebasePendingOp(std::unique_ptr<TextOperation>& pendingOp, std::unique_ptr<TextOperation>& incomingOp)
+{
+    // Keep the text a pending delete removes in step with what transform() does to its range
+    if (pendingOp->type == OperationType::DELETE)
+    {
+        auto deletedText = pendingDeletedTexts.find(pendingOp->operationId);
+        if (deletedText != pendingDeletedTexts.end())
+        {
+            const std::size_t start = pendingOp->pos;
+            const std::size_t end = pendingOp->pos + pendingOp->length;
+            if (incomingOp->type == OperationType::INSERT && incomingOp->pos > start && incomingOp->pos < end)
+            {
+                // The delete grows to take the inserted text with it
+                const auto& insertOp = static_cast<const InsertOperation&>(*incomingOp);
+                deletedText->second.insert(std::min(incomingOp->pos - start, deletedText->second.size()), insertOp.text);
+            }
+            else if (incomingOp->type == OperationType::DELETE)
+            {
+                // Text deleted by both is only removed once
+                const std::size_t overlapStart = std::max(start, incomingOp->pos);
+                const std::size_t overlapEnd = std::min(end, incomingOp->pos + incomingOp->length);
+                if (overlapStart < overlapEnd && overlapStart - start < deletedText->second.size())
+                    deletedText->second.erase(overlapStart - start, overlapEnd - overlapStart);
+            }
+        }
+    }
+
+    auto rebasedPendingOp = transform(pendingOp.get(), incomingOp.get());
+    incomingOp = transform(incomingOp.get(), pendingOp.get());
+    pendingOp = std::move(rebasedPendingOp);
+}
+
+void ClientTextEngine::reachServerVersion(uint64_t version)
+{
+    serverVersion = version;
+
+    versionRevisions.emplace_back(version, getEditRevision());
+    if (versionRevisions.size() > maxVersionRevisions)
+        versionRevisions.pop_front();
+}
@@ -1,26 +1,148 @@
 #pragma once
 
+#include <stdint.h>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <string>
 
 #include "text_engine.h"
 #include "operations.h"
+#include "presence.h"
 
+/**
+ * Local ops go to the server one at a time: the next one is only sent once the previous one was acknowledged,
+ * stamped with the server version it applies to. The server then only has to transform it against ops sequenced
+ * since that version, which never include our own.
+*/
 class ClientTextEngine : public TextEngine
 {
 private:
+    // Local ops the server has not acknowledged, oldest first, kept rebased onto every op we receive
     std::vector<std::unique_ptr<TextOperation>> pendingLocalOps;
     std::vector<std::unique_ptr<TextOperation>> acknowledgedOps;
 
+    // When the oldest edit folded into each pending op was applied to the text, by operation id
+    std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> pendingAppliedTimes;
+
+    // Text each pending delete removes, by operation id, so the unsent ops can be undone to find the text they
+    // were made in
+    std::unordered_map<uint64_t, std::string> pendingDeletedTexts;
+
+    // Text the unsent ops were made in, held from prepareForServerDocument() until resetToServerVersion()
+    std::optional<std::string> unsentOpsBase;
+
+    // Set while the oldest pending op is on its way to the server
+    bool opInFlight = false;
+
+    // Pending ops dropped by the last reset and the version it reset to. One the server still sequenced afterwards
+    // is not in the text.
+    std::unordered_set<uint64_t> droppedOpIds;
+    uint64_t resetVersion = 0;
+
+    // Server document version the local text is confirmed to include, unset until the server sent the document
+    std::optional<uint64_t> serverVersion;
+
+    // Edit revision at which each recent server version was reached, oldest first
+    std::deque<std::pair<uint64_t, uint64_t>> versionRevisions;
+    static constexpr std::size_t maxVersionRevisions = 1024;
+
+    struct RemotePresenceEntry
+    {
+        Presence presence;
+        uint64_t version;                   // Server version the sender was at
+        std::optional<uint64_t> revision;   // Our edit revision the positions refer to, once known
+    };
+
+    std::map<std::string, RemotePresenceEntry> remotePresences;
+
 public:
-    void addPendingLocalOp(std::unique_ptr<TextOperation> op);
-    void acknowledgePendingOp(TextOperation* op);
+    /**
+    * Queues a local op that was already applied to the text, folded into the last unsent op where one op can do
+    * both. Send it with takeOpToSend().
+    * @param deletedText Text a delete removed, read before it was applied
+    */
+    void addPendingLocalOp(std::unique_ptr<TextOperation> op, std::string deletedText = {});
+
+    /**
+    * @param sequencedVersion Version the server sequenced the op at
+    * @returns When the oldest edit in the acknowledged op was applied to the text, unset if it was not pending
+    */
+    std::optional<std::chrono::steady_clock::time_point> acknowledgePendingOp(uint64_t operationId, uint64_t sequencedVersion);
+
+    /**
+    * @returns The oldest pending op, stamped with the server version it applies to, or null if an op is still in
+    * flight or nothing is pending. The op counts as in flight from here on.
+    */
+    [[nodiscard]] const TextOperation* takeOpToSend();
+
+    /**
+    * Lets takeOpToSend() return the in-flight op again, e.g. after the connection dropped before it was sequenced.
+    */
+    void requeueInFlightOp() { opInFlight = false; }
+
+    /**
+    * Call before the text is replaced by a document from the server. Remembers the text the unsent ops were made
+    * in, so resetToServerVersion() can rebase them onto the new document.
+    */
+    void prepareForServerDocument();
+
+    /**
+    * Marks the local text as the server's document at a version. Unsent ops are rebased onto it by the difference
+    * from the text prepareForServerDocument() held, applied again and stay pending. The op in flight is dropped:
+    * the document either has it already or the server sends it back whole, see takeDroppedOp().
+    * @returns Number of unsent ops that were rebased
+    */
+    std::size_t resetToServerVersion(uint64_t version);
+
+    /**
+    * @returns True if the op is the server's copy of a pending op the last reset dropped, sequenced after the version
+    * it reset to. The text does not have it, so it has to be applied like someone else's.
+    */
+    bool takeDroppedOp(const TextOperation& op);
+
+    [[nodiscard]] std::optional<uint64_t> getServerVersion() const { return serverVersion; }
+    [[nodiscard]] const std::vector<std::unique_ptr<TextOperation>>& getPendingLocalOps() const { return pendingLocalOps; }
+
+    /**
+    * Stores the latest presence of another client, replacing the previous one.
+    * @param version Server version the sender's positions refer to
+    */
+    void setRemotePresence(const std::string& clientId, uint64_t version, const Presence& presence);
+    void removeRemotePresence(const std::string& clientId);
 
     /**
-    * Transforms operation against pending ops, applies op to local doc, retransforms pending ops against 
-    * transformed op, and returns copy for broadcasting
+    * Presences are only transformed here, against the edits applied since they were last looked at, so updates
+    * that are replaced before the next frame cost nothing.
+    * @returns Remote presences in current text positions, ordered by client id
+    */
+    [[nodiscard]] std::vector<RemotePresence> getRemotePresences();
+
+    /**
+    * Transforms operation against pending ops, applies op to local doc, retransforms each pending op against
+    * the incoming op as it was before that pending op, and returns copy for broadcasting
     * @param op Op to process
     * @returns Copy of the transformed op
     */
     std::unique_ptr<TextOperation> processIncomingOperation(std::unique_ptr<TextOperation> op);
+
+    /**
+    * Applies ops someone else made, in the order the server sequenced them. Each is transformed against the
+    * pending ops like processIncomingOperation() does, then the transformed ops are folded together where one
+    * edit does the work of several, e.g. a burst of typing, and applied to the text as few edits.
+    */
+    void processIncomingOperations(std::vector<std::unique_ptr<TextOperation>> ops);
+
+private:
+    void reachServerVersion(uint64_t version);
+
+    /**
+    * Rebases a pending op onto an incoming op made against the same text, and the incoming op past it.
+    */
+    void rebasePendingOp(std::unique_ptr<TextOperation>& pendingOp, std::unique_ptr<TextOperation>& incomingOp);
 };
@@ -0,0 +1,748 @@
+#include <algorithm>
+#include <iostream>
+
+#include "crdt_sequence.h"
+#include "text_engine.h"
+
+namespace
+{
+    struct ScannedRun
+    {
+        uint32_t agent;
+        uint32_t clock;
+        uint32_t length;
+    };
+
+    bool containsId(const std::vector<ScannedRun>& runs, uint32_t agent, uint32_t clock)
+    {
+        for (const ScannedRun& run : runs)
+        {
+            if (run.agent == agent && clock >= run.clock && clock - run.clock < run.length)
+                return true;
+        }
+
+        return false;
+    }
+
+    bool parseNumberField(const std::string& state, std::size_t& pos, uint64_t& value)
+    {
+        std::size_t end = state.find(':', pos);
+        if (end == std::string::npos || end == pos)
+            return false;
+
+        value = 0;
+        for (std::size_t i = pos; i < end; i++)
+        {
+            if (state[i] < '0' || state[i] > '9')
+                return false;
+
+            value = value * 10 + (state[i] - '0');
+        }
+
+        pos = end + 1;
+        return true;
+    }
+}
+
+CrdtSequence::CrdtSequence()
+{
+    clear();
+}
+
+void CrdtSequence::clear()
+{
+    leaves.clear();
+    leaves.push_back(std::make_unique<CrdtLeaf>());
+    agentNames.clear();
+    agentIndices.clear();
+    runLeaves.clear();
+    nextClocks.clear();
+    oversizedLeaves.clear();
+    visibleLength = 0;
+    runCount = 0;
+    rebuildLeafTree();
+}
+
+void CrdtSequence::reset(std::size_t length)
+{
+    clear();
+    if (length == 0)
+        return;
+
+    uint32_t agent = getAgent(crdtRootClientId);
+    CrdtRun run{agent, 0, static_cast<uint32_t>(length), noAgent, 0, noAgent, 0, false};
+    insertRun({nullptr, 0}, run);
+    addVisible(leaves.front().get(), length);
+    nextClocks[agent] = run.length;
+}
+
+std::unique_ptr<CrdtInsertOperation> CrdtSequence::insertLocal(std::size_t pos, const std::string& text, const std::string& clientId)
+{
+    pos = std::min(pos, visibleLength);
+    uint32_t agent = getAgent(clientId);
+
+    auto op = std::make_unique<CrdtInsertOperation>(text, pos, clientId);
+    op->clock = nextClocks[agent];
+
+    // The text goes between the visible character before it and whatever follows that character, tombstones included
+    Location right{nullptr, 0};
+    std::size_t rightOffset = 0;
+    if (pos > 0)
+    {
+        Location left;
+        std::size_t offset = 0;
+        if (!findVisible(pos - 1, left, offset))
+            return nullptr;
+
+        const CrdtRun& leftRun = getRun(left);
+        op->originLeft = CrdtId{agentNames[leftRun.agent], leftRun.clock + offset};
+
+        right = left;
+        rightOffset = offset + 1;
+        if (rightOffset == leftRun.length)
+        {
+            rightOffset = 0;
+            if (!next(right))
+                right.leaf = nullptr;
+        }
+    }
+    else if (!next(right))
+    {
+        right.leaf = nullptr;
+    }
+
+    if (right.leaf)
+    {
+        const CrdtRun& rightRun = getRun(right);
+        op->originRight = CrdtId{agentNames[rightRun.agent], rightRun.clock + rightOffset};
+    }
+
+    std::size_t integratedPos = 0;
+    if (!integrateInsert(*op, integratedPos))
+        return nullptr;
+
+    return op;
+}
+
+std::unique_ptr<CrdtDeleteOperation> CrdtSequence::deleteLocal(std::size_t pos, std::size_t length, const std::string& clientId)
+{
+    if (length == 0 || pos >= visibleLength)
+        return nullptr;
+
+    length = std::min(length, visibleLength - pos);
+
+    Location location;
+    std::size_t offset = 0;
+    if (!findVisible(pos, location, offset))
+        return nullptr;
+
+    if (offset > 0)
+    {
+        splitRun(location, offset);
+        location.run++;
+    }
+
+    auto op = std::make_unique<CrdtDeleteOperation>(pos, clientId);
+    std::size_t remaining = length;
+    while (remaining > 0)
+    {
+        if (!getRun(location).deleted)
+        {
+            std::size_t take = std::min<std::size_t>(remaining, getRun(location).length);
+            if (take < getRun(location).length)
+                splitRun(location, take);
+
+            CrdtRun& run = getRun(location);
+            run.deleted = true;
+            removeVisible(location.leaf, take);
+            remaining -= take;
+
+            // Backspacing over one client's typing yields one span
+            const std::string& runClientId = agentNames[run.agent];
+            if (!op->spans.empty() && op->spans.back().clientId == runClientId &&
+                op->spans.back().clock + op->spans.back().length == run.clock)
+                op->spans.back().length += take;
+            else
+                op->spans.push_back({runClientId, run.clock, take});
+
+            mergeWithPrevious(location);
+        }
+
+        if (remaining > 0 && !next(location))
+            break;
+    }
+
+    if (next(location))
+        mergeWithPrevious(location);
+
+    op->length = length - remaining;
+    splitOversizedLeaves();
+    return op;
+}
+
+bool CrdtSequence::integrateInsert(const CrdtInsertOperation& op, std::size_t& pos)
+{
+    if (op.text.empty())
+        return false;
+
+    uint32_t agent = getAgent(op.clientId);
+
+    // Ops from one client arrive in the order it made them, so anything below its clock was integrated already
+    if (op.clock < nextClocks[agent])
+        return false;
+
+    uint32_t leftAgent = noAgent;
+    uint32_t leftClock = 0;
+    Location left{nullptr, 0};
+    if (op.originLeft)
+    {
+        leftAgent = findAgent(op.originLeft->clientId);
+        leftClock = static_cast<uint32_t>(op.originLeft->clock);
+
+        std::size_t offset = 0;
+        if (leftAgent == noAgent || !findId(leftAgent, leftClock, left, offset))
+        {
+            std::cerr << "CrdtSequence: Unknown left origin " << op.originLeft->clientId << ":" << op.originLeft->clock << "\n";
+            return false;
+        }
+
+        if (offset + 1 < getRun(left).length)
+            splitRun(left, offset + 1);
+    }
+
+    uint32_t rightAgent = noAgent;
+    uint32_t rightClock = 0;
+    if (op.originRight)
+    {
+        rightAgent = findAgent(op.originRight->clientId);
+        rightClock = static_cast<uint32_t>(op.originRight->clock);
+
+        Location right;
+        std::size_t offset = 0;
+        if (rightAgent == noAgent || !findId(rightAgent, rightClock, right, offset))
+        {
+            std::cerr << "CrdtSequence: Unknown right origin " << op.originRight->clientId << ":" << op.originRight->clock << "\n";
+            return false;
+        }
+
+        if (offset > 0)
+            splitRun(right, offset);
+    }
+
+    // Order against concurrent inserts between the same origins, as in YATA. Runs typed after the same character go
+    // by client id, and runs whose left origin lies inside that group stay with it.
+    std::vector<ScannedRun> itemsBeforeOrigin;
+    std::vector<ScannedRun> conflictingItems;
+    Location scan = left;
+    while (next(scan))
+    {
+        const CrdtRun& run = getRun(scan);
+        if (run.agent == rightAgent && run.clock == rightClock)
+            break;
+
+        itemsBeforeOrigin.push_back({run.agent, run.clock, run.length});
+        conflictingItems.push_back({run.agent, run.clock, run.length});
+
+        if (run.originLeftAgent == leftAgent && run.originLeftClock == leftClock)
+        {
+            if (agentNames[run.agent] < op.clientId)
+            {
+                left = scan;
+                conflictingItems.clear();
+            }
+            else if (run.originRightAgent == rightAgent && run.originRightClock == rightClock)
+            {
+                break;
+            }
+        }
+        else if (run.originLeftAgent != noAgent && containsId(itemsBeforeOrigin, run.originLeftAgent, run.originLeftClock))
+        {
+            if (!containsId(conflictingItems, run.originLeftAgent, run.originLeftClock))
+            {
+                left = scan;
+                conflictingItems.clear();
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    const uint32_t clock = static_cast<uint32_t>(op.clock);
+    const uint32_t length = static_cast<uint32_t>(op.text.size());
+    CrdtLeaf* leaf = left.leaf ? left.leaf : leaves.front().get();
+
+    pos = 0;
+    if (left.leaf)
+    {
+        pos = getPosition(left);
+        if (!getRun(left).deleted)
+            pos += getRun(left).length;
+    }
+
+    // Typing on from the end of a run extends it instead of adding one
+    bool extended = false;
+    if (left.leaf)
+    {
+        CrdtRun& leftRun = getRun(left);
+        if (leftRun.agent == agent && !leftRun.deleted && leftRun.clock + leftRun.length == clock &&
+            leftAgent == agent && leftClock + 1 == clock &&
+            leftRun.originRightAgent == rightAgent && leftRun.originRightClock == rightClock)
+        {
+            leftRun.length += length;
+            extended = true;
+        }
+    }
+
+    if (!extended)
+        insertRun(left, {agent, clock, length, leftAgent, leftClock, rightAgent, rightClock, false});
+
+    addVisible(leaf, length);
+    nextClocks[agent] = clock + length;
+    splitOversizedLeaves();
+    return true;
+}
+
+void CrdtSequence::integrateDelete(const CrdtDeleteOperation& op, std::vector<CrdtTextRange>& removed)
+{
+    for (const CrdtSpan& span : op.spans)
+    {
+        uint32_t agent = findAgent(span.clientId);
+        uint32_t clock = static_cast<uint32_t>(span.clock);
+        std::size_t remaining = span.length;
+
+        while (remaining > 0)
+        {
+            Location location;
+            std::size_t offset = 0;
+            if (agent == noAgent || !findId(agent, clock, location, offset))
+            {
+                std::cerr << "CrdtSequence: Delete of unknown characters " << span.clientId << ":" << clock << "\n";
+                break;
+            }
+
+            if (offset > 0)
+            {
+                splitRun(location, offset);
+                location.run++;
+            }
+
+            std::size_t take = std::min<std::size_t>(remaining, getRun(location).length);
+            if (take < getRun(location).length)
+                splitRun(location, take);
+
+            CrdtRun& run = getRun(location);
+            if (!run.deleted)
+            {
+                removed.push_back({getPosition(location), take});
+                run.deleted = true;
+                removeVisible(location.leaf, take);
+                mergeWithPrevious(location);
+            }
+
+            clock += static_cast<uint32_t>(take);
+            remaining -= take;
+
+            if (remaining == 0 && next(location))
+                mergeWithPrevious(location);
+        }
+    }
+
+    splitOversizedLeaves();
+}
+
+bool CrdtSequence::integrate(const TextOperation& op, TextEngine& engine)
+{
+    if (op.type == OperationType::CRDT_INSERT)
+    {
+        const auto& insertOp = static_cast<const CrdtInsertOperation&>(op);
+        std::size_t pos = 0;
+        if (!integrateInsert(insertOp, pos))
+            return false;
+
+        engine.insertText(pos, insertOp.text);
+        return true;
+    }
+
+    if (op.type == OperationType::CRDT_DELETE)
+    {
+        std::vector<CrdtTextRange> removed;
+        integrateDelete(static_cast<const CrdtDeleteOperation&>(op), removed);
+        for (const CrdtTextRange& range : removed)
+            engine.removeText(range.pos, range.length);
+
+        return true;
+    }
+
+    return false;
+}
+
+std::string CrdtSequence::encode(const std::string& text) const
+{
+    // agentCount:(clientId:)*runCount:(agent:clock:length:leftAgent:leftClock:rightAgent:rightClock:deleted:)*text
+    std::string state = std::to_string(agentNames.size()) + ":";
+    for (const std::string& name : agentNames)
+        state += name + ":";
+
+    state += std::to_string(runCount) + ":";
+    for (const auto& leaf : leaves)
+    {
+        for (const CrdtRun& run : leaf->runs)
+        {
+            state += std::to_string(run.agent) + ":" + std::to_string(run.clock) + ":" + std::to_string(run.length) + ":" +
+                     std::to_string(run.originLeftAgent) + ":" + std::to_string(run.originLeftClock) + ":" +
+                     std::to_string(run.originRightAgent) + ":" + std::to_string(run.originRightClock) + ":" +
+                     (run.deleted ? "1:" : "0:");
+        }
+    }
+
+    return state + text;
+}
+
+bool CrdtSequence::decode(const std::string& state, std::string& text)
+{
+    clear();
+
+    std::size_t pos = 0;
+    uint64_t agentCount = 0;
+    if (!parseNumberField(state, pos, agentCount))
+        return false;
+
+    for (uint64_t i = 0; i < agentCount; i++)
+    {
+        std::size_t end = state.find(':', pos);
+        if (end == std::string::npos)
+        {
+            clear();
+            return false;
+        }
+
+        getAgent(state.substr(pos, end - pos));
+        pos = end + 1;
+    }
+
+    uint64_t count = 0;
+    if (!parseNumberField(state, pos, count))
+    {
+        clear();
+        return false;
+    }
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t fields[8];
+        for (uint64_t& field : fields)
+        {
+            if (!parseNumberField(state, pos, field))
+            {
+                clear();
+                return false;
+            }
+        }
+
+        CrdtRun run{static_cast<uint32_t>(fields[0]), static_cast<uint32_t>(fields[1]), static_cast<uint32_t>(fields[2]),
+                    static_cast<uint32_t>(fields[3]), static_cast<uint32_t>(fields[4]),
+                    static_cast<uint32_t>(fields[5]), static_cast<uint32_t>(fields[6]), fields[7] != 0};
+        if (run.agent >= agentCount || run.length == 0 ||
+            (run.originLeftAgent != noAgent && run.originLeftAgent >= agentCount) ||
+            (run.originRightAgent != noAgent && run.originRightAgent >= agentCount))
+        {
+            clear();
+            return false;
+        }
+
+        // Fill leaves halfway so they have room to grow
+        CrdtLeaf* leaf = leaves.back().get();
+        if (leaf->runs.size() >= maxLeafRuns / 2)
+        {
+            leaves.push_back(std::make_unique<CrdtLeaf>());
+            leaf = leaves.back().get();
+        }
+
+        leaf->runs.push_back(run);
+        runLeaves[run.agent][run.clock] = leaf;
+        nextClocks[run.agent] = std::max(nextClocks[run.agent], run.clock + run.length);
+        runCount++;
+        if (!run.deleted)
+        {
+            leaf->visibleLength += run.length;
+            visibleLength += run.length;
+        }
+    }
+
+    rebuildLeafTree();
+
+    text = state.substr(pos);
+    if (text.size() != visibleLength)
+    {
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+std::size_t CrdtSequence::getMemoryUsage() const
+{
+    // Map nodes carry a key, a value and about four pointers of tree overhead
+    constexpr std::size_t mapNodeSize = sizeof(std::pair<const uint32_t, CrdtLeaf*>) + 4 * sizeof(void*);
+
+    std::size_t bytes = leaves.capacity() * sizeof(std::unique_ptr<CrdtLeaf>) + leafTree.capacity() * sizeof(std::size_t);
+    for (const auto& leaf : leaves)
+        bytes += sizeof(CrdtLeaf) + leaf->runs.capacity() * sizeof(CrdtRun);
+
+    for (const auto& agentRuns : runLeaves)
+        bytes += sizeof(agentRuns) + agentRuns.size() * mapNodeSize;
+
+    for (const std::string& name : agentNames)
+        bytes += sizeof(name) + name.capacity() + mapNodeSize;
+
+    return bytes + nextClocks.capacity() * sizeof(uint32_t);
+}
+
+uint32_t CrdtSequence::getAgent(const std::string& clientId)
+{
+    auto it = agentIndices.find(clientId);
+    if (it != agentIndices.end())
+        return it->second;
+
+    uint32_t agent = static_cast<uint32_t>(agentNames.size());
+    agentNames.push_back(clientId);
+    agentIndices[clientId] = agent;
+    runLeaves.emplace_back();
+    nextClocks.push_back(0);
+    return agent;
+}
+
+uint32_t CrdtSequence::findAgent(const std::string& clientId) const
+{
+    auto it = agentIndices.find(clientId);
+    return it != agentIndices.end() ? it->second : noAgent;
+}
+
+bool CrdtSequence::findVisible(std::size_t pos, Location& location, std::size_t& offset) const
+{
+    if (pos >= visibleLength)
+        return false;
+
+    // Descend the Fenwick tree to the first leaf whose prefix sum passes pos
+    std::size_t leafIndex = 0;
+    std::size_t step = 1;
+    while (step * 2 <= leaves.size())
+        step *= 2;
+
+    for (; step > 0; step /= 2)
+    {
+        if (leafIndex + step <= leaves.size() && leafTree[leafIndex + step] <= pos)
+        {
+            leafIndex += step;
+            pos -= leafTree[leafIndex];
+        }
+    }
+
+    CrdtLeaf* leaf = leaves[leafIndex].get();
+    for (std::size_t i = 0; i < leaf->runs.size(); i++)
+    {
+        const CrdtRun& run = leaf->runs[i];
+        if (run.deleted)
+            continue;
+
+        if (pos < run.length)
+        {
+            location = {leaf, i};
+            offset = pos;
+            return true;
+        }
+
+        pos -= run.length;
+    }
+
+    return false;
+}
+
+bool CrdtSequence::findId(uint32_t agent, uint32_t clock, Location& location, std::size_t& offset) const
+{
+    const auto& agentRuns = runLeaves[agent];
+    auto it = agentRuns.upper_bound(clock);
+    if (it == agentRuns.begin())
+        return false;
+
+    --it;
+    CrdtLeaf* leaf = it->second;
+    for (std::size_t i = 0; i < leaf->runs.size(); i++)
+    {
+        const CrdtRun& run = leaf->runs[i];
+        if (run.agent == agent && run.clock == it->first)
+        {
+            if (clock - run.clock >= run.length)
+                return false;
+
+            location = {leaf, i};
+            offset = clock - run.clock;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CrdtSequence::next(Location& location) const
+{
+    std::size_t leafIndex = 0;
+    if (location.leaf)
+    {
+        if (location.run + 1 < location.leaf->runs.size())
+        {
+            location.run++;
+            return true;
+        }
+
+        leafIndex = location.leaf->index + 1;
+    }
+
+    for (; leafIndex < leaves.size(); leafIndex++)
+    {
+        if (!leaves[leafIndex]->runs.empty())
+        {
+            location = {leaves[leafIndex].get(), 0};
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::size_t CrdtSequence::getPosition(const Location& location) const
+{
+    std::size_t pos = 0;
+    for (std::size_t i = location.leaf->index; i > 0; i -= i & -i)
+        pos += leafTree[i];
+
+    for (std::size_t i = 0; i < location.run; i++)
+    {
+        if (!location.leaf->runs[i].deleted)
+            pos += location.leaf->runs[i].length;
+    }
+
+    return pos;
+}
+
+void CrdtSequence::splitRun(const Location& location, std::size_t offset)
+{
+    CrdtRun& run = getRun(location);
+    CrdtRun tail = run;
+    tail.clock += static_cast<uint32_t>(offset);
+    tail.length -= static_cast<uint32_t>(offset);
+    tail.originLeftAgent = run.agent;
+    tail.originLeftClock = tail.clock - 1;
+    run.length = static_cast<uint32_t>(offset);
+
+    insertRun(location, tail);
+}
+
+void CrdtSequence::insertRun(const Location& after, const CrdtRun& run)
+{
+    CrdtLeaf* leaf = after.leaf ? after.leaf : leaves.front().get();
+    std::size_t index = after.leaf ? after.run + 1 : 0;
+
+    leaf->runs.insert(leaf->runs.begin() + index, run);
+    runLeaves[run.agent][run.clock] = leaf;
+    runCount++;
+
+    if (leaf->runs.size() > maxLeafRuns)
+        oversizedLeaves.push_back(leaf);
+}
+
+void CrdtSequence::mergeWithPrevious(Location& location)
+{
+    if (location.run == 0)
+        return;
+
+    CrdtRun& previous = location.leaf->runs[location.run - 1];
+    const CrdtRun& run = getRun(location);
+    if (previous.agent != run.agent || previous.deleted != run.deleted || previous.clock + previous.length != run.clock ||
+        run.originLeftAgent != run.agent || run.originLeftClock + 1 != run.clock ||
+        previous.originRightAgent != run.originRightAgent || previous.originRightClock != run.originRightClock)
+        return;
+
+    previous.length += run.length;
+    runLeaves[run.agent].erase(run.clock);
+    location.leaf->runs.erase(location.leaf->runs.begin() + location.run);
+    runCount--;
+    location.run--;
+}
+
+void CrdtSequence::addVisible(CrdtLeaf* leaf, std::size_t length)
+{
+    leaf->visibleLength += length;
+    visibleLength += length;
+    for (std::size_t i = leaf->index + 1; i < leafTree.size(); i += i & -i)
+        leafTree[i] += length;
+}
+
+void CrdtSequence::removeVisible(CrdtLeaf* leaf, std::size_t length)
+{
+    leaf->visibleLength -= length;
+    visibleLength -= length;
+    for (std::size_t i = leaf->index + 1; i < leafTree.size(); i += i & -i)
+        leafTree[i] -= length;
+}
+
+void CrdtSequence::rebuildLeafTree()
+{
+    leafTree.assign(leaves.size() + 1, 0);
+    for (std::size_t i = 1; i <= leaves.size(); i++)
+    {
+        leaves[i - 1]->index = i - 1;
+        leafTree[i] += leaves[i - 1]->visibleLength;
+
+        std::size_t parent = i + (i & -i);
+        if (parent <= leaves.size())
+            leafTree[parent] += leafTree[i];
+    }
+}
+
+void CrdtSequence::splitOversizedLeaves()
+{
+    if (oversizedLeaves.empty())
+        return;
+
+    // Later leaves first so the indices of earlier ones stay valid while inserting
+    std::sort(oversizedLeaves.begin(), oversizedLeaves.end(), [] (const CrdtLeaf* a, const CrdtLeaf* b)
+        {
+            return a->index > b->index;
+        });
+    oversizedLeaves.erase(std::unique(oversizedLeaves.begin(), oversizedLeaves.end()), oversizedLeaves.end());
+
+    for (CrdtLeaf* leaf : oversizedLeaves)
+    {
+        if (leaf->runs.size() <= maxLeafRuns)
+            continue;
+
+        // Leave every part half full so splits stay rare
+        std::vector<std::unique_ptr<CrdtLeaf>> parts;
+        const std::size_t partSize = maxLeafRuns / 2;
+        for (std::size_t start = partSize; start < leaf->runs.size(); start += partSize)
+        {
+            auto part = std::make_unique<CrdtLeaf>();
+            std::size_t end = std::min(start + partSize, leaf->runs.size());
+            part->runs.assign(leaf->runs.begin() + start, leaf->runs.begin() + end);
+            for (const CrdtRun& run : part->runs)
+            {
+                runLeaves[run.agent][run.clock] = part.get();
+                if (!run.deleted)
+                    part->visibleLength += run.length;
+            }
+
+            leaf->visibleLength -= part->visibleLength;
+            parts.push_back(std::move(part));
+        }
+
+        leaf->runs.resize(partSize);
+        leaves.insert(leaves.begin() + leaf->index + 1, std::make_move_iterator(parts.begin()), std::make_move_iterator(parts.end()));
+    }
+
+    oversizedLeaves.clear();
+    rebuildLeafTree();
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+#include "operations.h"
+
+class TextEngine;
+
+// Client that typed the text a CRDT document was loaded with
+inline const std::string crdtRootClientId = "@";
+
+/**
+ * Consecutive characters typed by one client that are still next to each other and share their deleted state,
+ * stored as one item. Every character after the first has the one before it as its left origin.
+*/
+struct CrdtRun
+{
+    uint32_t agent;
+    uint32_t clock;
+    uint32_t length;
+    uint32_t originLeftAgent;   // CrdtSequence::noAgent if the first character was typed at the start
+    uint32_t originLeftClock;
+    uint32_t originRightAgent;  // CrdtSequence::noAgent if the run was typed at the end
+    uint32_t originRightClock;
+    bool deleted;
+};
+
+// Runs of a contiguous part of the document
+struct CrdtLeaf
+{
+    std::vector<CrdtRun> runs;
+    std::size_t visibleLength = 0;
+    std::size_t index = 0;  // Position in the sequence's leaves
+};
+
+// Visible characters removed from the text. Ranges apply one after another.
+struct CrdtTextRange
+{
+    std::size_t pos;
+    std::size_t length;
+};
+
+/**
+ * Ids and origins of every character of a document, including deleted ones, ordered by the YATA rules so that
+ * replicas integrating the same ops in any causal order end up with the same sequence. Only the metadata lives
+ * here: callers apply the returned positions to their own text buffer.
+ *
+ * Runs are kept in leaves of at most maxLeafRuns. A Fenwick tree over the leaves' visible lengths finds the leaf
+ * of a position and the position of a leaf in log time, and a per-client map from clocks to leaves finds runs
+ * by id.
+*/
+class CrdtSequence
+{
+public:
+    static constexpr uint32_t noAgent = UINT32_MAX;
+    static constexpr std::size_t maxLeafRuns = 64;
+
+private:
+    struct Location
+    {
+        CrdtLeaf* leaf;     // Null before the first run
+        std::size_t run;
+    };
+
+    std::vector<std::unique_ptr<CrdtLeaf>> leaves;
+    std::vector<std::size_t> leafTree;
+
+    // Client ids are interned so runs stay small
+    std::vector<std::string> agentNames;
+    std::unordered_map<std::string, uint32_t> agentIndices;
+
+    // Per agent: first clock of each of its runs and the leaf holding the run
+    std::vector<std::map<uint32_t, CrdtLeaf*>> runLeaves;
+
+    // Per agent: clock of the next character it will type
+    std::vector<uint32_t> nextClocks;
+
+    std::vector<CrdtLeaf*> oversizedLeaves;
+    std::size_t visibleLength = 0;
+    std::size_t runCount = 0;
+
+public:
+    CrdtSequence();
+
+    /**
+    * Replaces the sequence with a document of `length` characters typed by crdtRootClientId.
+    */
+    void reset(std::size_t length);
+
+    /**
+    * Inserts text typed by the local client.
+    * @param pos Visible position, clamped to the document length
+    * @returns The op to send to other replicas
+    */
+    std::unique_ptr<CrdtInsertOperation> insertLocal(std::size_t pos, const std::string& text, const std::string& clientId);
+
+    /**
+    * Deletes text removed by the local client.
+    * @returns The op to send to other replicas, or null if nothing was deleted
+    */
+    std::unique_ptr<CrdtDeleteOperation> deleteLocal(std::size_t pos, std::size_t length, const std::string& clientId);
+
+    /**
+    * Integrates an insert made by any replica, including this one.
+    * @param pos Receives the visible position the text goes to
+    * @returns False if the op was integrated before or names characters this replica does not know
+    */
+    bool integrateInsert(const CrdtInsertOperation& op, std::size_t& pos);
+
+    /**
+    * Integrates a delete made by any replica. Characters that are already deleted are skipped.
+    * @param removed Receives the visible ranges to remove from the text, in the order they have to be removed
+    */
+    void integrateDelete(const CrdtDeleteOperation& op, std::vector<CrdtTextRange>& removed);
+
+    /**
+    * Integrates a CRDT_INSERT or CRDT_DELETE and applies the resulting text change to the engine holding the text.
+    * @returns False if the op is not a CRDT op or is an insert that could not be integrated
+    */
+    bool integrate(const TextOperation& op, TextEngine& engine);
+
+    /**
+    * Serializes the sequence for a replica joining the document.
+    * @param text Visible text of the document, appended to the state
+    */
+    [[nodiscard]] std::string encode(const std::string& text) const;
+
+    /**
+    * Replaces the sequence with an encoded one.
+    * @param text Receives the visible text
+    * @returns False if the state is malformed, in which case the sequence is left empty
+    */
+    [[nodiscard]] bool decode(const std::string& state, std::string& text);
+
+    [[nodiscard]] std::size_t getVisibleLength() const { return visibleLength; }
+    [[nodiscard]] std::size_t getRunCount() const { return runCount; }
+
+    /**
+    * @returns Approximate heap bytes held by the sequence
+    */
+    [[nodiscard]] std::size_t getMemoryUsage() const;
+
+private:
+    void clear();
+    uint32_t getAgent(const std::string& clientId);
+    [[nodiscard]] uint32_t findAgent(const std::string& clientId) const;
+
+    [[nodiscard]] CrdtRun& getRun(const Location& location) { return location.leaf->runs[location.run]; }
+    [[nodiscard]] bool findVisible(std::size_t pos, Location& location, std::size_t& offset) const;
+    [[nodiscard]] bool findId(uint32_t agent, uint32_t clock, Location& location, std::size_t& offset) const;
+    [[nodiscard]] bool next(Location& location) const;
+    [[nodiscard]] std::size_t getPosition(const Location& location) const;
+
+    /**
+    * Splits a run so that its character at offset starts a new run right after it.
+    */
+    void splitRun(const Location& location, std::size_t offset);
+    void insertRun(const Location& after, const CrdtRun& run);
+
+    /**
+    * Merges a run into the one before it in the same leaf if together they read as one run, e.g. characters
+    * deleted one at a time. Moves the location to the merged run.
+    */
+    void mergeWithPrevious(Location& location);
+
+    void addVisible(CrdtLeaf* leaf, std::size_t length);
+    void removeVisible(CrdtLeaf* leaf, std::size_t length);
+    void rebuildLeafTree();
+
+    /**
+    * Splits leaves that grew past maxLeafRuns during an op. Locations are invalid afterwards.
+    */
+    void splitOversizedLeaves();
+};
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <iostream>
+
+#include "crdt_server_text_engine.h"
+
+void CrdtServerTextEngine::readFile(std::string filePathName)
+{
+    ServerTextEngine::readFile(filePathName);
+    sequence.reset(getDocumentLength());
+}
+
+void CrdtServerTextEngine::readString(const std::string& str)
+{
+    ServerTextEngine::readString(str);
+    sequence.reset(getDocumentLength());
+}
+
+std::unique_ptr<TextOperation> CrdtServerTextEngine::processIncomingOperation(std::unique_ptr<TextOperation> op)
+{
+    if (op->type != OperationType::CRDT_INSERT && op->type != OperationType::CRDT_DELETE)
+    {
+        std::cerr << "CrdtServerTextEngine: Rejected an operation made for another engine: " << op->serialize() << "\n";
+        return nullptr;
+    }
+
+    // A client resending an insert we already have, e.g. after reconnecting
+    if (!sequence.integrate(*op, *this))
+        return nullptr;
+
+    op->docVersion = docVersion++;
+
+    std::unique_ptr<TextOperation> broadcastCopy;
+    if (op->type == OperationType::CRDT_INSERT)
+        broadcastCopy = std::make_unique<CrdtInsertOperation>(static_cast<const CrdtInsertOperation&>(*op));
+    else
+        broadcastCopy = std::make_unique<CrdtDeleteOperation>(static_cast<const CrdtDeleteOperation&>(*op));
+
+    opHistory.push_back(std::move(op));
+    return broadcastCopy;
+}
+
+bool CrdtServerTextEngine::loadSnapshotState(std::string_view state)
+{
+    // Decoding checks the sequence against the text it was stored without
+    std::string text;
+    return sequence.decode(std::string(state) + getText(), text);
+}
+
+void CrdtServerTextEngine::applySequencedOperation(std::unique_ptr<TextOperation> op)
+{
+    if (!sequence.integrate(*op, *this))
+        std::cerr << "CrdtServerTextEngine: Could not integrate sequenced operation " << op->operationId << "\n";
+
+    docVersion = std::max(docVersion, op->docVersion + 1);
+    opHistory.push_back(std::move(op));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+
+#include "server_text_engine.h"
+#include "crdt_sequence.h"
+
+/**
+ * Authoritative replica of a CRDT document. Ops are integrated as they arrive instead of being transformed, and
+ * are sequenced and kept in the history like OT ops so logging and catch-up work the same.
+*/
+class CrdtServerTextEngine : public ServerTextEngine
+{
+private:
+    CrdtSequence sequence;
+
+public:
+    void readFile(std::string filePathName) override;
+    void readString(const std::string& str) override;
+
+    /**
+    * Integrates the op, stamps it with the next version and stores it in the history.
+    * @returns Copy for broadcasting, or null if the op was rejected or already integrated
+    */
+    std::unique_ptr<TextOperation> processIncomingOperation(std::unique_ptr<TextOperation> op) override;
+    void applySequencedOperation(std::unique_ptr<TextOperation> op) override;
+
+    /**
+    * @returns The encoded sequence and text, since clients need the character ids to edit
+    */
+    [[nodiscard]] std::string getDocumentState() const override { return sequence.encode(getText()); }
+
+    /**
+    * @returns The encoded sequence without the text, which the snapshot holds as pieces
+    */
+    [[nodiscard]] std::string getSnapshotState() const override { return sequence.encode(std::string()); }
+    [[nodiscard]] bool loadSnapshotState(std::string_view state) override;
+
+    [[nodiscard]] const CrdtSequence& getSequence() const { return sequence; }
+};
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <iostream>
+
+#include "crdt_text_engine.h"
+
+void CrdtTextEngine::readFile(std::string filePathName)
+{
+    TextEngine::readFile(filePathName);
+    sequence.reset(getDocumentLength());
+    unacknowledgedOps.clear();
+}
+
+void CrdtTextEngine::readString(const std::string& str)
+{
+    TextEngine::readString(str);
+    sequence.reset(getDocumentLength());
+    unacknowledgedOps.clear();
+}
+
+std::unique_ptr<TextOperation> CrdtTextEngine::applyLocalInsert(const InsertOperation& insertOp)
+{
+    std::unique_ptr<CrdtInsertOperation> op = sequence.insertLocal(insertOp.pos, insertOp.text, insertOp.clientId);
+    if (!op)
+        return nullptr;
+
+    op->docVersion = docVersion;
+    textBuffer.insert(op->text, op->pos);
+    recordEdit(op->pos, op->text.size(), 0);
+    cursorPosition = op->pos + op->text.size();
+
+    unacknowledgedOps.push_back(std::make_unique<CrdtInsertOperation>(*op));
+    return op;
+}
+
+std::unique_ptr<TextOperation> CrdtTextEngine::applyLocalDelete(const DeleteOperation& deleteOp)
+{
+    std::unique_ptr<CrdtDeleteOperation> op = sequence.deleteLocal(deleteOp.pos, deleteOp.length, deleteOp.clientId);
+    if (!op)
+        return nullptr;
+
+    op->docVersion = docVersion;
+    textBuffer.remove(op->pos, op->pos + op->length);
+    recordEdit(op->pos, 0, op->length);
+    cursorPosition = op->pos;
+
+    unacknowledgedOps.push_back(std::make_unique<CrdtDeleteOperation>(*op));
+    return op;
+}
+
+void CrdtTextEngine::processIncomingOperation(std::unique_ptr<TextOperation> op)
+{
+    if (op->type != OperationType::CRDT_INSERT && op->type != OperationType::CRDT_DELETE)
+    {
+        std::cerr << "CrdtTextEngine: Ignored an operation made for another engine: " << op->serialize() << "\n";
+        return;
+    }
+
+    sequence.integrate(*op, *this);
+    docVersion = std::max(docVersion, op->docVersion + 1);
+}
+
+void CrdtTextEngine::acknowledge(uint64_t operationId, uint64_t sequencedVersion)
+{
+    auto it = std::find_if(unacknowledgedOps.begin(), unacknowledgedOps.end(), [operationId] (const std::unique_ptr<TextOperation>& pendingOp)
+        {
+            return pendingOp->operationId == operationId;
+        });
+
+    if (it != unacknowledgedOps.end())
+        unacknowledgedOps.erase(it);
+
+    docVersion = std::max(docVersion, sequencedVersion + 1);
+}
+
+bool CrdtTextEngine::loadState(const std::string& state, uint64_t docVersion)
+{
+    std::string text;
+    if (!sequence.decode(state, text))
+    {
+        std::cerr << "CrdtTextEngine: Malformed document state\n";
+        return false;
+    }
+
+    TextEngine::readString(text);
+    this->docVersion = docVersion;
+
+    // Inserts the server has were sequenced while we were away. Deletes are idempotent, so they just stay.
+    std::vector<std::unique_ptr<TextOperation>> pendingOps = std::move(unacknowledgedOps);
+    unacknowledgedOps.clear();
+    for (auto& pendingOp : pendingOps)
+    {
+        if (sequence.integrate(*pendingOp, *this))
+            unacknowledgedOps.push_back(std::move(pendingOp));
+    }
+
+    return true;
+}
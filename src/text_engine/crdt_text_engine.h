@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+#include "text_engine.h"
+#include "operations.h"
+#include "crdt_sequence.h"
+
+/**
+ * Client side of the CRDT engine. Local edits are applied right away and sent as CRDT ops that every replica
+ * integrates the same way, so nothing has to be transformed and our own ops coming back are no-ops.
+*/
+class CrdtTextEngine : public TextEngine
+{
+private:
+    CrdtSequence sequence;
+
+    // Local ops the server has not sent back yet, resent after reconnecting
+    std::vector<std::unique_ptr<TextOperation>> unacknowledgedOps;
+
+public:
+    void readFile(std::string filePathName) override;
+    void readString(const std::string& str) override;
+
+    /**
+    * Applies text typed by the local user.
+    * @returns The op to send to the server, or null if nothing changed
+    */
+    std::unique_ptr<TextOperation> applyLocalInsert(const InsertOperation& insertOp);
+
+    /**
+    * Applies text deleted by the local user.
+    * @returns The op to send to the server, or null if nothing changed
+    */
+    std::unique_ptr<TextOperation> applyLocalDelete(const DeleteOperation& deleteOp);
+
+    /**
+    * Integrates an op broadcast by the server. Ops we already have, like our own, are skipped.
+    */
+    void processIncomingOperation(std::unique_ptr<TextOperation> op);
+
+    /**
+    * Drops a local op once the server sequenced it.
+    * @param sequencedVersion Version the server sequenced the op at
+    */
+    void acknowledge(uint64_t operationId, uint64_t sequencedVersion);
+
+    /**
+    * Replaces the document with the server's encoded sequence and integrates local ops the server does not have
+    * yet on top. Ops it already has count as acknowledged.
+    * @returns False if the state is malformed
+    */
+    [[nodiscard]] bool loadState(const std::string& state, uint64_t docVersion);
+
+    [[nodiscard]] const std::vector<std::unique_ptr<TextOperation>>& getUnacknowledgedOps() const { return unacknowledgedOps; }
+    [[nodiscard]] const CrdtSequence& getSequence() const { return sequence; }
+};
@@ -3,12 +3,32 @@
 #include <memory>
 #include <sstream>
 #include <vector>
+#include <cstdlib>
 
-#include "operations.h"
+namespace
+{
+    /**
+     * Op logs written before ids were numbers hold ids like clientId_timestamp_sequence. Ids of logged ops are
+     * never matched to anything, so those read as 0 instead of failing the replay.
+    */
+    uint64_t parseOperationId(const std::string& field)
+    {
+        return std::strtoull(field.c_str(), nullptr, 10);
+    }
 
-#include <memory>
-#include <sstream>
-#include <vector>
+    /**
+     * Ops come from clients, so a field that is not a number fails the op instead of throwing.
+     * @returns False if the field is not a number
+    */
+    bool parseNumber(const std::string& field, uint64_t& value)
+    {
+        if (field.empty() || field.size() > 20 || field.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+
+        value = std::strtoull(field.c_str(), nullptr, 10);
+        return true;
+    }
+}
 
 std::unique_ptr<Operation> Operation::deserialize(const std::string& str)
 {
@@ -41,9 +61,11 @@ std::unique_ptr<Operation> Operation::deserialize(const std::string& str)
         std::string text = str.substr(lastPos);
         
         std::string clientId = parts[1];
-        std::string operationId = parts[2];
-        uint64_t docVersion = std::stoull(parts[3]);
-        std::size_t pos = std::stoul(parts[4]);
+        uint64_t operationId = parseOperationId(parts[2]);
+        uint64_t docVersion = 0;
+        uint64_t pos = 0;
+        if (!parseNumber(parts[3], docVersion) || !parseNumber(parts[4], pos))
+            return nullptr;
         
         auto op = std::make_unique<InsertOperation>(text, pos, clientId);
         op->operationId = operationId;
@@ -63,16 +85,90 @@ std::unique_ptr<Operation> Operation::deserialize(const std::string& str)
             return nullptr;
         
         std::string clientId = parts[1];
-        std::string operationId = parts[2];
-        uint64_t docVersion = std::stoull(parts[3]);
-        std::size_t pos = std::stoul(parts[4]);
-        std::size_t length = std::stoul(parts[5]);
+        uint64_t operationId = parseOperationId(parts[2]);
+        uint64_t docVersion = 0;
+        uint64_t pos = 0;
+        uint64_t length = 0;
+        if (!parseNumber(parts[3], docVersion) || !parseNumber(parts[4], pos) || !parseNumber(parts[5], length))
+            return nullptr;
         
         auto op = std::make_unique<DeleteOperation>(pos, length, clientId);
         op->operationId = operationId;
         op->docVersion = docVersion;
         return std::move(op);
     }
+    else if (opType == "CRDT_INSERT")
+    {
+        // CRDT_INSERT:clientId:operationId:docVersion:clock:leftClientId:leftClock:rightClientId:rightClock:text
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (parts.size() < 9)
+        {
+            size_t colon = str.find(':', start);
+            if (colon == std::string::npos)
+                return nullptr;
+
+            parts.push_back(str.substr(start, colon - start));
+            start = colon + 1;
+        }
+
+        auto op = std::make_unique<CrdtInsertOperation>(str.substr(start), 0, parts[1]);
+        op->operationId = parseOperationId(parts[2]);
+        if (!parseNumber(parts[3], op->docVersion) || !parseNumber(parts[4], op->clock))
+            return nullptr;
+
+        uint64_t clock = 0;
+        if (!parts[5].empty())
+        {
+            if (!parseNumber(parts[6], clock))
+                return nullptr;
+
+            op->originLeft = CrdtId{parts[5], clock};
+        }
+        if (!parts[7].empty())
+        {
+            if (!parseNumber(parts[8], clock))
+                return nullptr;
+
+            op->originRight = CrdtId{parts[7], clock};
+        }
+
+        return std::move(op);
+    }
+    else if (opType == "CRDT_DELETE")
+    {
+        std::istringstream ss(str);
+        std::string token;
+
+        std::vector<std::string> parts;
+        while (std::getline(ss, token, ':'))
+            parts.push_back(token);
+
+        if (parts.size() < 5)  // CRDT_DELETE:clientId:operationId:docVersion:count(:clientId:clock:length)*
+            return nullptr;
+
+        // Checked against the fields there are before multiplying, a huge count would wrap around
+        uint64_t spanCount = 0;
+        if (!parseNumber(parts[4], spanCount) || spanCount > (parts.size() - 5) / 3 || parts.size() != 5 + spanCount * 3)
+            return nullptr;
+
+        auto op = std::make_unique<CrdtDeleteOperation>(0, parts[1]);
+        op->operationId = parseOperationId(parts[2]);
+        if (!parseNumber(parts[3], op->docVersion))
+            return nullptr;
+
+        for (std::size_t i = 0; i < spanCount; i++)
+        {
+            CrdtSpan span{parts[5 + i * 3], 0, 0};
+            if (!parseNumber(parts[6 + i * 3], span.clock) || !parseNumber(parts[7 + i * 3], span.length))
+                return nullptr;
+
+            op->length += span.length;
+            op->spans.push_back(std::move(span));
+        }
+
+        return std::move(op);
+    }
 
     return nullptr;
 }
@@ -1,16 +1,22 @@
 #pragma once
 
+#include <stdint.h>
 #include <cstddef>
 #include <string>
 #include <iostream>
 #include <chrono>
 #include <atomic>
+#include <optional>
+#include <memory>
+#include <vector>
 
 enum class OperationType
 {
     INSERT,
     DELETE,
-    CURSOR_MOVE
+    CURSOR_MOVE,
+    CRDT_INSERT,
+    CRDT_DELETE
 };
 
 class Operation
@@ -28,15 +34,15 @@ public:
 class TextOperation : public Operation
 {
 public:
-    std::string operationId;
-    std::size_t length;
+    uint64_t operationId;
+    std::size_t length = 0;
     std::string clientId;
     uint64_t docVersion;
     
     TextOperation(std::string clientId)
         : clientId(clientId), docVersion(0)
     {
-        operationId = generateOperationId(clientId);
+        operationId = generateOperationId();
     }
     
     TextOperation(const TextOperation& other)
@@ -48,14 +54,14 @@ public:
     }
     
 private:
-    static std::string generateOperationId(const std::string& clientId)
+    /**
+     * Ids only have to be unique among the ops of one client, which match their acks by id. Pending ops do not
+     * outlive the process, so a counter is enough and stays a short varint on the wire.
+    */
+    static uint64_t generateOperationId()
     {
-        static std::atomic<uint64_t> sequence = 0;
-        auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()
-        ).count();
-        
-        return clientId + "_" + std::to_string(timestamp) + "_" + std::to_string(sequence++);
+        static std::atomic<uint64_t> sequence = 1;
+        return sequence++;
     }
 };
 
@@ -69,6 +75,7 @@ public:
         : TextOperation(clientId), text(text)
     {
         this->pos = pos;
+        this->length = this->text.size();
         type = OperationType::INSERT;
     }
     
@@ -78,7 +85,7 @@ public:
     
     std::string serialize() const override
     {
-        return "INSERT:" + clientId + ":" + operationId + ":" + std::to_string(docVersion) + ":" + std::to_string(pos) + ":" + text;
+        return "INSERT:" + clientId + ":" + std::to_string(operationId) + ":" + std::to_string(docVersion) + ":" + std::to_string(pos) + ":" + text;
     }
 };
 
@@ -99,7 +106,7 @@ public:
     
     std::string serialize() const override
     {
-        return "DELETE:" + clientId + ":" + operationId + ":" + std::to_string(docVersion) + ":" + std::to_string(pos) + ":" + std::to_string(length);
+        return "DELETE:" + clientId + ":" + std::to_string(operationId) + ":" + std::to_string(docVersion) + ":" + std::to_string(pos) + ":" + std::to_string(length);
     }
 };
 
@@ -117,3 +124,90 @@ public:
         return "CURSOR:" + std::to_string(pos);
     }
 };
+
+// Names one character of a CRDT document: the client that typed it and how many characters that client typed before
+struct CrdtId
+{
+    std::string clientId;
+    uint64_t clock = 0;
+
+    bool operator==(const CrdtId& other) const { return clientId == other.clientId && clock == other.clock; }
+};
+
+// Consecutive characters typed by one client
+struct CrdtSpan
+{
+    std::string clientId;
+    uint64_t clock = 0;
+    uint64_t length = 0;
+};
+
+/**
+ * Inserts text between two characters named by id instead of at a position, so it lands in the same place on
+ * every replica without being transformed. The characters get ids clientId:clock onwards.
+*/
+class CrdtInsertOperation : public TextOperation
+{
+public:
+    uint64_t clock = 0;
+    std::optional<CrdtId> originLeft;   // Character the text was typed after, unset at the start of the document
+    std::optional<CrdtId> originRight;  // Character that followed it at the time, unset at the end
+    std::string text;
+
+public:
+    CrdtInsertOperation(std::string text, std::size_t pos, std::string clientId)
+        : TextOperation(clientId), text(text)
+    {
+        this->pos = pos;
+        this->length = this->text.size();
+        type = OperationType::CRDT_INSERT;
+    }
+
+    CrdtInsertOperation(const CrdtInsertOperation& other)
+        : TextOperation(other), clock(other.clock), originLeft(other.originLeft), originRight(other.originRight), text(other.text)
+    {}
+
+    std::string serialize() const override
+    {
+        return "CRDT_INSERT:" + clientId + ":" + std::to_string(operationId) + ":" + std::to_string(docVersion) + ":" + std::to_string(clock) + ":" +
+               serializeOrigin(originLeft) + ":" + serializeOrigin(originRight) + ":" + text;
+    }
+
+private:
+    static std::string serializeOrigin(const std::optional<CrdtId>& origin)
+    {
+        // An unset origin has an empty client id field
+        return origin ? origin->clientId + ":" + std::to_string(origin->clock) : ":0";
+    }
+};
+
+/**
+ * Deletes characters by id. Deleting a character twice has no effect, so concurrent deletes of the same text merge.
+*/
+class CrdtDeleteOperation : public TextOperation
+{
+public:
+    std::vector<CrdtSpan> spans;
+
+public:
+    CrdtDeleteOperation(std::size_t pos, std::string clientId)
+        : TextOperation(clientId)
+    {
+        this->pos = pos;
+        this->length = 0;
+        type = OperationType::CRDT_DELETE;
+    }
+
+    CrdtDeleteOperation(const CrdtDeleteOperation& other)
+        : TextOperation(other), spans(other.spans)
+    {}
+
+    std::string serialize() const override
+    {
+        std::string serialized = "CRDT_DELETE:" + clientId + ":" + std::to_string(operationId) + ":" + std::to_string(docVersion) + ":" + std::to_string(spans.size());
+        for (const CrdtSpan& span : spans)
+            serialized += ":" + span.clientId + ":" + std::to_string(span.clock) + ":" + std::to_string(span.length);
+
+        return serialized;
+    }
+};
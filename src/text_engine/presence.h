@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Where a user's cursor and selection are. Selection bounds are equal to the cursor when nothing is selected.
+*/
+struct Presence
+{
+    std::size_t cursor = 0;
+    std::size_t selectionStart = 0;
+    std::size_t selectionEnd = 0;
+
+    bool operator==(const Presence& other) const
+    {
+        return cursor == other.cursor && selectionStart == other.selectionStart && selectionEnd == other.selectionEnd;
+    }
+
+    bool operator!=(const Presence& other) const { return !(*this == other); }
+};
+
+struct RemotePresence
+{
+    std::string clientId;
+    Presence presence;
+};
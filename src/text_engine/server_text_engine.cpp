@@ -1,17 +1,37 @@
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+
 #include "server_text_engine.h"
 
 std::unique_ptr<TextOperation> ServerTextEngine::processIncomingOperation(std::unique_ptr<TextOperation> op) 
 {
-    // Transform against opHistory based on document versions
+    if (op->type != OperationType::INSERT && op->type != OperationType::DELETE)
+    {
+        std::cerr << "ServerTextEngine: Rejected an operation made for another engine: " << op->serialize() << "\n";
+        return nullptr;
+    }
+
+    // The op applies to the document at its version, so it is transformed against everything sequenced since.
+    // Clients wait for their previous op's ack before sending the next one, so none of those are their own.
     auto transformedOp = std::move(op);
-    for (const auto& historyOp : opHistory)
+    auto first = std::lower_bound(opHistory.begin(), opHistory.end(), transformedOp->docVersion, [] (const std::unique_ptr<TextOperation>& historyOp, uint64_t version)
+        {
+            return historyOp->docVersion < version;
+        });
+
+    if (first == opHistory.begin() && !opHistory.empty() && transformedOp->docVersion < opHistory.front()->docVersion)
+        std::cerr << "ServerTextEngine: Operation " << transformedOp->operationId << " is older than the history, transforming against what is left\n";
+
+    if (first != opHistory.end())
     {
-        // Only transform against operations that happened after the incoming operation was created
-        if (historyOp->docVersion > transformedOp->docVersion) {
-            auto newTransformed = transform(transformedOp.get(), historyOp.get());
-            if (newTransformed)
-                transformedOp = std::move(newTransformed);
-        }
+        auto transformStart = std::chrono::steady_clock::now();
+        for (auto it = first; it != opHistory.end(); ++it)
+            transformedOp = transform(transformedOp.get(), it->get());
+
+        transforms.add(static_cast<uint64_t>(opHistory.end() - first));
+        transformTime.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - transformStart).count()));
     }
     
     transformedOp->docVersion = docVersion;
@@ -45,3 +65,38 @@ std::unique_ptr<TextOperation> ServerTextEngine::processIncomingOperation(std::u
     
     return broadcastCopy;
 }
+
+void ServerTextEngine::applySequencedOperation(std::unique_ptr<TextOperation> op)
+{
+    if (op->type == OperationType::INSERT)
+        insertIncoming(static_cast<InsertOperation*>(op.get()));
+    else if (op->type == OperationType::DELETE)
+        deleteIncoming(static_cast<DeleteOperation*>(op.get()));
+
+    opHistory.push_back(std::move(op));
+}
+
+void ServerTextEngine::trimHistory(std::size_t operations)
+{
+    if (opHistory.size() > operations)
+        opHistory.erase(opHistory.begin(), opHistory.end() - static_cast<std::ptrdiff_t>(operations));
+}
+
+bool ServerTextEngine::getOperationsSince(uint64_t version, std::vector<const TextOperation*>& ops) const
+{
+    // History starts wherever the document was loaded from, e.g. a snapshot
+    uint64_t historyStart = opHistory.empty() ? docVersion : opHistory.front()->docVersion;
+    if (version < historyStart || version > docVersion)
+        return false;
+
+    // Sequenced versions are consecutive, so the history is sorted by them
+    auto first = std::lower_bound(opHistory.begin(), opHistory.end(), version, [] (const std::unique_ptr<TextOperation>& op, uint64_t version)
+        {
+            return op->docVersion < version;
+        });
+
+    for (auto it = first; it != opHistory.end(); ++it)
+        ops.push_back(it->get());
+
+    return true;
+}
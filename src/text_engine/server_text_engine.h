@@ -1,17 +1,27 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <memory>
+#include <string>
+#include <string_view>
 
 #include "text_engine.h"
 #include "operations.h"
+#include "../metrics/metrics.h"
 
 class TextOperation;
 
 class ServerTextEngine : public TextEngine
 {
-private:
-    std::vector<std::unique_ptr<TextOperation>> opHistory;
+protected:
+    std::deque<std::unique_ptr<TextOperation>> opHistory;
+
+    // Shared by the documents of the process. An op is only timed when it has history to be transformed against.
+    Counter& transforms = MetricsRegistry::global().getCounter("reped_server_transforms_total",
+        "Sequenced ops incoming ops were transformed against");
+    LatencyHistogram& transformTime = MetricsRegistry::global().getHistogram("reped_server_transform_nanoseconds",
+        "Time spent transforming an incoming op that was behind the document");
 
 public:
     /**
@@ -20,5 +30,46 @@ public:
     * @param op Op to process
     * @returns Copy of the transformed op
     */
-    std::unique_ptr<TextOperation> processIncomingOperation(std::unique_ptr<TextOperation> op);
+    virtual std::unique_ptr<TextOperation> processIncomingOperation(std::unique_ptr<TextOperation> op);
+
+    /**
+    * Applies an op that was already sequenced (e.g. replayed from the op log) without transforming it
+    * @param op Op carrying the version it was sequenced at
+    */
+    virtual void applySequencedOperation(std::unique_ptr<TextOperation> op);
+
+    /**
+    * @returns What a joining client needs to start editing, the plain text for OT
+    */
+    [[nodiscard]] virtual std::string getDocumentState() const { return getText(); }
+
+    /**
+    * @returns What a snapshot has to keep besides the text to restore the document, nothing for OT
+    */
+    [[nodiscard]] virtual std::string getSnapshotState() const { return {}; }
+
+    /**
+    * Restores what getSnapshotState() returned, after the snapshot's text was loaded with loadPieces()
+    * @returns False if the state does not match the text
+    */
+    [[nodiscard]] virtual bool loadSnapshotState(std::string_view state) { return state.empty(); }
+
+    /**
+    * Collects the ops sequenced at or after a version, in order, so a reconnecting client can catch up
+    * @param version Document version the client last saw
+    * @param ops Receives the ops, owned by the history
+    * @returns False if the history no longer reaches back to that version or the version is in the future
+    */
+    [[nodiscard]] bool getOperationsSince(uint64_t version, std::vector<const TextOperation*>& ops) const;
+
+    /**
+    * Drops the oldest ops until at most `operations` are left. Ops made on a version before what is left are
+    * transformed against the rest, and clients catching up from before it are sent the document instead.
+    */
+    void trimHistory(std::size_t operations);
+
+    /**
+    * @returns Ops kept for transforming and catching up
+    */
+    [[nodiscard]] std::size_t getHistorySize() const { return opHistory.size(); }
 };
@@ -5,33 +5,29 @@
 
 void TextEngine::insertLocal(InsertOperation* insertOp)
 {
-    std::cout << "TextEngine: INSERT local at position - " << insertOp->pos << " - text - " << insertOp->text << "\n";
-
     insertOp->docVersion = docVersion++;
 
     textBuffer.insert(insertOp->text, insertOp->pos);
+    recordEdit(insertOp->pos, insertOp->text.size(), 0);
     cursorPosition = insertOp->pos + insertOp->text.size();
 }
 
 void TextEngine::insertIncoming(InsertOperation* insertOp)
 {
-    std::cout << "TextEngine: INSERT incoming at position - " << insertOp->pos << " - text - " << insertOp->text << "\n";
-
     uint64_t oldVersion = docVersion;
     docVersion = std::max(docVersion, insertOp->docVersion) + 1;
 
-    textBuffer.insert(insertOp->text, insertOp->pos);
+    insertText(insertOp->pos, insertOp->text);
 }
 
 void TextEngine::deleteLocal(DeleteOperation* deleteOp)
 {
-    std::cout << "TextEngine: DELETE local from position - " << deleteOp->pos << " - to position - " << deleteOp->pos + deleteOp->length << "\n";
-
     deleteOp->docVersion = docVersion++;
     
-    if (deleteOp->length > 0 && deleteOp->pos >= 0 && deleteOp->pos + deleteOp->length <= textBuffer.getText().length())
+    if (deleteOp->length > 0 && deleteOp->pos >= 0 && deleteOp->pos + deleteOp->length <= textBuffer.getDocumentLength())
     {
         textBuffer.remove(deleteOp->pos, deleteOp->pos + deleteOp->length);
+        recordEdit(deleteOp->pos, 0, deleteOp->length);
         cursorPosition = deleteOp->pos;
     }
     else
@@ -42,19 +38,41 @@ void TextEngine::deleteLocal(DeleteOperation* deleteOp)
 
 void TextEngine::deleteIncoming(DeleteOperation* deleteOp)
 {
-    std::cout << "TextEngine: DELETE incoming from position - " << deleteOp->pos << " - to position - " << deleteOp->pos + deleteOp->length << "\n";
-
     docVersion = std::max(docVersion, deleteOp->docVersion) + 1;
     
-    if (deleteOp->length > 0 && deleteOp->pos >= 0 && deleteOp->pos + deleteOp->length <= textBuffer.getText().length())
-        textBuffer.remove(deleteOp->pos, deleteOp->pos + deleteOp->length);
+    // Deletes of text someone else deleted first arrive with length 0
+    if (deleteOp->length == 0)
+        return;
+
+    if (deleteOp->pos + deleteOp->length <= textBuffer.getDocumentLength())
+        removeText(deleteOp->pos, deleteOp->length);
     else
         std::cout << "TextEngine: Delete operation out of bounds - skipping\n";
 }
 
+void TextEngine::insertText(std::size_t pos, const std::string& text)
+{
+    textBuffer.insert(text, pos);
+    recordEdit(pos, text.size(), 0);
+
+    // Keep our cursor on the same character when someone else types before it
+    if (pos < cursorPosition)
+        cursorPosition += text.size();
+}
+
+void TextEngine::removeText(std::size_t pos, std::size_t length)
+{
+    textBuffer.remove(pos, pos + length);
+    recordEdit(pos, 0, length);
+
+    if (cursorPosition >= pos + length)
+        cursorPosition -= length;
+    else if (cursorPosition > pos)
+        cursorPosition = pos;
+}
+
 void TextEngine::setCursorPosition(std::size_t pos)
 {
-    std::cout << "TextEngine: CURSOR_MOVE operation to position " << pos << "\n";
     cursorPosition = pos;
 }
 
@@ -68,6 +86,11 @@ std::string TextEngine::getText() const
     return textBuffer.getText();
 }
 
+std::string TextEngine::getText(std::size_t pos, std::size_t length) const
+{
+    return textBuffer.getText(pos, length);
+}
+
 std::size_t TextEngine::getDocumentLength() const
 {
     return textBuffer.getDocumentLength();
@@ -78,6 +101,7 @@ void TextEngine::readFile(std::string filePathName)
     textBuffer.readFile(filePathName);
     docVersion = 0;
     cursorPosition = 0;
+    resetEditLog();
 }
 
 void TextEngine::readString(const std::string& str)
@@ -85,10 +109,73 @@ void TextEngine::readString(const std::string& str)
     textBuffer.readString(str);
     docVersion = 0;
     cursorPosition = 0;
+    resetEditLog();
+}
+
+void TextEngine::loadPieces(std::vector<Piece> pieces, std::string_view buffer, std::shared_ptr<const void> storage, uint64_t docVersion)
+{
+    textBuffer.loadBuffer(std::move(pieces), buffer, std::move(storage));
+    this->docVersion = docVersion;
+    cursorPosition = 0;
+    resetEditLog();
+}
+
+void TextEngine::beginDocument(std::size_t length)
+{
+    textBuffer.reset(length);
+    docVersion = 0;
+    cursorPosition = 0;
+    resetEditLog();
+}
+
+void TextEngine::appendDocument(std::string_view text)
+{
+    textBuffer.append(text);
+}
+
+std::size_t TextEngine::transformPosition(std::size_t pos, uint64_t sinceRevision) const
+{
+    for (uint64_t revision = std::max(sinceRevision, editLogStart); revision < getEditRevision(); revision++)
+    {
+        const TextEdit& edit = editLog[revision - editLogStart];
+
+        if (edit.insertedLength > 0 && edit.pos <= pos)
+            pos += edit.insertedLength;
+
+        if (edit.deletedLength > 0)
+        {
+            if (pos >= edit.pos + edit.deletedLength)
+                pos -= edit.deletedLength;
+            else if (pos > edit.pos)
+                pos = edit.pos;
+        }
+    }
+
+    return std::min(pos, textBuffer.getDocumentLength());
+}
+
+void TextEngine::recordEdit(std::size_t pos, std::size_t insertedLength, std::size_t deletedLength)
+{
+    editLog.push_back({pos, insertedLength, deletedLength});
+
+    if (editLog.size() > maxEditLogSize)
+    {
+        editLog.pop_front();
+        editLogStart++;
+    }
+}
+
+void TextEngine::resetEditLog()
+{
+    // Skip a revision so positions from the old text are never taken as current
+    editLogStart += editLog.size() + 1;
+    editLog.clear();
 }
 
 std::unique_ptr<TextOperation> TextEngine::transform(const TextOperation* op1, const TextOperation* op2)
 {    
+    transformCount++;
+
     if (op1->type == OperationType::INSERT && op2->type == OperationType::INSERT)
     {
         auto insert1 = static_cast<const InsertOperation*>(op1);
@@ -123,11 +210,17 @@ std::unique_ptr<TextOperation> TextEngine::transform(const TextOperation* op1, c
         transformed->docVersion = insert1->docVersion;
         
         if (delete2->pos + delete2->length <= insert1->pos)
+        {
             // Delete range is completely before insert position
             transformed->pos = insert1->pos - delete2->length;
+        }
         else if (delete2->pos < insert1->pos)
-            // Delete range overlaps with insert position
+        {
+            // Insert lands inside the deleted range. The delete cannot be split around it, so it takes the
+            // inserted text with it (see the DELETE/INSERT case) and the insert becomes a no-op.
             transformed->pos = delete2->pos;
+            transformed->text.clear();
+        }
         // else delete is after insert, no change needed
         
         return std::move(transformed);
@@ -144,7 +237,10 @@ std::unique_ptr<TextOperation> TextEngine::transform(const TextOperation* op1, c
         if (insert2->pos <= delete1->pos)
             // Insert is before delete range, shift delete right
             transformed->pos = delete1->pos + insert2->text.length();
-        // else insert is after delete start, no change needed
+        else if (insert2->pos < delete1->pos + delete1->length)
+            // Insert is inside the delete range, delete it too
+            transformed->length = delete1->length + insert2->text.length();
+        // else insert is after delete range, no change needed
         
         return std::move(transformed);
     }
@@ -157,31 +253,20 @@ std::unique_ptr<TextOperation> TextEngine::transform(const TextOperation* op1, c
         transformed->operationId = delete1->operationId;
         transformed->docVersion = delete1->docVersion;
         
-        if (delete2->pos + delete2->length <= delete1->pos)
+        std::size_t end1 = delete1->pos + delete1->length;
+        std::size_t end2 = delete2->pos + delete2->length;
+        if (end2 <= delete1->pos)
         {
             // delete2 range is completely before delete1
             transformed->pos = delete1->pos - delete2->length;
         }
-        else if (delete2->pos < delete1->pos + delete1->length && 
-                   delete2->pos + delete2->length > delete1->pos)
+        else if (delete2->pos < end1)
         {
-            // Ranges overlap - complex case
-            if (delete2->pos <= delete1->pos)
-            {
-                // delete2 starts before or at delete1
-                std::size_t overlap = std::min(delete2->pos + delete2->length - delete1->pos, delete1->length);
-                transformed->pos = delete2->pos;
-                transformed->length = delete1->length - overlap;
-                
-                if (transformed->length == 0)
-                    // delete1 is completely contained in delete2, operation becomes no-op
-                    return nullptr;
-            }
-            else
-            {
-                // delete2 starts within delete1 range
-                transformed->length = delete2->pos - delete1->pos;
-            }
+            // Ranges overlap, only the part delete2 did not remove is left. If delete2 covered all of delete1
+            // the op becomes a no-op of length 0.
+            std::size_t overlap = std::min(end1, end2) - std::max(delete1->pos, delete2->pos);
+            transformed->pos = std::min(delete1->pos, delete2->pos);
+            transformed->length = delete1->length - overlap;
         }
         // else delete2 is completely after delete1, no change needed
         
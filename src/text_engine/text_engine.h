@@ -2,10 +2,26 @@
 
 #include <cstddef>
 #include <string>
+#include <deque>
 
 #include "../piece_table/piece_table.h"
 #include "operations.h"
 
+// How concurrent edits are merged. Clients and the server they connect to have to use the same one.
+enum class TextEngineType
+{
+    OT,     // Positions are transformed against concurrent ops
+    CRDT    // Characters have ids and inserts are placed relative to them
+};
+
+// A change to the text as it was applied locally, used to move positions across edits
+struct TextEdit
+{
+    std::size_t pos;
+    std::size_t insertedLength;
+    std::size_t deletedLength;
+};
+
 class TextEngine
 {
 protected:
@@ -13,6 +29,13 @@ protected:
     std::size_t cursorPosition;
     uint64_t docVersion;
 
+    // Most recent edits, oldest first. editLogStart is the revision of the front edit.
+    std::deque<TextEdit> editLog;
+    uint64_t editLogStart = 0;
+    static constexpr std::size_t maxEditLogSize = 4096;
+
+    uint64_t transformCount = 0;
+
 public:
     TextEngine()
         : cursorPosition(0), docVersion(0)
@@ -27,15 +50,76 @@ public:
     void setCursorPosition(std::size_t pos);
     [[nodiscard]] std::size_t getCursorPosition() const;
     [[nodiscard]] std::string getText() const;
+    [[nodiscard]] std::string getText(std::size_t pos, std::size_t length) const;
     [[nodiscard]] std::size_t getDocumentLength() const;
-    void readFile(std::string filePathName);
-    void readString(const std::string& str);
+    virtual void readFile(std::string filePathName);
+    virtual void readString(const std::string& str);
+
+    /**
+    * Inserts text someone else typed, keeping our cursor on the same character.
+    */
+    void insertText(std::size_t pos, const std::string& text);
+
+    /**
+    * Removes text someone else deleted, moving our cursor to the start of the deletion if it was inside.
+    */
+    void removeText(std::size_t pos, std::size_t length);
+
+    /**
+    * Replaces the document with pieces pointing into an external buffer, e.g. a mapped snapshot.
+    * @param docVersion Version the document was at when the pieces were captured
+    */
+    void loadPieces(std::vector<Piece> pieces, std::string_view buffer, std::shared_ptr<const void> storage, uint64_t docVersion);
+
+    /**
+    * Empties the document for text that arrives in parts, see appendDocument().
+    * @param length Expected length of the document, reserved up front
+    */
+    void beginDocument(std::size_t length);
 
     /**
-    * Transform op1 against op2.
+    * Adds the next part of a document started with beginDocument(). Not an edit, nothing is logged.
+    */
+    void appendDocument(std::string_view text);
+
+    [[nodiscard]] PieceTableView getPieceTableView() const { return textBuffer.getView(); }
+    [[nodiscard]] uint64_t getDocumentVersion() const { return docVersion; }
+
+    /**
+    * @returns Pieces the text is split into, which grows with scattered edits until the document is reloaded
+    */
+    [[nodiscard]] std::size_t getPieceCount() const { return textBuffer.getPieceCount(); }
+
+    /**
+    * @returns Number of edits applied so far. Loading a new document also counts as a revision boundary.
+    */
+    [[nodiscard]] uint64_t getEditRevision() const { return editLogStart + editLog.size(); }
+
+    /**
+    * Moves a position across the edits applied since a revision. Positions inside deleted text collapse to the
+    * start of the deletion; inserts at the position push it right.
+    * @param sinceRevision Revision the position refers to. Edits older than the log are skipped.
+    * @returns The position in the current text, clamped to the document length
+    */
+    [[nodiscard]] std::size_t transformPosition(std::size_t pos, uint64_t sinceRevision) const;
+
+    /**
+    * Transform op1 against op2. Both have to apply to the same text.
+    * An insert into text op2 deletes is swallowed by the delete, and a delete of text op2 already deleted
+    * shrinks, down to length 0.
     * @param op1 The op that will be transformed
     * @param op2 The op that op1 will be transformed against
-    * @returns The transformed op
+    * @returns The transformed op, never null
     */
     std::unique_ptr<TextOperation> transform(const TextOperation* op1, const TextOperation* op2);
+
+    [[nodiscard]] uint64_t getTransformCount() const { return transformCount; }
+
+protected:
+    void recordEdit(std::size_t pos, std::size_t insertedLength, std::size_t deletedLength);
+
+    /**
+    * Drops the edit log when the whole text is replaced. Positions from before can no longer be transformed.
+    */
+    void resetEditLog();
 };
@@ -1,11 +1,50 @@
 #include <algorithm>
 #include <SDL3/SDL.h>
 #include <string_view>
+#include <functional>
+#include <cstdio>
 
 #include "editor.h"
 #include "imgui.h"
 #include "../controller/controller.h"
 #include "../text_engine/input_events.h"
+#include "../networking/client.h"
+
+namespace
+{
+    std::string formatMillis(uint64_t micros)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.1f", static_cast<double>(micros) / 1000.0);
+        return buffer;
+    }
+
+    /**
+     * @returns Median and 99th percentile, e.g. "12.0/31.5 ms"
+    */
+    std::string formatLatency(const LatencySummary& summary)
+    {
+        return formatMillis(summary.p50) + "/" + formatMillis(summary.p99) + " ms";
+    }
+
+    /**
+     * @returns Heartbeat round trip and how long our edits take to be acknowledged, split into the way to the
+     * server and back once the clock offset is known
+    */
+    std::string formatConnectionStats(const ConnectionStats& stats)
+    {
+        if (!stats.connected)
+            return "Offline";
+
+        std::string text = "RTT " + (stats.roundTrip.count > 0 ? formatLatency(stats.roundTrip) : std::string("-"));
+        if (stats.ack.count > 0)
+            text += " | Edit " + formatLatency(stats.ack);
+        if (stats.uplink.count > 0)
+            text += " (up " + formatMillis(stats.uplink.p50) + ", down " + formatMillis(stats.downlink.p50) + ")";
+
+        return text;
+    }
+}
 
 Editor::Editor()
     : controller(nullptr), cursorLastMovedTime(0.0f), isDragging(false),
@@ -51,6 +90,9 @@ void Editor::showEditor(bool* open)
     float baseX = contentAreaOrigin.x + 5.0f;
     float baseY = contentAreaOrigin.y + 5.0f;
 
+    // Whatever arrived since the last frame is applied here, so the text does not change while we draw it
+    controller->processIncomingMessages();
+
     std::string text = controller->getText();
     std::size_t cursorPos = controller->getCursorPosition();
     
@@ -63,6 +105,13 @@ void Editor::showEditor(bool* open)
 
     cursorPos = controller->getCursorPosition();
 
+    // Let the other clients see where we are
+    Presence localPresence;
+    localPresence.cursor = cursorPos;
+    localPresence.selectionStart = hasSelection() ? getSelectionStart() : cursorPos;
+    localPresence.selectionEnd = hasSelection() ? getSelectionEnd() : cursorPos;
+    controller->updatePresence(localPresence);
+
     // Re-fetch updated text after input handling
     text = controller->getText();
     
@@ -172,106 +221,11 @@ void Editor::showEditor(bool* open)
     if (hasSelection())
     {
         ImU32 bg_color = ImGui::GetColorU32(ImGuiCol_TextSelectedBg, 0.6f);
-        
-        std::size_t selStart = getSelectionStart();
-        std::size_t selEnd = getSelectionEnd();
-        
-        // Find line/column for start and end positions
-        auto startIt = std::upper_bound(lineStartOffsets.begin(), lineStartOffsets.end(), selStart);
-        std::size_t startLine = std::distance(lineStartOffsets.begin(), startIt) - 1;
-        std::size_t startColumn = selStart - lineStartOffsets[startLine];
-        
-        auto endIt = std::upper_bound(lineStartOffsets.begin(), lineStartOffsets.end(), selEnd);
-        std::size_t endLine = std::distance(lineStartOffsets.begin(), endIt) - 1;
-        std::size_t endColumn = selEnd - lineStartOffsets[endLine];
-        
-        if (startLine == endLine)
-        {
-            // Single line selection
-            float startX = baseX + (startColumn > charScrollOffsetX ? 
-                (startColumn - charScrollOffsetX) * charWidth : 0);
-            float endX = baseX + (endColumn > charScrollOffsetX ? 
-                (endColumn - charScrollOffsetX) * charWidth : 0);
-            
-            float y = baseY + (startLine - lineScrollOffsetY) * lineHeight;
-            
-            drawList->AddRectFilled(
-                ImVec2(startX, y),
-                ImVec2(endX, y + lineHeight),
-                bg_color
-            );
-        }
-        else
-        {
-            // Multi-line selection
-            // First line: from start column to end of line
-            if (startLine >= lineScrollOffsetY && startLine < lineScrollOffsetY + numLinesToRender)
-            {
-                // Account for horizontal scrolling in first line
-                float startX = baseX;
-                if (startColumn > charScrollOffsetX)
-                    startX = baseX + (startColumn - charScrollOffsetX) * charWidth;
-                
-                float startY = baseY + (startLine - lineScrollOffsetY) * lineHeight;
-                
-                // Calculate end of first line
-                std::size_t firstLineEnd = (startLine + 1 < lineStartOffsets.size()) ? 
-                    lineStartOffsets[startLine + 1] - lineStartOffsets[startLine] - 1 : 
-                    text.size() - lineStartOffsets[startLine];
-                
-                // Adjust for horizontal scroll
-                float firstLineEndX = baseX;
-                if (firstLineEnd > charScrollOffsetX)
-                    firstLineEndX = baseX + (firstLineEnd - charScrollOffsetX) * charWidth;
-                
-                drawList->AddRectFilled(
-                    ImVec2(startX, startY),
-                    ImVec2(firstLineEndX, startY + lineHeight),
-                    bg_color
-                );
-            }
-            
-            // Middle lines: full width
-            for (size_t line = std::max(startLine + 1, lineScrollOffsetY); 
-                line < std::min(endLine, lineScrollOffsetY + numLinesToRender); 
-                ++line)
-            {
-                float y = baseY + (line - lineScrollOffsetY) * lineHeight;
-                size_t lineLength = (line + 1 < lineStartOffsets.size()) ?
-                    lineStartOffsets[line + 1] - lineStartOffsets[line] - 1 :
-                    text.size() - lineStartOffsets[line];
-                
-                // Account for horizontal scrolling
-                float lineEndX = baseX;
-                if (lineLength > charScrollOffsetX)
-                    lineEndX = baseX + (lineLength - charScrollOffsetX) * charWidth;
-                
-                drawList->AddRectFilled(
-                    ImVec2(baseX, y),
-                    ImVec2(lineEndX, y + lineHeight),
-                    bg_color
-                );
-            }
-            
-            // Last line: from start of line to end column
-            if (endLine >= lineScrollOffsetY && endLine < lineScrollOffsetY + numLinesToRender)
-            {
-                // Account for horizontal scrolling
-                float endX = baseX;
-                if (endColumn > charScrollOffsetX)
-                    endX = baseX + (endColumn - charScrollOffsetX) * charWidth;
-                
-                float endY = baseY + (endLine - lineScrollOffsetY) * lineHeight;
-                
-                drawList->AddRectFilled(
-                    ImVec2(baseX, endY),
-                    ImVec2(endX, endY + lineHeight),
-                    bg_color
-                );
-            }
-        }
+        drawSelection(drawList, getSelectionStart(), getSelectionEnd(), bg_color, baseX, baseY, charWidth, lineHeight, numLinesToRender, text.size());
     }
 
+    drawRemotePresences(drawList, baseX, baseY, charWidth, lineHeight, numLinesToRender, maxRenderableChars, text.size());
+
     // Draw status bar
     ImVec2 statusBarPos = ImVec2(contentAreaOrigin.x, contentAreaOrigin.y + textAreaSize.y);
     ImVec2 statusBarMax = ImVec2(contentAreaOrigin.x + contentRegionAvail.x, statusBarPos.y + statusBarHeight);
@@ -292,12 +246,165 @@ void Editor::showEditor(bool* open)
     statusText += "Characters: " + std::to_string(text.size()) + " | ";
     statusText += "Line: " + std::to_string(cursorLine + 1) + ", ";
     statusText += "Column: " + std::to_string(cursorColumn + 1);
+
+    ConnectionStats connectionStats;
+    if (controller && controller->getConnectionStats(connectionStats))
+        statusText += " | " + formatConnectionStats(connectionStats);
     
     drawList->AddText(textPos, IM_COL32(180, 180, 180, 255), statusText.c_str());
 
     ImGui::End();
 }
 
+void Editor::drawSelection(ImDrawList* drawList, std::size_t selStart, std::size_t selEnd, ImU32 color, float baseX, float baseY,
+                           float charWidth, float lineHeight, std::size_t numLinesToRender, std::size_t textLength)
+{
+    // Find line/column for start and end positions
+    auto startIt = std::upper_bound(lineStartOffsets.begin(), lineStartOffsets.end(), selStart);
+    std::size_t startLine = std::distance(lineStartOffsets.begin(), startIt) - 1;
+    std::size_t startColumn = selStart - lineStartOffsets[startLine];
+    
+    auto endIt = std::upper_bound(lineStartOffsets.begin(), lineStartOffsets.end(), selEnd);
+    std::size_t endLine = std::distance(lineStartOffsets.begin(), endIt) - 1;
+    std::size_t endColumn = selEnd - lineStartOffsets[endLine];
+    
+    if (startLine == endLine)
+    {
+        if (startLine < lineScrollOffsetY || startLine >= lineScrollOffsetY + numLinesToRender)
+            return;
+
+        // Single line selection
+        float startX = baseX + (startColumn > charScrollOffsetX ? 
+            (startColumn - charScrollOffsetX) * charWidth : 0);
+        float endX = baseX + (endColumn > charScrollOffsetX ? 
+            (endColumn - charScrollOffsetX) * charWidth : 0);
+        
+        float y = baseY + (startLine - lineScrollOffsetY) * lineHeight;
+        
+        drawList->AddRectFilled(
+            ImVec2(startX, y),
+            ImVec2(endX, y + lineHeight),
+            color
+        );
+    }
+    else
+    {
+        // Multi-line selection
+        // First line: from start column to end of line
+        if (startLine >= lineScrollOffsetY && startLine < lineScrollOffsetY + numLinesToRender)
+        {
+            // Account for horizontal scrolling in first line
+            float startX = baseX;
+            if (startColumn > charScrollOffsetX)
+                startX = baseX + (startColumn - charScrollOffsetX) * charWidth;
+            
+            float startY = baseY + (startLine - lineScrollOffsetY) * lineHeight;
+            
+            // Calculate end of first line
+            std::size_t firstLineEnd = (startLine + 1 < lineStartOffsets.size()) ? 
+                lineStartOffsets[startLine + 1] - lineStartOffsets[startLine] - 1 : 
+                textLength - lineStartOffsets[startLine];
+            
+            // Adjust for horizontal scroll
+            float firstLineEndX = baseX;
+            if (firstLineEnd > charScrollOffsetX)
+                firstLineEndX = baseX + (firstLineEnd - charScrollOffsetX) * charWidth;
+            
+            drawList->AddRectFilled(
+                ImVec2(startX, startY),
+                ImVec2(firstLineEndX, startY + lineHeight),
+                color
+            );
+        }
+        
+        // Middle lines: full width
+        for (size_t line = std::max(startLine + 1, lineScrollOffsetY); 
+            line < std::min(endLine, lineScrollOffsetY + numLinesToRender); 
+            ++line)
+        {
+            float y = baseY + (line - lineScrollOffsetY) * lineHeight;
+            size_t lineLength = (line + 1 < lineStartOffsets.size()) ?
+                lineStartOffsets[line + 1] - lineStartOffsets[line] - 1 :
+                textLength - lineStartOffsets[line];
+            
+            // Account for horizontal scrolling
+            float lineEndX = baseX;
+            if (lineLength > charScrollOffsetX)
+                lineEndX = baseX + (lineLength - charScrollOffsetX) * charWidth;
+            
+            drawList->AddRectFilled(
+                ImVec2(baseX, y),
+                ImVec2(lineEndX, y + lineHeight),
+                color
+            );
+        }
+        
+        // Last line: from start of line to end column
+        if (endLine >= lineScrollOffsetY && endLine < lineScrollOffsetY + numLinesToRender)
+        {
+            // Account for horizontal scrolling
+            float endX = baseX;
+            if (endColumn > charScrollOffsetX)
+                endX = baseX + (endColumn - charScrollOffsetX) * charWidth;
+            
+            float endY = baseY + (endLine - lineScrollOffsetY) * lineHeight;
+            
+            drawList->AddRectFilled(
+                ImVec2(baseX, endY),
+                ImVec2(endX, endY + lineHeight),
+                color
+            );
+        }
+    }
+}
+
+void Editor::drawRemotePresences(ImDrawList* drawList, float baseX, float baseY, float charWidth, float lineHeight,
+                                 std::size_t numLinesToRender, std::size_t maxRenderableChars, std::size_t textLength)
+{
+    static const ImU32 presenceColors[] = {
+        IM_COL32(230, 120, 80, 255),
+        IM_COL32(90, 180, 240, 255),
+        IM_COL32(120, 210, 110, 255),
+        IM_COL32(220, 100, 200, 255),
+        IM_COL32(240, 200, 70, 255),
+        IM_COL32(150, 130, 250, 255)
+    };
+    const std::size_t colorCount = sizeof(presenceColors) / sizeof(presenceColors[0]);
+
+    for (const RemotePresence& remote : controller->getRemotePresences())
+    {
+        // Same color for a client on every screen
+        ImU32 color = presenceColors[std::hash<std::string>{}(remote.clientId) % colorCount];
+
+        if (remote.presence.selectionStart < remote.presence.selectionEnd)
+        {
+            ImU32 selectionColor = (color & ~IM_COL32_A_MASK) | IM_COL32(0, 0, 0, 70);
+            drawSelection(drawList, remote.presence.selectionStart, remote.presence.selectionEnd, selectionColor,
+                baseX, baseY, charWidth, lineHeight, numLinesToRender, textLength);
+        }
+
+        auto it = std::upper_bound(lineStartOffsets.begin(), lineStartOffsets.end(), remote.presence.cursor);
+        std::size_t line = std::distance(lineStartOffsets.begin(), it) - 1;
+        std::size_t column = remote.presence.cursor - lineStartOffsets[line];
+
+        if (line < lineScrollOffsetY || line >= lineScrollOffsetY + numLinesToRender ||
+            column < charScrollOffsetX || column >= charScrollOffsetX + maxRenderableChars)
+            continue;
+
+        float x = baseX + (column - charScrollOffsetX) * charWidth;
+        float y = baseY + (line - lineScrollOffsetY) * lineHeight;
+        drawList->AddLine(ImVec2(x, y), ImVec2(x, y + lineHeight), color, 2.0f);
+
+        // Small name tag above the cursor
+        ImVec2 labelSize = ImGui::CalcTextSize(remote.clientId.c_str());
+        float labelScale = 0.75f;
+        ImVec2 labelPos(x, y - labelSize.y * labelScale);
+        drawList->AddRectFilled(labelPos, ImVec2(labelPos.x + labelSize.x * labelScale + 4.0f, y), color);
+        drawList->AddText(ImGui::GetFont(), ImGui::GetFontSize() * labelScale, ImVec2(labelPos.x + 2.0f, labelPos.y),
+            IM_COL32(20, 20, 20, 255), remote.clientId.c_str());
+    }
+}
+
 void Editor::handleTextInput(const char* text)
 {
     if (!controller || !text)
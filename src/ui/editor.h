@@ -4,8 +4,11 @@
 #include <vector>
 
 struct ImGuiInputTextCallbackData;
+struct ImDrawList;
 class Controller;
 
+typedef unsigned int ImU32;
+
 class Editor
 {
 private:
@@ -52,4 +55,14 @@ private:
     std::size_t getSelectionStart() const;
     std::size_t getSelectionEnd() const;
     void deleteSelectedText(std::size_t& cursorPos);
+
+    // Rendering
+    void drawSelection(ImDrawList* drawList, std::size_t selStart, std::size_t selEnd, ImU32 color, float baseX, float baseY,
+                       float charWidth, float lineHeight, std::size_t numLinesToRender, std::size_t textLength);
+
+    /**
+     * Draws the cursors and selections of the other clients with a name tag per cursor.
+    */
+    void drawRemotePresences(ImDrawList* drawList, float baseX, float baseY, float charWidth, float lineHeight,
+                             std::size_t numLinesToRender, std::size_t maxRenderableChars, std::size_t textLength);
 };
@@ -6,8 +6,19 @@
 #include "setup_window.h"
 #include "../application.h"
 
+namespace
+{
+    const char* engineNames[] = { "OT", "CRDT" };
+
+    TextEngineType getEngineType(int engineIndex)
+    {
+        return engineIndex == 1 ? TextEngineType::CRDT : TextEngineType::OT;
+    }
+}
+
 SetupWindow::SetupWindow()
-    : inputClientId(""), inputClientPort("8080"), inputClientAddress("localhost"), inputServerPort("8080"), inputServerAddress("localhost"), filePathName("")
+    : inputClientId(""), inputClientPort("8080"), inputClientAddress("localhost"), inputClientDocument("default"), inputServerPort("8080"), inputServerAddress("localhost"), filePathName(""),
+      serverEngineIndex(0), clientEngineIndex(0)
 {
 }
 
@@ -71,6 +82,13 @@ void SetupWindow::showSetupWindow(bool* open)
         ImGui::SetNextItemWidth(inputWidth);
         ImGui::InputText("##ServerAddress", inputServerAddress, IM_ARRAYSIZE(inputServerAddress));
 
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        ImGui::Text("Engine");
+        ImGui::TableSetColumnIndex(1);
+        ImGui::SetNextItemWidth(inputWidth);
+        ImGui::Combo("##ServerEngine", &serverEngineIndex, engineNames, IM_ARRAYSIZE(engineNames));
+
         ImGui::TableNextRow();
         ImGui::TableSetColumnIndex(0);
         ImGui::Text("File");
@@ -125,7 +143,7 @@ void SetupWindow::showSetupWindow(bool* open)
     if (ImGui::Button("Create Server", ImVec2(columnWidth, 0)))
     {
         if (setupCompletedCallback)
-            setupCompletedCallback(AppMode::SERVER, std::stoi(inputServerPort), inputServerAddress, "", filePathName.size() > 0 ? filePathName : "");
+            setupCompletedCallback(AppMode::SERVER, std::stoi(inputServerPort), inputServerAddress, "", "", filePathName.size() > 0 ? filePathName : "", getEngineType(serverEngineIndex));
     }
 
     ImGui::EndDisabled();
@@ -177,6 +195,20 @@ void SetupWindow::showSetupWindow(bool* open)
         ImGui::SetNextItemWidth(inputWidth);
         ImGui::InputText("##ClientAddress", inputClientAddress, IM_ARRAYSIZE(inputClientAddress));
 
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        ImGui::Text("Document");
+        ImGui::TableSetColumnIndex(1);
+        ImGui::SetNextItemWidth(inputWidth);
+        ImGui::InputText("##ClientDocument", inputClientDocument, IM_ARRAYSIZE(inputClientDocument));
+
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        ImGui::Text("Engine");
+        ImGui::TableSetColumnIndex(1);
+        ImGui::SetNextItemWidth(inputWidth);
+        ImGui::Combo("##ClientEngine", &clientEngineIndex, engineNames, IM_ARRAYSIZE(engineNames));
+
         ImGui::EndTable();
     }
 
@@ -186,7 +218,8 @@ void SetupWindow::showSetupWindow(bool* open)
     bool clientIdValid = strlen(inputClientId) > 0;
     bool clientPortValid = strlen(inputClientPort) > 0;
     bool clientAddressValid = strlen(inputClientAddress) > 0;
-    bool allClientFieldsValid = clientIdValid && clientPortValid && clientAddressValid;
+    bool clientDocumentValid = strlen(inputClientDocument) > 0 && strchr(inputClientDocument, ':') == nullptr;
+    bool allClientFieldsValid = clientIdValid && clientPortValid && clientAddressValid && clientDocumentValid;
     
     // Show validation messages if fields are empty
     if (!allClientFieldsValid) {
@@ -201,7 +234,7 @@ void SetupWindow::showSetupWindow(bool* open)
     if (ImGui::Button("Connect As Client", ImVec2(columnWidth, 0)))
     {
         if (setupCompletedCallback)
-            setupCompletedCallback(AppMode::CLIENT, std::stoi(inputClientPort), inputClientAddress, std::string(inputClientId), "");
+            setupCompletedCallback(AppMode::CLIENT, std::stoi(inputClientPort), inputClientAddress, std::string(inputClientId), std::string(inputClientDocument), "", getEngineType(clientEngineIndex));
     }
 
     ImGui::EndDisabled();
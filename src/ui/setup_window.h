@@ -3,21 +3,27 @@
 #include <functional>
 
 enum class AppMode;
+enum class TextEngineType;
 
 class SetupWindow
 {
 public:
-    using SetupCompletedCallback = std::function<void(AppMode appMode, const uint16_t port, const std::string& serverAddress, const std::string& clientId, const std::string& filePathName)>;
+    using SetupCompletedCallback = std::function<void(AppMode appMode, const uint16_t port, const std::string& serverAddress, const std::string& clientId, const std::string& documentName, const std::string& filePathName, TextEngineType engineType)>;
 
 private:
     char inputClientId[20];
     char inputClientPort[6];
     char inputClientAddress[18];
+    char inputClientDocument[64];
 
     char inputServerPort[6];
     char inputServerAddress[18];
     std::string filePathName;
 
+    // Index into the engine names shown in each column
+    int serverEngineIndex;
+    int clientEngineIndex;
+
 public:
     SetupWindow();
     void showSetupWindow(bool* open);
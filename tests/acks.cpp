@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+#include "test_client.h"
+
+namespace
+{
+    /**
+     * @returns The socket once the document arrived, -1 if it did not
+    */
+    int join(uint16_t port, const std::string& clientId, FrameReader& reader)
+    {
+        int clientSocket = connectToServer(port);
+        if (clientSocket == -1)
+            return -1;
+
+        ParsedMessage parsed;
+        if (Framing::sendFrame(clientSocket, MessageParser::createConnectedMessage(clientId, "acks", std::nullopt, WireProtocol::BINARY)) &&
+            receiveUntil(clientSocket, reader, MessageType::INIT_DOCUMENT, parsed))
+        {
+            return clientSocket;
+        }
+
+        close(clientSocket);
+        return -1;
+    }
+}
+
+TEST(AckTest, SenderIsAcknowledgedInsteadOfSentItsOps)
+{
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+
+    // Long enough for ops sent together to go out in one batch
+    ServerConfig config;
+    config.shardCount = 1;
+    config.reactorCount = 1;
+    config.broadcastInterval = std::chrono::milliseconds(50);
+    auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+    ASSERT_TRUE(server->isRunning());
+
+    FrameReader writerReader;
+    int writerSocket = join(server->getPort(), "writer", writerReader);
+    ASSERT_NE(writerSocket, -1);
+    FrameReader readerReader;
+    int readerSocket = join(server->getPort(), "reader", readerReader);
+    ASSERT_NE(readerSocket, -1);
+
+    // Made on the document it was sent, which a client drops its pending ops for, so it comes back whole
+    InsertOperation first("a", 0, "writer");
+    first.docVersion = 0;
+    ASSERT_TRUE(Framing::sendFrame(writerSocket, first.serialize()));
+    ParsedMessage parsed;
+    ASSERT_TRUE(receiveNext(writerSocket, writerReader, parsed));
+    ASSERT_EQ(parsed.type, MessageType::OPERATION);
+    EXPECT_EQ(parsed.operation->clientId, "writer");
+
+    // The rest go out with one write and are confirmed by one ack
+    const uint64_t operationCount = 5;
+    std::string frames;
+    for (uint64_t i = 1; i <= operationCount; i++)
+    {
+        InsertOperation insert("b", 0, "writer");
+        insert.docVersion = i;
+        Framing::appendFrame(frames, insert.serialize(), false);
+    }
+
+    ASSERT_EQ(send(writerSocket, frames.data(), frames.size(), MSG_NOSIGNAL), static_cast<ssize_t>(frames.size()));
+
+    ASSERT_TRUE(receiveNext(writerSocket, writerReader, parsed));
+    ASSERT_EQ(parsed.type, MessageType::ACK);
+    uint64_t docVersion = 0;
+    uint64_t operations = 0;
+    uint64_t sequencedAt = 0;
+    ASSERT_TRUE(MessageParser::parseAckMessage(parsed.content, docVersion, operations, sequencedAt));
+    EXPECT_EQ(docVersion, operationCount);
+    EXPECT_EQ(operations, operationCount + 1);
+    EXPECT_EQ(sequencedAt, 0u);
+
+    // Everyone else gets the ops themselves
+    for (uint64_t i = 0; i <= operationCount; i++)
+    {
+        ASSERT_TRUE(receiveNext(readerSocket, readerReader, parsed));
+        ASSERT_EQ(parsed.type, MessageType::OPERATION);
+        EXPECT_EQ(parsed.operation->docVersion, i);
+    }
+
+    // Whatever the reader sends next is all the writer receives
+    InsertOperation reply("c", 0, "reader");
+    reply.docVersion = operationCount + 1;
+    ASSERT_TRUE(Framing::sendFrame(readerSocket, reply.serialize()));
+    ASSERT_TRUE(receiveNext(writerSocket, writerReader, parsed));
+    ASSERT_EQ(parsed.type, MessageType::OPERATION);
+    EXPECT_EQ(parsed.operation->clientId, "reader");
+
+    close(writerSocket);
+    close(readerSocket);
+    server.reset();
+}
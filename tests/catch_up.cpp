@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <mutex>
+#include <condition_variable>
+
+#include "message_parser.h"
+#include "sequencer.h"
+#include "server_document.h"
+#include "server_text_engine.h"
+#include "client_text_engine.h"
+
+TEST(CatchUpTest, HistoryReturnsOperationsSinceVersion)
+{
+    ServerTextEngine engine;
+    engine.processIncomingOperation(std::make_unique<InsertOperation>("a", 0, "c1"));
+    engine.processIncomingOperation(std::make_unique<InsertOperation>("b", 1, "c1"));
+    engine.processIncomingOperation(std::make_unique<InsertOperation>("c", 2, "c1"));
+
+    std::vector<const TextOperation*> ops;
+    ASSERT_TRUE(engine.getOperationsSince(1, ops));
+    ASSERT_EQ(ops.size(), 2);
+    EXPECT_EQ(ops[0]->docVersion, 1);
+    EXPECT_EQ(static_cast<const InsertOperation*>(ops[1])->text, "c");
+
+    ops.clear();
+    EXPECT_TRUE(engine.getOperationsSince(3, ops));
+    EXPECT_TRUE(ops.empty());
+
+    EXPECT_FALSE(engine.getOperationsSince(4, ops));
+}
+
+TEST(CatchUpTest, HistoryDoesNotReachBeforeLoadedVersion)
+{
+    ServerTextEngine engine;
+    engine.loadPieces({}, {}, nullptr, 10);
+    engine.processIncomingOperation(std::make_unique<InsertOperation>("a", 0, "c1"));
+
+    std::vector<const TextOperation*> ops;
+    EXPECT_FALSE(engine.getOperationsSince(5, ops));
+    ASSERT_TRUE(engine.getOperationsSince(10, ops));
+    ASSERT_EQ(ops.size(), 1);
+    EXPECT_EQ(ops[0]->docVersion, 10);
+}
+
+TEST(CatchUpTest, MessagesRoundTrip)
+{
+    std::vector<std::string> operations = { "INSERT:c1:op1:0:0:a:b", "DELETE:c2:op2:1:0:1", "" };
+    std::string msg = MessageParser::createCatchUpMessage(7, operations);
+    EXPECT_EQ(MessageParser::parseMessage(msg).type, MessageType::CATCH_UP);
+
+    uint64_t docVersion = 0;
+    std::vector<std::string> parsed;
+    ASSERT_TRUE(MessageParser::parseCatchUpMessage(msg, docVersion, parsed));
+    EXPECT_EQ(docVersion, 7);
+    EXPECT_EQ(parsed, operations);
+
+    EXPECT_FALSE(MessageParser::parseCatchUpMessage(msg.substr(0, msg.size() - 3), docVersion, parsed));
+
+    std::string text;
+    ASSERT_TRUE(MessageParser::parseInitDocumentMessage(MessageParser::createInitDocumentMessage(3, "x:y"), docVersion, text));
+    EXPECT_EQ(docVersion, 3);
+    EXPECT_EQ(text, "x:y");
+
+    ParsedMessage connected = MessageParser::parseMessage(MessageParser::createConnectedMessage("c1", "notes", 42));
+    EXPECT_EQ(connected.documentName, "notes");
+    ASSERT_TRUE(connected.knownVersion.has_value());
+    EXPECT_EQ(*connected.knownVersion, 42);
+    EXPECT_FALSE(MessageParser::parseMessage(MessageParser::createConnectedMessage("c1", "notes")).knownVersion.has_value());
+}
+
+TEST(CatchUpTest, JoinWithKnownVersionOnlyReceivesMissedOperations)
+{
+    ServerTextEngine engine;
+    ServerDocument document("doc", 0, &engine);
+    Sequencer sequencer;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::vector<std::string> missed;
+    bool caughtUp = false;
+    bool fullJoin = false;
+
+    sequencer.setJoinCallback([&] (ServerDocument&, int)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        fullJoin = true;
+        doneCondition.notify_one();
+    });
+    sequencer.setCatchUpCallback([&] (ServerDocument&, int, const std::vector<const TextOperation*>& operations)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        for (const TextOperation* operation : operations)
+            missed.push_back(static_cast<const InsertOperation*>(operation)->text);
+        caughtUp = true;
+        doneCondition.notify_one();
+    });
+    sequencer.start();
+
+    sequencer.submitOperation(&document, 1, std::make_unique<InsertOperation>("a", 0, "c1"));
+    sequencer.submitOperation(&document, 1, std::make_unique<InsertOperation>("b", 1, "c1"));
+    sequencer.submitOperation(&document, 1, std::make_unique<InsertOperation>("c", 2, "c1"));
+    sequencer.submitJoin(&document, 2, 1);
+
+    // A version we never reached falls back to the whole document
+    sequencer.submitJoin(&document, 3, 100);
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return caughtUp && fullJoin; });
+    }
+    sequencer.stop();
+
+    EXPECT_THAT(missed, ::testing::ElementsAre("b", "c"));
+}
+
+TEST(CatchUpTest, JoinFromBeforeTheTrimmedHistoryGetsTheDocument)
+{
+    ServerTextEngine engine;
+    ServerDocument document("doc", 0, &engine);
+    Sequencer sequencer;
+    sequencer.setHistoryLimit(2);
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::vector<int> fullJoins;
+    std::vector<std::string> missed;
+
+    sequencer.setJoinCallback([&] (ServerDocument&, int clientSocket)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        fullJoins.push_back(clientSocket);
+        doneCondition.notify_one();
+    });
+    sequencer.setCatchUpCallback([&] (ServerDocument&, int, const std::vector<const TextOperation*>& operations)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        for (const TextOperation* operation : operations)
+            missed.push_back(static_cast<const InsertOperation*>(operation)->text);
+        doneCondition.notify_one();
+    });
+    sequencer.start();
+
+    const std::vector<std::string> texts = {"a", "b", "c", "d"};
+    for (std::size_t i = 0; i < texts.size(); i++)
+    {
+        auto insert = std::make_unique<InsertOperation>(texts[i], i, "c1");
+        insert->docVersion = i;
+        sequencer.submitOperation(&document, 1, std::move(insert));
+    }
+
+    // Only the last two ops are kept once they went out
+    sequencer.submitJoin(&document, 2, 1);
+    sequencer.submitJoin(&document, 3, 2);
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return fullJoins.size() == 1 && !missed.empty(); });
+    }
+    sequencer.stop();
+
+    EXPECT_THAT(fullJoins, ::testing::ElementsAre(2));
+    EXPECT_THAT(missed, ::testing::ElementsAre("c", "d"));
+    EXPECT_EQ(engine.getHistorySize(), 2);
+}
+
+TEST(CatchUpTest, PendingOperationsAreRebasedOntoMissedOperations)
+{
+    ClientTextEngine client;
+    client.readString("Hello");
+    client.resetToServerVersion(5);
+
+    // Typed while disconnected
+    auto local = std::make_unique<InsertOperation>("!", 5, "c1");
+    client.insertLocal(local.get());
+    client.addPendingLocalOp(std::make_unique<InsertOperation>(*local));
+
+    // Missed remote op inserted before it
+    auto remote = std::make_unique<InsertOperation>(">> ", 0, "c2");
+    remote->docVersion = 5;
+    client.processIncomingOperation(std::move(remote));
+
+    EXPECT_EQ(client.getText(), ">> Hello!");
+    ASSERT_EQ(client.getPendingLocalOps().size(), 1);
+    EXPECT_EQ(client.getPendingLocalOps()[0]->pos, 8);
+    EXPECT_EQ(client.getServerVersion(), 6);
+}
+
+TEST(CatchUpTest, UnsentOperationsAreRebasedOntoAFreshDocument)
+{
+    ClientTextEngine client;
+    client.readString("Hello world");
+    client.resetToServerVersion(5);
+
+    auto inFlight = std::make_unique<InsertOperation>("!", 11, "c1");
+    client.insertLocal(inFlight.get());
+    client.addPendingLocalOp(std::make_unique<InsertOperation>(*inFlight));
+    ASSERT_NE(client.takeOpToSend(), nullptr);
+
+    // Typed while it was in flight
+    auto deleted = std::make_unique<DeleteOperation>(6, 5, "c1");
+    std::string deletedText = client.getText(6, 5);
+    client.deleteLocal(deleted.get());
+    client.addPendingLocalOp(std::make_unique<DeleteOperation>(*deleted), deletedText);
+    auto typed = std::make_unique<InsertOperation>("there", 6, "c1");
+    client.insertLocal(typed.get());
+    client.addPendingLocalOp(std::make_unique<InsertOperation>(*typed));
+
+    // Inserted into the deleted text, so the delete takes it along
+    auto remote = std::make_unique<InsertOperation>("X", 8, "c2");
+    remote->docVersion = 5;
+    client.processIncomingOperation(std::move(remote));
+    EXPECT_EQ(client.getText(), "Hello there!");
+
+    // The fresh document has the op in flight and someone else's edit
+    client.prepareForServerDocument();
+    client.readString(">> Hello woXrld!");
+    EXPECT_EQ(client.resetToServerVersion(9), 2);
+
+    EXPECT_EQ(client.getText(), ">> Hello there!");
+    const TextOperation* resent = client.takeOpToSend();
+    ASSERT_NE(resent, nullptr);
+    EXPECT_EQ(resent->type, OperationType::DELETE);
+    EXPECT_EQ(resent->pos, 9);
+    EXPECT_EQ(resent->length, 6);
+    EXPECT_EQ(resent->docVersion, 9);
+    EXPECT_EQ(client.getPendingLocalOps()[1]->pos, 9);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+
+#include "lz4.h"
+#include "framing.h"
+
+namespace
+{
+    std::string makeText(std::size_t size)
+    {
+        static const char* words[] = {"the ", "piece ", "table ", "holds ", "every ", "edit ", "of ", "a ", "document\n"};
+        std::mt19937 random(7);
+        std::string text;
+        while (text.size() < size)
+            text += words[random() % 9];
+
+        text.resize(size);
+        return text;
+    }
+
+    std::string makeNoise(std::size_t size)
+    {
+        std::mt19937 random(11);
+        std::string noise(size, '\0');
+        for (char& c : noise)
+            c = static_cast<char>(random());
+
+        return noise;
+    }
+
+    std::string roundTrip(std::string_view data, std::size_t& compressedSize)
+    {
+        std::vector<char> compressed(Lz4::getMaxCompressedSize(data.size()));
+        compressedSize = Lz4::compress(data.data(), data.size(), compressed.data());
+        EXPECT_LE(compressedSize, compressed.size());
+
+        std::string restored(data.size(), '\0');
+        EXPECT_TRUE(Lz4::decompress(compressed.data(), compressedSize, restored.data(), restored.size()));
+        return restored;
+    }
+}
+
+TEST(CompressionTest, Lz4RoundTripsAnyInput)
+{
+    for (std::string data : {std::string(), std::string("a"), std::string(13, 'a'), std::string(100000, 'z'),
+                             makeText(5000), makeNoise(5000), std::string("abcabcabcabcabcabcabcabcabc")})
+    {
+        std::size_t compressedSize = 0;
+        EXPECT_EQ(roundTrip(data, compressedSize), data);
+    }
+}
+
+TEST(CompressionTest, Lz4ShrinksText)
+{
+    std::string text = makeText(FrameCompressor::blockSize);
+    std::size_t compressedSize = 0;
+    EXPECT_EQ(roundTrip(text, compressedSize), text);
+    EXPECT_LT(compressedSize * 2, text.size());
+}
+
+TEST(CompressionTest, Lz4RejectsMalformedBlocks)
+{
+    std::string text = makeText(4000);
+    std::vector<char> compressed(Lz4::getMaxCompressedSize(text.size()));
+    std::size_t compressedSize = Lz4::compress(text.data(), text.size(), compressed.data());
+
+    std::string restored(text.size(), '\0');
+    EXPECT_FALSE(Lz4::decompress(compressed.data(), compressedSize / 2, restored.data(), restored.size()));
+    EXPECT_FALSE(Lz4::decompress(compressed.data(), compressedSize, restored.data(), restored.size() - 1));
+
+    // A match reaching back before the start of the block
+    const char badOffset[] = {0x10, 'a', 0x05, 0x00};
+    EXPECT_FALSE(Lz4::decompress(badOffset, sizeof(badOffset), restored.data(), 5));
+}
+
+TEST(CompressionTest, ReaderInflatesCompressedFramesBetweenPlainOnes)
+{
+    // Larger than one block, handed to the compressor in uneven pieces
+    std::string document = makeText(3 * FrameCompressor::blockSize + 123);
+    std::string noise = makeNoise(10000);
+
+    std::string stream;
+    Framing::appendFrame(stream, "before");
+    {
+        FrameCompressor compressor(stream);
+        for (std::size_t pos = 0; pos < document.size(); pos += 7777)
+            compressor.append(std::string_view(document).substr(pos, 7777));
+
+        compressor.finish();
+    }
+    Framing::appendFrame(stream, noise, true);
+    Framing::appendFrame(stream, "after");
+    EXPECT_LT(stream.size(), document.size());
+
+    FrameReader reader;
+    std::vector<std::string> frames;
+    for (std::size_t pos = 0; pos < stream.size(); pos += 1000)
+    {
+        reader.receive(std::string_view(stream).substr(pos, 1000));
+        std::string_view frame;
+        while (reader.nextFrame(frame))
+            frames.emplace_back(frame);
+    }
+
+    EXPECT_FALSE(reader.isCorrupt());
+    ASSERT_EQ(frames.size(), 4u);
+    EXPECT_EQ(frames[0], "before");
+    EXPECT_EQ(frames[1], document);
+    EXPECT_EQ(frames[2], noise);
+    EXPECT_EQ(frames[3], "after");
+}
+
+TEST(CompressionTest, MalformedCompressedFrameCorruptsTheStream)
+{
+    std::string stream;
+    Framing::appendFrame(stream, makeText(10000), true);
+
+    // Claim a larger block than the frame holds
+    stream[Framing::headerSize] = 0x7F;
+
+    FrameReader reader;
+    reader.receive(stream);
+    std::string_view frame;
+    EXPECT_FALSE(reader.nextFrame(frame));
+    EXPECT_TRUE(reader.isCorrupt());
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include "convergence_simulator.h"
+
+namespace
+{
+    void expectConverged(const SimulationConfig& config)
+    {
+        SimulationResult result = ConvergenceSimulator(config).run();
+
+        EXPECT_TRUE(result.converged) << "seed " << config.seed << ", " << result.divergedClients.size()
+                                      << " clients diverged from \"" << result.serverText << "\"";
+        EXPECT_EQ(result.edits, config.clientCount * config.editsPerClient);
+    }
+}
+
+TEST(ConvergenceTest, SameSeedReplaysTheSameSession)
+{
+    SimulationConfig config;
+    config.seed = 7;
+
+    SimulationResult first = ConvergenceSimulator(config).run();
+    SimulationResult second = ConvergenceSimulator(config).run();
+
+    EXPECT_EQ(first.serverText, second.serverText);
+    EXPECT_EQ(first.serverTransforms, second.serverTransforms);
+    EXPECT_EQ(first.clientTransforms, second.clientTransforms);
+    EXPECT_EQ(first.virtualDuration, second.virtualDuration);
+    EXPECT_GT(first.serverTransforms, 0);
+}
+
+TEST(ConvergenceTest, ClientsConvergeUnderRandomDelays)
+{
+    for (uint64_t seed = 1; seed <= 40; seed++)
+    {
+        SimulationConfig config;
+        config.seed = seed;
+        config.clientCount = 2 + seed % 4;
+        config.editsPerClient = 40;
+        expectConverged(config);
+    }
+}
+
+TEST(ConvergenceTest, ClientsConvergeWhenEditingFasterThanTheNetwork)
+{
+    // Every client edits all over the document many ops ahead of what it heard from the server, mostly deleting
+    for (uint64_t seed = 1; seed <= 20; seed++)
+    {
+        SimulationConfig config;
+        config.seed = seed;
+        config.clientCount = 4;
+        config.editsPerClient = 50;
+        config.maxEditInterval = 50;
+        config.jumpPercent = 100;
+        config.deletePercent = 60;
+        config.maxDeleteLength = 10;
+        expectConverged(config);
+    }
+}
+
+TEST(ConvergenceTest, ClientsConvergeOnAnEmptyDocument)
+{
+    for (uint64_t seed = 1; seed <= 10; seed++)
+    {
+        SimulationConfig config;
+        config.seed = seed;
+        config.initialText.clear();
+        config.clientCount = 3;
+        config.editsPerClient = 30;
+        config.deletePercent = 50;
+        expectConverged(config);
+    }
+}
+
+TEST(ConvergenceTest, ClientSendsOneOperationAtATime)
+{
+    ClientTextEngine client;
+    client.readString("abc");
+    client.resetToServerVersion(3);
+
+    auto typeAt = [&client] (std::size_t pos, const std::string& text)
+    {
+        auto op = std::make_unique<InsertOperation>(text, pos, "c1");
+        client.insertLocal(op.get());
+        client.addPendingLocalOp(std::make_unique<InsertOperation>(*op));
+    };
+
+    typeAt(0, "x");
+    const TextOperation* first = client.takeOpToSend();
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first->docVersion, 3);
+    uint64_t firstId = first->operationId;
+
+    // Typing on while the first op is in flight grows a single queued op
+    typeAt(0, "x");
+    typeAt(1, "y");
+    EXPECT_EQ(client.takeOpToSend(), nullptr);
+    ASSERT_EQ(client.getPendingLocalOps().size(), 2);
+
+    // A remote op arrives before the ack, the second op is rebased onto it
+    auto remote = std::make_unique<InsertOperation>("R", 0, "c0");
+    remote->docVersion = 3;
+    client.processIncomingOperation(std::move(remote));
+
+    client.acknowledgePendingOp(firstId, 4);
+
+    const TextOperation* second = client.takeOpToSend();
+    ASSERT_NE(second, nullptr);
+    EXPECT_EQ(second->docVersion, 5);
+    EXPECT_EQ(second->pos, 1);
+    EXPECT_EQ(static_cast<const InsertOperation*>(second)->text, "xy");
+    EXPECT_EQ(client.getText(), "Rxyxabc");
+}
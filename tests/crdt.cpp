@@ -0,0 +1,393 @@
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <random>
+#include <filesystem>
+#include <unistd.h>
+
+#include "crdt_sequence.h"
+#include "crdt_text_engine.h"
+#include "crdt_server_text_engine.h"
+#include "message_parser.h"
+#include "server.h"
+#include "../controller/controller.h"
+#include "test_client.h"
+
+namespace
+{
+    std::unique_ptr<TextOperation> typeLocal(CrdtTextEngine& engine, std::size_t pos, const std::string& text, const std::string& clientId)
+    {
+        return engine.applyLocalInsert(InsertOperation(text, pos, clientId));
+    }
+
+    std::unique_ptr<TextOperation> deleteLocal(CrdtTextEngine& engine, std::size_t pos, std::size_t length, const std::string& clientId)
+    {
+        return engine.applyLocalDelete(DeleteOperation(pos, length, clientId));
+    }
+
+    std::unique_ptr<TextOperation> roundTrip(const TextOperation& op)
+    {
+        std::unique_ptr<Operation> parsed = Operation::deserialize(op.serialize());
+        return std::unique_ptr<TextOperation>(static_cast<TextOperation*>(parsed.release()));
+    }
+}
+
+TEST(CrdtTest, LocalEditsKeepTextAndSequenceInStep)
+{
+    CrdtTextEngine engine;
+    engine.readString("Hello");
+
+    typeLocal(engine, 5, " World", "c1");
+    typeLocal(engine, 0, ">> ", "c1");
+    deleteLocal(engine, 3, 6, "c1");
+    typeLocal(engine, 3, "Bye", "c1");
+
+    EXPECT_EQ(engine.getText(), ">> ByeWorld");
+    EXPECT_EQ(engine.getSequence().getVisibleLength(), engine.getDocumentLength());
+    EXPECT_EQ(engine.getCursorPosition(), 6);
+}
+
+TEST(CrdtTest, SequentialTypingIsOneRun)
+{
+    CrdtTextEngine engine;
+    std::string typed;
+    for (int i = 0; i < 500; i++)
+    {
+        typed += static_cast<char>('a' + i % 26);
+        typeLocal(engine, i, typed.substr(i), "c1");
+    }
+
+    EXPECT_EQ(engine.getText(), typed);
+    EXPECT_EQ(engine.getSequence().getRunCount(), 1);
+}
+
+TEST(CrdtTest, ConcurrentInsertsConvergeInAnyOrder)
+{
+    CrdtTextEngine a;
+    CrdtTextEngine b;
+    a.readString("ac");
+    b.readString("ac");
+
+    auto fromA = typeLocal(a, 1, "b", "alice");
+    auto fromB = typeLocal(b, 1, "B", "bob");
+
+    a.processIncomingOperation(roundTrip(*fromB));
+    b.processIncomingOperation(roundTrip(*fromA));
+
+    EXPECT_EQ(a.getText(), b.getText());
+    EXPECT_EQ(a.getText(), "abBc");
+}
+
+TEST(CrdtTest, ConcurrentTypingDoesNotInterleave)
+{
+    CrdtTextEngine a;
+    CrdtTextEngine b;
+    a.readString("[]");
+    b.readString("[]");
+
+    std::vector<std::unique_ptr<TextOperation>> fromA;
+    std::vector<std::unique_ptr<TextOperation>> fromB;
+    for (int i = 0; i < 3; i++)
+    {
+        fromA.push_back(typeLocal(a, 1 + i, std::string(1, 'x' + i), "alice"));
+        fromB.push_back(typeLocal(b, 1 + i, std::string(1, '1' + i), "bob"));
+    }
+
+    for (const auto& op : fromB)
+        a.processIncomingOperation(roundTrip(*op));
+    for (const auto& op : fromA)
+        b.processIncomingOperation(roundTrip(*op));
+
+    EXPECT_EQ(a.getText(), "[xyz123]");
+    EXPECT_EQ(b.getText(), "[xyz123]");
+}
+
+TEST(CrdtTest, OverlappingDeletesMerge)
+{
+    CrdtTextEngine a;
+    CrdtTextEngine b;
+    a.readString("abcdef");
+    b.readString("abcdef");
+
+    auto fromA = deleteLocal(a, 1, 3, "alice");
+    auto fromB = deleteLocal(b, 2, 3, "bob");
+
+    a.processIncomingOperation(roundTrip(*fromB));
+    b.processIncomingOperation(roundTrip(*fromA));
+
+    // Applying a delete twice changes nothing
+    b.processIncomingOperation(roundTrip(*fromA));
+
+    EXPECT_EQ(a.getText(), "af");
+    EXPECT_EQ(b.getText(), "af");
+}
+
+TEST(CrdtTest, OperationsRoundTrip)
+{
+    CrdtInsertOperation insertOp("a:b\nc", 0, "c1");
+    insertOp.docVersion = 4;
+    insertOp.clock = 7;
+    insertOp.originLeft = CrdtId{"c2", 3};
+
+    auto parsedInsert = roundTrip(insertOp);
+    ASSERT_TRUE(parsedInsert);
+    ASSERT_EQ(parsedInsert->type, OperationType::CRDT_INSERT);
+    auto& insertCopy = static_cast<CrdtInsertOperation&>(*parsedInsert);
+    EXPECT_EQ(insertCopy.text, "a:b\nc");
+    EXPECT_EQ(insertCopy.clock, 7);
+    EXPECT_EQ(insertCopy.docVersion, 4);
+    EXPECT_EQ(insertCopy.operationId, insertOp.operationId);
+    ASSERT_TRUE(insertCopy.originLeft.has_value());
+    EXPECT_EQ(*insertCopy.originLeft, (CrdtId{"c2", 3}));
+    EXPECT_FALSE(insertCopy.originRight.has_value());
+
+    CrdtDeleteOperation deleteOp(0, "c1");
+    deleteOp.spans = { {"c1", 0, 3}, {"c2", 5, 1} };
+
+    auto parsedDelete = roundTrip(deleteOp);
+    ASSERT_TRUE(parsedDelete);
+    ASSERT_EQ(parsedDelete->type, OperationType::CRDT_DELETE);
+    auto& deleteCopy = static_cast<CrdtDeleteOperation&>(*parsedDelete);
+    ASSERT_EQ(deleteCopy.spans.size(), 2);
+    EXPECT_EQ(deleteCopy.spans[1].clientId, "c2");
+    EXPECT_EQ(deleteCopy.length, 4);
+
+    EXPECT_EQ(MessageParser::parseMessage(insertOp.serialize()).type, MessageType::OPERATION);
+    EXPECT_EQ(MessageParser::parseMessage(insertOp.serialize()).clientId, "c1");
+}
+
+TEST(CrdtTest, StateLoadKeepsUnsentEdits)
+{
+    CrdtServerTextEngine server;
+    server.readString("Hello");
+
+    CrdtTextEngine client;
+    ASSERT_TRUE(client.loadState(server.getDocumentState(), server.getDocumentVersion()));
+    EXPECT_EQ(client.getText(), "Hello");
+
+    // One edit reaches the server, the next is typed while disconnected
+    auto sent = typeLocal(client, 5, "!", "c1");
+    server.processIncomingOperation(roundTrip(*sent));
+    typeLocal(client, 0, ">> ", "c1");
+
+    // Someone else deletes meanwhile
+    CrdtTextEngine other;
+    ASSERT_TRUE(other.loadState(server.getDocumentState(), server.getDocumentVersion()));
+    auto remote = deleteLocal(other, 0, 1, "c2");
+    ASSERT_TRUE(server.processIncomingOperation(roundTrip(*remote)));
+
+    ASSERT_TRUE(client.loadState(server.getDocumentState(), server.getDocumentVersion()));
+    EXPECT_EQ(client.getText(), ">> ello!");
+    ASSERT_EQ(client.getUnacknowledgedOps().size(), 1);
+    EXPECT_EQ(client.getUnacknowledgedOps()[0]->type, OperationType::CRDT_INSERT);
+
+    std::string text;
+    CrdtSequence sequence;
+    EXPECT_FALSE(sequence.decode("1:@:1:0:0", text));
+}
+
+TEST(CrdtTest, ServerSequencesOnlyNewCrdtOperations)
+{
+    CrdtServerTextEngine server;
+    CrdtTextEngine client;
+
+    auto op = typeLocal(client, 0, "abc", "c1");
+    auto first = server.processIncomingOperation(roundTrip(*op));
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first->docVersion, 0);
+
+    EXPECT_FALSE(server.processIncomingOperation(roundTrip(*op)));
+    EXPECT_FALSE(server.processIncomingOperation(std::make_unique<InsertOperation>("x", 0, "c2")));
+    EXPECT_EQ(server.getDocumentVersion(), 1);
+    EXPECT_EQ(server.getText(), "abc");
+
+    // A replayed log rebuilds the same document
+    CrdtServerTextEngine recovered;
+    std::vector<const TextOperation*> history;
+    ASSERT_TRUE(server.getOperationsSince(0, history));
+    for (const TextOperation* sequenced : history)
+        recovered.applySequencedOperation(roundTrip(*sequenced));
+
+    EXPECT_EQ(recovered.getText(), "abc");
+    EXPECT_EQ(recovered.getDocumentVersion(), 1);
+}
+
+TEST(CrdtTest, RandomConcurrentEditsConverge)
+{
+    std::mt19937 random(1234);
+    const std::vector<std::string> clientIds = { "amy", "bo", "cy" };
+
+    CrdtServerTextEngine server;
+    server.readString("The quick brown fox");
+
+    std::vector<std::unique_ptr<CrdtTextEngine>> clients;
+    std::vector<std::deque<std::unique_ptr<TextOperation>>> toServer(clientIds.size());
+    std::vector<std::deque<std::string>> toClient(clientIds.size());
+    for (std::size_t c = 0; c < clientIds.size(); c++)
+    {
+        clients.push_back(std::make_unique<CrdtTextEngine>());
+        ASSERT_TRUE(clients.back()->loadState(server.getDocumentState(), server.getDocumentVersion()));
+    }
+
+    auto step = [&] (bool allowLocalEdits)
+    {
+        std::size_t c = random() % clients.size();
+        switch (random() % 3)
+        {
+            case 0:
+            {
+                if (!allowLocalEdits)
+                    break;
+
+                CrdtTextEngine& client = *clients[c];
+                std::size_t pos = random() % (client.getDocumentLength() + 1);
+                std::unique_ptr<TextOperation> op;
+                if (random() % 3 == 0 && pos < client.getDocumentLength())
+                    op = deleteLocal(client, pos, 1 + random() % 4, clientIds[c]);
+                else
+                    op = typeLocal(client, pos, std::string(1 + random() % 3, 'a' + random() % 26), clientIds[c]);
+
+                if (op)
+                    toServer[c].push_back(roundTrip(*op));
+                break;
+            }
+            case 1:
+            {
+                if (toServer[c].empty())
+                    break;
+
+                auto sequenced = server.processIncomingOperation(std::move(toServer[c].front()));
+                toServer[c].pop_front();
+                if (sequenced)
+                {
+                    for (auto& inbox : toClient)
+                        inbox.push_back(sequenced->serialize());
+                }
+                break;
+            }
+            case 2:
+            {
+                if (toClient[c].empty())
+                    break;
+
+                std::unique_ptr<Operation> parsed = Operation::deserialize(toClient[c].front());
+                auto op = std::unique_ptr<TextOperation>(static_cast<TextOperation*>(parsed.release()));
+                toClient[c].pop_front();
+                if (op->clientId == clientIds[c])
+                    clients[c]->acknowledge(op->operationId, op->docVersion);
+                else
+                    clients[c]->processIncomingOperation(std::move(op));
+                break;
+            }
+        }
+    };
+
+    for (int i = 0; i < 3000; i++)
+        step(true);
+
+    auto quiescent = [&]
+    {
+        for (std::size_t c = 0; c < clients.size(); c++)
+        {
+            if (!toServer[c].empty() || !toClient[c].empty())
+                return false;
+        }
+
+        return true;
+    };
+
+    while (!quiescent())
+        step(false);
+
+    for (std::size_t c = 0; c < clients.size(); c++)
+    {
+        EXPECT_EQ(clients[c]->getText(), server.getText()) << "client " << clientIds[c];
+        EXPECT_TRUE(clients[c]->getUnacknowledgedOps().empty());
+    }
+
+    EXPECT_EQ(server.getSequence().getVisibleLength(), server.getDocumentLength());
+}
+
+namespace
+{
+    /**
+     * Types into a CRDT server running on a fresh data directory, then starts another one on it.
+     * @param recovered Receives the document the second server recovered
+    */
+    void restartOnDataDirectory(const std::string& dataDirectory, uint64_t snapshotInterval, CrdtServerTextEngine& recovered)
+    {
+        std::filesystem::remove_all(dataDirectory);
+
+        ServerConfig config;
+        config.shardCount = 1;
+        config.reactorCount = 1;
+        config.dataDirectory = dataDirectory;
+        config.snapshotInterval = snapshotInterval;
+
+        {
+            Controller controller;
+            CrdtServerTextEngine engine;
+            controller.textEngine = &engine;
+            auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+            ASSERT_TRUE(server->isRunning());
+
+            int clientSocket = connectToServer(server->getPort());
+            ASSERT_NE(clientSocket, -1);
+            FrameReader reader;
+            ParsedMessage parsed;
+            ASSERT_TRUE(Framing::sendFrame(clientSocket, MessageParser::createConnectedMessage("c1", "", std::nullopt, WireProtocol::BINARY)));
+            ASSERT_TRUE(receiveUntil(clientSocket, reader, MessageType::INIT_CRDT, parsed));
+
+            // Confirmed only once its log committed
+            CrdtTextEngine client;
+            for (const auto& op : {typeLocal(client, 0, "Hello", "c1"), typeLocal(client, 5, " World", "c1"), deleteLocal(client, 0, 1, "c1")})
+            {
+                ASSERT_TRUE(Framing::sendFrame(clientSocket, op->serialize()));
+                do
+                {
+                    ASSERT_TRUE(receiveNext(clientSocket, reader, parsed));
+                } while (parsed.type != MessageType::ACK && parsed.type != MessageType::OPERATION);
+            }
+
+            close(clientSocket);
+            server.reset();
+        }
+
+        Controller controller;
+        controller.textEngine = &recovered;
+        auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+        ASSERT_TRUE(server->isRunning());
+    }
+}
+
+TEST(CrdtTest, ServerRecoversDocumentFromItsLog)
+{
+    const std::string dataDirectory = ::testing::TempDir() + "reped_crdt_log_" + std::to_string(getpid());
+    CrdtServerTextEngine recovered;
+    restartOnDataDirectory(dataDirectory, 0, recovered);
+
+    EXPECT_EQ(recovered.getText(), "ello World");
+    EXPECT_EQ(recovered.getDocumentVersion(), 3);
+    std::filesystem::remove_all(dataDirectory);
+}
+
+TEST(CrdtTest, ServerRecoversDocumentFromItsSnapshot)
+{
+    const std::string dataDirectory = ::testing::TempDir() + "reped_crdt_snapshot_" + std::to_string(getpid());
+    CrdtServerTextEngine recovered;
+    restartOnDataDirectory(dataDirectory, 2, recovered);
+
+    // The snapshot at version 2 replaced the segment before it, the last op is replayed onto it
+    EXPECT_FALSE(std::filesystem::exists(dataDirectory + "/default.0.oplog"));
+    EXPECT_TRUE(std::filesystem::exists(dataDirectory + "/default.snapshot"));
+    EXPECT_EQ(recovered.getText(), "ello World");
+    EXPECT_EQ(recovered.getDocumentVersion(), 3);
+
+    // Its sequence came back too, so ops made against the characters it holds still integrate
+    CrdtTextEngine client;
+    ASSERT_TRUE(client.loadState(recovered.getDocumentState(), recovered.getDocumentVersion()));
+    auto op = typeLocal(client, 4, ",", "c2");
+    ASSERT_TRUE(recovered.processIncomingOperation(roundTrip(*op)));
+    EXPECT_EQ(recovered.getText(), "ello, World");
+    std::filesystem::remove_all(dataDirectory);
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+#include "document_stream.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "piece_table.h"
+
+namespace
+{
+    PieceTable makeDocument()
+    {
+        // Several pieces in both buffers, longer than a few chunks
+        PieceTable table;
+        table.readString(std::string(150000, 'o'));
+        table.insert(std::string(70000, 'a'), 1000);
+        table.insert("middle", 100000);
+        table.insert(std::string(30000, 'b'), table.getDocumentLength());
+        return table;
+    }
+
+    /**
+     * Streams the document to the client side of a socketpair, with an op queued behind it.
+     * @returns The frames the client received
+    */
+    std::vector<std::string> streamDocument(const PieceTable& table, bool compress)
+    {
+        int sockets[2];
+        EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+        int bufferSize = 16384;
+        setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+        fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK);
+        fcntl(sockets[1], F_SETFL, fcntl(sockets[1], F_GETFL) | O_NONBLOCK);
+
+        Connection connection(sockets[0], 1024 * 1024);
+        EXPECT_TRUE(connection.send(std::make_shared<DocumentStream>(table.getView(), 7, compress)));
+        EXPECT_TRUE(connection.send(Framing::makeSharedFrame("after")));
+
+        // Only what the socket takes is produced, not the whole document
+        EXPECT_LT(connection.getQueuedBytes(), 2 * DocumentStream::chunkSize);
+
+        FrameReader reader;
+        std::vector<std::string> frames;
+        while (frames.empty() || frames.back() != "after")
+        {
+            std::size_t space = 0;
+            char* buffer = reader.prepareReceive(space);
+            ssize_t length = recv(sockets[1], buffer, space, 0);
+            if (length > 0)
+            {
+                reader.commitReceive(static_cast<std::size_t>(length));
+                std::string_view frame;
+                while (reader.nextFrame(frame))
+                    frames.emplace_back(frame);
+            }
+            else if (!connection.flush())
+            {
+                ADD_FAILURE() << "Connection failed";
+                break;
+            }
+        }
+
+        EXPECT_EQ(connection.getQueuedBytes(), 0u);
+        close(sockets[1]);
+        return frames;
+    }
+}
+
+TEST(DocumentStreamTest, DocumentArrivesInChunksBeforeLaterFrames)
+{
+    PieceTable table = makeDocument();
+
+    for (bool compress : {false, true})
+    {
+        std::vector<std::string> frames = streamDocument(table, compress);
+        ASSERT_GE(frames.size(), 3u);
+
+        uint64_t docVersion = 0;
+        uint64_t length = 0;
+        ASSERT_TRUE(MessageParser::parseInitBeginMessage(frames.front(), docVersion, length));
+        EXPECT_EQ(docVersion, 7u);
+        EXPECT_EQ(length, table.getDocumentLength());
+
+        PieceTable received;
+        received.reset(length);
+        for (std::size_t i = 1; i + 1 < frames.size(); i++)
+        {
+            ASSERT_EQ(MessageParser::parseMessage(frames[i]).type, MessageType::INIT_CHUNK);
+            std::string_view text = MessageParser::getInitChunkText(frames[i]);
+            EXPECT_LE(text.size(), DocumentStream::chunkSize);
+            received.append(text);
+        }
+
+        EXPECT_EQ(received.getText(), table.getText());
+        EXPECT_EQ(frames.back(), "after");
+    }
+}
+
+TEST(DocumentStreamTest, EmptyDocumentIsOnlyTheBeginMessage)
+{
+    std::vector<std::string> frames = streamDocument(PieceTable(), false);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames.front(), MessageParser::createInitBeginMessage(7, 0));
+    EXPECT_EQ(frames.back(), "after");
+}
+
+TEST(DocumentStreamTest, AppendedChunksStayOnePiece)
+{
+    PieceTable table;
+    table.reset(12);
+    table.append("hello ");
+    table.append("");
+    table.append("world!");
+
+    EXPECT_EQ(table.getText(), "hello world!");
+    EXPECT_EQ(table.getView().pieces.size(), 1u);
+
+    // An edit in between starts a new piece for the next append
+    table.insert(">", 0);
+    table.append("?");
+    EXPECT_EQ(table.getText(), ">hello world!?");
+    EXPECT_EQ(table.getDocumentLength(), 14u);
+}
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <unistd.h>
+
+#include "server.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+#include "test_client.h"
+
+namespace
+{
+    /**
+     * @returns The socket once the document arrived, -1 if the server did not send it
+    */
+    int open(uint16_t port, const std::string& documentName, FrameReader& reader, ParsedMessage& parsed)
+    {
+        int clientSocket = connectToServer(port);
+        if (clientSocket == -1)
+            return -1;
+
+        if (Framing::sendFrame(clientSocket, MessageParser::createConnectedMessage("c1", documentName, std::nullopt, WireProtocol::BINARY)) &&
+            receiveUntil(clientSocket, reader, MessageType::INIT_DOCUMENT, parsed))
+        {
+            return clientSocket;
+        }
+
+        close(clientSocket);
+        return -1;
+    }
+}
+
+TEST(DocumentsTest, InvalidNamesAndDocumentsPastTheLimitAreRefused)
+{
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+
+    // The default document and one more
+    ServerConfig config;
+    config.shardCount = 1;
+    config.reactorCount = 1;
+    config.maxDocuments = 2;
+    auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+    ASSERT_TRUE(server->isRunning());
+
+    FrameReader reader;
+    ParsedMessage parsed;
+    int notesSocket = open(server->getPort(), "notes", reader, parsed);
+    ASSERT_NE(notesSocket, -1);
+
+    for (const std::string& documentName : {std::string("../notes"), std::string(".hidden"), std::string(200, 'a'), std::string("more")})
+    {
+        FrameReader refusedReader;
+        EXPECT_EQ(open(server->getPort(), documentName, refusedReader, parsed), -1) << documentName;
+    }
+
+    EXPECT_EQ(server->getDocumentCount(), 2);
+
+    close(notesSocket);
+    server.reset();
+}
+
+TEST(DocumentsTest, DocumentIsUnloadedOnceItsLastClientLeaves)
+{
+    const std::string dataDirectory = ::testing::TempDir() + "reped_unload_" + std::to_string(getpid());
+    std::filesystem::remove_all(dataDirectory);
+
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+
+    ServerConfig config;
+    config.shardCount = 1;
+    config.reactorCount = 1;
+    config.dataDirectory = dataDirectory;
+    auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+    ASSERT_TRUE(server->isRunning());
+
+    FrameReader reader;
+    ParsedMessage parsed;
+    int clientSocket = open(server->getPort(), "notes", reader, parsed);
+    ASSERT_NE(clientSocket, -1);
+    EXPECT_EQ(server->getDocumentCount(), 2);
+
+    // Made on the version it was sent, so it comes back whole once it is committed
+    InsertOperation insert("Hello", 0, "c1");
+    ASSERT_TRUE(Framing::sendFrame(clientSocket, insert.serialize()));
+    ASSERT_TRUE(receiveUntil(clientSocket, reader, MessageType::OPERATION, parsed));
+    close(clientSocket);
+
+    for (int i = 0; i < 100 && server->getDocumentCount() > 1; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(server->getDocumentCount(), 1);
+
+    // Opened again from its log
+    FrameReader reopenedReader;
+    clientSocket = open(server->getPort(), "notes", reopenedReader, parsed);
+    ASSERT_NE(clientSocket, -1);
+    uint64_t docVersion = 0;
+    std::string text;
+    ASSERT_TRUE(MessageParser::parseInitDocumentMessage(parsed.content, docVersion, text));
+    EXPECT_EQ(docVersion, 1);
+    EXPECT_EQ(text, "Hello");
+
+    close(clientSocket);
+    server.reset();
+    std::filesystem::remove_all(dataDirectory);
+}
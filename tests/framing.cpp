@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "framing.h"
+
+namespace
+{
+    /**
+     * Copies bytes into the reader in chunks of at most chunkSize, like a series of recv() calls.
+     * @returns Every frame that completed
+    */
+    std::vector<std::string> feed(FrameReader& reader, std::string_view bytes, std::size_t chunkSize)
+    {
+        std::vector<std::string> frames;
+        while (!bytes.empty())
+        {
+            std::size_t space = 0;
+            char* target = reader.prepareReceive(space);
+            std::size_t length = std::min({space, chunkSize, bytes.size()});
+            memcpy(target, bytes.data(), length);
+            reader.commitReceive(length);
+            bytes.remove_prefix(length);
+
+            std::string_view frame;
+            while (reader.nextFrame(frame))
+                frames.emplace_back(frame);
+        }
+
+        return frames;
+    }
+}
+
+TEST(FramingTest, ReadsManyFramesFromOneChunk)
+{
+    std::vector<std::string> messages = {"INSERT:a:1:0:0:x", "", "DELETE:b:1:0:3:2", "PRESENCE:c:4:1:1"};
+    std::string stream;
+    for (const std::string& message : messages)
+        Framing::appendFrame(stream, message);
+
+    FrameReader reader;
+    EXPECT_EQ(feed(reader, stream, stream.size()), messages);
+}
+
+TEST(FramingTest, ReassemblesFramesSplitAtEveryByte)
+{
+    std::vector<std::string> messages = {"INIT_DOCUMENT:3:line one\nline two", "INSERT:a:1:3:0:with:colons:"};
+    std::string stream;
+    for (const std::string& message : messages)
+        Framing::appendFrame(stream, message);
+
+    FrameReader reader;
+    EXPECT_EQ(feed(reader, stream, 1), messages);
+}
+
+TEST(FramingTest, GrowsForLargeFramesAndShrinksWhenDrained)
+{
+    std::string large(3 * 1024 * 1024, 'x');
+    large[12345] = '\0';
+    std::string stream;
+    Framing::appendFrame(stream, large);
+    Framing::appendFrame(stream, "small");
+
+    FrameReader reader;
+    std::vector<std::string> frames = feed(reader, stream, 64 * 1024);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0], large);
+    EXPECT_EQ(frames[1], "small");
+
+    // The next read gives the large buffer back
+    std::size_t space = 0;
+    reader.prepareReceive(space);
+    EXPECT_EQ(reader.getCapacity(), FrameReader::initialCapacity);
+}
+
+TEST(FramingTest, GrowsOnlyAsTheFrameArrives)
+{
+    std::string large(8 * 1024 * 1024, 'x');
+    std::string stream;
+    Framing::appendFrame(stream, large);
+
+    // A header that claims a large frame is not room for it yet
+    FrameReader reader;
+    EXPECT_TRUE(feed(reader, std::string_view(stream).substr(0, Framing::headerSize + 100), 4096).empty());
+    std::size_t space = 0;
+    reader.prepareReceive(space);
+    EXPECT_EQ(reader.getCapacity(), FrameReader::initialCapacity);
+
+    std::vector<std::string> frames = feed(reader, std::string_view(stream).substr(Framing::headerSize + 100), 64 * 1024);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0], large);
+}
+
+TEST(FramingTest, RejectsOversizedFrameHeader)
+{
+    const char header[] = {'\x7f', '\xff', '\xff', '\xff', 'a', 'b'};
+
+    FrameReader reader;
+    EXPECT_TRUE(feed(reader, std::string_view(header, sizeof(header)), sizeof(header)).empty());
+    EXPECT_TRUE(reader.isCorrupt());
+
+    reader.reset();
+    EXPECT_FALSE(reader.isCorrupt());
+}
+
+TEST(FramingTest, SendsFramesOverSocket)
+{
+    int sockets[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+    // Larger than the socket buffer, so sendFrame has to write it in pieces while the reader drains
+    std::string large(2 * 1024 * 1024, 'y');
+    std::thread sender([&]
+    {
+        EXPECT_TRUE(Framing::sendFrame(sockets[0], "hello"));
+        EXPECT_TRUE(Framing::sendFrame(sockets[0], large));
+        close(sockets[0]);
+    });
+
+    FrameReader reader;
+    std::vector<std::string> frames;
+    while (true)
+    {
+        std::size_t space = 0;
+        char* target = reader.prepareReceive(space);
+        ssize_t received = recv(sockets[1], target, space, 0);
+        if (received <= 0)
+            break;
+
+        reader.commitReceive(static_cast<std::size_t>(received));
+        std::string_view frame;
+        while (reader.nextFrame(frame))
+            frames.emplace_back(frame);
+    }
+
+    sender.join();
+    close(sockets[1]);
+
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0], "hello");
+    EXPECT_EQ(frames[1], large);
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "client_text_engine.h"
+#include "operations.h"
+
+namespace
+{
+    void addLocalInsert(ClientTextEngine& client, const std::string& text, std::size_t pos)
+    {
+        auto local = std::make_unique<InsertOperation>(text, pos, "c1");
+        client.insertLocal(local.get());
+        client.addPendingLocalOp(std::make_unique<InsertOperation>(*local));
+    }
+
+    /**
+     * Remote ops as the server sequenced them from version 10 on: typing runs, backspaces and jumps.
+    */
+    std::vector<std::unique_ptr<TextOperation>> makeRemoteOps(std::mt19937& random, std::size_t documentLength)
+    {
+        std::vector<std::unique_ptr<TextOperation>> ops;
+        std::size_t pos = random() % (documentLength + 1);
+        for (uint64_t version = 10; version < 60; version++)
+        {
+            std::unique_ptr<TextOperation> op;
+            if (random() % 4 == 0 && pos > 0)
+            {
+                op = std::make_unique<DeleteOperation>(pos - 1, 1, "c2");
+                pos--;
+                documentLength--;
+            }
+            else
+            {
+                if (random() % 8 == 0)
+                    pos = random() % (documentLength + 1);
+
+                op = std::make_unique<InsertOperation>(std::string(1, static_cast<char>('a' + random() % 26)), pos, "c2");
+                pos++;
+                documentLength++;
+            }
+
+            op->docVersion = version;
+            ops.push_back(std::move(op));
+        }
+
+        return ops;
+    }
+}
+
+TEST(IncomingBatchTest, BatchMatchesOpsAppliedOneAtATime)
+{
+    for (unsigned seed = 0; seed < 20; seed++)
+    {
+        ClientTextEngine single;
+        ClientTextEngine batched;
+        for (ClientTextEngine* client : {&single, &batched})
+        {
+            client->readString("The quick brown fox");
+            client->resetToServerVersion(10);
+            addLocalInsert(*client, "[one]", 4);
+            addLocalInsert(*client, "[two]", 15);
+        }
+
+        // The same ops for both, from the same seed
+        std::mt19937 singleRandom(seed);
+        for (auto& op : makeRemoteOps(singleRandom, 19))
+            single.processIncomingOperation(std::move(op));
+
+        std::mt19937 batchedRandom(seed);
+        batched.processIncomingOperations(makeRemoteOps(batchedRandom, 19));
+
+        EXPECT_EQ(batched.getText(), single.getText()) << "seed " << seed;
+        EXPECT_EQ(batched.getServerVersion(), single.getServerVersion());
+        EXPECT_EQ(batched.getDocumentVersion(), single.getDocumentVersion());
+        ASSERT_EQ(batched.getPendingLocalOps().size(), single.getPendingLocalOps().size());
+        for (std::size_t i = 0; i < single.getPendingLocalOps().size(); i++)
+        {
+            EXPECT_EQ(batched.getPendingLocalOps()[i]->type, single.getPendingLocalOps()[i]->type);
+            EXPECT_EQ(batched.getPendingLocalOps()[i]->pos, single.getPendingLocalOps()[i]->pos);
+        }
+    }
+}
+
+TEST(IncomingBatchTest, TypingBurstIsAppliedAsOneEdit)
+{
+    ClientTextEngine client;
+    client.readString("Hello");
+    client.resetToServerVersion(0);
+
+    std::vector<std::unique_ptr<TextOperation>> ops;
+    const std::string typed = " world, typed fast";
+    for (std::size_t i = 0; i < typed.size(); i++)
+    {
+        auto op = std::make_unique<InsertOperation>(typed.substr(i, 1), 5 + i, "c2");
+        op->docVersion = i;
+        ops.push_back(std::move(op));
+    }
+
+    const uint64_t revision = client.getEditRevision();
+    client.processIncomingOperations(std::move(ops));
+
+    EXPECT_EQ(client.getText(), "Hello world, typed fast");
+    EXPECT_EQ(client.getEditRevision(), revision + 1);
+    EXPECT_EQ(client.getServerVersion(), typed.size());
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.h"
+
+TEST(LatencyHistogramTest, BucketsHoldTheirValues)
+{
+    for (uint64_t value : {uint64_t(0), uint64_t(31), uint64_t(32), uint64_t(33), uint64_t(1000), uint64_t(123456789),
+                           LatencyHistogram::maxValue})
+    {
+        std::size_t index = LatencyHistogram::getBucketIndex(value);
+        EXPECT_GE(LatencyHistogram::getBucketLimit(index), value);
+        if (index > 0)
+        {
+            EXPECT_LT(LatencyHistogram::getBucketLimit(index - 1), value);
+        }
+    }
+
+    // Buckets stay within a sub-bucket's share of their values
+    for (uint64_t value = 32; value < (uint64_t(1) << 30); value = value * 3 / 2)
+    {
+        uint64_t limit = LatencyHistogram::getBucketLimit(LatencyHistogram::getBucketIndex(value));
+        EXPECT_LE(limit - value, value / LatencyHistogram::subBucketCount) << value;
+    }
+
+    EXPECT_EQ(LatencyHistogram::getBucketIndex(UINT64_MAX), LatencyHistogram::getBucketIndex(LatencyHistogram::maxValue));
+}
+
+TEST(LatencyHistogramTest, ReportsPercentiles)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.getPercentile(50), 0u);
+
+    for (uint64_t value = 1; value <= 10000; value++)
+        histogram.record(value);
+
+    LatencySummary summary = histogram.getSummary();
+    EXPECT_EQ(summary.count, 10000u);
+    EXPECT_EQ(summary.max, 10000u);
+    EXPECT_NEAR(static_cast<double>(summary.p50), 5000, 5000 / 32.0);
+    EXPECT_NEAR(static_cast<double>(summary.p90), 9000, 9000 / 32.0);
+    EXPECT_NEAR(static_cast<double>(summary.p99), 9900, 9900 / 32.0);
+    EXPECT_EQ(histogram.getPercentile(100), 10000u);
+    EXPECT_EQ(histogram.getPercentile(0), 1u);
+
+    // A single outlier moves the maximum, not the median
+    histogram.record(60 * 1000 * 1000);
+    EXPECT_EQ(histogram.getMax(), 60u * 1000 * 1000);
+    EXPECT_NEAR(static_cast<double>(histogram.getPercentile(50)), 5000, 5000 / 32.0);
+}
+
+TEST(LatencyHistogramTest, RecordsFromManyThreads)
+{
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&histogram]
+        {
+            for (uint64_t i = 0; i < 10000; i++)
+                histogram.record(i % 100);
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(histogram.getCount(), 40000u);
+    EXPECT_EQ(histogram.getMax(), 99u);
+    EXPECT_EQ(histogram.getPercentile(50), 49u);
+}
+
+TEST(LatencyHistogramTest, AppendsPrometheusSummary)
+{
+    LatencyHistogram histogram;
+    histogram.record(10);
+    histogram.record(20);
+
+    std::string metrics;
+    histogram.appendMetrics(metrics, "rtt_microseconds");
+    EXPECT_NE(metrics.find("# TYPE rtt_microseconds summary\n"), std::string::npos);
+    EXPECT_NE(metrics.find("rtt_microseconds{quantile=\"0.5\"} 10\n"), std::string::npos);
+    EXPECT_NE(metrics.find("rtt_microseconds{quantile=\"0.99\"} 20\n"), std::string::npos);
+    EXPECT_NE(metrics.find("rtt_microseconds_sum 30\n"), std::string::npos);
+    EXPECT_NE(metrics.find("rtt_microseconds_count 2\n"), std::string::npos);
+}
+
+TEST(LatencyHistogramTest, AddsOtherHistograms)
+{
+    LatencyHistogram fast;
+    LatencyHistogram slow;
+    for (uint64_t i = 1; i <= 90; i++)
+        fast.record(i);
+
+    for (uint64_t i = 0; i < 10; i++)
+        slow.record(5000);
+
+    LatencyHistogram total;
+    total.add(fast);
+    total.add(slow);
+
+    EXPECT_EQ(total.getCount(), 100u);
+    EXPECT_EQ(total.getMax(), 5000u);
+    EXPECT_EQ(total.getPercentile(50), 50u);
+    EXPECT_EQ(total.getPercentile(99), 5000u);
+}
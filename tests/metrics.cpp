@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+#include "metrics_endpoint.h"
+#include "server.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+#include "test_client.h"
+
+namespace
+{
+    /**
+     * Sends one request to the endpoint at a Unix domain socket.
+     * @returns The whole response, empty if the endpoint could not be reached
+    */
+    std::string request(const std::string& path, const std::string& requestLine)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.data(), path.size());
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            close(fd);
+            return {};
+        }
+
+        const std::string bytes = requestLine + "\r\nHost: localhost\r\n\r\n";
+        if (send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(bytes.size()))
+        {
+            close(fd);
+            return {};
+        }
+
+        std::string response;
+        char buffer[4096];
+        ssize_t received;
+        while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+            response.append(buffer, static_cast<std::size_t>(received));
+
+        close(fd);
+        return response;
+    }
+}
+
+TEST(MetricsTest, CounterAddsUpEveryThread)
+{
+    Counter counter;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++)
+    {
+        threads.emplace_back([&counter]
+        {
+            for (int j = 0; j < 100000; j++)
+                counter.add();
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    counter.add(5);
+    EXPECT_EQ(counter.getValue(), 800005u);
+}
+
+TEST(MetricsTest, LookupsReturnTheSameMetric)
+{
+    MetricsRegistry registry;
+    Counter& counter = registry.getCounter("test_total", "Test");
+    EXPECT_EQ(&registry.getCounter("test_total", "Other help"), &counter);
+    EXPECT_NE(&registry.getCounter("test_total", "Test", "shard=\"1\""), &counter);
+
+    // A name registered as a counter cannot become a gauge
+    Gauge& gauge = registry.getGauge("test_total", "Test");
+    gauge.set(7);
+
+    std::string text;
+    registry.appendText(text);
+    EXPECT_EQ(text.find("test_total 7"), std::string::npos);
+}
+
+TEST(MetricsTest, FormatsLabels)
+{
+    EXPECT_EQ(MetricsRegistry::formatLabel("document", "notes"), "document=\"notes\"");
+    EXPECT_EQ(MetricsRegistry::formatLabel("document", "a\"b\\c\nd"), "document=\"a\\\"b\\\\c\\nd\"");
+}
+
+TEST(MetricsTest, WritesTheTextFormat)
+{
+    MetricsRegistry registry;
+    registry.getCounter("test_requests_total", "Requests served").add(3);
+    registry.getCounter("test_requests_total", "Requests served", "shard=\"1\"").add(4);
+    registry.getGauge("test_depth", "Queue depth").set(-2);
+
+    LatencyHistogram& histogram = registry.getHistogram("test_nanoseconds", "Time taken", "document=\"notes\"");
+    for (uint64_t value = 1; value <= 100; value++)
+        histogram.record(value);
+
+    const uint64_t collector = registry.addCollector([] (std::string& out)
+    {
+        out += "test_collected 1\n";
+    });
+
+    std::string text;
+    registry.appendText(text);
+    EXPECT_NE(text.find("# HELP test_requests_total Requests served\n# TYPE test_requests_total counter\n"
+                        "test_requests_total 3\ntest_requests_total{shard=\"1\"} 4\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("# TYPE test_depth gauge\ntest_depth -2\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("# TYPE test_nanoseconds summary\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("test_nanoseconds{document=\"notes\",quantile=\"0.5\"} 50\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("test_nanoseconds_sum{document=\"notes\"} 5050\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("test_nanoseconds_count{document=\"notes\"} 100\n"), std::string::npos) << text;
+    EXPECT_EQ(text.substr(text.size() - 17), "test_collected 1\n");
+
+    registry.removeCollector(collector);
+    text.clear();
+    registry.appendText(text);
+    EXPECT_EQ(text.find("test_collected"), std::string::npos);
+}
+
+TEST(MetricsTest, EndpointServesScrapes)
+{
+    MetricsRegistry registry;
+    registry.getCounter("test_scrapes_total", "Scrapes").add(42);
+
+    const std::string path = "/tmp/reped_metrics_test_" + std::to_string(getpid()) + ".sock";
+    MetricsEndpoint endpoint(registry);
+    ASSERT_TRUE(endpoint.start(0, path));
+
+    std::string response = request(path, "GET /metrics HTTP/1.1");
+    EXPECT_EQ(response.compare(0, 15, "HTTP/1.1 200 OK"), 0) << response;
+    EXPECT_NE(response.find("Content-Type: text/plain; version=0.0.4"), std::string::npos);
+    EXPECT_NE(response.find("\r\n\r\n# HELP test_scrapes_total Scrapes\n"), std::string::npos);
+    EXPECT_NE(response.find("test_scrapes_total 42\n"), std::string::npos);
+
+    response = request(path, "GET /other HTTP/1.1");
+    EXPECT_EQ(response.compare(0, 22, "HTTP/1.1 404 Not Found"), 0) << response;
+
+    endpoint.stop();
+    EXPECT_NE(access(path.c_str(), F_OK), 0);
+}
+
+TEST(MetricsTest, DocumentsPastTheLimitShareOneSeries)
+{
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+
+    // The default document and the first one a client opens get series of their own
+    ServerConfig config;
+    config.shardCount = 1;
+    config.reactorCount = 1;
+    config.documentMetricsLimit = 2;
+    auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+    ASSERT_TRUE(server->isRunning());
+
+    Gauge& overflowVersion = MetricsRegistry::global().getGauge("reped_document_version", "", "overflow=\"true\"");
+    const int64_t overflowVersionBefore = overflowVersion.getValue();
+
+    std::vector<int> sockets;
+    for (const char* documentName : {"limited_a", "limited_b", "limited_c"})
+    {
+        int clientSocket = connectToServer(server->getPort());
+        ASSERT_NE(clientSocket, -1);
+        sockets.push_back(clientSocket);
+
+        FrameReader reader;
+        ParsedMessage parsed;
+        ASSERT_TRUE(Framing::sendFrame(clientSocket, MessageParser::createConnectedMessage("c", documentName, std::nullopt, WireProtocol::BINARY)));
+        ASSERT_TRUE(receiveUntil(clientSocket, reader, MessageType::INIT_DOCUMENT, parsed));
+    }
+
+    // One op in the second document and two in the third add up in the shared series
+    for (uint64_t i = 0; i < 3; i++)
+    {
+        InsertOperation insert("x", 0, "c");
+        insert.docVersion = i == 0 ? 0 : i - 1;
+        ASSERT_TRUE(Framing::sendFrame(sockets[i == 0 ? 1 : 2], insert.serialize()));
+    }
+
+    for (int i = 0; i < 100 && overflowVersion.getValue() < overflowVersionBefore + 3; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(overflowVersion.getValue(), overflowVersionBefore + 3);
+
+    std::string text;
+    MetricsRegistry::global().appendText(text);
+    EXPECT_NE(text.find("reped_document_version{document=\"limited_a\"}"), std::string::npos);
+    EXPECT_EQ(text.find("limited_b"), std::string::npos);
+    EXPECT_EQ(text.find("limited_c"), std::string::npos);
+
+    for (int clientSocket : sockets)
+        close(clientSocket);
+
+    server.reset();
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <csignal>
+#include <fstream>
+#include <vector>
+#include <sys/resource.h>
+
+#include "op_log.h"
+#include "checksum.h"
+#include "server_text_engine.h"
+
+class OpLogTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // Named after the test, so tests run in parallel each get their own
+        logPath = ::testing::TempDir() + "reped_op_log_test_" +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".oplog";
+        std::remove(logPath.c_str());
+    }
+
+    void TearDown() override {
+        std::remove(logPath.c_str());
+    }
+
+    std::vector<std::unique_ptr<TextOperation>> replayAll()
+    {
+        std::vector<std::unique_ptr<TextOperation>> ops;
+        OpLog::replay(logPath, [&ops] (std::unique_ptr<TextOperation> op) { ops.push_back(std::move(op)); });
+        return ops;
+    }
+
+    std::string logPath;
+};
+
+TEST(ChecksumTest, MatchesKnownCrc32)
+{
+    EXPECT_EQ(crc32("123456789", 9), 0xCBF43926u);
+}
+
+TEST_F(OpLogTest, ReplaysCommittedRecordsInOrder)
+{
+    {
+        OpLog log(logPath, std::chrono::microseconds(0));
+        ASSERT_TRUE(log.open());
+
+        auto insert = std::make_unique<InsertOperation>("Hello: World", 0, "c1");
+        insert->docVersion = 0;
+        auto remove = std::make_unique<DeleteOperation>(5, 1, "c2");
+        remove->docVersion = 1;
+
+        log.append(*insert);
+        log.append(*remove);
+        EXPECT_TRUE(log.hasPendingRecords());
+        EXPECT_TRUE(log.commit());
+        EXPECT_FALSE(log.hasPendingRecords());
+        EXPECT_EQ(log.getStats().commits, 1);
+        EXPECT_EQ(log.getStats().recordsCommitted, 2);
+    }
+
+    auto ops = replayAll();
+    ASSERT_EQ(ops.size(), 2);
+    EXPECT_EQ(ops[0]->type, OperationType::INSERT);
+    EXPECT_EQ(static_cast<InsertOperation*>(ops[0].get())->text, "Hello: World");
+    EXPECT_EQ(ops[1]->type, OperationType::DELETE);
+    EXPECT_EQ(ops[1]->docVersion, 1);
+}
+
+TEST_F(OpLogTest, RecoversEngineState)
+{
+    {
+        OpLog log(logPath, std::chrono::microseconds(0));
+        ASSERT_TRUE(log.open());
+
+        ServerTextEngine engine;
+        auto first = engine.processIncomingOperation(std::make_unique<InsertOperation>("Hello World", 0, "c1"));
+        log.append(*first);
+        auto deleteOp = std::make_unique<DeleteOperation>(5, 6, "c1");
+        deleteOp->docVersion = engine.getDocumentVersion();
+        auto second = engine.processIncomingOperation(std::move(deleteOp));
+        log.append(*second);
+        ASSERT_TRUE(log.commit());
+    }
+
+    ServerTextEngine recovered;
+    OpLog::replay(logPath, [&recovered] (std::unique_ptr<TextOperation> op) { recovered.applySequencedOperation(std::move(op)); });
+
+    EXPECT_EQ(recovered.getText(), "Hello");
+}
+
+TEST_F(OpLogTest, StopsAtTornTailAndTruncatesIt)
+{
+    {
+        OpLog log(logPath, std::chrono::microseconds(0));
+        ASSERT_TRUE(log.open());
+        log.append(InsertOperation("a", 0, "c1"));
+        log.append(InsertOperation("b", 1, "c1"));
+        ASSERT_TRUE(log.commit());
+    }
+
+    // Simulate a crash in the middle of writing a record
+    {
+        std::ofstream out(logPath, std::ios::binary | std::ios::app);
+        const char partialRecord[] = { 40, 0, 0, 0, 1, 2 };
+        out.write(partialRecord, sizeof(partialRecord));
+    }
+
+    EXPECT_EQ(replayAll().size(), 2);
+
+    // The torn record is gone, so new appends are readable again
+    {
+        OpLog log(logPath, std::chrono::microseconds(0));
+        ASSERT_TRUE(log.open());
+        log.append(InsertOperation("c", 2, "c1"));
+        ASSERT_TRUE(log.commit());
+    }
+
+    EXPECT_EQ(replayAll().size(), 3);
+}
+
+TEST_F(OpLogTest, StopsAtCorruptRecord)
+{
+    {
+        OpLog log(logPath, std::chrono::microseconds(0));
+        ASSERT_TRUE(log.open());
+        log.append(InsertOperation("a", 0, "c1"));
+        log.append(InsertOperation("b", 1, "c1"));
+        ASSERT_TRUE(log.commit());
+    }
+
+    // Flip the last payload byte of the second record
+    {
+        std::fstream file(logPath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(-1, std::ios::end);
+        file.put('z');
+    }
+
+    EXPECT_EQ(replayAll().size(), 1);
+}
+
+TEST_F(OpLogTest, GroupCommitDeadlineFollowsOldestPendingRecord)
+{
+    OpLog log(logPath, std::chrono::milliseconds(5));
+    ASSERT_TRUE(log.open());
+
+    auto before = std::chrono::steady_clock::now();
+    log.append(InsertOperation("a", 0, "c1"));
+    auto deadline = log.getCommitDeadline();
+    log.append(InsertOperation("b", 1, "c1"));
+
+    EXPECT_GE(deadline, before + std::chrono::milliseconds(5));
+    EXPECT_EQ(log.getCommitDeadline(), deadline);
+
+    ASSERT_TRUE(log.commit());
+    EXPECT_EQ(log.getStats().commits, 1);
+    EXPECT_EQ(log.getStats().recordsCommitted, 2);
+}
+
+TEST_F(OpLogTest, FailedCommitDoesNotLeaveRecordsToBeReplayedTwice)
+{
+    OpLog log(logPath, std::chrono::microseconds(0));
+    ASSERT_TRUE(log.open());
+    log.append(InsertOperation("a", 0, "c1"));
+    ASSERT_TRUE(log.commit());
+
+    // The file size limit stops the commit after part of its records reached the file
+    std::ifstream committed(logPath, std::ios::binary | std::ios::ate);
+    const rlim_t committedSize = static_cast<rlim_t>(committed.tellg());
+    struct rlimit original;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &original), 0);
+    auto previousHandler = std::signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limited = original;
+    limited.rlim_cur = committedSize + 30;
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limited), 0);
+
+    for (uint64_t i = 1; i <= 3; i++)
+    {
+        InsertOperation insert("b", 0, "c1");
+        insert.docVersion = i;
+        log.append(insert);
+    }
+
+    EXPECT_FALSE(log.commit());
+    EXPECT_TRUE(log.hasPendingRecords());
+
+    setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, previousHandler);
+
+    ASSERT_TRUE(log.commit());
+    auto ops = replayAll();
+    ASSERT_EQ(ops.size(), 4);
+    for (uint64_t i = 0; i < ops.size(); i++)
+        EXPECT_EQ(ops[i]->docVersion, i);
+}
@@ -227,3 +227,47 @@ TEST_F(OperationTransformationTest, ConvergenceProperty)
     // Results should be identical
     EXPECT_EQ(engine1.getText(), engine2.getText());
 }
+
+TEST_F(OperationTransformationTest, InsertInsideConcurrentDeleteConverges)
+{
+    // Document: "Hello World"
+    // c1 deletes "lo Wo" (pos 3, length 5)
+    // c2 inserts "XY" at pos 5, inside that range
+    auto c1Op = std::make_unique<DeleteOperation>(3, 5, "c1");
+    auto c2Op = std::make_unique<InsertOperation>("XY", 5, "c2");
+
+    TextEngine deleteFirst;
+    deleteFirst.readString("Hello World");
+    deleteFirst.deleteIncoming(c1Op.get());
+    auto transformedInsert = deleteFirst.transform(c2Op.get(), c1Op.get());
+    deleteFirst.insertIncoming(static_cast<InsertOperation*>(transformedInsert.get()));
+
+    TextEngine insertFirst;
+    insertFirst.readString("Hello World");
+    insertFirst.insertIncoming(c2Op.get());
+    auto transformedDelete = insertFirst.transform(c1Op.get(), c2Op.get());
+    insertFirst.deleteIncoming(static_cast<DeleteOperation*>(transformedDelete.get()));
+
+    EXPECT_EQ(deleteFirst.getText(), "Helrld");
+    EXPECT_EQ(insertFirst.getText(), deleteFirst.getText());
+}
+
+TEST_F(OperationTransformationTest, DeleteAroundConcurrentDeleteKeepsBothEnds)
+{
+    // Document: "Hello World"
+    // c1 deletes "llo Wor" (pos 2, length 7)
+    // c2 deletes "o W" (pos 4, length 3), inside c1's range
+    auto c1Op = std::make_unique<DeleteOperation>(2, 7, "c1");
+    auto c2Op = std::make_unique<DeleteOperation>(4, 3, "c2");
+
+    auto transformed = textEngine.transform(c1Op.get(), c2Op.get());
+    ASSERT_NE(transformed, nullptr);
+    EXPECT_EQ(transformed->pos, 2);
+    EXPECT_EQ(transformed->length, 4);
+
+    // The other way around nothing is left to delete
+    auto swallowed = textEngine.transform(c2Op.get(), c1Op.get());
+    ASSERT_NE(swallowed, nullptr);
+    EXPECT_EQ(swallowed->pos, 2);
+    EXPECT_EQ(swallowed->length, 0);
+}
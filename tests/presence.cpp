@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "message_parser.h"
+#include "sequencer.h"
+#include "server_document.h"
+#include "client_text_engine.h"
+
+TEST(PresenceTest, PositionsFollowEdits)
+{
+    TextEngine engine;
+    engine.readString("Hello World");
+    uint64_t revision = engine.getEditRevision();
+
+    InsertOperation insert(">> ", 0, "c1");
+    engine.insertIncoming(&insert);
+    DeleteOperation remove(3, 6, "c1");
+    engine.deleteIncoming(&remove);
+    ASSERT_EQ(engine.getText(), ">> World");
+
+    EXPECT_EQ(engine.transformPosition(0, revision), 3);    // Inserts at the position push it right
+    EXPECT_EQ(engine.transformPosition(2, revision), 3);    // Inside the deleted text
+    EXPECT_EQ(engine.transformPosition(11, revision), 8);
+    EXPECT_EQ(engine.transformPosition(11, engine.getEditRevision()), 8); // Clamped to the text
+
+    // A new document is a revision boundary
+    engine.readString("abc");
+    EXPECT_EQ(engine.transformPosition(1, revision), 1);
+}
+
+TEST(PresenceTest, RemotePresenceIsTransformedWhenRead)
+{
+    ClientTextEngine client;
+    client.readString("Hello World");
+    client.resetToServerVersion(4);
+
+    Presence presence;
+    presence.cursor = 6;
+    presence.selectionStart = 6;
+    presence.selectionEnd = 11;
+    client.setRemotePresence("c2", 4, presence);
+
+    auto remote = std::make_unique<InsertOperation>("Big ", 0, "c3");
+    remote->docVersion = 4;
+    client.processIncomingOperation(std::move(remote));
+
+    auto presences = client.getRemotePresences();
+    ASSERT_EQ(presences.size(), 1);
+    EXPECT_EQ(presences[0].clientId, "c2");
+    EXPECT_EQ(presences[0].presence.cursor, 10);
+    EXPECT_EQ(presences[0].presence.selectionEnd, 15);
+
+    // Presence from a version we have not reached yet is used as is until we get there
+    client.setRemotePresence("c2", 6, presence);
+    EXPECT_EQ(client.getRemotePresences()[0].presence.cursor, 6);
+
+    auto next = std::make_unique<InsertOperation>("!", 15, "c3");
+    next->docVersion = 5;
+    client.processIncomingOperation(std::move(next));
+    auto prefix = std::make_unique<InsertOperation>("# ", 0, "c3");
+    prefix->docVersion = 6;
+    client.processIncomingOperation(std::move(prefix));
+    EXPECT_EQ(client.getRemotePresences()[0].presence.cursor, 8);
+
+    client.removeRemotePresence("c2");
+    EXPECT_TRUE(client.getRemotePresences().empty());
+}
+
+TEST(PresenceTest, MessagesRoundTrip)
+{
+    Presence presence;
+    presence.cursor = 5;
+    presence.selectionStart = 2;
+    presence.selectionEnd = 5;
+
+    std::string msg = MessageParser::createPresenceMessage("c1", 12, presence);
+    ParsedMessage parsed = MessageParser::parseMessage(msg);
+    EXPECT_EQ(parsed.type, MessageType::PRESENCE);
+    EXPECT_EQ(parsed.clientId, "c1");
+
+    std::string clientId;
+    uint64_t docVersion = 0;
+    Presence parsedPresence;
+    ASSERT_TRUE(MessageParser::parsePresenceMessage(msg, clientId, docVersion, parsedPresence));
+    EXPECT_EQ(clientId, "c1");
+    EXPECT_EQ(docVersion, 12);
+    EXPECT_EQ(parsedPresence, presence);
+
+    EXPECT_FALSE(MessageParser::parsePresenceMessage("PRESENCE:c1:12:5:2", clientId, docVersion, parsedPresence));
+    EXPECT_EQ(MessageParser::parseMessage(MessageParser::createPresenceLeftMessage("c1")).type, MessageType::PRESENCE_LEFT);
+}
+
+TEST(PresenceTest, SequencerCoalescesAndThrottlesPresence)
+{
+    ServerDocument document("doc", 0);
+    Sequencer sequencer;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    bool joined = false;
+    std::vector<std::vector<std::pair<int, std::string>>> broadcasts;
+
+    sequencer.setJoinCallback([&] (ServerDocument&, int)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        joined = true;
+        doneCondition.notify_one();
+    });
+    sequencer.setPresenceCallback([&] (ServerDocument&, const std::vector<std::pair<int, std::string>>& updates)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        broadcasts.push_back(updates);
+        doneCondition.notify_one();
+    }, std::chrono::milliseconds(200));
+    sequencer.start();
+
+    sequencer.submitJoin(&document, 1);
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return joined; });
+    }
+
+    // The first update goes out right away, the burst behind it collapses into one broadcast of the latest
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; i++)
+        sequencer.submitPresence(&document, 1, "P" + std::to_string(i));
+
+    // Presence of a client that never joined is dropped
+    sequencer.submitPresence(&document, 2, "stranger");
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return !broadcasts.empty() && broadcasts.back().back().second == "P99"; });
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    sequencer.stop();
+
+    EXPECT_LE(broadcasts.size(), 2);
+    for (const auto& updates : broadcasts)
+    {
+        ASSERT_EQ(updates.size(), 1);
+        EXPECT_EQ(updates[0].first, 1);
+    }
+
+    if (broadcasts.size() == 2)
+    {
+        EXPECT_GE(elapsed, std::chrono::milliseconds(200));
+    }
+
+    EXPECT_EQ(document.presence[1], "P99");
+}
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "io_uring_reactor.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+#include "test_client.h"
+
+namespace
+{
+    /**
+     * @returns True if the server closed the connection, skipping whatever it sent before
+    */
+    bool receivesEndOfStream(int clientSocket)
+    {
+        char buffer[4096];
+        while (true)
+        {
+            // The io_uring backend's task work can interrupt a blocking receive on the test's thread
+            ssize_t received = recv(clientSocket, buffer, sizeof(buffer), 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+
+            if (received <= 0)
+                return received == 0;
+        }
+    }
+
+    /**
+     * Connects many clients, broadcasts an op to them and checks they are all disconnected when the server stops.
+    */
+    void serveManyClients(ReactorBackend backend)
+    {
+        constexpr int clientCount = 200;
+
+        Controller controller;
+        ServerTextEngine engine;
+        controller.textEngine = &engine;
+
+        ServerConfig config;
+        config.shardCount = 2;
+        config.reactorCount = 2;
+        config.reactorBackend = backend;
+        auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+        ASSERT_TRUE(server->isRunning());
+
+        std::vector<int> sockets;
+        std::vector<FrameReader> readers(clientCount);
+        for (int i = 0; i < clientCount; i++)
+        {
+            int clientSocket = connectToServer(server->getPort());
+            ASSERT_NE(clientSocket, -1);
+            sockets.push_back(clientSocket);
+
+            std::string connected = MessageParser::createConnectedMessage("c" + std::to_string(i), "", std::nullopt, WireProtocol::BINARY);
+            ASSERT_TRUE(Framing::sendFrame(clientSocket, connected));
+        }
+
+        ParsedMessage parsed;
+        for (int i = 0; i < clientCount; i++)
+        {
+            ASSERT_TRUE(receiveUntil(sockets[i], readers[i], MessageType::PROTOCOL, parsed));
+            EXPECT_EQ(parsed.wireProtocol, WireProtocol::BINARY);
+            ASSERT_TRUE(receiveUntil(sockets[i], readers[i], MessageType::INIT_DOCUMENT, parsed));
+        }
+
+        // Every subscriber gets the op, its sender as the ack
+        InsertOperation insert("hello", 0, "c0");
+        insert.docVersion = 0;
+        ASSERT_TRUE(Framing::sendFrame(sockets[0], insert.serialize()));
+        for (int i = 0; i < clientCount; i++)
+        {
+            ASSERT_TRUE(receiveUntil(sockets[i], readers[i], MessageType::OPERATION, parsed));
+            ASSERT_NE(parsed.operation, nullptr);
+            EXPECT_EQ(parsed.operation->clientId, "c0");
+        }
+
+        // A client leaving does not disturb the others
+        close(sockets[1]);
+        sockets[1] = -1;
+
+        server.reset();
+
+        for (int clientSocket : sockets)
+        {
+            if (clientSocket == -1)
+                continue;
+
+            EXPECT_TRUE(receivesEndOfStream(clientSocket));
+            close(clientSocket);
+        }
+    }
+}
+
+TEST(ReactorTest, EpollServesManyClientsAndClosesThemOnShutdown)
+{
+    serveManyClients(ReactorBackend::EPOLL);
+}
+
+TEST(ReactorTest, IoUringServesManyClientsAndClosesThemOnShutdown)
+{
+    if (!IoUringReactor::isSupported())
+        GTEST_SKIP() << "No multishot receives in this kernel";
+
+    serveManyClients(ReactorBackend::IO_URING);
+}
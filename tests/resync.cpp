@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+
+#include "server.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "operations.h"
+#include "server_text_engine.h"
+#include "client_text_engine.h"
+#include "../controller/controller.h"
+#include "test_client.h"
+
+namespace
+{
+    /**
+     * Reads until the server confirmed an op we sent: with an ack, or with the op itself if it was made on the
+     * document we were sent.
+    */
+    bool receiveConfirmation(int clientSocket, FrameReader& reader, ParsedMessage& parsed)
+    {
+        while (receiveNext(clientSocket, reader, parsed))
+        {
+            if (parsed.type == MessageType::ACK || parsed.type == MessageType::OPERATION)
+                return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * Joins the document and reports having applied it in a heartbeat.
+     * @returns The socket, -1 if the server did not answer
+    */
+    int joinAndReport(uint16_t port, const std::string& clientId, uint64_t unsentOperations, FrameReader& reader)
+    {
+        int clientSocket = connectToServer(port);
+        ParsedMessage parsed;
+        if (clientSocket == -1 ||
+            !Framing::sendFrame(clientSocket, MessageParser::createConnectedMessage(clientId, "resync", std::nullopt, WireProtocol::BINARY)) ||
+            !receiveUntil(clientSocket, reader, MessageType::INIT_DOCUMENT, parsed) ||
+            !Framing::sendFrame(clientSocket, MessageParser::createPingMessage(1, 0, unsentOperations)) ||
+            !receiveUntil(clientSocket, reader, MessageType::PONG, parsed))
+        {
+            close(clientSocket);
+            return -1;
+        }
+
+        return clientSocket;
+    }
+}
+
+TEST(ResyncTest, LaggingIdleClientGetsTheDocumentInsteadOfOps)
+{
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+
+    ServerConfig config;
+    config.shardCount = 1;
+    config.reactorCount = 1;
+    config.resyncBacklogBytes = 0;
+    config.resyncLagOperations = 5;
+    auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+    ASSERT_TRUE(server->isRunning());
+
+    const uint64_t resyncsBefore = MetricsRegistry::global().getCounter("reped_server_resyncs_total", "").getValue();
+
+    // Neither reads until the editor is done, the second one has edits of its own in flight
+    FrameReader idleReader;
+    int idleSocket = joinAndReport(server->getPort(), "idle", 0, idleReader);
+    ASSERT_NE(idleSocket, -1);
+    FrameReader editingReader;
+    int editingSocket = joinAndReport(server->getPort(), "editing", 1, editingReader);
+    ASSERT_NE(editingSocket, -1);
+
+    FrameReader editorReader;
+    int editorSocket = connectToServer(server->getPort());
+    ASSERT_NE(editorSocket, -1);
+    ASSERT_TRUE(Framing::sendFrame(editorSocket, MessageParser::createConnectedMessage("editor", "resync", std::nullopt, WireProtocol::BINARY)));
+    ParsedMessage parsed;
+    ASSERT_TRUE(receiveUntil(editorSocket, editorReader, MessageType::INIT_DOCUMENT, parsed));
+
+    // Each op waits for its ack, so each goes out in a broadcast of its own
+    const uint64_t operationCount = 20;
+    for (uint64_t i = 0; i < operationCount; i++)
+    {
+        InsertOperation insert("a", 0, "editor");
+        insert.docVersion = i;
+        ASSERT_TRUE(Framing::sendFrame(editorSocket, insert.serialize()));
+        ASSERT_TRUE(receiveConfirmation(editorSocket, editorReader, parsed));
+    }
+
+    // Some ops went out before it fell too far behind, then the document, then only ops sequenced after it
+    std::size_t operationsBeforeResync = 0;
+    while (receiveNext(idleSocket, idleReader, parsed) && parsed.type != MessageType::INIT_DOCUMENT)
+    {
+        if (parsed.type == MessageType::OPERATION)
+            operationsBeforeResync++;
+    }
+
+    ASSERT_EQ(parsed.type, MessageType::INIT_DOCUMENT);
+    uint64_t resyncVersion = 0;
+    std::string text;
+    ASSERT_TRUE(MessageParser::parseInitDocumentMessage(parsed.content, resyncVersion, text));
+    EXPECT_GT(resyncVersion, config.resyncLagOperations);
+    EXPECT_EQ(text, std::string(resyncVersion, 'a'));
+    EXPECT_LT(operationsBeforeResync, resyncVersion);
+
+    uint64_t nextVersion = resyncVersion;
+    while (nextVersion < operationCount)
+    {
+        ASSERT_TRUE(receiveNext(idleSocket, idleReader, parsed));
+        ASSERT_NE(parsed.type, MessageType::INIT_DOCUMENT);
+        if (parsed.type == MessageType::OPERATION)
+        {
+            EXPECT_EQ(parsed.operation->docVersion, nextVersion++);
+        }
+    }
+
+    // A fresh document would drop the edits, so it gets every op
+    for (uint64_t i = 0; i < operationCount; i++)
+    {
+        ASSERT_TRUE(receiveUntil(editingSocket, editingReader, MessageType::OPERATION, parsed));
+        EXPECT_EQ(parsed.operation->docVersion, i);
+    }
+
+    EXPECT_EQ(MetricsRegistry::global().getCounter("reped_server_resyncs_total", "").getValue(), resyncsBefore + 1);
+
+    // One write per subscriber per op, except for the batch the idle client got the document instead of.
+    // Counted after the writes went out, so the last one may still be on its way.
+    const uint64_t expectedWrites = 3 * operationCount - 1;
+    for (int i = 0; i < 100 && server->getBroadcastStats().writes < expectedWrites; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(server->getBroadcastStats().writes, expectedWrites);
+
+    close(idleSocket);
+    close(editingSocket);
+    close(editorSocket);
+    server.reset();
+}
+
+TEST(ResyncTest, OwnOpSequencedAfterTheFreshDocumentIsApplied)
+{
+    ClientTextEngine client;
+    client.readString("Hello");
+    client.resetToServerVersion(5);
+
+    // Sent, then a fresh document at version 7 arrived before its ack
+    auto inFlight = std::make_unique<InsertOperation>("!", 5, "c1");
+    inFlight->operationId = 1;
+    client.insertLocal(inFlight.get());
+    client.addPendingLocalOp(std::make_unique<InsertOperation>(*inFlight));
+    ASSERT_NE(client.takeOpToSend(), nullptr);
+
+    client.prepareForServerDocument();
+    client.readString(">> Hello");
+    EXPECT_EQ(client.resetToServerVersion(7), 0);
+    EXPECT_TRUE(client.getPendingLocalOps().empty());
+
+    // Sequenced after the document, so its text does not have it
+    InsertOperation sequenced("!", 8, "c1");
+    sequenced.operationId = 1;
+    sequenced.docVersion = 7;
+    EXPECT_TRUE(client.takeDroppedOp(sequenced));
+    EXPECT_FALSE(client.takeDroppedOp(sequenced));
+
+    // One sequenced before the document is part of it
+    auto older = std::make_unique<InsertOperation>("?", 0, "c1");
+    older->operationId = 2;
+    client.addPendingLocalOp(std::move(older));
+    client.resetToServerVersion(9);
+    InsertOperation included("?", 0, "c1");
+    included.operationId = 2;
+    included.docVersion = 8;
+    EXPECT_FALSE(client.takeDroppedOp(included));
+}
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+#include "framing.h"
+
+namespace
+{
+    struct SocketPair
+    {
+        int serverSide;
+        int clientSide;
+
+        explicit SocketPair(int bufferSize)
+        {
+            int sockets[2];
+            EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+            serverSide = sockets[0];
+            clientSide = sockets[1];
+
+            // Small buffers so the socket stops taking frames early
+            setsockopt(serverSide, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+            setsockopt(clientSide, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+            fcntl(serverSide, F_SETFL, fcntl(serverSide, F_GETFL) | O_NONBLOCK);
+            fcntl(clientSide, F_SETFL, fcntl(clientSide, F_GETFL) | O_NONBLOCK);
+        }
+
+        ~SocketPair()
+        {
+            close(clientSide);
+        }
+    };
+
+    /**
+     * Reads what the client side has buffered.
+     * @returns False once the stream ended
+    */
+    bool receive(int socket, FrameReader& reader, std::vector<std::string>& frames)
+    {
+        while (true)
+        {
+            std::size_t space = 0;
+            char* buffer = reader.prepareReceive(space);
+            ssize_t length = recv(socket, buffer, space, 0);
+            if (length == 0)
+                return false;
+            if (length < 0)
+                return true;
+
+            reader.commitReceive(static_cast<std::size_t>(length));
+            std::string_view frame;
+            while (reader.nextFrame(frame))
+                frames.emplace_back(frame);
+        }
+    }
+}
+
+TEST(SendQueueTest, QueuedFramesAreSharedAndArriveInOrder)
+{
+    SocketPair sockets(4096);
+    Connection connection(sockets.serverSide, 1024 * 1024);
+
+    // One frame for every client, like a broadcast
+    std::vector<SharedFrame> sent;
+    for (int i = 0; i < 200; i++)
+    {
+        sent.push_back(Framing::makeSharedFrame("op " + std::to_string(i) + std::string(200, 'x')));
+        ASSERT_TRUE(connection.send(sent.back()));
+    }
+
+    ASSERT_GT(connection.getQueuedBytes(), 0u);
+    EXPECT_EQ(sent.back().use_count(), 2);
+
+    FrameReader reader;
+    std::vector<std::string> frames;
+    while (connection.getQueuedBytes() > 0)
+    {
+        ASSERT_TRUE(receive(sockets.clientSide, reader, frames));
+        ASSERT_TRUE(connection.flush());
+    }
+
+    ASSERT_TRUE(receive(sockets.clientSide, reader, frames));
+    ASSERT_EQ(frames.size(), sent.size());
+    for (std::size_t i = 0; i < sent.size(); i++)
+        EXPECT_EQ(frames[i], sent[i]->substr(Framing::headerSize));
+
+    // Written frames are released
+    EXPECT_EQ(sent.back().use_count(), 1);
+    connection.closeSocket();
+}
+
+TEST(SendQueueTest, LaggingClientIsDisconnected)
+{
+    SocketPair sockets(4096);
+    Connection connection(sockets.serverSide, 16 * 1024);
+
+    // The client never reads, so its queue fills up until the connection gives up on it
+    SharedFrame frame = Framing::makeSharedFrame(std::string(1000, 'x'));
+    int sends = 0;
+    while (connection.send(frame))
+        ASSERT_LT(++sends, 1000);
+
+    EXPECT_EQ(connection.getQueuedBytes(), 0u);
+    EXPECT_EQ(frame.use_count(), 1);
+    EXPECT_FALSE(connection.send("late"));
+
+    // The client sees the stream end after what was already written, which makes it reconnect and catch up
+    FrameReader reader;
+    std::vector<std::string> frames;
+    while (receive(sockets.clientSide, reader, frames))
+        ;
+
+    EXPECT_GT(frames.size(), 0u);
+    connection.closeSocket();
+}
+
+TEST(SendQueueTest, FrameLargerThanTheLimitIsSent)
+{
+    SocketPair sockets(4096);
+    Connection connection(sockets.serverSide, 16 * 1024);
+
+    // A large document goes to a new client while nothing else is queued
+    std::string document(256 * 1024, 'd');
+    ASSERT_TRUE(connection.send(document));
+    ASSERT_GT(connection.getQueuedBytes(), 16 * 1024u);
+
+    FrameReader reader;
+    std::vector<std::string> frames;
+    while (connection.getQueuedBytes() > 0)
+    {
+        ASSERT_TRUE(receive(sockets.clientSide, reader, frames));
+        ASSERT_TRUE(connection.flush());
+    }
+
+    ASSERT_TRUE(receive(sockets.clientSide, reader, frames));
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0], document);
+    connection.closeSocket();
+}
+
+TEST(SendQueueTest, DiscardingKeepsThePartlyWrittenFrame)
+{
+    SocketPair sockets(4096);
+    Connection connection(sockets.serverSide, 1024 * 1024);
+
+    std::vector<SharedFrame> sent;
+    for (int i = 0; i < 50; i++)
+    {
+        sent.push_back(Framing::makeSharedFrame("op " + std::to_string(i) + std::string(1000, 'x')));
+        ASSERT_TRUE(connection.send(sent.back()));
+    }
+
+    const std::size_t queued = connection.getQueuedBytes();
+    std::optional<std::size_t> discarded = connection.discardQueued();
+    ASSERT_TRUE(discarded);
+    EXPECT_EQ(*discarded + connection.getQueuedBytes(), queued);
+    ASSERT_TRUE(connection.send("after"));
+
+    // Whatever was cut off, the stream still splits into whole frames
+    FrameReader reader;
+    std::vector<std::string> frames;
+    while (connection.getQueuedBytes() > 0)
+    {
+        ASSERT_TRUE(receive(sockets.clientSide, reader, frames));
+        ASSERT_TRUE(connection.flush());
+    }
+
+    ASSERT_TRUE(receive(sockets.clientSide, reader, frames));
+    EXPECT_FALSE(reader.isCorrupt());
+    ASSERT_LT(frames.size(), sent.size());
+    for (std::size_t i = 0; i + 1 < frames.size(); i++)
+        EXPECT_EQ(frames[i], sent[i]->substr(Framing::headerSize));
+
+    EXPECT_EQ(frames.back(), "after");
+    connection.closeSocket();
+}
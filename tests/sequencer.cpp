@@ -0,0 +1,281 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <csignal>
+#include <sys/resource.h>
+
+#include "mpsc_queue.h"
+#include "sequencer.h"
+#include "server_text_engine.h"
+#include "server_document.h"
+#include "op_log.h"
+
+TEST(MpscQueueTest, PreservesPerProducerOrder)
+{
+    MpscQueue<std::pair<int, int>> queue;
+    const int producerCount = 8;
+    const int itemsPerProducer = 10000;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; p++)
+    {
+        producers.emplace_back([&queue, p]
+        {
+            for (int i = 0; i < itemsPerProducer; i++)
+                queue.push({p, i});
+        });
+    }
+
+    std::vector<int> nextExpected(producerCount, 0);
+    int received = 0;
+    std::pair<int, int> item;
+    while (received < producerCount * itemsPerProducer)
+    {
+        if (!queue.tryPop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        EXPECT_EQ(item.second, nextExpected[item.first]);
+        nextExpected[item.first] = item.second + 1;
+        received++;
+    }
+
+    for (auto& producer : producers)
+        producer.join();
+
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(SequencerTest, AppliesConcurrentOperationsInTotalOrder)
+{
+    ServerDocument document("doc", 0);
+    Sequencer sequencer;
+
+    const int clientCount = 16;
+    const int opsPerClient = 200;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::vector<uint64_t> broadcastVersions;
+
+    // Broadcast stage runs on the sequencer thread
+    sequencer.setBroadcastCallback([&] (ServerDocument&, std::vector<SequencedOperation>& batch)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        for (const auto& sequencedOp : batch)
+            broadcastVersions.push_back(sequencedOp.operation->docVersion);
+        doneCondition.notify_one();
+    });
+    sequencer.start();
+
+    std::vector<std::thread> connections;
+    for (int c = 0; c < clientCount; c++)
+    {
+        connections.emplace_back([&sequencer, &document, c]
+        {
+            for (int i = 0; i < opsPerClient; i++)
+                sequencer.submitOperation(&document, c, std::make_unique<InsertOperation>("a", 0, "c" + std::to_string(c)));
+        });
+    }
+
+    for (auto& connection : connections)
+        connection.join();
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return broadcastVersions.size() == clientCount * opsPerClient; });
+    }
+    sequencer.stop();
+
+    // Every op got a unique, consecutive version in the order it was broadcast
+    for (std::size_t i = 0; i < broadcastVersions.size(); i++)
+        EXPECT_EQ(broadcastVersions[i], i);
+
+    EXPECT_EQ(document.textEngine->getDocumentLength(), clientCount * opsPerClient);
+    EXPECT_EQ(sequencer.getStats().operationsSequenced, clientCount * opsPerClient);
+}
+
+TEST(SequencerTest, JoinSeesOnlyOperationsSequencedBeforeIt)
+{
+    ServerTextEngine engine;
+    ServerDocument document("doc", 0, &engine);
+    Sequencer sequencer;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::string joinText;
+    bool joined = false;
+    std::size_t broadcastCount = 0;
+
+    sequencer.setJoinCallback([&] (ServerDocument& document, int)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        joinText = document.textEngine->getDocumentState();
+        joined = true;
+        doneCondition.notify_one();
+    });
+    sequencer.setBroadcastCallback([&] (ServerDocument&, std::vector<SequencedOperation>& batch)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        broadcastCount += batch.size();
+        doneCondition.notify_one();
+    });
+    sequencer.start();
+
+    sequencer.submitOperation(&document, 1, std::make_unique<InsertOperation>("Hello", 0, "c1"));
+    sequencer.submitJoin(&document, 2);
+    sequencer.submitOperation(&document, 1, std::make_unique<InsertOperation>(" World", 5, "c1"));
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return joined && broadcastCount == 2; });
+    }
+    sequencer.stop();
+
+    EXPECT_EQ(joinText, "Hello");
+    EXPECT_EQ(engine.getText(), "Hello World");
+    EXPECT_EQ(document.subscribers.count(2), 1);
+}
+
+TEST(SequencerTest, DocumentsOnOneShardAreIndependent)
+{
+    ServerDocument first("first", 0);
+    ServerDocument second("second", 0);
+    Sequencer sequencer;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::size_t firstBroadcasts = 0;
+    std::size_t secondBroadcasts = 0;
+
+    sequencer.setBroadcastCallback([&] (ServerDocument& document, std::vector<SequencedOperation>& batch)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (&document == &first)
+            firstBroadcasts += batch.size();
+        else
+            secondBroadcasts += batch.size();
+        doneCondition.notify_one();
+    });
+    sequencer.start();
+
+    sequencer.submitOperation(&first, 1, std::make_unique<InsertOperation>("one", 0, "c1"));
+    sequencer.submitOperation(&second, 2, std::make_unique<InsertOperation>("two", 0, "c2"));
+    sequencer.submitOperation(&first, 1, std::make_unique<InsertOperation>("!", 3, "c1"));
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return firstBroadcasts == 2 && secondBroadcasts == 1; });
+    }
+    sequencer.stop();
+
+    EXPECT_EQ(first.textEngine->getText(), "one!");
+    EXPECT_EQ(second.textEngine->getText(), "two");
+}
+
+TEST(SequencerTest, BroadcastIntervalCollectsOperationsIntoOneBatch)
+{
+    ServerDocument document("doc", 0);
+    Sequencer sequencer;
+
+    const int opCount = 20;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::vector<std::size_t> batchSizes;
+    std::size_t broadcast = 0;
+
+    sequencer.setBroadcastCallback([&] (ServerDocument&, std::vector<SequencedOperation>& batch)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        batchSizes.push_back(batch.size());
+        broadcast += batch.size();
+        doneCondition.notify_one();
+    }, std::chrono::milliseconds(200));
+    sequencer.start();
+
+    // Ops trickle in one at a time, each of them would be a batch of its own without the interval
+    for (int i = 0; i < opCount; i++)
+    {
+        sequencer.submitOperation(&document, 0, std::make_unique<InsertOperation>("a", 0, "c0"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return broadcast == opCount; });
+    }
+    sequencer.stop();
+
+    EXPECT_EQ(batchSizes, std::vector<std::size_t>{opCount});
+}
+
+TEST(SequencerTest, HoldsBackOperationsUntilTheirLogCommits)
+{
+    const std::string logPath = ::testing::TempDir() + "reped_sequencer_test.oplog";
+    std::remove(logPath.c_str());
+
+    ServerTextEngine engine;
+    ServerDocument document("doc", 0, &engine);
+    document.opLog = std::make_unique<OpLog>(logPath, std::chrono::microseconds(0));
+    ASSERT_TRUE(document.opLog->open());
+    Sequencer sequencer;
+
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::string joinText;
+    bool joined = false;
+    std::size_t broadcastCount = 0;
+
+    sequencer.setJoinCallback([&] (ServerDocument& joinedDocument, int)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        joinText = joinedDocument.textEngine->getDocumentState();
+        joined = true;
+        doneCondition.notify_one();
+    });
+    sequencer.setBroadcastCallback([&] (ServerDocument&, std::vector<SequencedOperation>& batch)
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        broadcastCount += batch.size();
+        doneCondition.notify_one();
+    });
+
+    // The log cannot grow, so nothing it holds is durable
+    struct rlimit original;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &original), 0);
+    auto previousHandler = std::signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limited = original;
+    limited.rlim_cur = 0;
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limited), 0);
+
+    sequencer.start();
+    sequencer.submitOperation(&document, 1, std::make_unique<InsertOperation>("Hello", 0, "c1"));
+    sequencer.submitJoin(&document, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        EXPECT_EQ(broadcastCount, 0u);
+        EXPECT_FALSE(joined);
+    }
+
+    // Retried once the disk takes writes again
+    setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, previousHandler);
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&] { return joined && broadcastCount == 1; });
+    }
+    sequencer.stop();
+
+    EXPECT_EQ(joinText, "Hello");
+    EXPECT_EQ(OpLog::replay(logPath, [] (std::unique_ptr<TextOperation>) {}), 1u);
+    std::remove(logPath.c_str());
+}
@@ -0,0 +1,324 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "shared_memory_channel.h"
+#include "server.h"
+#include "framing.h"
+#include "message_parser.h"
+#include "server_text_engine.h"
+#include "../controller/controller.h"
+
+namespace
+{
+    // Both ends of one channel over a socket pair, the first as the server
+    struct ChannelPair
+    {
+        int sockets[2] = {-1, -1};
+        std::unique_ptr<SharedMemoryChannel> server;
+        std::unique_ptr<SharedMemoryChannel> client;
+
+        explicit ChannelPair(std::size_t ringBytes)
+        {
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) == -1)
+                return;
+
+            server = SharedMemoryChannel::create(sockets[0], ringBytes);
+            client = SharedMemoryChannel::accept(sockets[1], std::chrono::milliseconds(1000));
+        }
+
+        ~ChannelPair()
+        {
+            server.reset();
+            client.reset();
+            for (int fd : sockets)
+            {
+                if (fd != -1)
+                    close(fd);
+            }
+        }
+    };
+
+    ssize_t sendString(SharedMemoryChannel& channel, std::string_view bytes)
+    {
+        struct iovec part = { const_cast<char*>(bytes.data()), bytes.size() };
+        return channel.send(&part, 1);
+    }
+
+    /**
+     * @returns True if the socket has a wake-up or end of stream to read within the timeout
+    */
+    bool becomesReadable(int socket, int timeoutMs)
+    {
+        struct pollfd readable = { socket, POLLIN, 0 };
+        return poll(&readable, 1, timeoutMs) == 1;
+    }
+
+    int connectToLocalSocket(const std::string& path)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return -1;
+
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.data(), path.size());
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    /**
+     * Reads frames off a channel until one of the wanted type arrives, waiting on the socket for wake-ups.
+     * @returns False on timeout or end of stream
+    */
+    bool receiveUntil(SharedMemoryChannel& channel, int socket, FrameReader& reader, MessageType type, ParsedMessage& parsed)
+    {
+        while (true)
+        {
+            std::string_view frame;
+            while (reader.nextFrame(frame))
+            {
+                parsed = MessageParser::parseMessage(frame);
+                if (parsed.type == type)
+                    return true;
+            }
+
+            std::size_t space = 0;
+            char* buffer = reader.prepareReceive(space);
+            ssize_t received = channel.receive(buffer, space);
+            if (received < 0 && errno == EAGAIN)
+            {
+                if (!becomesReadable(socket, 5000))
+                    return false;
+
+                continue;
+            }
+
+            if (received <= 0)
+                return false;
+
+            reader.commitReceive(static_cast<std::size_t>(received));
+        }
+    }
+}
+
+TEST(SharedMemoryChannelTest, CarriesBytesBothWays)
+{
+    ChannelPair pair(4096);
+    ASSERT_NE(pair.server, nullptr);
+    ASSERT_NE(pair.client, nullptr);
+
+    char buffer[64];
+    EXPECT_EQ(pair.client->receive(buffer, sizeof(buffer)), -1);
+    EXPECT_EQ(errno, EAGAIN);
+
+    EXPECT_EQ(sendString(*pair.client, "hello"), 5);
+    EXPECT_EQ(pair.server->receive(buffer, sizeof(buffer)), 5);
+    EXPECT_EQ(std::string_view(buffer, 5), "hello");
+
+    EXPECT_EQ(sendString(*pair.server, "world"), 5);
+    EXPECT_EQ(pair.client->receive(buffer, sizeof(buffer)), 5);
+    EXPECT_EQ(std::string_view(buffer, 5), "world");
+}
+
+TEST(SharedMemoryChannelTest, WrapsAroundTheEndOfTheRing)
+{
+    ChannelPair pair(4096);
+    ASSERT_NE(pair.server, nullptr);
+    ASSERT_NE(pair.client, nullptr);
+
+    // Chunks that do not divide the ring size, so they straddle its end in every position
+    std::string sent;
+    std::string received;
+    std::vector<char> buffer(1000);
+    for (int i = 0; i < 100; i++)
+    {
+        std::string chunk(997, static_cast<char>('a' + i % 26));
+        ASSERT_EQ(sendString(*pair.client, chunk), static_cast<ssize_t>(chunk.size()));
+        sent += chunk;
+
+        ssize_t size;
+        while ((size = pair.server->receive(buffer.data(), buffer.size())) > 0)
+            received.append(buffer.data(), static_cast<std::size_t>(size));
+    }
+
+    EXPECT_EQ(received, sent);
+}
+
+TEST(SharedMemoryChannelTest, FullRingWakesTheWriterOnceRead)
+{
+    ChannelPair pair(4096);
+    ASSERT_NE(pair.server, nullptr);
+    ASSERT_NE(pair.client, nullptr);
+
+    // The first write may wake the server, which sleeps on an empty ring
+    std::string bytes(6000, 'x');
+    EXPECT_EQ(sendString(*pair.client, bytes), 4096);
+    EXPECT_EQ(sendString(*pair.client, bytes), 0);
+    EXPECT_FALSE(becomesReadable(pair.sockets[1], 0));
+
+    char buffer[100];
+    EXPECT_EQ(pair.server->receive(buffer, sizeof(buffer)), 100);
+    EXPECT_TRUE(becomesReadable(pair.sockets[1], 1000));
+
+    // Reading the wake-up leaves the ring to the client
+    EXPECT_EQ(pair.client->receive(buffer, sizeof(buffer)), -1);
+    EXPECT_EQ(errno, EAGAIN);
+    EXPECT_EQ(sendString(*pair.client, bytes), 100);
+}
+
+TEST(SharedMemoryChannelTest, ReportsEndOfStreamAfterTheLastBytes)
+{
+    ChannelPair pair(4096);
+    ASSERT_NE(pair.server, nullptr);
+    ASSERT_NE(pair.client, nullptr);
+
+    EXPECT_EQ(sendString(*pair.server, "bye"), 3);
+    close(pair.sockets[0]);
+    pair.sockets[0] = -1;
+
+    char buffer[16];
+    EXPECT_EQ(pair.client->receive(buffer, sizeof(buffer)), 3);
+    EXPECT_EQ(pair.client->receive(buffer, sizeof(buffer)), 0);
+}
+
+TEST(SharedMemoryChannelTest, RejectsIndicesOutsideTheRing)
+{
+    int sockets[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets), 0);
+    auto server = SharedMemoryChannel::create(sockets[0], 4096);
+    ASSERT_NE(server, nullptr);
+
+    // Map the memory ourselves, as a misbehaving client could, and scribble over the indices after magic and size
+    char byte;
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct iovec part = { &byte, 1 };
+    struct msghdr msg = {};
+    msg.msg_iov = &part;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ASSERT_EQ(recvmsg(sockets[1], &msg, 0), 1);
+    int memoryFd;
+    memcpy(&memoryFd, CMSG_DATA(CMSG_FIRSTHDR(&msg)), sizeof(int));
+
+    char* memory = static_cast<char*>(mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0));
+    ASSERT_NE(memory, MAP_FAILED);
+    memset(memory + 16, 0xff, 4096 - 16);
+
+    char buffer[16];
+    EXPECT_EQ(server->receive(buffer, sizeof(buffer)), -1);
+    EXPECT_EQ(errno, EPROTO);
+
+    munmap(memory, 4096);
+    close(memoryFd);
+    server.reset();
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST(SharedMemoryChannelTest, ServerTalksToLocalClients)
+{
+    const std::string unixPath = "/tmp/reped_test_" + std::to_string(getpid()) + ".sock";
+    const std::string sharedMemoryPath = "/tmp/reped_test_" + std::to_string(getpid()) + ".shm";
+
+    Controller controller;
+    ServerTextEngine engine;
+    controller.textEngine = &engine;
+
+    ServerConfig config;
+    config.shardCount = 1;
+    config.reactorCount = 1;
+    config.unixSocketPath = unixPath;
+    config.sharedMemorySocketPath = sharedMemoryPath;
+    config.sharedMemoryRingBytes = 4096;
+    auto server = std::make_unique<Server>(0, "127.0.0.1", &controller, config);
+    ASSERT_TRUE(server->isRunning());
+
+    int unixSocket = connectToLocalSocket(unixPath);
+    ASSERT_NE(unixSocket, -1);
+    ASSERT_TRUE(Framing::sendFrame(unixSocket, MessageParser::createConnectedMessage("u", "", std::nullopt, WireProtocol::BINARY)));
+
+    int sharedMemorySocket = connectToLocalSocket(sharedMemoryPath);
+    ASSERT_NE(sharedMemorySocket, -1);
+    auto channel = SharedMemoryChannel::accept(sharedMemorySocket, std::chrono::milliseconds(5000));
+    ASSERT_NE(channel, nullptr);
+
+    std::string frames;
+    Framing::appendFrame(frames, MessageParser::createConnectedMessage("s", "", std::nullopt, WireProtocol::BINARY), false);
+    ASSERT_EQ(sendString(*channel, frames), static_cast<ssize_t>(frames.size()));
+
+    FrameReader sharedMemoryReader;
+    ParsedMessage parsed;
+    ASSERT_TRUE(receiveUntil(*channel, sharedMemorySocket, sharedMemoryReader, MessageType::INIT_DOCUMENT, parsed));
+
+    // An op larger than the ring goes through in pieces, and reaches the Unix socket client too
+    InsertOperation insert(std::string(10000, 'x'), 0, "s");
+    insert.docVersion = 0;
+    frames.clear();
+    Framing::appendFrame(frames, insert.serialize(), false);
+    std::size_t sent = 0;
+    while (sent < frames.size())
+    {
+        ssize_t written = sendString(*channel, std::string_view(frames).substr(sent));
+        ASSERT_GE(written, 0);
+        if (written == 0)
+        {
+            ASSERT_TRUE(becomesReadable(sharedMemorySocket, 5000));
+        }
+
+        sent += static_cast<std::size_t>(written);
+    }
+
+    ASSERT_TRUE(receiveUntil(*channel, sharedMemorySocket, sharedMemoryReader, MessageType::OPERATION, parsed));
+    EXPECT_EQ(parsed.operation->clientId, "s");
+
+    FrameReader unixReader;
+    bool received = false;
+    while (!received)
+    {
+        std::string_view frame;
+        while (!received && unixReader.nextFrame(frame))
+        {
+            parsed = MessageParser::parseMessage(frame);
+            received = parsed.type == MessageType::OPERATION;
+        }
+
+        if (received || !becomesReadable(unixSocket, 5000))
+            break;
+
+        std::size_t space = 0;
+        char* buffer = unixReader.prepareReceive(space);
+        ssize_t size = recv(unixSocket, buffer, space, 0);
+        ASSERT_GT(size, 0);
+        unixReader.commitReceive(static_cast<std::size_t>(size));
+    }
+
+    ASSERT_TRUE(received);
+    ASSERT_NE(parsed.operation, nullptr);
+    EXPECT_EQ(parsed.operation->length, 10000u);
+
+    server.reset();
+    EXPECT_NE(access(unixPath.c_str(), F_OK), 0);
+
+    char buffer[64];
+    EXPECT_EQ(channel->receive(buffer, sizeof(buffer)), 0);
+    channel.reset();
+    close(sharedMemorySocket);
+    close(unixSocket);
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "snapshot.h"
+#include "server_text_engine.h"
+
+namespace
+{
+    // Sends an op made against the engine's latest version, like a client that saw every earlier op
+    void applyAtLatestVersion(ServerTextEngine& engine, std::unique_ptr<TextOperation> op)
+    {
+        op->docVersion = engine.getDocumentVersion();
+        engine.processIncomingOperation(std::move(op));
+    }
+}
+
+class SnapshotTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        snapshotPath = ::testing::TempDir() + "reped_snapshot_test_" +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".snapshot";
+        std::remove(snapshotPath.c_str());
+    }
+
+    void TearDown() override {
+        std::remove(snapshotPath.c_str());
+    }
+
+    std::string snapshotPath;
+};
+
+TEST_F(SnapshotTest, RoundTripsOriginalAndAddPieces)
+{
+    ServerTextEngine engine;
+    engine.readString("Hello World");
+    applyAtLatestVersion(engine, std::make_unique<InsertOperation>(",", 5, "c1"));
+    applyAtLatestVersion(engine, std::make_unique<DeleteOperation>(7, 5, "c1"));
+    applyAtLatestVersion(engine, std::make_unique<InsertOperation>("there", 7, "c1"));
+    ASSERT_EQ(engine.getText(), "Hello, there");
+
+    ASSERT_TRUE(Snapshot::write(snapshotPath, engine.getPieceTableView(), engine.getDocumentVersion()));
+
+    LoadedSnapshot snapshot;
+    ASSERT_TRUE(Snapshot::load(snapshotPath, snapshot));
+    EXPECT_EQ(snapshot.docVersion, engine.getDocumentVersion());
+
+    ServerTextEngine recovered;
+    recovered.loadPieces(std::move(snapshot.pieces), snapshot.buffer, std::move(snapshot.storage), snapshot.docVersion);
+    EXPECT_EQ(recovered.getText(), "Hello, there");
+    EXPECT_EQ(recovered.getDocumentVersion(), engine.getDocumentVersion());
+}
+
+TEST_F(SnapshotTest, LoadedDocumentAcceptsEdits)
+{
+    ServerTextEngine engine;
+    engine.readString("abc");
+    ASSERT_TRUE(Snapshot::write(snapshotPath, engine.getPieceTableView(), 0));
+
+    ServerTextEngine recovered;
+    {
+        LoadedSnapshot snapshot;
+        ASSERT_TRUE(Snapshot::load(snapshotPath, snapshot));
+        recovered.loadPieces(std::move(snapshot.pieces), snapshot.buffer, std::move(snapshot.storage), snapshot.docVersion);
+    }
+
+    // The mapping must stay alive after the LoadedSnapshot is gone
+    applyAtLatestVersion(recovered, std::make_unique<InsertOperation>("X", 1, "c1"));
+    applyAtLatestVersion(recovered, std::make_unique<DeleteOperation>(3, 1, "c1"));
+    EXPECT_EQ(recovered.getText(), "aXb");
+}
+
+TEST_F(SnapshotTest, RejectsMissingAndCorruptFiles)
+{
+    LoadedSnapshot snapshot;
+    EXPECT_FALSE(Snapshot::load(snapshotPath, snapshot));
+
+    ServerTextEngine engine;
+    engine.readString("some text to corrupt");
+    ASSERT_TRUE(Snapshot::write(snapshotPath, engine.getPieceTableView(), 3));
+
+    // Flip a byte in the body
+    {
+        std::fstream file(snapshotPath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(-3, std::ios::end);
+        char c = 0;
+        file.get(c);
+        file.seekp(-3, std::ios::end);
+        file.put(static_cast<char>(c ^ 0x5A));
+    }
+    EXPECT_FALSE(Snapshot::load(snapshotPath, snapshot));
+
+    // Truncated file
+    {
+        std::ofstream file(snapshotPath, std::ios::binary | std::ios::trunc);
+        file << "REPEDSNP";
+    }
+    EXPECT_FALSE(Snapshot::load(snapshotPath, snapshot));
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+#include "spsc_queue.h"
+
+TEST(SpscQueueTest, PreservesOrderAcrossThreads)
+{
+    SpscQueue<std::string> queue(64);
+    const int itemCount = 100000;
+
+    std::thread producer([&queue]
+    {
+        for (int i = 0; i < itemCount; i++)
+        {
+            std::string* slot;
+            while (!(slot = queue.tryBeginPush()))
+                std::this_thread::yield();
+
+            *slot = std::to_string(i);
+            queue.commitPush();
+        }
+    });
+
+    int nextExpected = 0;
+    while (nextExpected < itemCount)
+    {
+        std::string* slot = queue.tryFront();
+        if (!slot)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        ASSERT_EQ(*slot, std::to_string(nextExpected));
+        queue.pop();
+        nextExpected++;
+    }
+
+    producer.join();
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscQueueTest, FullQueueRejectsPushesAndReusesSlots)
+{
+    SpscQueue<std::string> queue(3);
+
+    // Rounded up to four slots
+    for (int i = 0; i < 4; i++)
+    {
+        std::string* slot = queue.tryBeginPush();
+        ASSERT_NE(slot, nullptr);
+        *slot = std::string(100, 'a' + i);
+        queue.commitPush();
+    }
+
+    EXPECT_EQ(queue.tryBeginPush(), nullptr);
+
+    std::string* front = queue.tryFront();
+    ASSERT_NE(front, nullptr);
+    EXPECT_EQ(*front, std::string(100, 'a'));
+    queue.pop();
+
+    // The freed slot still holds the popped value and its memory
+    std::string* slot = queue.tryBeginPush();
+    ASSERT_EQ(slot, front);
+    EXPECT_GE(slot->capacity(), 100u);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "framing.h"
+#include "message_parser.h"
+
+// What the tests that talk to a running Server over TCP do as its clients. Start the server on port 0 and connect to
+// its getPort(), so tests running at the same time never race for a port.
+
+/**
+ * @returns The connected socket, -1 if the server could not be reached
+*/
+inline int connectToServer(uint16_t port)
+{
+    int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (clientSocket == -1)
+        return -1;
+
+    // A missing frame fails the test instead of hanging it
+    struct timeval timeout = {5, 0};
+    setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) == -1)
+    {
+        close(clientSocket);
+        return -1;
+    }
+
+    return clientSocket;
+}
+
+/**
+ * Reads the next frame that is not presence, which depends on when the other clients joined and left.
+ * @returns False on timeout or end of stream
+*/
+inline bool receiveNext(int clientSocket, FrameReader& reader, ParsedMessage& parsed)
+{
+    while (true)
+    {
+        std::string_view frame;
+        if (reader.nextFrame(frame))
+        {
+            parsed = MessageParser::parseMessage(frame);
+            if (parsed.type == MessageType::PRESENCE || parsed.type == MessageType::PRESENCE_LEFT)
+                continue;
+
+            return true;
+        }
+
+        std::size_t space = 0;
+        char* buffer = reader.prepareReceive(space);
+        ssize_t received = recv(clientSocket, buffer, space, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+
+        if (received <= 0)
+            return false;
+
+        reader.commitReceive(static_cast<std::size_t>(received));
+    }
+}
+
+/**
+ * Reads frames until one of the wanted type arrives.
+ * @returns False on timeout or end of stream
+*/
+inline bool receiveUntil(int clientSocket, FrameReader& reader, MessageType type, ParsedMessage& parsed)
+{
+    while (receiveNext(clientSocket, reader, parsed))
+    {
+        if (parsed.type == type)
+            return true;
+    }
+
+    return false;
+}
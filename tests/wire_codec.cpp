@@ -0,0 +1,291 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "wire_codec.h"
+#include "message_parser.h"
+#include "operations.h"
+
+namespace
+{
+    std::vector<std::unique_ptr<TextOperation>> makeOperations()
+    {
+        std::vector<std::unique_ptr<TextOperation>> operations;
+
+        auto insertOp = std::make_unique<InsertOperation>(std::string("a:b\0c\xc3\xa9\n", 8), 12345, "c1");
+        insertOp->docVersion = 987654321;
+        operations.push_back(std::move(insertOp));
+
+        auto deleteOp = std::make_unique<DeleteOperation>(300, 70000, "c2");
+        deleteOp->docVersion = 1;
+        operations.push_back(std::move(deleteOp));
+
+        auto crdtInsert = std::make_unique<CrdtInsertOperation>("hello", 0, "c3");
+        crdtInsert->clock = 42;
+        crdtInsert->originLeft = CrdtId{"c1", 7};
+        operations.push_back(std::move(crdtInsert));
+
+        auto crdtInsertAtStart = std::make_unique<CrdtInsertOperation>("", 0, "c3");
+        crdtInsertAtStart->originRight = CrdtId{"@", 0};
+        operations.push_back(std::move(crdtInsertAtStart));
+
+        auto crdtDelete = std::make_unique<CrdtDeleteOperation>(0, "c4");
+        crdtDelete->spans = {{"c1", 3, 2}, {"c2", 1000000, 1}};
+        crdtDelete->length = 3;
+        operations.push_back(std::move(crdtDelete));
+
+        return operations;
+    }
+}
+
+TEST(WireCodecTest, RoundTripsEveryOperationType)
+{
+    for (const auto& operation : makeOperations())
+    {
+        std::string encoded;
+        WireCodec::encode(*operation, encoded);
+        EXPECT_EQ(encoded.size(), WireCodec::getEncodedSize(*operation));
+        EXPECT_TRUE(WireCodec::isBinary(encoded));
+
+        WireOperationView view;
+        ASSERT_TRUE(WireCodec::decode(encoded, view));
+        EXPECT_EQ(view.type, operation->type);
+        EXPECT_EQ(view.clientId, operation->clientId);
+
+        std::unique_ptr<TextOperation> decoded = WireCodec::toOperation(view);
+        ASSERT_NE(decoded, nullptr);
+        EXPECT_EQ(decoded->serialize(), operation->serialize());
+        EXPECT_EQ(decoded->operationId, operation->operationId);
+        EXPECT_EQ(decoded->length, operation->length);
+    }
+}
+
+TEST(WireCodecTest, RoundTripsVarints)
+{
+    for (uint64_t value : {uint64_t(0), uint64_t(127), uint64_t(128), uint64_t(16383), uint64_t(16384), uint64_t(1) << 32, UINT64_MAX})
+    {
+        char buffer[WireCodec::maxVarintSize];
+        char* end = WireCodec::writeVarint(buffer, value);
+        EXPECT_EQ(static_cast<std::size_t>(end - buffer), WireCodec::getVarintSize(value));
+
+        std::string_view in(buffer, end - buffer);
+        uint64_t decoded = 0;
+        ASSERT_TRUE(WireCodec::readVarint(in, decoded));
+        EXPECT_EQ(decoded, value);
+        EXPECT_TRUE(in.empty());
+    }
+
+    // Runs past 64 bits
+    std::string_view tooLong("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x02", 10);
+    uint64_t value = 0;
+    EXPECT_FALSE(WireCodec::readVarint(tooLong, value));
+
+    std::string_view unterminated("\x80\x80", 2);
+    EXPECT_FALSE(WireCodec::readVarint(unterminated, value));
+}
+
+TEST(WireCodecTest, RejectsTruncatedAndTrailingBytes)
+{
+    for (const auto& operation : makeOperations())
+    {
+        std::string encoded;
+        WireCodec::encode(*operation, encoded);
+
+        WireOperationView view;
+        for (std::size_t length = 0; length < encoded.size(); length++)
+            EXPECT_FALSE(WireCodec::decode(std::string_view(encoded).substr(0, length), view)) << length;
+
+        EXPECT_FALSE(WireCodec::decode(encoded + "x", view));
+    }
+
+    WireOperationView view;
+    EXPECT_FALSE(WireCodec::decode(std::string_view("\x09\x00\x00\x00", 4), view));
+    EXPECT_FALSE(WireCodec::decode("INSERT:c1:1:0:0:a", view));
+}
+
+TEST(WireCodecTest, RejectsMalformedTextOperations)
+{
+    // Any client can send these, none of them may throw
+    const char* malformed[] = {
+        "INSERT:c1:1:x:0:a",
+        "INSERT:c1:1:0:-1:a",
+        "DELETE:c1:1:0:0:",
+        "DELETE:c1:1:0:99999999999999999999999:1",
+        "CRDT_INSERT:c1:1:0:x:::::a",
+        "CRDT_INSERT:c1:1:0:1:c2:x:::a",
+        "CRDT_DELETE:c1:1:0:x",
+        "CRDT_DELETE:c1:1:0:6148914691236517206:c2:1:1",
+        "CRDT_DELETE:c1:1:0:1:c2:1:x"
+    };
+
+    for (const char* message : malformed)
+    {
+        ParsedMessage parsed = MessageParser::parseMessage(message);
+        EXPECT_EQ(parsed.type, MessageType::OPERATION) << message;
+        EXPECT_EQ(parsed.operation, nullptr) << message;
+    }
+}
+
+TEST(WireCodecTest, ParsesBinaryAndTextOperationsAlike)
+{
+    for (const auto& operation : makeOperations())
+    {
+        std::string binary;
+        WireCodec::encode(*operation, WireProtocol::BINARY, binary);
+        std::string text;
+        WireCodec::encode(*operation, WireProtocol::TEXT, text);
+        EXPECT_LT(binary.size(), text.size());
+
+        for (const std::string& message : {binary, text})
+        {
+            ParsedMessage parsed = MessageParser::parseMessage(message);
+            EXPECT_EQ(parsed.type, MessageType::OPERATION);
+            EXPECT_EQ(parsed.clientId, operation->clientId);
+            ASSERT_NE(parsed.operation, nullptr);
+            EXPECT_EQ(parsed.operation->serialize(), operation->serialize());
+            EXPECT_EQ(parsed.toDisplayString(), operation->serialize());
+        }
+    }
+
+    // A client id with a colon only survives the binary encoding
+    DeleteOperation deleteOp(1, 2, "client:1");
+    std::string binary;
+    WireCodec::encode(deleteOp, binary);
+    EXPECT_EQ(MessageParser::parseMessage(binary).clientId, "client:1");
+    EXPECT_NE(MessageParser::parseMessage(deleteOp.serialize()).clientId, "client:1");
+}
+
+TEST(WireCodecTest, NegotiatesProtocolInHandshake)
+{
+    ParsedMessage binary = MessageParser::parseMessage(MessageParser::createConnectedMessage("c1", "notes", std::nullopt, WireProtocol::BINARY));
+    EXPECT_EQ(binary.type, MessageType::CONNECTED);
+    EXPECT_EQ(binary.documentName, "notes");
+    EXPECT_FALSE(binary.knownVersion.has_value());
+    EXPECT_EQ(binary.wireProtocol, WireProtocol::BINARY);
+
+    ParsedMessage reconnect = MessageParser::parseMessage(MessageParser::createConnectedMessage("c1", "notes", 42, WireProtocol::BINARY));
+    ASSERT_TRUE(reconnect.knownVersion.has_value());
+    EXPECT_EQ(*reconnect.knownVersion, 42);
+    EXPECT_EQ(reconnect.wireProtocol, WireProtocol::BINARY);
+
+    // Clients that do not announce a protocol speak text
+    EXPECT_EQ(MessageParser::createConnectedMessage("c1", "notes", 42), "CONNECTED:c1:notes:42");
+    EXPECT_EQ(MessageParser::parseMessage("CONNECTED:c1:notes:42").wireProtocol, WireProtocol::TEXT);
+
+    // A newer client is answered with the newest protocol we know
+    EXPECT_EQ(MessageParser::parseMessage("CONNECTED:c1:notes::9").wireProtocol, latestWireProtocol);
+
+    ParsedMessage protocol = MessageParser::parseMessage(MessageParser::createProtocolMessage(WireProtocol::BINARY));
+    EXPECT_EQ(protocol.type, MessageType::PROTOCOL);
+    EXPECT_EQ(protocol.wireProtocol, WireProtocol::BINARY);
+    EXPECT_EQ(MessageParser::parseMessage("PROTOCOL:x").type, MessageType::UNKNOWN);
+}
+
+TEST(WireCodecTest, CarriesSequencedTime)
+{
+    for (const auto& operation : makeOperations())
+    {
+        std::string encoded;
+        WireCodec::encode(*operation, WireProtocol::TIMED, encoded);
+        WireCodec::appendSequencedAt(encoded, 1700000000123456);
+
+        ParsedMessage parsed = MessageParser::parseMessage(encoded);
+        ASSERT_NE(parsed.operation, nullptr);
+        EXPECT_EQ(parsed.operation->serialize(), operation->serialize());
+        EXPECT_EQ(parsed.sequencedAt, 1700000000123456u);
+
+        // A stamp cut short or followed by anything is as malformed as any other trailing bytes
+        WireOperationView view;
+        EXPECT_FALSE(WireCodec::decode(std::string_view(encoded).substr(0, encoded.size() - 1), view));
+        EXPECT_FALSE(WireCodec::decode(encoded + "x", view));
+    }
+
+    std::string unstamped;
+    WireCodec::encode(DeleteOperation(1, 2, "c1"), unstamped);
+    EXPECT_EQ(MessageParser::parseMessage(unstamped).sequencedAt, 0u);
+}
+
+TEST(WireCodecTest, ParsesHeartbeats)
+{
+    ParsedMessage ping = MessageParser::parseMessage(MessageParser::createPingMessage(123456789));
+    EXPECT_EQ(ping.type, MessageType::PING);
+    uint64_t sentTime = 0;
+    std::optional<uint64_t> knownVersion = 1;
+    uint64_t unsentOperations = 1;
+    ASSERT_TRUE(MessageParser::parsePingMessage(ping.content, sentTime, knownVersion, unsentOperations));
+    EXPECT_EQ(sentTime, 123456789u);
+    EXPECT_FALSE(knownVersion);
+    EXPECT_EQ(unsentOperations, 0u);
+
+    ping = MessageParser::parseMessage(MessageParser::createPingMessage(42, 1000, 3));
+    EXPECT_EQ(ping.type, MessageType::PING);
+    ASSERT_TRUE(MessageParser::parsePingMessage(ping.content, sentTime, knownVersion, unsentOperations));
+    EXPECT_EQ(sentTime, 42u);
+    EXPECT_EQ(knownVersion, 1000u);
+    EXPECT_EQ(unsentOperations, 3u);
+
+    ParsedMessage pong = MessageParser::parseMessage(MessageParser::createPongMessage(123456789, 1700000000000000));
+    EXPECT_EQ(pong.type, MessageType::PONG);
+    uint64_t serverTime = 0;
+    ASSERT_TRUE(MessageParser::parsePongMessage(pong.content, sentTime, serverTime));
+    EXPECT_EQ(sentTime, 123456789u);
+    EXPECT_EQ(serverTime, 1700000000000000u);
+
+    EXPECT_FALSE(MessageParser::parsePingMessage("PING:", sentTime, knownVersion, unsentOperations));
+    EXPECT_FALSE(MessageParser::parsePingMessage("PING:12:34", sentTime, knownVersion, unsentOperations));
+    EXPECT_FALSE(MessageParser::parsePingMessage("PING:12:34:5:6", sentTime, knownVersion, unsentOperations));
+    EXPECT_FALSE(MessageParser::parsePingMessage("PING:12:x:5", sentTime, knownVersion, unsentOperations));
+    EXPECT_FALSE(MessageParser::parsePongMessage("PONG:12", sentTime, serverTime));
+    EXPECT_FALSE(MessageParser::parsePongMessage("PONG:12:x", sentTime, serverTime));
+}
+
+TEST(WireCodecTest, ParsesAcks)
+{
+    ParsedMessage ack = MessageParser::parseMessage(MessageParser::createAckMessage(41, 7));
+    EXPECT_EQ(ack.type, MessageType::ACK);
+    uint64_t docVersion = 0;
+    uint64_t operations = 0;
+    uint64_t sequencedAt = 1;
+    ASSERT_TRUE(MessageParser::parseAckMessage(ack.content, docVersion, operations, sequencedAt));
+    EXPECT_EQ(docVersion, 41u);
+    EXPECT_EQ(operations, 7u);
+    EXPECT_EQ(sequencedAt, 0u);
+
+    ack = MessageParser::parseMessage(MessageParser::createAckMessage(0, 1, 1700000000000000));
+    ASSERT_TRUE(MessageParser::parseAckMessage(ack.content, docVersion, operations, sequencedAt));
+    EXPECT_EQ(docVersion, 0u);
+    EXPECT_EQ(operations, 1u);
+    EXPECT_EQ(sequencedAt, 1700000000000000u);
+
+    EXPECT_FALSE(MessageParser::parseAckMessage("ACK:", docVersion, operations, sequencedAt));
+    EXPECT_FALSE(MessageParser::parseAckMessage("ACK:41", docVersion, operations, sequencedAt));
+    EXPECT_FALSE(MessageParser::parseAckMessage("ACK:41:x", docVersion, operations, sequencedAt));
+    EXPECT_FALSE(MessageParser::parseAckMessage("ACK:41:7:", docVersion, operations, sequencedAt));
+    EXPECT_FALSE(MessageParser::parseAckMessage("ACK:41:7:8:9", docVersion, operations, sequencedAt));
+
+    // Numbers past 64 bits are rejected instead of read as the largest one
+    EXPECT_FALSE(MessageParser::parseAckMessage("ACK:18446744073709551616:7", docVersion, operations, sequencedAt));
+    EXPECT_FALSE(MessageParser::parseAckMessage("ACK:41:99999999999999999999", docVersion, operations, sequencedAt));
+    ASSERT_TRUE(MessageParser::parseAckMessage("ACK:18446744073709551615:7", docVersion, operations, sequencedAt));
+    EXPECT_EQ(docVersion, UINT64_MAX);
+
+    // Binary connections get the fields as varints
+    std::string binary = MessageParser::createAckMessage(300, 7, 1700000000000000, WireProtocol::TIMED);
+    EXPECT_TRUE(WireCodec::isBinary(binary));
+    EXPECT_LT(binary.size(), MessageParser::createAckMessage(300, 7, 1700000000000000).size());
+    ack = MessageParser::parseMessage(binary);
+    EXPECT_EQ(ack.type, MessageType::ACK);
+    ASSERT_TRUE(MessageParser::parseAckMessage(ack.content, docVersion, operations, sequencedAt));
+    EXPECT_EQ(docVersion, 300u);
+    EXPECT_EQ(operations, 7u);
+    EXPECT_EQ(sequencedAt, 1700000000000000u);
+
+    ack = MessageParser::parseMessage(MessageParser::createAckMessage(300, 7, 0, WireProtocol::BINARY));
+    ASSERT_TRUE(MessageParser::parseAckMessage(ack.content, docVersion, operations, sequencedAt));
+    EXPECT_EQ(sequencedAt, 0u);
+
+    EXPECT_FALSE(MessageParser::parseAckMessage(binary.substr(0, binary.size() - 1), docVersion, operations, sequencedAt));
+    EXPECT_FALSE(MessageParser::parseAckMessage(binary + "x", docVersion, operations, sequencedAt));
+}
@@ -0,0 +1,521 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <sys/resource.h>
+
+#include "server.h"
+#include "client.h"
+#include "latency_histogram.h"
+#include "server_text_engine.h"
+#include "client_text_engine.h"
+#include "input_events.h"
+#include "../controller/controller.h"
+
+// Opens many client connections from one process and lets each one type like a person into a shared document, then
+// waits until every op is acknowledged and checks that all clients of a document ended up with the same text.
+// Reports throughput, latency percentiles and errors. Runs an embedded server on localhost unless --no-server is given.
+// Usage: reped_loadgen [--clients N] [--documents N] [--duration seconds] [--typing-rate keys/s] ... (--help lists all)
+
+namespace
+{
+    struct TypingModel
+    {
+        double typingRate = 8;              // Keystrokes per second while typing a burst
+        double burstLength = 20;            // Mean keystrokes per burst
+        double pauseSeconds = 1.5;          // Mean pause between bursts
+        double backspaceProbability = 0.1;  // Share of keystrokes that delete the character before the cursor
+        double pasteProbability = 0.02;     // Chance a burst is a single paste instead
+        std::size_t pasteSize = 200;        // Mean characters per paste
+        double locality = 0.8;              // Chance a burst starts where the cursor is rather than anywhere
+    };
+
+    struct Options
+    {
+        std::string address = "127.0.0.1";
+        uint16_t port = 47400;
+        bool embeddedServer = true;
+        std::size_t clients = 50;
+        std::size_t documents = 1;
+        std::size_t threads = 0;
+        double durationSeconds = 10;
+        double settleSeconds = 30;
+        unsigned int seed = 1;
+        TypingModel typing;
+    };
+
+    struct Counters
+    {
+        uint64_t keystrokes = 0;
+        uint64_t backspaces = 0;
+        uint64_t pastes = 0;
+        uint64_t pastedCharacters = 0;
+        uint64_t connectionLosses = 0;
+    };
+
+    /**
+     * One simulated user: a client with its own engine, typing in bursts with pauses in between.
+    */
+    class Bot
+    {
+    public:
+        const std::size_t documentIndex;
+        Controller controller;
+        ClientTextEngine engine;
+        std::unique_ptr<Client> client;
+        Counters counters;
+
+    private:
+        const TypingModel& typing;
+        std::mt19937_64 random;
+        std::chrono::steady_clock::time_point nextAction;
+        std::size_t burstRemaining = 0;
+        bool wasConnected = false;
+        bool everConnected = false;
+
+    public:
+        Bot(const Options& options, std::size_t index)
+            : documentIndex(index % options.documents), typing(options.typing), random(options.seed * 7919 + index)
+        {
+            controller.textEngine = &engine;
+            client = std::make_unique<Client>(options.port, options.address, &controller, "bot" + std::to_string(index),
+                                              "loadgen-" + std::to_string(documentIndex));
+            controller.client = client.get();
+            nextAction = std::chrono::steady_clock::now() + getDelay(typing.pauseSeconds);
+        }
+
+        [[nodiscard]] bool hasConnected() const { return everConnected; }
+
+        /**
+         * Applies what arrived and, while typing, performs the next keystroke or paste once it is due.
+        */
+        void step(std::chrono::steady_clock::time_point now, bool typingAllowed)
+        {
+            controller.processIncomingMessages();
+
+            bool connected = client->isConnected();
+            if (wasConnected && !connected)
+                counters.connectionLosses++;
+
+            wasConnected = connected;
+            everConnected = everConnected || connected;
+            if (!typingAllowed || !connected || !engine.getServerVersion() || now < nextAction)
+                return;
+
+            if (burstRemaining == 0)
+            {
+                startBurst();
+                if (burstRemaining == 0)
+                {
+                    nextAction = now + getDelay(typing.pauseSeconds);
+                    return;
+                }
+            }
+
+            typeKey();
+            burstRemaining--;
+            nextAction = now + getDelay(burstRemaining > 0 ? 1.0 / typing.typingRate : typing.pauseSeconds);
+        }
+
+        /**
+         * @returns True once every op this bot typed was acknowledged
+        */
+        [[nodiscard]] bool isIdle() const { return engine.getPendingLocalOps().empty(); }
+
+    private:
+        std::chrono::steady_clock::duration getDelay(double meanSeconds)
+        {
+            std::exponential_distribution<double> distribution(1.0 / std::max(meanSeconds, 1e-6));
+            return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(distribution(random)));
+        }
+
+        bool chance(double probability)
+        {
+            return std::uniform_real_distribution<double>(0, 1)(random) < probability;
+        }
+
+        char getCharacter()
+        {
+            if (chance(0.02))
+                return '\n';
+
+            if (chance(0.15))
+                return ' ';
+
+            return static_cast<char>('a' + random() % 26);
+        }
+
+        /**
+         * Moves the cursor elsewhere unless the burst is local and either pastes or picks the burst's length.
+        */
+        void startBurst()
+        {
+            const std::size_t length = engine.getDocumentLength();
+            if (!chance(typing.locality))
+                controller.handleCursorInputEvent(CursorInputEvent(random() % (length + 1)));
+
+            if (chance(typing.pasteProbability))
+            {
+                std::size_t size = 1 + random() % std::max<std::size_t>(1, 2 * typing.pasteSize);
+                std::string text(size, ' ');
+                for (char& c : text)
+                    c = getCharacter();
+
+                insert(text);
+                counters.pastes++;
+                counters.pastedCharacters += size;
+                return;
+            }
+
+            std::geometric_distribution<std::size_t> distribution(1.0 / std::max(typing.burstLength, 1.0));
+            burstRemaining = 1 + distribution(random);
+        }
+
+        void typeKey()
+        {
+            const std::size_t cursor = engine.getCursorPosition();
+            if (cursor > 0 && chance(typing.backspaceProbability))
+            {
+                controller.handleTextInputEvent(TextInputEvent(TextInputEventType::DELETE, "", cursor - 1, 1));
+                controller.handleCursorInputEvent(CursorInputEvent(cursor - 1));
+                counters.backspaces++;
+            }
+            else
+            {
+                insert(std::string(1, getCharacter()));
+            }
+
+            counters.keystrokes++;
+        }
+
+        void insert(const std::string& text)
+        {
+            const std::size_t cursor = std::min(engine.getCursorPosition(), engine.getDocumentLength());
+            controller.handleTextInputEvent(TextInputEvent(TextInputEventType::INSERT, text, cursor, text.size()));
+            controller.handleCursorInputEvent(CursorInputEvent(cursor + text.size()));
+        }
+    };
+
+    /**
+     * Steps a share of the bots about once per millisecond, like the frame loops of that many editors.
+    */
+    void drive(const std::vector<Bot*>& bots, std::chrono::steady_clock::time_point end)
+    {
+        for (auto now = std::chrono::steady_clock::now(); now < end; now = std::chrono::steady_clock::now())
+        {
+            for (Bot* bot : bots)
+                bot->step(now, true);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /**
+     * @returns True if no bot waits for acks and all bots of each document saw the same number of ops
+    */
+    bool isSettled(const std::vector<std::unique_ptr<Bot>>& bots, std::size_t documentCount)
+    {
+        std::vector<std::optional<uint64_t>> versions(documentCount);
+        for (const auto& bot : bots)
+        {
+            if (!bot->client->isConnected())
+                continue;
+
+            if (!bot->isIdle())
+                return false;
+
+            std::optional<uint64_t>& version = versions[bot->documentIndex];
+            if (!version)
+                version = bot->engine.getServerVersion();
+            else if (*version != bot->engine.getServerVersion())
+                return false;
+        }
+
+        return true;
+    }
+
+    void raiseFileLimit(std::size_t connections)
+    {
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+            return;
+
+        // Each connection needs a socket on both ends when the server runs in this process, plus some slack
+        rlim_t wanted = static_cast<rlim_t>(connections * 2 + 256);
+        if (limit.rlim_cur >= wanted)
+            return;
+
+        limit.rlim_cur = std::min(wanted, limit.rlim_max);
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+            std::cerr << "reped_loadgen: Failed to raise the open file limit\n";
+    }
+
+    void printUsage(std::ostream& out)
+    {
+        const Options defaults;
+        out << "Usage: reped_loadgen [options]\n"
+            << "  --address ADDRESS          Server address (" << defaults.address << ")\n"
+            << "  --port PORT                Server port (" << defaults.port << ")\n"
+            << "  --no-server                Connect to a running server instead of starting one\n"
+            << "  --clients N                Connections to open (" << defaults.clients << ")\n"
+            << "  --documents N              Documents the clients are spread over (" << defaults.documents << ")\n"
+            << "  --threads N                Threads driving the clients, 0 for one per core (" << defaults.threads << ")\n"
+            << "  --duration SECONDS         How long the clients type (" << defaults.durationSeconds << ")\n"
+            << "  --settle SECONDS           How long to wait for acks afterwards (" << defaults.settleSeconds << ")\n"
+            << "  --seed N                   Seed of the typing (" << defaults.seed << ")\n"
+            << "  --typing-rate KEYS         Keystrokes per second within a burst (" << defaults.typing.typingRate << ")\n"
+            << "  --burst-length KEYS        Mean keystrokes per burst (" << defaults.typing.burstLength << ")\n"
+            << "  --pause SECONDS            Mean pause between bursts (" << defaults.typing.pauseSeconds << ")\n"
+            << "  --backspace-probability P  Share of keystrokes that are backspaces (" << defaults.typing.backspaceProbability << ")\n"
+            << "  --paste-probability P      Chance a burst is a paste (" << defaults.typing.pasteProbability << ")\n"
+            << "  --paste-size CHARS         Mean characters per paste (" << defaults.typing.pasteSize << ")\n"
+            << "  --locality P               Chance a burst starts at the cursor (" << defaults.typing.locality << ")\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string flag = argv[i];
+            if (flag == "--no-server")
+            {
+                options.embeddedServer = false;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                std::cerr << "reped_loadgen: Unknown option or missing value: " << flag << "\n";
+                return false;
+            }
+
+            const std::string value = argv[++i];
+            try
+            {
+                if (flag == "--address")
+                    options.address = value;
+                else if (flag == "--port")
+                    options.port = static_cast<uint16_t>(std::stoul(value));
+                else if (flag == "--clients")
+                    options.clients = std::stoul(value);
+                else if (flag == "--documents")
+                    options.documents = std::max<std::size_t>(1, std::stoul(value));
+                else if (flag == "--threads")
+                    options.threads = std::stoul(value);
+                else if (flag == "--duration")
+                    options.durationSeconds = std::stod(value);
+                else if (flag == "--settle")
+                    options.settleSeconds = std::stod(value);
+                else if (flag == "--seed")
+                    options.seed = static_cast<unsigned int>(std::stoul(value));
+                else if (flag == "--typing-rate")
+                    options.typing.typingRate = std::stod(value);
+                else if (flag == "--burst-length")
+                    options.typing.burstLength = std::stod(value);
+                else if (flag == "--pause")
+                    options.typing.pauseSeconds = std::stod(value);
+                else if (flag == "--backspace-probability")
+                    options.typing.backspaceProbability = std::stod(value);
+                else if (flag == "--paste-probability")
+                    options.typing.pasteProbability = std::stod(value);
+                else if (flag == "--paste-size")
+                    options.typing.pasteSize = std::stoul(value);
+                else if (flag == "--locality")
+                    options.typing.locality = std::stod(value);
+                else
+                {
+                    std::cerr << "reped_loadgen: Unknown option: " << flag << "\n";
+                    return false;
+                }
+            }
+            catch (const std::exception&)
+            {
+                std::cerr << "reped_loadgen: Invalid value for " << flag << ": " << value << "\n";
+                return false;
+            }
+        }
+
+        if (options.typing.typingRate <= 0)
+        {
+            std::cerr << "reped_loadgen: --typing-rate must be positive\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    void printLatency(std::ostream& out, const char* name, const LatencyHistogram& histogram)
+    {
+        LatencySummary summary = histogram.getSummary();
+        out << "  " << std::left << std::setw(11) << name << std::right << " n " << std::setw(8) << summary.count
+            << "  p50 " << std::setw(8) << summary.p50 / 1000.0 << " ms  p90 " << std::setw(8) << summary.p90 / 1000.0
+            << " ms  p99 " << std::setw(8) << summary.p99 / 1000.0 << " ms  max " << std::setw(8) << summary.max / 1000.0 << " ms\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h")
+        {
+            printUsage(std::cout);
+            return 0;
+        }
+    }
+
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(std::cerr);
+        return 2;
+    }
+
+    if (options.threads == 0)
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    options.threads = std::min(options.threads, std::max<std::size_t>(1, options.clients));
+
+    // Keep the per-op logging of clients and server out of the report
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(nullptr);
+    std::cerr.rdbuf(nullptr);
+
+    raiseFileLimit(options.clients);
+
+    Controller serverController;
+    ServerTextEngine serverEngine;
+    serverController.textEngine = &serverEngine;
+    std::unique_ptr<Server> server;
+    if (options.embeddedServer)
+        server = std::make_unique<Server>(options.port, options.address, &serverController);
+
+    out << options.clients << " clients on " << options.documents << " document(s), " << options.threads
+        << " thread(s), typing for " << options.durationSeconds << " s against "
+        << (options.embeddedServer ? "an embedded server on " : "") << options.address << ":" << options.port << "\n";
+
+    std::vector<std::unique_ptr<Bot>> bots;
+    bots.reserve(options.clients);
+    for (std::size_t i = 0; i < options.clients; i++)
+        bots.push_back(std::make_unique<Bot>(options, i));
+
+    // Connect before typing so the measured time is spent editing
+    const auto connectDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < connectDeadline)
+    {
+        bool allConnected = true;
+        for (const auto& bot : bots)
+        {
+            bot->step(std::chrono::steady_clock::now(), false);
+            allConnected = allConnected && bot->hasConnected() && bot->engine.getServerVersion();
+        }
+
+        if (allConnected)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::vector<std::vector<Bot*>> shares(options.threads);
+    for (std::size_t i = 0; i < bots.size(); i++)
+        shares[i % options.threads].push_back(bots[i].get());
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.durationSeconds));
+    std::vector<std::thread> drivers;
+    for (const std::vector<Bot*>& share : shares)
+        drivers.emplace_back(drive, std::cref(share), end);
+
+    for (std::thread& driver : drivers)
+        driver.join();
+
+    const double typedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Stop typing and wait for the last acks and broadcasts to arrive everywhere
+    const auto settleStart = std::chrono::steady_clock::now();
+    const auto settleDeadline = settleStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.settleSeconds));
+    bool settled = false;
+    while (!settled && std::chrono::steady_clock::now() < settleDeadline)
+    {
+        for (const auto& bot : bots)
+            bot->step(std::chrono::steady_clock::now(), false);
+
+        settled = isSettled(bots, options.documents);
+        if (!settled)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    const double settleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - settleStart).count();
+
+    Counters total;
+    LatencyHistogram roundTrip, ack, uplink, downlink;
+    uint64_t failedConnections = 0;
+    uint64_t unacknowledged = 0;
+    uint64_t diverged = 0;
+    std::vector<const Bot*> references(options.documents, nullptr);
+    for (const auto& bot : bots)
+    {
+        total.keystrokes += bot->counters.keystrokes;
+        total.backspaces += bot->counters.backspaces;
+        total.pastes += bot->counters.pastes;
+        total.pastedCharacters += bot->counters.pastedCharacters;
+        total.connectionLosses += bot->counters.connectionLosses;
+
+        roundTrip.add(bot->client->getRoundTripLatency());
+        ack.add(bot->client->getAckLatency());
+        uplink.add(bot->client->getUplinkLatency());
+        downlink.add(bot->client->getDownlinkLatency());
+
+        if (!bot->hasConnected())
+        {
+            failedConnections++;
+            continue;
+        }
+
+        unacknowledged += bot->engine.getPendingLocalOps().size();
+
+        const Bot*& reference = references[bot->documentIndex];
+        if (!reference)
+            reference = bot.get();
+        else if (bot->engine.getText() != reference->engine.getText())
+            diverged++;
+    }
+
+    const uint64_t edits = total.keystrokes + total.pastes;
+    out << std::fixed << std::setprecision(2);
+    out << "typed " << edits << " edits in " << typedSeconds << " s: " << total.keystrokes << " keystrokes ("
+        << total.backspaces << " backspaces), " << total.pastes << " pastes (" << total.pastedCharacters << " characters)\n";
+    out << "throughput " << edits / typedSeconds << " edits/s, " << ack.getCount() / typedSeconds << " acks/s\n";
+    if (server)
+    {
+        BroadcastStats broadcast = server->getBroadcastStats();
+        out << "server broadcast " << broadcast.operationsBroadcast << " ops in " << broadcast.writes << " writes\n";
+    }
+
+    out << "latency\n";
+    printLatency(out, "round trip", roundTrip);
+    printLatency(out, "ack", ack);
+    printLatency(out, "uplink", uplink);
+    printLatency(out, "downlink", downlink);
+
+    out << (settled ? "settled" : "did not settle") << " after " << settleSeconds << " s\n";
+    for (std::size_t i = 0; i < references.size(); i++)
+    {
+        if (references[i])
+            out << "document " << i << ": " << references[i]->engine.getDocumentLength() << " characters at version "
+                << references[i]->engine.getServerVersion().value_or(0) << "\n";
+    }
+
+    out << "errors: " << failedConnections << " failed connections, " << total.connectionLosses << " connection losses, "
+        << unacknowledged << " unacknowledged ops, " << diverged << " diverged clients\n";
+
+    return failedConnections == 0 && unacknowledged == 0 && diverged == 0 ? 0 : 1;
+}